@@ -0,0 +1,403 @@
+/**
+*	@file AssetChecks.cpp
+*
+*	形の分かっている合成メッシュで最適化の結果を検証し、Res のメッシュの統計を出力する
+*	検証に失敗した項目は "FAILED" を出力する
+*
+*	使い方:
+*		OpenGlTutrialBench --check all
+*		OpenGlTutrialBench --check acmr
+*/
+#include "AssetChecks.h"
+#include "../Src/Mesh.h"
+#include "../Src/MeshOptimizer.h"
+#include "../Src/Texture.h"
+#include "../Src/TextureCompressor.h"
+#include "../Src/Profiler.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <random>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+namespace AssetChecks {
+
+	namespace {
+
+		/// 合成メッシュの頂点座標
+		struct Position {
+			float x, y, z;
+		};
+
+		/**
+		*	格子状の平面メッシュ
+		*/
+		struct GridMesh {
+			std::vector<Position> positions;
+			std::vector<uint32_t> indices;
+		};
+
+		/**
+		*	格子状の平面メッシュを作成する
+		*
+		*	@param size	1 辺の四角形の数
+		*
+		*	@return 作成したメッシュ(三角形は行ごとに並んでいる)
+		*/
+		GridMesh CreateGrid(int size) {
+			GridMesh mesh;
+			for (int y = 0; y <= size; ++y) {
+				for (int x = 0; x <= size; ++x) {
+					mesh.positions.push_back(Position{ static_cast<float>(x), static_cast<float>(y), 0 });
+				}
+			}
+			for (int y = 0; y < size; ++y) {
+				for (int x = 0; x < size; ++x) {
+					const uint32_t i = y * (size + 1) + x;
+					const uint32_t quad[] = { i, i + 1, i + size + 2, i, i + size + 2, i + size + 1 };
+					mesh.indices.insert(mesh.indices.end(), std::begin(quad), std::end(quad));
+				}
+			}
+			return mesh;
+		}
+
+		/**
+		*	三角形の順序を乱数で入れ替える
+		*
+		*	@param indices	三角形リストのインデックス
+		*	@param seed		乱数の種(結果を再現できるように固定値を使う)
+		*/
+		void ShuffleTriangles(std::vector<uint32_t>& indices, uint32_t seed) {
+			std::vector<std::array<uint32_t, 3>> triangles(indices.size() / 3);
+			memcpy(triangles.data(), indices.data(), triangles.size() * sizeof(triangles[0]));
+			std::shuffle(triangles.begin(), triangles.end(), std::mt19937(seed));
+			memcpy(indices.data(), triangles.data(), triangles.size() * sizeof(triangles[0]));
+		}
+
+		/**
+		*	三角形の集合を比較できる形に正規化する
+		*
+		*	@param indices	三角形リストのインデックス
+		*
+		*	@return 各三角形を最小の頂点が先頭になるよう回転し、三角形を整列したもの
+		*
+		*	回転だけなので表裏の向きは保たれる
+		*/
+		std::vector<std::array<uint32_t, 3>> CanonicalTriangles(const std::vector<uint32_t>& indices) {
+			std::vector<std::array<uint32_t, 3>> triangles;
+			for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+				std::array<uint32_t, 3> t = { indices[i], indices[i + 1], indices[i + 2] };
+				std::rotate(t.begin(), std::min_element(t.begin(), t.end()), t.end());
+				triangles.push_back(t);
+			}
+			std::sort(triangles.begin(), triangles.end());
+			return triangles;
+		}
+
+		/**
+		*	検証結果を出力する
+		*
+		*	@param name	検証項目名
+		*	@param ok	検証に成功したら true
+		*
+		*	@return ok をそのまま返す
+		*/
+		bool Report(const char* name, bool ok) {
+			std::cout << name << ": " << (ok ? "OK" : "FAILED") << std::endl;
+			return ok;
+		}
+
+		/**
+		*	頂点キャッシュ最適化の前後で ACMR が改善することを検証する
+		*
+		*	三角形の順序を乱した 32x32 の格子を使う
+		*	格子の ACMR の理論的な下限は約 0.5 で、LRU キャッシュ 16 個なら 0.7 程度まで下がるはず
+		*/
+		bool CheckAcmr() {
+			const int gridSize = 32;
+			const float maxAcmr = 0.8f;
+			GridMesh mesh = CreateGrid(gridSize);
+			ShuffleTriangles(mesh.indices, 12345);
+			const auto triangles = CanonicalTriangles(mesh.indices);
+			const MeshOptimizer::Statistics before = MeshOptimizer::AnalyzeVertexCache(mesh.indices, mesh.positions.size());
+			MeshOptimizer::OptimizeVertexCache(mesh.indices, mesh.positions.size());
+			const MeshOptimizer::Statistics after = MeshOptimizer::AnalyzeVertexCache(mesh.indices, mesh.positions.size());
+			std::cout << "acmr: 格子 " << gridSize << "x" << gridSize << " ACMR " << before.acmr << " -> " << after.acmr <<
+				", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+			return Report("acmr", after.acmr < before.acmr && after.acmr <= maxAcmr && CanonicalTriangles(mesh.indices) == triangles);
+		}
+
+		/**
+		*	三角形の面積を XY 平面に投影して合計する
+		*
+		*	@param mesh		座標を参照するメッシュ
+		*	@param indices	三角形リストのインデックス
+		*	@param minArea	最も小さい三角形の符号付き面積を格納する変数
+		*
+		*	@return 符号付き面積の合計(反時計回りが正)
+		*/
+		double ProjectedArea(const GridMesh& mesh, const std::vector<uint32_t>& indices, double& minArea) {
+			double total = 0;
+			minArea = DBL_MAX;
+			for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+				const Position& a = mesh.positions[indices[i]];
+				const Position& b = mesh.positions[indices[i + 1]];
+				const Position& c = mesh.positions[indices[i + 2]];
+				const double area = 0.5 * ((b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x));
+				total += area;
+				minArea = std::min(minArea, area);
+			}
+			return total;
+		}
+
+		/**
+		*	インデックスが全て頂点配列の範囲内か調べる
+		*/
+		bool IsIndexValid(const std::vector<uint32_t>& indices, size_t vertexCount) {
+			return indices.size() % 3 == 0 &&
+				std::all_of(indices.begin(), indices.end(), [vertexCount](uint32_t i) { return i < vertexCount; });
+		}
+
+		/**
+		*	SimplifyMesh の結果を検証する
+		*
+		*	- 平らな格子は誤差なしで目標の三角形数まで減り、縁が動かないので面積が変わらず、裏返る三角形もない
+		*	- 起伏のある格子は、目標の三角形数に届く前に許容誤差の手前で止まる
+		*	- 目標が現在のインデックス数以上なら何もしない
+		*/
+		bool CheckSimplify() {
+			const int gridSize = 32;
+			const double gridArea = gridSize * gridSize;
+			bool result = true;
+
+			GridMesh flat = CreateGrid(gridSize);
+			const size_t flatTarget = flat.indices.size() / 4;
+			const float flatError = MeshOptimizer::SimplifyMesh(flat.indices, flat.positions.data(), sizeof(Position), flat.positions.size(), flatTarget, 0.01f);
+			double minArea = 0;
+			const double area = ProjectedArea(flat, flat.indices, minArea);
+			std::cout << "simplify: 平面 三角形 " << gridSize * gridSize * 2 << " -> " << flat.indices.size() / 3 <<
+				"(目標 " << flatTarget / 3 << "), 誤差 " << flatError << ", 面積 " << area << ", 最小面積 " << minArea << std::endl;
+			result &= IsIndexValid(flat.indices, flat.positions.size()) && flat.indices.size() <= flatTarget &&
+				flatError <= 1e-5f && std::abs(area - gridArea) < 1e-3 && minArea > 0;
+
+			GridMesh bumpy = CreateGrid(gridSize);
+			for (Position& p : bumpy.positions) {
+				p.z = 2.0f * sinf(p.x * 0.4f) * cosf(p.y * 0.3f);
+			}
+			const size_t bumpyCount = bumpy.indices.size();
+			const float maxError = 0.0005f;
+			const float bumpyError = MeshOptimizer::SimplifyMesh(bumpy.indices, bumpy.positions.data(), sizeof(Position), bumpy.positions.size(), bumpyCount / 8, maxError);
+			std::cout << "simplify: 起伏 三角形 " << bumpyCount / 3 << " -> " << bumpy.indices.size() / 3 <<
+				"(目標 " << bumpyCount / 24 << "), 誤差 " << bumpyError << "(許容 " << maxError << ")" << std::endl;
+			result &= IsIndexValid(bumpy.indices, bumpy.positions.size()) && bumpyError <= maxError &&
+				bumpy.indices.size() < bumpyCount && bumpy.indices.size() > bumpyCount / 8;
+
+			GridMesh unchanged = CreateGrid(4);
+			const std::vector<uint32_t> original = unchanged.indices;
+			const float noError = MeshOptimizer::SimplifyMesh(unchanged.indices, unchanged.positions.data(), sizeof(Position), unchanged.positions.size(), original.size(), 0.01f);
+			result &= unchanged.indices == original && noError == 0;
+
+			return Report("simplify", result);
+		}
+
+		/**
+		*	Res のメッシュを変換し、各段階の統計を出力する
+		*
+		*	統計は Mesh::AnalyzeMeshFile が出力する
+		*/
+		bool CheckResMeshes() {
+			const char* const fileList[] = { "Res/Toroid.fbx", "Res/Player.fbx", "Res/Blast.fbx" };
+			bool result = true;
+			for (const char* fileName : fileList) {
+				result &= Mesh::AnalyzeMeshFile(fileName);
+			}
+			return Report("res", result);
+		}
+
+		/**
+		*	Res のメッシュの全ての頂点を圧縮・展開し、誤差が許容範囲内か検証する
+		*
+		*	許容誤差は色が 1/510、テクスチャ座標が値の 2^-11 倍、法線が各成分 1/511、座標は誤差なし
+		*/
+		bool CheckPacking() {
+			const char* const fileList[] = { "Res/Toroid.fbx", "Res/Player.fbx", "Res/Blast.fbx" };
+			bool result = true;
+			for (const char* fileName : fileList) {
+				result &= Mesh::CheckVertexPacking(fileName);
+			}
+			return Report("packing", result);
+		}
+
+		/**
+		*	Res のメッシュをゲーム画面に配置して、クラスタ単位のカリングで描画しない三角形の割合を出力する
+		*
+		*	視点と投影は main.cpp と GameEngine::Render に合わせる
+		*	配置は敵が出現してから画面外に出るまでの範囲(x = -12～12, z = -8～44)を 4 刻みで埋め、Y 軸回転を 30 度刻みで変える
+		*/
+		bool CheckClusterCulling() {
+			const glm::mat4 matView = glm::lookAt(glm::vec3(0, 20, -8), glm::vec3(0, 0, 12), glm::vec3(0, 0, 1));
+			const glm::mat4 matProj = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 1.0f, 200.0f);
+			std::vector<glm::mat4> modelList;
+			for (int z = -8; z <= 44; z += 4) {
+				for (int x = -12; x <= 12; x += 4) {
+					for (int angle = 0; angle < 360; angle += 30) {
+						const glm::mat4 matT = glm::translate(glm::mat4(1), glm::vec3(x, 0, z));
+						modelList.push_back(glm::rotate(matT, glm::radians(static_cast<float>(angle)), glm::vec3(0, 1, 0)));
+					}
+				}
+			}
+			const char* const fileList[] = { "Res/Toroid.fbx", "Res/Player.fbx", "Res/Blast.fbx" };
+			bool result = true;
+			for (const char* fileName : fileList) {
+				result &= Mesh::AnalyzeClusterCulling(fileName, matView, matProj, modelList);
+			}
+			return Report("culling", result);
+		}
+
+		/**
+		*	圧縮ブロックの上下反転を検証する
+		*
+		*	乱数の画素を BC1/BC3/BC7 で圧縮し、反転したブロックの展開結果が元のブロックの展開結果の行を入れ替えたものと一致するか調べる
+		*	反転する行数は 1～4(高さ 4 未満のミップレベルを含む)を全て試す
+		*/
+		bool CheckBlockFlip() {
+			const TextureCompressor::Format formats[] = { TextureCompressor::Format::BC1, TextureCompressor::Format::BC3, TextureCompressor::Format::BC7 };
+			std::mt19937 rand(1);
+			std::uniform_int_distribution<int> range(0, 255);
+			bool result = true;
+			size_t mismatchCount = 0;
+			for (int n = 0; n < 1000; ++n) {
+				uint8_t rgba[16 * 4];
+				for (uint8_t& e : rgba) {
+					e = static_cast<uint8_t>(range(rand));
+				}
+				for (TextureCompressor::Format format : formats) {
+					uint8_t block[16];
+					switch (format) {
+					case TextureCompressor::Format::BC1: TextureCompressor::EncodeBC1(rgba, block); break;
+					case TextureCompressor::Format::BC3: TextureCompressor::EncodeBC3(rgba, block); break;
+					case TextureCompressor::Format::BC7: TextureCompressor::EncodeBC7(rgba, block); break;
+					}
+					uint8_t original[16 * 4];
+					TextureCompressor::DecodeBlock(format, block, original);
+					for (int rows = 1; rows <= 4; ++rows) {
+						uint8_t flipped[16];
+						memcpy(flipped, block, sizeof(flipped));
+						result &= TextureCompressor::FlipBlock(format, flipped, rows);
+						uint8_t decoded[16 * 4];
+						TextureCompressor::DecodeBlock(format, flipped, decoded);
+						for (int y = 0; y < 4; ++y) {
+							const int sourceY = y < rows ? rows - 1 - y : y;
+							if (memcmp(decoded + y * 16, original + sourceY * 16, 16) != 0) {
+								++mismatchCount;
+							}
+						}
+					}
+				}
+			}
+			std::cout << "flip: 不一致の行 " << mismatchCount << std::endl;
+			return Report("flip", result && mismatchCount == 0);
+		}
+
+		/**
+		*	Res のテクスチャを各形式で圧縮して DDS に書き出し、読み込んだ結果が圧縮結果と一致するか検証する
+		*
+		*	形式ごとに圧縮時間、最上位のミップレベルの PSNR、DDS の読み込み(上下反転を含む)時間を出力する
+		*	書き出した DDS ファイルは検証後に削除する
+		*/
+		bool CheckDds() {
+			const char* const fileList[] = { "Res/Toroid.bmp", "Res/Player.bmp", "Res/Sample.bmp" };
+			const TextureCompressor::Format formats[] = { TextureCompressor::Format::BC1, TextureCompressor::Format::BC3, TextureCompressor::Format::BC7 };
+			static const char* const formatNames[] = { "BC1", "BC3", "BC7" };
+			Texture::CompressedFormatSupport(true, true);
+			bool result = true;
+			for (const char* fileName : fileList) {
+				ImageData source;
+				if (!Texture::Decode(fileName, source, false)) {
+					std::cerr << "ERROR: " << fileName << " を読み込めません" << std::endl;
+					result = false;
+					continue;
+				}
+				for (TextureCompressor::Format format : formats) {
+					ImageData compressed;
+					const int64_t compressBegin = Profiler::Now();
+					if (!TextureCompressor::Compress(source, format, compressed)) {
+						result = false;
+						continue;
+					}
+					const double compressMs = static_cast<double>(Profiler::Now() - compressBegin) / 1e6;
+					const std::string ddsName = std::string(fileName) + ".check.dds";
+					if (!TextureCompressor::WriteDds(ddsName.c_str(), compressed)) {
+						result = false;
+						continue;
+					}
+					ImageData loaded;
+					const int64_t loadBegin = Profiler::Now();
+					const MappedFilePtr file = MappedFile::Open(ddsName.c_str());
+					const bool isLoaded = file && Texture::DecodeDds(ddsName.c_str(), file, loaded);
+					const double loadMs = static_cast<double>(Profiler::Now() - loadBegin) / 1e6;
+					bool match = isLoaded && loaded.iformat == compressed.iformat && loaded.LevelCount() == compressed.LevelCount();
+					for (int level = 0; match && level < compressed.LevelCount(); ++level) {
+						match = memcmp(loaded.Pixels(level), compressed.Pixels(level), compressed.LevelBytes(level)) == 0;
+					}
+					std::cout << fileName << ": " << formatNames[static_cast<int>(format)] << " " << source.width << "x" << source.height <<
+						" 圧縮 " << compressMs << "ms, PSNR " << TextureCompressor::CalcPsnr(source, compressed) << "dB, DDS 読み込み " << loadMs << "ms" <<
+						(match ? "" : " 不一致") << std::endl;
+					result &= match;
+					remove(ddsName.c_str());
+				}
+			}
+			Texture::CompressedFormatSupport(false, false);
+			return Report("dds", result);
+		}
+
+		/// 検証項目
+		struct Check {
+			const char* name;
+			bool(*func)();
+		};
+		const Check checkList[] = {
+			{ "acmr", CheckAcmr },
+			{ "simplify", CheckSimplify },
+			{ "packing", CheckPacking },
+			{ "res", CheckResMeshes },
+			{ "culling", CheckClusterCulling },
+			{ "flip", CheckBlockFlip },
+			{ "dds", CheckDds },
+		};
+
+	} // unnamed namespace
+
+	/**
+	*	検証を実行する
+	*
+	*	@param name	検証項目名("all" なら全ての項目)
+	*
+	*	@retval true	全ての検証に成功
+	*	@retval false	失敗した検証があるか、項目名が不明
+	*/
+	bool Run(const char* name) {
+		const bool isAll = strcmp(name, "all") == 0;
+		bool found = false;
+		bool result = true;
+		for (const Check& e : checkList) {
+			if (isAll || strcmp(name, e.name) == 0) {
+				found = true;
+				result &= e.func();
+			}
+		}
+		if (!found) {
+			std::cerr << "ERROR: 検証項目 " << name << " はありません" << std::endl;
+			return false;
+		}
+		return result;
+	}
+
+} // namespace AssetChecks
@@ -0,0 +1,16 @@
+/**
+*	@file AssetChecks.h
+*/
+#pragma once
+
+/**
+*	メッシュ最適化とアセット変換の検証
+*
+*	GPU を使わずに実行できる検証をまとめたもの
+*	ベンチマークの --check オプションから呼び出す
+*/
+namespace AssetChecks {
+
+	bool Run(const char* name);
+
+}
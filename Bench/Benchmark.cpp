@@ -0,0 +1,435 @@
+/**
+*	@file Benchmark.cpp
+*
+*	エンティティ処理のベンチマーク
+*
+*	合成したワークロードでエンジンを数百フレーム動かし、段階毎のエンティティ当たりの処理時間、
+*	フレーム当たりのメモリ確保回数と描画三角形数、クラスタ単位のカリングで除外した三角形の割合、
+*	フレーム時間のパーセンタイルを JSON 形式で出力する
+*	リソースを読み込むため、リポジトリのルートディレクトリで実行すること
+*
+*	使い方:
+*		OpenGlTutrialBench [--frames N] [--scenario 名前] [--out ファイル名]
+*		OpenGlTutrialBench --enemies N --shots M --pairs K --churn C [--frames N]
+*		OpenGlTutrialBench --check <項目名|all>	(メッシュ最適化などの検証を行って終了する)
+*/
+#include "AssetChecks.h"
+#include "../Src/GameEngine.h"
+#include "../Src/Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+	std::atomic<uint64_t> allocationCount(0);	///< operator new が呼ばれた回数
+}
+
+/**
+*	メモリ確保回数を数えるための operator new
+*/
+void* operator new(size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+namespace {
+	/// ベンチマーク用の衝突グループ ID
+	enum BenchGroupId {
+		BenchGroupId_Shot = 0,		///< 自機弾
+		BenchGroupId_EnemyBegin = 1,///< 敵(衝突グループの組の数だけ連番で使う)
+		BenchGroupId_Churn = 30,	///< 生成直後に削除されるエンティティ
+		BenchGroupId_Others = 31,	///< 爆発
+	};
+
+	const double frameDelta = 1.0 / 60.0;	///< 1 フレームの経過時間(固定)
+	const int warmupFrames = 60;			///< 計測前に空回しするフレーム数
+	const float enemyLifetime = 8.0f;		///< 敵が画面外に出るまでのおおよその秒数
+	const int readInterval = 128;			///< プロファイラのサンプルを回収する間隔(フレーム数)
+	const int gpuSampleDelay = 8;			///< GPU のサンプルが届くまでの猶予(フレーム数)
+
+	/// 計測対象の段階名
+	const char* const stageNames[] = {
+		"UpdateFunc", "Integrate", "Collision", "EntityUpdateFunc", "UBOFill", "Draw", "Scene",
+	};
+
+	/**
+	*	ベンチマークのシナリオ
+	*/
+	struct Scenario {
+		std::string name;
+		int enemyCount;			///< 同時に存在する敵の数の目安
+		double shotsPerSecond;	///< 1 秒間に発射する自機弾の数
+		int collisionPairs;		///< 衝突判定を行うグループの組の数
+		int churnPerFrame;		///< 毎フレーム生成・削除するエンティティの数
+		int frames;				///< 計測するフレーム数
+	};
+
+	/**
+	*	敵の更新
+	*/
+	struct UpdateEnemy {
+		void operator()(Entity::Entity& entity, double delta) {
+			const glm::vec3 pos = entity.Position();
+			if (pos.z < -40.0f || std::abs(pos.x) > 40.0f) {
+				entity.Destroy();
+			}
+		}
+	};
+
+	/**
+	*	自機弾の更新
+	*/
+	struct UpdateShot {
+		void operator()(Entity::Entity& entity, double delta) {
+			if (entity.Position().z > 40.0f) {
+				entity.Destroy();
+			}
+		}
+	};
+
+	/**
+	*	生成直後に削除されるエンティティの更新
+	*/
+	struct UpdateChurn {
+		void operator()(Entity::Entity& entity, double delta) {
+			entity.Destroy();
+		}
+	};
+
+	/**
+	*	爆発の更新
+	*/
+	struct UpdateBlast {
+		void operator()(Entity::Entity& entity, double delta) {
+			timer += delta;
+			if (timer >= 0.5) {
+				entity.Destroy();
+				return;
+			}
+			entity.Scale(glm::vec3(static_cast<float>(1 + timer * 4)));
+		}
+		double timer = 0;
+	};
+
+	/**
+	*	ワークロードで生成するエンティティの雛形
+	*/
+	struct PrefabList {
+		GameEngine::PrefabHandle enemy[BenchGroupId_Churn - BenchGroupId_EnemyBegin];	///< 敵(衝突グループ毎)
+		GameEngine::PrefabHandle shot;	///< 自機弾
+		GameEngine::PrefabHandle churn;	///< 生成直後に削除されるエンティティ
+		GameEngine::PrefabHandle blast;	///< 爆発
+	};
+	PrefabList prefabs;
+
+	/**
+	*	エンティティの雛形を登録する
+	*
+	*	@retval true	登録成功
+	*	@retval false	登録失敗
+	*/
+	bool RegisterPrefabs() {
+		GameEngine& game = GameEngine::Instance();
+		GameEngine::Prefab enemy;
+		enemy.mesh = game.GetMeshHandle("Toroid");
+		enemy.texture = game.GetTextureHandle("Res/Toroid.bmp");
+		enemy.collision = { glm::vec3(-1, -1, -1), glm::vec3(1, 1, 1) };
+		enemy.func = UpdateEnemy();
+		for (int i = 0; i < BenchGroupId_Churn - BenchGroupId_EnemyBegin; ++i) {
+			enemy.groupId = BenchGroupId_EnemyBegin + i;
+			prefabs.enemy[i] = game.RegisterPrefab(enemy);
+		}
+
+		GameEngine::Prefab shot;
+		shot.groupId = BenchGroupId_Shot;
+		shot.mesh = game.GetMeshHandle("NormalShot");
+		shot.texture = game.GetTextureHandle("Res/Player.bmp");
+		shot.collision = { glm::vec3(-0.5f, -0.5f, -1.0f), glm::vec3(0.5f, 0.5f, 1.0f) };
+		shot.velocity = glm::vec3(0, 0, 80);
+		shot.func = UpdateShot();
+		prefabs.shot = game.RegisterPrefab(shot);
+
+		GameEngine::Prefab churn;
+		churn.groupId = BenchGroupId_Churn;
+		churn.mesh = enemy.mesh;
+		churn.texture = enemy.texture;
+		churn.func = UpdateChurn();
+		prefabs.churn = game.RegisterPrefab(churn);
+
+		GameEngine::Prefab blast;
+		blast.groupId = BenchGroupId_Others;
+		blast.mesh = game.GetMeshHandle("Blast");
+		blast.texture = enemy.texture;
+		blast.func = UpdateBlast();
+		prefabs.blast = game.RegisterPrefab(blast);
+
+		return prefabs.shot.IsValid() && prefabs.churn.IsValid() && prefabs.blast.IsValid() && prefabs.enemy[0].IsValid();
+	}
+
+	/**
+	*	自機弾と敵の衝突処理
+	*/
+	void ShotAndEnemyCollisionHandler(Entity::Entity& lhs, Entity::Entity& rhs) {
+		GameEngine& game = GameEngine::Instance();
+		game.Spawn(prefabs.blast, rhs.Position());
+		lhs.Destroy();
+		rhs.Destroy();
+	}
+
+	/**
+	*	シナリオに従ってエンティティを生成する状態更新関数
+	*
+	*	敵の出現方法は main.cpp の Update と同じく、ランダムな間隔で複数体をまとめて出現させる
+	*/
+	struct SpawnWorkload {
+		void operator()(double delta) {
+			GameEngine& game = GameEngine::Instance();
+			const int enemyGroups = std::max(1, scenario.collisionPairs);
+
+			enemyInterval -= delta;
+			if (enemyInterval <= 0 && scenario.enemyCount > 0) {
+				std::uniform_real_distribution<> rndInterval(0.5, 1.0);
+				const double interval = rndInterval(game.Rand());
+				std::uniform_int_distribution<> rndX(-12, 12);
+				std::uniform_int_distribution<> rndZ(40, 44);
+				enemyCarry += scenario.enemyCount * interval / enemyLifetime;
+				for (; enemyCarry >= 1.0; enemyCarry -= 1.0) {
+					const glm::vec3 pos(rndX(game.Rand()), 0, rndZ(game.Rand()));
+					if (Entity::Entity* p = game.Spawn(prefabs.enemy[spawnedEnemies++ % enemyGroups], pos)) {
+						p->Velocity(glm::vec3(pos.x < 0 ? 1.0f : -1.0f, 0, -10));
+					}
+				}
+				enemyInterval = interval;
+			}
+
+			shotCarry += scenario.shotsPerSecond * delta;
+			for (; shotCarry >= 1.0; shotCarry -= 1.0) {
+				std::uniform_real_distribution<float> rndX(-12, 12);
+				game.Spawn(prefabs.shot, glm::vec3(rndX(game.Rand()), 0, 0));
+			}
+
+			for (int i = 0; i < scenario.churnPerFrame; ++i) {
+				game.Spawn(prefabs.churn, glm::vec3(0, -10, 0));
+			}
+		}
+
+		explicit SpawnWorkload(const Scenario& s) : scenario(s) {}
+
+		Scenario scenario;
+		double enemyInterval = 0;
+		double enemyCarry = 0;
+		double shotCarry = 0;
+		int spawnedEnemies = 0;
+	};
+
+	/**
+	*	パーセンタイル値を求める
+	*
+	*	@param sorted	昇順にソート済みの値の配列
+	*	@param p		求めるパーセンタイル(0~1)
+	*/
+	double Percentile(const std::vector<double>& sorted, double p) {
+		if (sorted.empty()) {
+			return 0;
+		}
+		const size_t i = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+		return sorted[i];
+	}
+
+	/**
+	*	シナリオを実行し、結果を JSON 形式で出力する
+	*
+	*	@param scenario	実行するシナリオ
+	*	@param fp		出力先
+	*/
+	void RunScenario(const Scenario& scenario, FILE* fp) {
+		GameEngine& game = GameEngine::Instance();
+		game.ClearEntities();
+		game.ClearCollisionHandlerList();
+		for (int i = 0; i < scenario.collisionPairs; ++i) {
+			game.CollisionHandler(BenchGroupId_Shot, BenchGroupId_EnemyBegin + i, &ShotAndEnemyCollisionHandler);
+		}
+		game.Rand().seed(12345);
+		game.UpdateFunc(SpawnWorkload(scenario));
+
+		for (int i = 0; i < warmupFrames; ++i) {
+			game.Step(frameDelta);
+		}
+
+		std::map<std::string, int64_t> stageTime;
+		std::map<std::string, double> counterTotal;
+		std::vector<double> frameTimes;
+		frameTimes.reserve(scenario.frames);
+		std::vector<int64_t> frameBegins;
+		frameBegins.reserve(scenario.frames);
+		std::vector<Profiler::Sample> samples;
+		samples.reserve(4096);
+		uint64_t totalAllocations = 0;
+		uint64_t totalEntities = 0;
+		size_t maxEntities = 0;
+		int64_t readSince = Profiler::Now();
+		for (int i = 0; i < scenario.frames; ++i) {
+			const size_t entityCount = game.EntityCount();
+			totalEntities += entityCount;
+			maxEntities = std::max(maxEntities, entityCount);
+
+			const uint64_t allocBegin = allocationCount.load(std::memory_order_relaxed);
+			const int64_t begin = Profiler::Now();
+			game.Step(frameDelta);
+			const int64_t end = Profiler::Now();
+			totalAllocations += allocationCount.load(std::memory_order_relaxed) - allocBegin;
+			frameTimes.push_back(static_cast<double>(end - begin) * 1e-6);
+			frameBegins.push_back(begin);
+
+			//サンプルはリングバッファが一周する前に回収する
+			//GPU のサンプルは数フレーム遅れて届くので、少し前のフレームまでを集計対象にする
+			const bool isLast = i + 1 == scenario.frames;
+			if (isLast || (i % readInterval == readInterval - 1 && i >= gpuSampleDelay)) {
+				const int64_t cutoff = isLast ? INT64_MAX : frameBegins[i - gpuSampleDelay];
+				samples.clear();
+				Profiler::ReadSamples(readSince, samples);
+				for (const Profiler::Sample& s : samples) {
+					if (s.type == Profiler::SampleType_Scope && s.time < cutoff) {
+						stageTime[s.name] += s.duration;
+					} else if (s.type == Profiler::SampleType_Counter && s.time < cutoff) {
+						counterTotal[s.name] += s.value;
+					}
+				}
+				readSince = cutoff;
+			}
+		}
+		std::sort(frameTimes.begin(), frameTimes.end());
+
+		const double frames = static_cast<double>(scenario.frames);
+		const double entities = std::max<double>(1.0, static_cast<double>(totalEntities));
+		fprintf(fp, "    {\n      \"name\": \"%s\",\n", scenario.name.c_str());
+		fprintf(fp, "      \"params\": {\"enemies\": %d, \"shotsPerSecond\": %g, \"collisionPairs\": %d, \"churnPerFrame\": %d, \"frames\": %d},\n",
+			scenario.enemyCount, scenario.shotsPerSecond, scenario.collisionPairs, scenario.churnPerFrame, scenario.frames);
+		fprintf(fp, "      \"entities\": {\"avg\": %.1f, \"max\": %u},\n", static_cast<double>(totalEntities) / frames, static_cast<unsigned>(maxEntities));
+		fprintf(fp, "      \"stages\": {");
+		const char* separator = "";
+		for (const char* name : stageNames) {
+			const double ns = static_cast<double>(stageTime[name]);
+			fprintf(fp, "%s\n        \"%s\": {\"nsPerEntity\": %.2f, \"msPerFrame\": %.4f}", separator, name, ns / entities, ns * 1e-6 / frames);
+			separator = ",";
+		}
+		fprintf(fp, "\n      },\n");
+		fprintf(fp, "      \"allocationsPerFrame\": %.2f,\n", static_cast<double>(totalAllocations) / frames);
+		fprintf(fp, "      \"trianglesPerFrame\": {\"lod\": %.1f, \"withoutLod\": %.1f},\n",
+			counterTotal["Triangles"] / frames, counterTotal["TrianglesWithoutLod"] / frames);
+		fprintf(fp, "      \"drawCallsPerFrame\": %.1f,\n", counterTotal["DrawCalls"] / frames);
+		fprintf(fp, "      \"glStateCallsPerFrame\": {\"issued\": %.1f, \"saved\": %.1f},\n",
+			counterTotal["GLStateCalls"] / frames, counterTotal["GLStateCallsSaved"] / frames);
+		fprintf(fp, "      \"textureCache\": {\"hitsPerFrame\": %.2f, \"missesPerFrame\": %.2f, \"evictionsPerFrame\": %.2f, \"residentMB\": %.2f},\n",
+			counterTotal["TextureCacheHits"] / frames, counterTotal["TextureCacheMisses"] / frames, counterTotal["TextureCacheEvictions"] / frames,
+			counterTotal["TextureResidentBytes"] / frames / (1024 * 1024));
+		const double clusterTriangles = std::max(1.0, counterTotal["ClusterTriangles"]);
+		fprintf(fp, "      \"clusterCulling\": {\"trianglesPerFrame\": %.1f, \"frustumCulledPercent\": %.1f, \"backfaceCulledPercent\": %.1f},\n",
+			counterTotal["ClusterTriangles"] / frames, counterTotal["ClusterFrustumCulled"] * 100.0 / clusterTriangles,
+			counterTotal["ClusterBackfaceCulled"] * 100.0 / clusterTriangles);
+		fprintf(fp, "      \"frameTimeMs\": {\"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f, \"max\": %.4f}\n    }",
+			Percentile(frameTimes, 0.5), Percentile(frameTimes, 0.9), Percentile(frameTimes, 0.99), frameTimes.empty() ? 0.0 : frameTimes.back());
+	}
+}
+
+int main(int argc, char** argv) {
+	int frames = 600;
+	const char* scenarioName = nullptr;
+	const char* outFileName = nullptr;
+	const char* checkName = nullptr;
+	Scenario custom = { "custom", -1, 0, 1, 0, 0 };
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "--frames") == 0) {
+			frames = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "--scenario") == 0) {
+			scenarioName = argv[i + 1];
+		} else if (strcmp(argv[i], "--out") == 0) {
+			outFileName = argv[i + 1];
+		} else if (strcmp(argv[i], "--check") == 0) {
+			checkName = argv[i + 1];
+		} else if (strcmp(argv[i], "--enemies") == 0) {
+			custom.enemyCount = atoi(argv[i + 1]);
+		} else if (strcmp(argv[i], "--shots") == 0) {
+			custom.shotsPerSecond = atof(argv[i + 1]);
+		} else if (strcmp(argv[i], "--pairs") == 0) {
+			custom.collisionPairs = std::min(atoi(argv[i + 1]), BenchGroupId_Churn - BenchGroupId_EnemyBegin);
+		} else if (strcmp(argv[i], "--churn") == 0) {
+			custom.churnPerFrame = atoi(argv[i + 1]);
+		} else {
+			std::cerr << "ERROR: 不明なオプション " << argv[i] << std::endl;
+			return 1;
+		}
+	}
+
+	if (checkName) {
+		return AssetChecks::Run(checkName) ? 0 : 1;
+	}
+
+	std::vector<Scenario> scenarios = {
+		{ "idle", 0, 0, 0, 0, frames },
+		{ "enemies_100", 100, 0, 1, 0, frames },
+		{ "enemies_500_shots_60", 500, 60, 1, 0, frames },
+		{ "collision_pairs_8", 500, 60, 8, 0, frames },
+		{ "churn_200", 100, 20, 1, 200, frames },
+	};
+	if (custom.enemyCount >= 0) {
+		custom.frames = frames;
+		scenarios.assign(1, custom);
+	} else if (scenarioName) {
+		scenarios.erase(std::remove_if(scenarios.begin(), scenarios.end(), [scenarioName](const Scenario& s) { return s.name != scenarioName; }), scenarios.end());
+		if (scenarios.empty()) {
+			std::cerr << "ERROR: シナリオ " << scenarioName << " はありません" << std::endl;
+			return 1;
+		}
+	}
+
+	GameEngine& game = GameEngine::Instance();
+	if (!game.Init(800, 600, "OpenGlTutrialBench", false)) {
+		return 1;
+	}
+	GameEngine::AssetManifest manifest;
+	manifest.textureList = { "Res/Toroid.bmp", "Res/Player.bmp" };
+	manifest.meshList = { "Res/Toroid.fbx", "Res/Player.fbx", "Res/Blast.fbx" };
+	if (!game.LoadAssets(manifest)) {
+		std::cerr << "ERROR: リソースを読み込めません(リポジトリのルートで実行してください)" << std::endl;
+		return 1;
+	}
+	if (!RegisterPrefabs()) {
+		return 1;
+	}
+	game.Camera({ glm::vec3(0, 20, -8), glm::vec3(0, 0, 12), glm::vec3(0, 0, 1) });
+	game.AmbientLight(glm::vec4(0.05f, 0.1f, 0.2f, 1));
+	game.Light(0, { glm::vec4(40, 100, 10, 1), glm::vec4(12000, 12000, 12000, 1) });
+	Profiler::Enable(true);
+
+	FILE* fp = outFileName ? fopen(outFileName, "w") : stdout;
+	if (!fp) {
+		std::cerr << "ERROR: " << outFileName << "を開けません" << std::endl;
+		return 1;
+	}
+	fprintf(fp, "{\n  \"frameDelta\": %g,\n  \"scenarios\": [\n", frameDelta);
+	for (size_t i = 0; i < scenarios.size(); ++i) {
+		RunScenario(scenarios[i], fp);
+		fprintf(fp, i + 1 < scenarios.size() ? ",\n" : "\n");
+	}
+	fprintf(fp, "  ]\n}\n");
+	if (fp != stdout) {
+		fclose(fp);
+	}
+	return 0;
+}
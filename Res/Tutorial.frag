@@ -1,37 +1,54 @@
 #version 410
 
+//機能フラグ(Shader::Feature)に対応する #define がこのファイルの #version の直後に挿入される
+//LIT: ライティングする(LIGHT_COUNT 個の点光源を計算する)  TEXTURED: テクスチャを貼る
+
 layout(location=0) in vec4 inColor;
-layout(location=1) in vec2 inTexCoord;
+#ifdef TEXTURED
+layout(location=1) in vec3 inTexCoord;	//z: テクスチャ配列のレイヤー番号
+#endif
+#ifdef LIT
 layout(location=2) in vec3 inWorldPosition;
 layout(location=3) in vec3 inWorldNormal;
 
-//colorSampler ϐ`̉ɒǋL
-//Cgf[^(_)
+//ライトデータ(点光源)
 struct PointLight{
-    vec4 position;  //W([hWn)
-    vec4 color;     //邳
+    vec4 position;  //座標(ワールド座標系)
+    vec4 color;     //明るさ
 };
 
-const int maxLightCount = 4;    //Cg̐
+const int maxLightCount = 4;    //ライトの数
+
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT maxLightCount   //計算する点光源の数(Uniform ブロックの大きさは変えない)
+#endif
 
-//CeBOp[^
+//ライティングパラメータ
 layout(std140) uniform LightData{
-    vec4 ambientColor;                  //
-    PointLight light[maxLightCount];    //Cg̃Xg
+    vec4 ambientColor;                  //環境光
+    PointLight light[maxLightCount];    //ライトのリスト
 }lightData;
+#endif
 
-uniform sampler2D colorSampler;
+#ifdef TEXTURED
+uniform sampler2DArray colorSampler;
+#endif
 
 out vec4 fragColor;
 
 void main(){
+	fragColor = inColor;
+#ifdef TEXTURED
+	fragColor *= texture(colorSampler, inTexCoord);
+#endif
+#ifdef LIT
 	vec3 lightColor = lightData.ambientColor.rgb;
-	for (int i = 0; i < maxLightCount; ++i){
+	for (int i = 0; i < LIGHT_COUNT; ++i){
 		vec3 lightVector = lightData.light[i].position.xyz - inWorldPosition;
 		float lightPower = 1.0 / dot(lightVector, lightVector);
 		float cosTheta = clamp(dot(inWorldNormal, normalize(lightVector)), 0, 1);
 		lightColor += lightData.light[i].color.rgb * cosTheta * lightPower;
 	}
-	fragColor = inColor * texture(colorSampler, inTexCoord);
 	fragColor.rgb *= lightColor;
+#endif
 }
\ No newline at end of file
@@ -5,27 +5,59 @@ layout(location=1) in vec4 vColor;
 layout(location=2) in vec2 vTexCoord;
 layout(location=3) in vec3 vNormal;
 
+//機能フラグ(Shader::Feature)に対応する #define がこのファイルの #version の直後に挿入される
+//LIT: ライティングする  INSTANCED: gl_InstanceID 番目のデータを使う  TEXTURED: テクスチャを貼る
+
 layout(location=0) out vec4 outColor;
-layout(location=1) out vec2 outTexCoord;
+#ifdef TEXTURED
+layout(location=1) out vec3 outTexCoord;
+#endif
+#ifdef LIT
 layout(location=2) out vec3 outWorldPosition;
 layout(location=3) out vec3 outWorldNormal;
+#endif
 
 //uniform mat4x4 matMVP;
 /**
-*	_VF[_̃p[^[
+*	頂点シェーダのパラメーター(インスタンス 1 個分)
 */
-layout(std140) uniform VertexData{
+struct VertexDataItem{
 	mat4 matMVP;
 	mat4 matModel;
 	mat3x4 matNormal;
 	vec4 color;
+	vec4 texLayer;	//x: テクスチャ配列のレイヤー番号
+};
+
+#ifdef INSTANCED
+const int maxInstanceCount = 64;	//Uniform::maxInstanceCount と一致させること
+#else
+const int maxInstanceCount = 1;
+#endif
+
+/**
+*	インスタンス毎のパラメーター
+*
+*	INSTANCED なら gl_InstanceID 番目の要素、そうでなければ先頭の要素を使う
+*/
+layout(std140) uniform VertexData{
+	VertexDataItem item[maxInstanceCount];
 } vertexData;
 
 
 void main(){
-	outColor = vColor * vertexData.color;
-	outTexCoord = vTexCoord;
-	outWorldPosition = (vertexData.matModel * vec4(vPosition, 1.0)).xyz;
-	outWorldNormal = mat3(vertexData.matNormal) * vNormal;
-	gl_Position = vertexData.matMVP * vec4(vPosition, 1);
+#ifdef INSTANCED
+	VertexDataItem data = vertexData.item[gl_InstanceID];
+#else
+	VertexDataItem data = vertexData.item[0];
+#endif
+	outColor = vColor * data.color;
+#ifdef TEXTURED
+	outTexCoord = vec3(vTexCoord, data.texLayer.x);
+#endif
+#ifdef LIT
+	outWorldPosition = (data.matModel * vec4(vPosition, 1.0)).xyz;
+	outWorldNormal = mat3(data.matNormal) * vNormal;
+#endif
+	gl_Position = data.matMVP * vec4(vPosition, 1);
 }
\ No newline at end of file
@@ -0,0 +1,42 @@
+/**
+*	@file Arena.cpp
+*/
+#include "Arena.h"
+#include <algorithm>
+
+/**
+*	コンストラクタ
+*
+*	@param blockSize	ブロックの最小バイト数
+*						一時データ全体が収まる大きさを指定すれば、ヒープからの確保は 1 回で済む
+*/
+Arena::Arena(size_t blockSize) : blockSize(std::max<size_t>(blockSize, 256))
+{
+}
+
+/**
+*	メモリを切り出す
+*
+*	@param size			バイト数
+*	@param alignment	アラインメント(2 のべき乗)
+*
+*	@return 切り出したメモリの先頭アドレス
+*
+*	現在のブロックに収まらなければ新しいブロックを確保する
+*	残りの部分は使われずに残る
+*/
+void* Arena::Allocate(size_t size, size_t alignment) {
+	++allocationCount;
+	uintptr_t p = (reinterpret_cast<uintptr_t>(current) + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+	if (!current || p + size > reinterpret_cast<uintptr_t>(end)) {
+		const size_t newSize = std::max(blockSize, size + alignment);
+		blockList.emplace_back(new uint8_t[newSize]);
+		current = blockList.back().get();
+		end = current + newSize;
+		reservedBytes += newSize;
+		p = (reinterpret_cast<uintptr_t>(current) + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+	}
+	current = reinterpret_cast<uint8_t*>(p + size);
+	usedBytes += size;
+	return reinterpret_cast<void*>(p);
+}
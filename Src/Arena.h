@@ -0,0 +1,65 @@
+/**
+*	@file Arena.h
+*/
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <memory>
+
+/**
+*	一時データ用のアリーナ(バンプアロケータ)
+*
+*	ブロックの先頭から順に切り出すだけで、個別には解放しない
+*	確保したメモリはアリーナを破棄したときにまとめて解放される
+*	スレッドセーフではないので、スレッド毎に用意すること
+*/
+class Arena {
+public:
+	explicit Arena(size_t blockSize = 64 * 1024);
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void* Allocate(size_t size, size_t alignment);
+
+	size_t AllocationCount() const { return allocationCount; }
+	size_t BlockCount() const { return blockList.size(); }
+	size_t UsedBytes() const { return usedBytes; }
+	size_t ReservedBytes() const { return reservedBytes; }
+
+private:
+	std::vector<std::unique_ptr<uint8_t[]>> blockList;	///< 確保したブロックのリスト
+	size_t blockSize;			///< 新しく確保するブロックの最小バイト数
+	uint8_t* current = nullptr;	///< 現在のブロックの未使用部分の先頭
+	uint8_t* end = nullptr;		///< 現在のブロックの終端
+	size_t allocationCount = 0;	///< Allocate を呼び出した回数
+	size_t usedBytes = 0;		///< 切り出したバイト数
+	size_t reservedBytes = 0;	///< 確保したブロックの合計バイト数
+};
+
+/**
+*	アリーナからメモリを確保する STL アロケータ
+*
+*	deallocate は何もしないので、要素数が分かっているコンテナに reserve して使うこと
+*/
+template<typename T>
+class ArenaAllocator {
+public:
+	typedef T value_type;
+
+	explicit ArenaAllocator(Arena& arena) : arena(&arena) {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t n) { return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T))); }
+	void deallocate(T*, size_t) {}
+
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& rhs) const { return arena == rhs.arena; }
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& rhs) const { return arena != rhs.arena; }
+
+private:
+	template<typename U> friend class ArenaAllocator;
+	Arena* arena;
+};
@@ -0,0 +1,22 @@
+/**
+*	@file AssetHandle.h
+*/
+#pragma once
+#include <stdint.h>
+
+/**
+*	名前を整数に置き換えたアセットの参照
+*
+*	GameEngine::GetMeshHandle などで名前から一度だけ取得し、以降は文字列の検索なしでアセットを指定できる
+*	型引数はハンドルの種類を区別するためだけに使う
+*/
+template<typename T>
+struct AssetHandle {
+	static const uint32_t invalidIndex = UINT32_MAX;	///< 無効なハンドルを表す値
+
+	uint32_t index = invalidIndex;	///< アセット表のインデックス
+
+	bool IsValid() const { return index != invalidIndex; }
+	bool operator==(const AssetHandle& rhs) const { return index == rhs.index; }
+	bool operator!=(const AssetHandle& rhs) const { return index != rhs.index; }
+};
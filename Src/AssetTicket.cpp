@@ -0,0 +1,59 @@
+/**
+*	@file AssetTicket.cpp
+*/
+#include "AssetTicket.h"
+
+/**
+*	チケットを作成する
+*
+*	@param name	アセット名
+*
+*	@return 作成したチケットへのポインタ
+*/
+AssetTicketPtr AssetTicket::Create(const char* name) {
+	struct Impl : AssetTicket { Impl() {} ~Impl() {} };
+	AssetTicketPtr p = std::make_shared<Impl>();
+	p->name = name;
+	p->future = p->promise.get_future().share();
+	return p;
+}
+
+/**
+*	読み込み完了時に呼び出す関数を登録する
+*
+*	@param func	登録する関数
+*
+*	@return このチケットへの参照
+*
+*	既に読み込みが完了している場合は、その場で func を呼び出す
+*	失敗した場合も呼び出されるので、状態は GetState で確認すること
+*/
+AssetTicket& AssetTicket::Then(const CallbackType& func) {
+	if (IsDone()) {
+		func(*this);
+	} else {
+		callbackList.push_back(func);
+	}
+	return *this;
+}
+
+/**
+*	読み込みの完了を通知する
+*
+*	@param succeeded	読み込みに成功したら true, 失敗したら false
+*
+*	登録されている関数を登録順に呼び出す
+*	二回目以降の呼び出しは無視される
+*/
+void AssetTicket::Complete(bool succeeded) {
+	if (IsDone()) {
+		return;
+	}
+	state = succeeded ? State::Ready : State::Failed;
+	promise.set_value(succeeded);
+	std::vector<CallbackType> list;
+	list.swap(callbackList);
+	for (const CallbackType& func : list) {
+		func(*this);
+	}
+}
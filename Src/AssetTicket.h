@@ -0,0 +1,52 @@
+/**
+*	@file AssetTicket.h
+*/
+#pragma once
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+class AssetTicket;
+typedef std::shared_ptr<AssetTicket> AssetTicketPtr;	///< 読み込みチケットポインタ
+
+/**
+*	非同期読み込みの進行状況を表すチケット
+*
+*	GameEngine::LoadTextureAsync などが返す
+*	読み込みの完了はメインスレッドで通知されるので、Then で登録した関数からはエンティティの追加などを自由に行える
+*/
+class AssetTicket {
+public:
+	///読み込み状態
+	enum class State {
+		Loading,	///< 読み込み中
+		Ready,		///< 読み込み完了
+		Failed,		///< 読み込み失敗
+	};
+	typedef std::function<void(const AssetTicket&)> CallbackType;	///< 完了時に呼び出す関数の型
+
+	static AssetTicketPtr Create(const char* name);
+	AssetTicket& Then(const CallbackType& func);
+	void Complete(bool succeeded);
+
+	const std::string& Name() const { return name; }
+	State GetState() const { return state; }
+	bool IsDone() const { return state != State::Loading; }
+	bool IsReady() const { return state == State::Ready; }
+	const std::shared_future<bool>& Future() const { return future; }
+
+private:
+	AssetTicket() = default;
+	~AssetTicket() = default;
+	AssetTicket(const AssetTicket&) = delete;
+	AssetTicket& operator=(const AssetTicket&) = delete;
+
+private:
+	std::string name;						///< アセット名
+	State state = State::Loading;			///< 読み込み状態
+	std::vector<CallbackType> callbackList;	///< 完了時に呼び出す関数のリスト
+	std::promise<bool> promise;				///< 完了を通知するプロミス
+	std::shared_future<bool> future;		///< 完了を待つためのフューチャー
+};
@@ -1,14 +1,17 @@
 #include "Entity.h"
+#include "Profiler.h"
 #include <glm/gtc/matrix_transform.hpp>
 #include <iostream>
 #include <algorithm>
+#include <tuple>
+#include <math.h>
 
 /**
-*	GeBeBɊւR[hi[閼O
+*	エンティティに関するコードを格納する名前空間
 */
 namespace Entity {
 	/**
-	* VertexDataUBOɓ].
+	* VertexDataをUBOに転送する.
 	*
 	* @param entity
 	* @param ubo
@@ -21,13 +24,40 @@ namespace Entity {
 		data.matNormal = glm::mat4_cast(entity.Rotation());
 		data.matMVP = matVP * data.matModel;
 		data.color = entity.Color();
+		data.texLayer = glm::vec4(static_cast<float>(entity.TextureLayer()), 0, 0, 0);
 		memcpy(ubo, &data, sizeof(data));
 	}
 
+	const float lodScreenSize = 0.25f;	///< LOD 1 に切り替える画面上の大きさ(境界球の半径 / 画面の高さの半分)
+	const float lodHysteresis = 0.1f;	///< 切り替えの閾値に持たせる幅の割合
+
+	/**
+	*	画面上の大きさから詳細度の段階を選ぶ
+	*
+	*	@param screenSize	境界球の画面上の大きさ(半径 / 画面の高さの半分)
+	*	@param current		現在の段階
+	*	@param lodCount		段階数
+	*
+	*	@return 選んだ段階
+	*
+	*	段階 n と n + 1 の境界は lodScreenSize / 2^n
+	*	境界付近で段階が頻繁に切り替わらないように、現在の段階から離れる方向にだけ閾値の幅を持たせる
+	*/
+	int SelectLod(float screenSize, int current, int lodCount) {
+		int lod = std::min(current, lodCount - 1);
+		while (lod + 1 < lodCount && screenSize < ldexpf(lodScreenSize, -lod) * (1.0f - lodHysteresis)) {
+			++lod;
+		}
+		while (lod > 0 && screenSize > ldexpf(lodScreenSize, -(lod - 1)) * (1.0f + lodHysteresis)) {
+			--lod;
+		}
+		return lod;
+	}
+
 	/**
-	*	ړE]Egks擾
+	*	移動・回転・拡縮行列を取得する
 	*
-	*	@return TRS s
+	*	@return TRS 行列
 	*/
 	glm::mat4 Entity::CalcModelMatrix() const {
 		const glm::mat4 t = glm::translate(glm::mat4(), position);
@@ -38,9 +68,30 @@ namespace Entity {
 	}
 
 	/**
-	*	GeBeBj
+	*	ワールド座標系の衝突形状を更新する
 	*
-	*	̊֐ďóAGeBeB𑀍삵Ă͂ȂȂ
+	*	AutoCollision が有効な場合は、メッシュの AABB を拡大・回転したものを包む AABB を衝突形状にする
+	*	メッシュが読み込み中でも仮表示用の立方体の大きさになるので、衝突判定は常に行われる
+	*/
+	void Entity::UpdateWorldCollision() {
+		if (autoCollision && mesh) {
+			const glm::vec3 center = (mesh->BoundingMin() + mesh->BoundingMax()) * 0.5f * scale;
+			const glm::vec3 extent = (mesh->BoundingMax() - mesh->BoundingMin()) * 0.5f * glm::abs(scale);
+			const glm::mat3 r = glm::mat3_cast(rotation);
+			const glm::vec3 rotatedExtent =
+				glm::abs(r[0]) * extent.x + glm::abs(r[1]) * extent.y + glm::abs(r[2]) * extent.z;
+			const glm::vec3 rotatedCenter = r * center;
+			colLocal.min = rotatedCenter - rotatedExtent;
+			colLocal.max = rotatedCenter + rotatedExtent;
+		}
+		colWorld.min = colLocal.min + position;
+		colWorld.max = colLocal.max + position;
+	}
+
+	/**
+	*	エンティティを破棄する
+	*
+	*	この関数を呼出した後は、エンティティを操作してはならない
 	*/
 	void Entity::Destroy() {
 		if (pBuffer) {
@@ -49,9 +100,9 @@ namespace Entity {
 	}
 
 	/**
-	*	gNXg؂藣
+	*	自分自身をリンクリストから切り離す
 	*
-	*	͂ǂɂڑĂȂԂɂȂ
+	*	自分はどこにも接続されていない状態になる
 	*/
 	void Buffer::Link::Remove() {
 		next->prev = prev;
@@ -61,11 +112,11 @@ namespace Entity {
 	}
 
 	/**
-	*	NIuWFNg̎Oɒǉ
+	*	リンクオブジェクトを自分の手前に追加する
 	*
-	*	@param p	ǉ郊NIuWFNgւ̃|C^
+	*	@param p	追加するリンクオブジェクトへのポインタ
 	*
-	*	p ̃NXg؂藣A̎Oɒǉ
+	*	p を所属元のリンクリストから切り離し、自分の手前に追加する
 	*/
 	void Buffer::Link::Insert(Link* p) {
 		p->Remove();
@@ -76,65 +127,74 @@ namespace Entity {
 	}
 
 	/**
-	*	GeBeBobt@쐬
+	*	エンティティバッファを作成する
+	*
+	*	@param maxEntityCount	扱えるエンティティの最大数
+	*	@param ubSizePerEntity	エンティティごとの Uniform Buffer のバイト数(シェーダの配列の要素の間隔)
+	*	@param bindingPoint		エンティティ用 UBO のバインディングポイント
+	*	@param ubName			エンティティ用 Uniform Buffer の名前
 	*
-	*	@param maxEntityCount	GeBeB̍ő吔
-	*	@param ubSizePerEntity	GeBeBƂ Uniform Buffer ̃oCg
-	*	@param bindingPoint		GeBeBp UBO ̃oCfBO|Cg
-	*	@param ubName			GeBeBp Uniform Buffer ̖O
+	*	@return 作成したエンティティバッファへのポインタ
 	*
-	*	@return 쐬GeBeBobt@ւ̃|C^
+	*	UBO には、全ての描画命令の先頭を GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT に揃えても収まり
+	*	最後の描画命令からも Uniform::maxInstanceCount 個分の範囲を割り当てられるだけの容量を確保する
 	*/
 	BufferPtr Buffer::Create(size_t maxEntityCount, GLsizeiptr ubSizePerEntity, int bindingPoint, const char*  ubName) {
 		struct Impl : Buffer { Impl() {} ~Impl() {} };
 		BufferPtr p = std::make_shared<Impl>();
 		if (!p) {
-			std::cerr << "WARNING in Entity::Buffer::Create: obt@̍쐬Ɏs" << std::endl;
+			std::cerr << "WARNING in Entity::Buffer::Create: バッファの作成に失敗" << std::endl;
 			return{};
 		}
-		p->ubo = UniformBuffer::Create(maxEntityCount * ubSizePerEntity, bindingPoint, ubName);
+		GLint alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		p->uboAlignment = std::max<GLsizeiptr>(alignment, 16);
+		const GLsizeiptr alignedSize = (ubSizePerEntity + p->uboAlignment - 1) / p->uboAlignment * p->uboAlignment;
+		p->ubo = UniformBuffer::Create(maxEntityCount * alignedSize + Uniform::maxInstanceCount * ubSizePerEntity, bindingPoint, ubName);
 		p->buffer.reset(new LinkEntity[maxEntityCount]);
 		if (!p->ubo || !p->buffer) {
-			std::cerr << "WARNING in Entity::Buffer::Create: obt@̍쐬Ɏs" << std::endl;
+			std::cerr << "WARNING in Entity::Buffer::Create: バッファの作成に失敗" << std::endl;
 			return{};
 		}
 		p->bufferSize = maxEntityCount;
 		p->ubSizePerEntity = ubSizePerEntity;
-		GLintptr offset = 0;
 		const LinkEntity* const end = &p->buffer[maxEntityCount];
 		for (LinkEntity* itr = &p->buffer[0]; itr != end; ++itr) {
-			itr->uboOffset = offset;
 			itr->pBuffer = p.get();
 			p->freeList.Insert(itr);
-			offset += ubSizePerEntity;
 		}
 		p->collisionHandlerList.reserve(maxGroupID);
+		p->drawList.reserve(maxEntityCount);
+		p->batchList.reserve(maxEntityCount);
 		return p;
 	}
 
 	/**
-	*	GeBeBǉ
+	*	エンティティを追加する
 	*
-	*	@param groupId	GeBeB̃O[v ID
-	*	@param position	GeBeB̍W
-	*	@param mesh		GeBeB̕\Ɏgp郁bV
-	*	@param texture	GeBeB̕\ɎgpeNX`
-	*	@param program	GeBeB̕\ɎgpVF[_vO
-	*	@param func		GeBeB̏ԂXV֐(܂͊֐IuWFNg)
+	*	@param groupId	エンティティのグループ ID
+	*	@param position	エンティティの座標
+	*	@param mesh		エンティティの表示に使用するメッシュ
+	*	@param texture	エンティティの表示に使用するテクスチャ(nullptr ならテクスチャを貼らない)
+	*	@param program	エンティティの表示に使用するシェーダプログラム
+	*	@param func		エンティティの状態を更新する関数(または関数オブジェクト)
+	*	@param textureLayer	テクスチャ配列のレイヤー番号
 	*
-	*	@return ǉGeBeBւ̃|C^
-	*			ȏGeBeBǉłȂꍇ nullptr Ԃ
-	*			]g嗦ݒ肷ꍇ͂̃|C^oRōs
-	*			̃|C^AvP[VŕێKv͂Ȃ
+	*	@return 追加したエンティティへのポインタ
+	*			これ以上エンティティを追加できない場合は nullptr が返される
+	*			回転や拡大率を設定する場合はこのポインタ経由で行う
+	*			このポインタをアプリケーション側で保持する必要はない
+	*
+	*	メッシュ、テクスチャ、シェーダは参照カウントを持たないので、エンティティより長く生存させること
 	*/
-	Entity* Buffer::AddEntity(int groupId, const glm::vec3& position, const Mesh::MeshPtr& mesh, const TexturePtr& texture, const Shader::ProgramPtr& program, Entity::UpdateFuncType func) {
+	Entity* Buffer::AddEntity(int groupId, const glm::vec3& position, const Mesh::Mesh* mesh, const Texture* texture, Shader::Program* program, const Entity::UpdateFuncType& func, int textureLayer) {
 		if (freeList.prev == freeList.next) {
-			std::cout << "WARNING in Buffer::AddEntity;" "󂫃GeBeB܂" << std::endl;
+			std::cout << "WARNING in Buffer::AddEntity;" "空きエンティティがありません" << std::endl;
 			return nullptr;
 		}
 		if (groupId < 0 || groupId > maxGroupID) {
-			std::cout << "ERROR in Entity::Buffer::AddEntity: ͈͊ÕO[v ID(" << groupId <<
-				") n܂\n O[v ID ́@0`" << maxGroupID << "łȂ΂Ȃ܂" << std::endl;
+			std::cout << "ERROR in Entity::Buffer::AddEntity: 範囲外のグループ ID(" << groupId <<
+				") が渡されました\n グループ ID は　0～" << maxGroupID << "でなければなりません" << std::endl;
 			return nullptr;
 		}
 
@@ -146,27 +206,31 @@ namespace Entity {
 		entity->scale = glm::vec3(1, 1, 1);
 		entity->velocity = glm::vec3();
 		entity->mesh = mesh;
+		entity->lodLevel = 0;
+		entity->autoCollision = false;
 		entity->texture = texture;
+		entity->textureLayer = textureLayer;
 		entity->program = program;
 		entity->updateFunc = func;
 		entity->isActive = true;
+		++activeCount;
 
 		return entity;
 	}
 
 	/**
-	*	GeBeB폜
+	*	エンティティを削除する
 	*
-	*	@param 폜GeBeB̃|C^
+	*	@param 削除するエンティティのポインタ
 	*/
 	void Buffer::RemoveEntity(Entity* entity) {
 		if (!entity || !entity->isActive) {
-			std::cout << "WARNING in Buffer::RemoveEntity;" "ANeBuȃGeBeB폜悤Ƃ܂" << std::endl;
+			std::cout << "WARNING in Buffer::RemoveEntity;" "非アクティブなエンティティを削除しようとしました" << std::endl;
 			return;
 		}
 		LinkEntity* p = static_cast<LinkEntity*>(entity);
 		if (p < &buffer[0] || p >= &buffer[bufferSize]) {
-			std::cout << "WARNING in Buffer::RemoveEntity;" "قȂobt@GeBeB폜悤Ƃ܂" << std::endl;
+			std::cout << "WARNING in Buffer::RemoveEntity;" "異なるバッファからエンティティを削除しようとしました" << std::endl;
 			return;
 		}
 		if (p == itrUpdate) {
@@ -177,15 +241,68 @@ namespace Entity {
 		}
 
 		freeList.Insert(p);
-		p->mesh.reset();
-		p->texture.reset();
-		p->program.reset();
+		p->mesh = nullptr;
+		p->texture = nullptr;
+		p->program = nullptr;
 		p->updateFunc = nullptr;
 		p->isActive = false;
+		--activeCount;
+	}
+
+	/**
+	*	全てのエンティティを削除する
+	*/
+	void Buffer::Clear() {
+		for (int groupId = 0; groupId <= maxGroupID; ++groupId) {
+			while (activeList[groupId].next != &activeList[groupId]) {
+				RemoveEntity(static_cast<LinkEntity*>(activeList[groupId].next));
+			}
+		}
+		batchList.clear();
+		textureList.clear();
+	}
+
+	/**
+	*	エンティティが使っているシェーダプログラムを差し替える
+	*
+	*	@param from	差し替える前のシェーダプログラム
+	*	@param to	差し替えた後のシェーダプログラム
+	*
+	*	from を使っている全てのアクティブなエンティティを to に切り替える
+	*	描画命令は次の Update でまとめ直される
+	*/
+	void Buffer::ReplaceProgram(const Shader::Program* from, Shader::Program* to) {
+		for (int groupId = 0; groupId <= maxGroupID; ++groupId) {
+			for (Link* e = activeList[groupId].next; e != &activeList[groupId]; e = e->next) {
+				LinkEntity& entity = *static_cast<LinkEntity*>(e);
+				if (entity.program == from) {
+					entity.program = to;
+				}
+			}
+		}
+	}
+
+	/**
+	*	メッシュを使用中のエンティティがあるか調べる
+	*
+	*	@param mesh	調べるメッシュ
+	*
+	*	@retval true	mesh を使用中のエンティティがある
+	*	@retval false	mesh を使用中のエンティティはない
+	*/
+	bool Buffer::IsMeshInUse(const Mesh::Mesh* mesh) const {
+		for (int groupId = 0; groupId <= maxGroupID; ++groupId) {
+			for (const Link* e = activeList[groupId].next; e != &activeList[groupId]; e = e->next) {
+				if (static_cast<const LinkEntity*>(e)->mesh == mesh) {
+					return true;
+				}
+			}
+		}
+		return false;
 	}
 
 	/**
-	*	`m̏Փ˔
+	*	矩形同士の衝突判定
 	*/
 	bool HasCollision(const CollisionData& lhs, const CollisionData& rhs) {
 		if (lhs.max.x < rhs.min.x || lhs.min.x > rhs.max.x) return false;
@@ -195,106 +312,212 @@ namespace Entity {
 	}
 	
 	/**
-	*	ANeBuȃGeBeB̏ԂXV
+	*	アクティブなエンティティの状態を更新する
+	*
+	*	@param delta	前回の更新からの経過時間
+	*	@param matView	View 行列
+	*	@param matProj	Projection 行列
 	*
-	*	@param delta	O̍XV̌oߎ
-	*	@param matView	View s
-	*	@param matProj	Projection s
+	*	UBO を更新する際に、描画に使うメッシュの詳細度も選ぶ
+	*	描画するエンティティはシェーダ、テクスチャ、メッシュ、詳細度の順に並べ替え
+	*	状態の同じエンティティを Uniform::maxInstanceCount 個までまとめて 1 つの描画命令にする
+	*	UBO にはまとめたエンティティのデータを連続して書き込む
+	*	描画するエンティティが使うテクスチャの一覧(TextureList)も作成する
 	*/
 	void Buffer::Update(double delta, const glm::mat4& matView, const glm::mat4& matProj) {
-		//Wƃ[hWn̏Փˌ`XV
-		for (int groupId = 0; groupId <= maxGroupID; ++groupId) {
-			for (Link* itr = activeList[groupId].next; itr != &activeList[groupId]; itr = itr->next) {
-				LinkEntity& e = *static_cast<LinkEntity*>(itr);
-				e.position += e.velocity * static_cast<float>(delta);
-				e.colWorld.min = e.colLocal.min + e.position;
-				e.colWorld.max = e.colLocal.max + e.position;
+		//座標とワールド座標系の衝突形状を更新する
+		{
+			PROFILE_SCOPE("Integrate");
+			for (int groupId = 0; groupId <= maxGroupID; ++groupId) {
+				for (Link* itr = activeList[groupId].next; itr != &activeList[groupId]; itr = itr->next) {
+					LinkEntity& e = *static_cast<LinkEntity*>(itr);
+					e.position += e.velocity * static_cast<float>(delta);
+					e.UpdateWorldCollision();
+				}
 			}
 		}
 
-		//Փ˔s
-		for (const auto& e : collisionHandlerList) {
-			if (!e.handler) {
-				continue;
-			}
-			Link* listL = &activeList[e.groupID[0]];
-			Link* listR = &activeList[e.groupID[1]];
-			for (itrUpdate = listL->next; itrUpdate != listL; itrUpdate = itrUpdate->next) {
-				LinkEntity* entityL = static_cast<LinkEntity*>(itrUpdate);
-				for (itrUpdateRhs = listR->next; itrUpdateRhs != listR; itrUpdateRhs = itrUpdateRhs->next) {
-					LinkEntity* entityR = static_cast<LinkEntity*>(itrUpdateRhs);
-					if (!HasCollision(entityL->colWorld, entityR->colWorld)) {
-						continue;
-					}
-					e.handler(*entityL, *entityR);
-					if (entityL != itrUpdate) {
-						break;
+		//衝突判定を実行する
+		{
+			PROFILE_SCOPE("Collision");
+			for (const auto& e : collisionHandlerList) {
+				if (!e.handler) {
+					continue;
+				}
+				Link* listL = &activeList[e.groupID[0]];
+				Link* listR = &activeList[e.groupID[1]];
+				for (itrUpdate = listL->next; itrUpdate != listL; itrUpdate = itrUpdate->next) {
+					LinkEntity* entityL = static_cast<LinkEntity*>(itrUpdate);
+					for (itrUpdateRhs = listR->next; itrUpdateRhs != listR; itrUpdateRhs = itrUpdateRhs->next) {
+						LinkEntity* entityR = static_cast<LinkEntity*>(itrUpdateRhs);
+						if (!HasCollision(entityL->colWorld, entityR->colWorld)) {
+							continue;
+						}
+						e.handler(*entityL, *entityR);
+						if (entityL != itrUpdate) {
+							break;
+						}
 					}
 				}
 			}
 		}
-		 //eGeBeB̏ԂXV
-		
-		for (int groupId = 0; groupId <= maxGroupID; ++groupId) {
-			for (itrUpdate = activeList[groupId].next; itrUpdate != &activeList[groupId]; itrUpdate = itrUpdate->next) {
-				LinkEntity& e = *static_cast<LinkEntity*>(itrUpdate);
-				e.position += e.velocity * static_cast<float>(delta);
-				if (e.updateFunc) {
-					e.updateFunc(e, delta);
+		//各エンティティの状態を更新する
+		{
+			PROFILE_SCOPE("EntityUpdateFunc");
+			for (int groupId = 0; groupId <= maxGroupID; ++groupId) {
+				for (itrUpdate = activeList[groupId].next; itrUpdate != &activeList[groupId]; itrUpdate = itrUpdate->next) {
+					LinkEntity& e = *static_cast<LinkEntity*>(itrUpdate);
+					e.position += e.velocity * static_cast<float>(delta);
+					if (e.updateFunc) {
+						e.updateFunc(e, delta);
+					}
+					e.UpdateWorldCollision();
 				}
-				e.colWorld.min = e.colLocal.min + e.position;
-				e.colWorld.max = e.colLocal.max + e.position;
 			}
 		}
 		itrUpdate = nullptr;
 		itrUpdateRhs = nullptr;
 //		ubo->UnmapBuffer();
 
-		uint8_t* p = static_cast<uint8_t*>(ubo->MapBuffer());
+		PROFILE_SCOPE("UBOFill");
+		clusterCuller.Setup(matView, matProj);
 		const glm::mat4 matVP = matProj * matView;
+		drawList.clear();
 		for (int groupId = 0; groupId <= maxGroupID; ++groupId) {
-			for (itrUpdate = activeList[groupId].next; itrUpdate != &activeList[groupId]; itrUpdate = itrUpdate->next) {
-				LinkEntity& e = *static_cast<LinkEntity*>(itrUpdate);
-				UpdateUniformVertexData(e, p + e.uboOffset, matVP);
+			for (Link* itr = activeList[groupId].next; itr != &activeList[groupId]; itr = itr->next) {
+				LinkEntity& e = *static_cast<LinkEntity*>(itr);
+
+				//境界球の画面上の大きさから詳細度を選ぶ
+				if (e.mesh && e.mesh->LodCount() > 1) {
+					const glm::vec3 center = e.position + e.rotation * (e.scale * e.mesh->BoundingCenter());
+					const float w = (matVP * glm::vec4(center, 1)).w;
+					const float scale = std::max(std::max(std::abs(e.scale.x), std::abs(e.scale.y)), std::abs(e.scale.z));
+					const float radius = e.mesh->BoundingRadius() * scale;
+					if (w > radius) {
+						e.lodLevel = SelectLod(radius * matProj[1][1] / w, e.lodLevel, e.mesh->LodCount());
+					} else {
+						e.lodLevel = 0;
+					}
+				} else {
+					e.lodLevel = 0;
+				}
+				if (e.mesh && e.program) {
+					drawList.push_back(&e);
+				}
 			}
 		}
+
+		//不透明なエンティティだけを、描画の状態が同じものが隣り合うように並べる(同じ状態の中ではグループ順を保つ)
+		//半透明のエンティティはブレンド結果が描画順で変わるため、不透明なものの後に登録順のまま描画する
+		const auto isOpaque = [](const LinkEntity* e) {
+			return e->color.a >= 1 && !e->mesh->IsTranslucent() && !(e->texture && e->texture->HasAlpha());
+		};
+		const auto endOpaque = std::stable_partition(drawList.begin(), drawList.end(), isOpaque);
+		const auto stateKey = [](const LinkEntity* e) {
+			return std::make_tuple(reinterpret_cast<uintptr_t>(e->program), e->texture ? e->texture->Id() : 0, reinterpret_cast<uintptr_t>(e->mesh), e->lodLevel);
+		};
+		std::stable_sort(drawList.begin(), endOpaque, [&stateKey](const LinkEntity* lhs, const LinkEntity* rhs) {
+			return stateKey(lhs) < stateKey(rhs);
+		});
+
+		//テクスチャキャッシュが使用中のテクスチャを追い出さないように、使っているテクスチャを集める
+		textureList.clear();
+		for (const LinkEntity* e : drawList) {
+			if (e->texture && (textureList.empty() || textureList.back() != e->texture)) {
+				textureList.push_back(e->texture);
+			}
+		}
+		std::sort(textureList.begin(), textureList.end());
+		textureList.erase(std::unique(textureList.begin(), textureList.end()), textureList.end());
+
+		batchList.clear();
+		uint8_t* p = static_cast<uint8_t*>(ubo->MapBuffer());
+		GLintptr offset = 0;
+		for (size_t i = 0; i < drawList.size();) {
+			const LinkEntity& first = *drawList[i];
+			DrawBatch batch;
+			batch.mesh = first.mesh;
+			batch.texture = first.texture;
+			batch.program = first.program;
+			batch.lodLevel = first.lodLevel;
+			batch.uboOffset = offset;
+			batch.instanceCount = 0;
+			batch.useClusters = first.mesh->HasClusters() && clusterCuller.IsEnabled();
+			if (batch.useClusters) {
+				batch.matModel = first.CalcModelMatrix();
+			}
+			//クラスタ単位でカリングするメッシュはエンティティ毎にカリング結果が異なるため、まとめない
+			do {
+				UpdateUniformVertexData(*drawList[i], p + offset, matVP);
+				offset += ubSizePerEntity;
+				++batch.instanceCount;
+				++i;
+			} while (!batch.useClusters && i < drawList.size() && batch.instanceCount < Uniform::maxInstanceCount &&
+				stateKey(drawList[i]) == stateKey(&first));
+			batchList.push_back(batch);
+			offset = (offset + uboAlignment - 1) / uboAlignment * uboAlignment;
+		}
 		ubo->UnmapBuffer();
 	}
 
 	/**
-	*	ANeBuȃGeBeB`悷
+	*	アクティブなエンティティを描画する
+	*
+	*	@param meshBuffer 描画に使用するメッシュバッファへのポインタ
 	*
-	*	@param meshBuffer `Ɏgp郁bVobt@ւ̃|C^
+	*	Update でまとめた描画命令の単位で、エンティティ毎に選んだ詳細度のメッシュをインスタンス描画する
+	*	テクスチャ配列のレイヤーだけが異なるエンティティは同じ描画命令で描画される
+	*	クラスタを持つメッシュは、視錐台の外と裏を向いたクラスタを除いて描画する
+	*	描画した三角形数と、全て LOD 0 でカリングせずに描画した場合の三角形数をプロファイラのカウンタに記録する
+	*	クラスタ単位のカリングで除外した三角形数と、描画命令の数も記録する
+	*	シェーダプログラムのコンパイルが終わっていないエンティティは、プログラムに設定された代わりのプログラムで描画する
 	*/
 	void Buffer::Draw(const Mesh::BufferPtr& meshBuffer) const {
+		PROFILE_SCOPE("Draw");
 		meshBuffer->BindVAO();
-		for (int groupId = 0; groupId <= maxGroupID; ++groupId) {
-			for (const Link* itr = activeList[groupId].next; itr != &activeList[groupId]; itr = itr->next) {
-				const LinkEntity& e = *static_cast<const LinkEntity*>(itr);
-				if (e.mesh && e.texture && e.program) {
-					e.program->UseProgram();
-					e.program->BindTexture(GL_TEXTURE0, GL_TEXTURE_2D, e.texture->Id());
-					ubo->BufferRange(e.uboOffset, ubSizePerEntity);
-					e.mesh->Draw(meshBuffer);
-				}
+		size_t triangles = 0;
+		size_t trianglesWithoutLod = 0;
+		clusterCuller.ResetStatistics();
+		for (const DrawBatch& e : batchList) {
+			//コンパイル中のプログラムは、準備ができるまで代わりのプログラムで描画する
+			Shader::Program* program = e.program->IsReady() ? e.program : e.program->Fallback();
+			if (!program || !program->IsReady()) {
+				continue;
+			}
+			//同じプログラムやテクスチャの設定し直しは GLState が省略する
+			program->UseProgram();
+			if (e.texture) {
+				program->BindTexture(GL_TEXTURE0, e.texture->Target(), e.texture->Id());
 			}
+			ubo->BufferRange(e.uboOffset, ubSizePerEntity * Uniform::maxInstanceCount);
+			const size_t drawn = e.useClusters ?
+				e.mesh->Draw(meshBuffer, e.lodLevel, clusterCuller, e.matModel) : e.mesh->Draw(meshBuffer, e.lodLevel, e.instanceCount);
+			triangles += drawn;
+			trianglesWithoutLod += (e.lodLevel || e.useClusters) ? e.mesh->TriangleCount(meshBuffer, 0) * e.instanceCount : drawn;
 		}
+		Profiler::Counter("Triangles", static_cast<double>(triangles));
+		Profiler::Counter("TrianglesWithoutLod", static_cast<double>(trianglesWithoutLod));
+		Profiler::Counter("DrawCalls", static_cast<double>(batchList.size()));
+		const Mesh::ClusterCuller::Statistics& stats = clusterCuller.GetStatistics();
+		Profiler::Counter("ClusterTriangles", static_cast<double>(stats.triangles));
+		Profiler::Counter("ClusterFrustumCulled", static_cast<double>(stats.frustumCulled));
+		Profiler::Counter("ClusterBackfaceCulled", static_cast<double>(stats.backfaceCulled));
 	}
 
 	/**
-	*	Փˉnhݒ肷
+	*	衝突解決ハンドラを設定する
 	*
-	*	@param gid0		ՓˑΏۂ̃O[v ID
-	*	@param gid1		ՓˑΏۂ̃O[v ID
-	*	@param handler	Փˉnh
+	*	@param gid0		衝突対象のグループ ID
+	*	@param gid1		衝突対象のグループ ID
+	*	@param handler	衝突解決ハンドラ
 	*
-	*	Փ˂ՓˉnhĂяo鎞A菬O[v ID GeBeBɓn
-	*	Ŏw肵O[v ID ̏Ƃ͖֌Wł邱Ƃɒ
+	*	衝突が発生し衝突解決ハンドラが呼び出される時、より小さいグループ ID を持つエンティティから先に渡される
+	*	ここで指定したグループ ID の順序とは無関係であることに注意
 	*	ex)
 	*		CollisionHandler(10, 1, Func)
-	*		ƂR[hŃnho^ƂAՓ˂
-	*		Finc(O[v ID = 1 ̃GeBeBAO[v ID = 10 ̃GeBeB)
-	*		̂悤ɌĂяo
+	*		というコードでハンドラを登録したとする、衝突が発生すると
+	*		Finc(グループ ID = 1 のエンティティ、グループ ID = 10 のエンティティ)
+	*		のように呼び出される
 	*/
 	void Buffer::CollisionHandler(int gid0, int gid1, CollisionHandlerType handler) {
 		if (gid0 > gid1) {
@@ -310,12 +533,12 @@ namespace Entity {
 	}
 
 	/**
-	*	Փˉnh擾
+	*	衝突解決ハンドラを取得する
 	*
-	*	@param gid0		ՓˑΏۂ̃O[v ID
-	*	@param gid1		ՓˑΏۂ̃O[v ID
+	*	@param gid0		衝突対象のグループ ID
+	*	@param gid1		衝突対象のグループ ID
 	*
-	*	@return	Փˉnh
+	*	@return	衝突解決ハンドラ
 	*/
 	const CollisionHandlerType& Buffer::collisionHandler(int gid0, int gid1) const {
 		if (gid0 > gid1) {
@@ -331,7 +554,7 @@ namespace Entity {
 	}
 
 	/**
-	*SĂ̏Փˉnh폜
+	*全ての衝突解決ハンドラを削除する
 	*/
 	void Buffer::ClearCollisionHandlerList() {
 		collisionHandlerList.clear();
@@ -14,15 +14,15 @@
 namespace Entity {
 	class Entity;
 	class Buffer;
-	typedef std::shared_ptr<Buffer> BufferPtr;	///< GeBeBobt@|C^^
+	typedef std::shared_ptr<Buffer> BufferPtr;	///< エンティティバッファポインタ型
 
-	/// Փˉnh^
+	/// 衝突解決ハンドラ型
 	typedef std::function<void(Entity&, Entity&)> CollisionHandlerType;
 
-	static const int maxGroupID = 31;	///< O[v ID ̍ől
+	static const int maxGroupID = 31;	///< グループ ID の最大値
 
 	/**
-	*	Փ˔`
+	*	衝突判定形状
 	*/
 	struct CollisionData {
 		glm::vec3 min;
@@ -30,14 +30,14 @@ namespace Entity {
 	};
 
 	/**
-	*	GeBeB
+	*	エンティティ
 	*/
 	class Entity {
 		friend class Buffer;
 	
 	public:
 		typedef std::function<void(Entity&, double)> UpdateFuncType;
-		/// ԍXV֐^
+		/// 状態更新関数型
 //		typedef std::function<void(Entity&, void*, double, const glm::mat4&, const glm::mat4&)> UpdateFuncType;
 
 		void Position(const glm::vec3& v) { position = v; }
@@ -52,11 +52,16 @@ namespace Entity {
 		const glm::vec3& Velocity() const { return velocity; }
 		void UpdateFunc(const UpdateFuncType& func) { updateFunc = func; }
 		const UpdateFuncType& UpdateFunc() const { return updateFunc; }
-		void Collision(const CollisionData& c) { colLocal = c; }
+		void Collision(const CollisionData& c) { colLocal = c; autoCollision = false; }
 		const CollisionData& Collision() const { return colLocal; }
+		void AutoCollision(bool enable) { autoCollision = enable; }
+		bool AutoCollision() const { return autoCollision; }
+		void TextureLayer(int layer) { textureLayer = layer; }
+		int TextureLayer() const { return textureLayer; }
 
 		glm::mat4 CalcModelMatrix() const;
 		int GroupID() const { return groupID; }
+		int LodLevel() const { return lodLevel; }
 		void Destroy();
 
 	private:
@@ -64,40 +69,50 @@ namespace Entity {
 		~Entity() = default;
 		Entity(const Entity&) = default;
 		Entity& operator=(const Entity&) = default;
+		void UpdateWorldCollision();
 
 	private:
-		int groupID = -1;						///< O[v ID
-		Buffer* pBuffer = nullptr;				///<  Buffer NXւ̃|C^
-		glm::vec3 position;						///< W
-		glm::vec3 scale = glm::vec3(1, 1, 1);	///< g嗦
-		glm::vec4 color = glm::vec4(1, 1, 1, 1);///< F
-		glm::quat rotation;						///< ]
-		glm::vec3 velocity;						///< x
-		UpdateFuncType updateFunc;				///< ԍXV֐
-		CollisionData colLocal;					///< [JWn̏Փˌ`
-		CollisionData colWorld;					///< [hWn̏Փˌ`
-		Mesh::MeshPtr mesh;						///< GeBeB`悷鎞Ɏg郁bVf[^
-		TexturePtr texture;						///< GeBeB`悷鎞ɎgeNX`
-		Shader::ProgramPtr program;				///< GeBeB`悷鎞ɎgVF[_
-		GLintptr uboOffset;						///< UBO ̃GeBeBp̈ւ̃oCgItZbg
-		bool isActive = false;					///< ANeBuȃGeBeBȂ true, ANeBuȂ false
+		int groupID = -1;						///< グループ ID
+		Buffer* pBuffer = nullptr;				///< 生成元の Buffer クラスへのポインタ
+		glm::vec3 position;						///< 座標
+		glm::vec3 scale = glm::vec3(1, 1, 1);	///< 拡大率
+		glm::vec4 color = glm::vec4(1, 1, 1, 1);///< 色
+		glm::quat rotation;						///< 回転
+		glm::vec3 velocity;						///< 速度
+		UpdateFuncType updateFunc;				///< 状態更新関数
+		CollisionData colLocal;					///< ローカル座標系の衝突形状
+		CollisionData colWorld;					///< ワールド座標系の衝突形状
+		const Mesh::Mesh* mesh = nullptr;		///< エンティティを描画する時に使われるメッシュデータ
+		const Texture* texture = nullptr;		///< エンティティを描画する時に使われるテクスチャ
+		Shader::Program* program = nullptr;		///< エンティティを描画する時に使われるシェーダ
+		int textureLayer = 0;					///< テクスチャ配列のレイヤー番号
+		int lodLevel = 0;						///< 描画に使うメッシュの詳細度
+		bool isActive = false;					///< アクティブなエンティティなら true, 非アクティブなら false
+		bool autoCollision = false;				///< メッシュの AABB から衝突形状を求めるなら true
 	};
 
 	/**
-	*	GeBeBobt@
+	*	エンティティバッファ
 	*/
 	class Buffer{
 	public:
 		static BufferPtr Create(size_t maxEntityCount, GLsizeiptr ubSizePerEntity, int bindingPoint, const char*  name);
 
-		Entity* AddEntity(int groupId, const glm::vec3& pos, const Mesh::MeshPtr& m, const TexturePtr& t, const Shader::ProgramPtr& p, Entity::UpdateFuncType func);
+		Entity* AddEntity(int groupId, const glm::vec3& pos, const Mesh::Mesh* m, const Texture* t, Shader::Program* p, const Entity::UpdateFuncType& func, int textureLayer = 0);
 		void RemoveEntity(Entity* entity);
+		void Clear();
+		void ReplaceProgram(const Shader::Program* from, Shader::Program* to);
+		bool IsMeshInUse(const Mesh::Mesh* mesh) const;
 		void Update(double delta, const glm::mat4& matView, const glm::mat4& matProj);
 		void Draw(const Mesh::BufferPtr& meshBuffer) const;
 
 		void CollisionHandler(int gid0, int gid1, CollisionHandlerType handler);
 		const CollisionHandlerType& collisionHandler(int gid0, int gid1) const;
 		void ClearCollisionHandlerList();
+		size_t ActiveCount() const { return activeCount; }
+		void ClusterCulling(bool enable) { clusterCuller.Enable(enable); }
+		bool ClusterCulling() const { return clusterCuller.IsEnabled(); }
+		const std::vector<const Texture*>& TextureList() const { return textureList; }
 
 	private:
 		Buffer() = default;
@@ -106,24 +121,26 @@ namespace Entity {
 		Buffer& operator=(const Buffer&) = default;
 
 	private:
-		///GeBeBpNXg
+		///エンティティ用リンクリスト
 		struct Link {
 			void Insert(Link* e);
 			void Remove();
 			Link* prev = this;
 			Link* next = this;
 		};
-		///NtGeBeB
+		///リンク付エンティティ
 		struct LinkEntity : public Link, public Entity {};
-		///NtGeBeBz̍폜p֐IuWFNg
+		///リンク付エンティティ配列の削除用関数オブジェクト
 		struct EntityArrayDeleter { void operator()(LinkEntity* p) { delete[] p; } };
 
-		std::unique_ptr<LinkEntity[], EntityArrayDeleter> buffer;	///< GeBeB̔z
-		size_t bufferSize;				///< GeBeB̑
-		Link freeList;					///< gp̃GeBeB̃NXg
-		Link activeList[maxGroupID + 1];///< gp̃GeBeB̃NXg
-		UniformBufferPtr ubo;			///< GeBeBp UBO
-		Link* itrUpdate = nullptr;		///< Update Ɓ@RemoveEntity ̑ݍpɑΉׂ̃Ce[^
+		std::unique_ptr<LinkEntity[], EntityArrayDeleter> buffer;	///< エンティティの配列
+		size_t bufferSize;				///< エンティティの総数
+		size_t activeCount = 0;			///< 使用中のエンティティの数
+		Link freeList;					///< 未使用のエンティティのリンクリスト
+		Link activeList[maxGroupID + 1];///< 使用中のエンティティのリンクリスト
+		UniformBufferPtr ubo;			///< エンティティ用 UBO
+		GLsizeiptr uboAlignment = 256;	///< 描画命令毎の UBO の範囲の先頭を揃える境界
+		Link* itrUpdate = nullptr;		///< Update と　RemoveEntity の相互作用に対応する為のイテレータ
 		Link* itrUpdateRhs = nullptr;
 
 		struct CollisionHandIerInfo{
@@ -132,6 +149,26 @@ namespace Entity {
 		};
 		std::vector<CollisionHandIerInfo> collisionHandlerList;
 
-		GLsizeiptr ubSizePerEntity;		///< eGeBeBg Uniform Buffer ̃oCg
+		GLsizeiptr ubSizePerEntity;		///< 各エンティティが使える Uniform Buffer のバイト数
+		mutable Mesh::ClusterCuller clusterCuller;	///< クラスタ単位のカリング(Draw で統計と作業領域を更新する)
+
+		/**
+		*	1 回の描画命令で描画するエンティティの集まり
+		*
+		*	Update の時点の状態を保持するので、Draw までにエンティティが削除されても安全に描画できる
+		*/
+		struct DrawBatch {
+			const Mesh::Mesh* mesh;
+			const Texture* texture;
+			Shader::Program* program;
+			int lodLevel;
+			GLintptr uboOffset;			///< 先頭のインスタンスの UBO 内のバイトオフセット
+			GLsizei instanceCount;		///< インスタンス数
+			bool useClusters;			///< クラスタ単位でカリングするなら true(インスタンス数は常に 1)
+			glm::mat4 matModel;			///< クラスタ単位のカリングに使うモデル行列
+		};
+		std::vector<LinkEntity*> drawList;	///< 描画の状態順に並べた不透明なエンティティと、登録順の半透明なエンティティ(Update の作業領域)
+		std::vector<DrawBatch> batchList;	///< Update で作成した描画命令のリスト
+		std::vector<const Texture*> textureList;	///< Update で描画対象にしたエンティティが使うテクスチャ(重複なし)
 	};
 }
\ No newline at end of file
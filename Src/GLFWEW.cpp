@@ -5,34 +5,34 @@
 #include"GLFWEW.h"
 #include<iostream>
 
-///GLFWGLEWbv邽߂̖O
+///GLFWとGLEWをラップするための名前空間
 namespace GLFWEW {
 	/**
-	* GLFW ̃G[񍐂
+	* GLFW からのエラー報告を処理する
 	*
-	* @param error	G[ԍ
-	* @param desc	G[̓e
+	* @param error	エラー番号
+	* @param desc	エラーの内容
 	*/
 	void ErrorCallback(int error, const char* desc) {
 		std::cerr << "ERROR: " << desc << std::endl;
 	}
 
 	/**
-	* VOgCX^X擾
+	* シングルトンインスタンスを取得する
 	*
-	* @return Window ̃VOgCX^X
+	* @return Window のシングルトンインスタンス
 	*/
 	Window& Window::Instance() {
 		static Window instance;
 		return instance;
 	}
 
-	//RXgN^
+	//コンストラクタ
 	Window::Window() :isGLFWInitialized(false), isInitialized(false), window(nullptr) {
 
 	}
 
-	//fXgN^
+	//デストラクタ
 	Window::~Window() {
 		if (isGLFWInitialized) {
 			glfwTerminate();
@@ -40,19 +40,20 @@ namespace GLFWEW {
 	}
 
 	/**
-	* GLFW/GLEW ̏
+	* GLFW/GLEW の初期化
 	*
-	* @param w		EBhE̕`͈͂̕(sNZ)
-	* @param h		EBhE̕`͈͂̍(sNZ)
-	* @param title	EBhE^Cg(UTF-8  0 I[)
+	* @param w		ウィンドウの描画範囲の幅(ピクセル)
+	* @param h		ウィンドウの描画範囲の高さ(ピクセル)
+	* @param title	ウィンドウタイトル(UTF-8 の 0 終端文字列)
+	* @param visible	false ならウィンドウを表示しない(ベンチマーク等で使用する)
 	*
-	* @retval true	
-	* @retval false	s
+	* @retval true	初期化成功
+	* @retval false	初期化失敗
 	*/
-	bool Window::Init(int w, int h, const char* title) {
-		//GLFW̏
+	bool Window::Init(int w, int h, const char* title, bool visible) {
+		//GLFWの初期化
 		if (isInitialized) {
-			std::cerr << "ERROR: GLFWEW ͊ɑ݂Ă܂B" << std::endl;
+			std::cerr << "ERROR: GLFWEW は既に存在しています。" << std::endl;
 			return false;
 		}
 		if (!isGLFWInitialized) {
@@ -63,19 +64,20 @@ namespace GLFWEW {
 			isGLFWInitialized = true;
 		}
 		if (!window) {
+			glfwWindowHint(GLFW_VISIBLE, visible ? GL_TRUE : GL_FALSE);
 			window = glfwCreateWindow(w, h, title, nullptr, nullptr);
 			if (!window) {
 				return false;
 			}
 			glfwMakeContextCurrent(window);
 		}
-		//GLEW̏
+		//GLEWの初期化
 		if (glewInit() != GLEW_OK) {
-			std::cerr << "ERROR: GLEW̏Ɏs܂B" << std::endl;
+			std::cerr << "ERROR: GLEWの初期化に失敗しました。" << std::endl;
 			return false;
 		}
 
-		//`foCXƑΉo[Wo
+		//描画デバイスと対応バージョンを出力
 		const GLubyte* renderer = glGetString(GL_RENDERER);
 		std::cout << "Renderer: " << renderer << std::endl;
 		const GLubyte* version = glGetString(GL_VERSION);
@@ -85,16 +87,16 @@ namespace GLFWEW {
 	}
 
 	/**
-	* EBhEׂׂ
+	* ウィンドウを閉じるべきか調べる
 	*
-	* @retval true	
-	* @retval false	Ȃ
+	* @retval true	閉じる
+	* @retval false	閉じない
 	*/
 	bool Window::ShouldClose() const {
 		return glfwWindowShouldClose(window) != 0;
 	}
 
-	//tgobt@ƃobNobt@؂ւ
+	//フロントバッファとバックバッファを切り替える
 	void Window::SwapBuffers() const {
 		glfwPollEvents();
 		glfwSwapBuffers(window);
@@ -105,42 +107,67 @@ namespace GLFWEW {
 	}
 
 	/**
-	*	WCXeBbÑAiO͑u ID
+	* キーが押されているか調べる
+	*
+	* @param key	調べるキー(GLFW_KEY_～)
+	*
+	* @retval true	押されている
+	* @retval false	押されていない
+	*
+	* ゲームパッドの入力とは別に、デバッグ機能の操作などに使う(入力ログには記録されない)
+	*/
+	bool Window::IsKeyPressed(int key) const {
+		return glfwGetKey(window, key) == GLFW_PRESS;
+	}
+
+	/**
+	*	ゲームパッドの状態を設定する
+	*
+	*	@param gamepad	設定するゲームパッドの状態
+	*
+	*	記録した入力を再生する場合に、UpdateGamePad の代わりに使用する
+	*/
+	void Window::SetGamePad(const GamePad& gamepad) {
+		gamePad = gamepad;
+	}
+
+	/**
+	*	ジョイスティックのアナログ入力装置 ID
 	+
-	*	@note XBOX360 Rg[[
+	*	@note XBOX360 コントローラー基準
 	*/
 	enum GLFWAXESID {
-		GLFWAXESID_LeftX,	///< XeBbN x 
-		GLFWAXESID_LeftY,	///< XeBbN y 
-		GLFWAXESID_BackX,	///< AiOgK[
-		GLFWAXESID_RightX,	///< EXeBbN x 
-		GLFWAXESID_RightY,	///< EXeBbN y 
+		GLFWAXESID_LeftX,	///< 左スティックの x 軸
+		GLFWAXESID_LeftY,	///< 左スティックの y 軸
+		GLFWAXESID_BackX,	///< アナログトリガー
+		GLFWAXESID_RightX,	///< 右スティックの x 軸
+		GLFWAXESID_RightY,	///< 右スティックの y 軸
 	};
 
 	/**
-	*	WCXeBbÑfW^͑u ID
+	*	ジョイスティックのデジタル入力装置 ID
 	+
-	*	@note XBOX360 Rg[[
+	*	@note XBOX360 コントローラー基準
 	*/
 	enum GLFWBUTTONID {
-		GLFWAXESID_A,	///< A {^
-		GLFWAXESID_B,	///< B {^
-		GLFWAXESID_X,	///< X {^
-		GLFWAXESID_Y,	///< Y {^
-		GLFWAXESID_L,	///< L {^
-		GLFWAXESID_R,	///< R {^
-		GLFWAXESID_Back,	///< Back {^
-		GLFWAXESID_Start,	///< Start {^
-		GLFWAXESID_LThumb,	///< XeBbN{^
-		GLFWAXESID_RThumb,	///< EXeBbN{^
-		GLFWAXESID_Up,		///< L[
-		GLFWAXESID_Right,	///< EL[
-		GLFWAXESID_Down,	///< L[
-		GLFWAXESID_Left,	///< L[
+		GLFWAXESID_A,	///< A ボタン
+		GLFWAXESID_B,	///< B ボタン
+		GLFWAXESID_X,	///< X ボタン
+		GLFWAXESID_Y,	///< Y ボタン
+		GLFWAXESID_L,	///< L ボタン
+		GLFWAXESID_R,	///< R ボタン
+		GLFWAXESID_Back,	///< Back ボタン
+		GLFWAXESID_Start,	///< Start ボタン
+		GLFWAXESID_LThumb,	///< 左スティックボタン
+		GLFWAXESID_RThumb,	///< 右スティックボタン
+		GLFWAXESID_Up,		///< 上キー
+		GLFWAXESID_Right,	///< 右キー
+		GLFWAXESID_Down,	///< 下キー
+		GLFWAXESID_Left,	///< 左キー
 	};
 
 	/**
-	*	Q[pbh̏ԂXV
+	*	ゲームパッドの状態を更新する
 	*/
 	void Window::UpdateGamePad() {
 		const uint32_t prevButtons = gamePad.buttons;
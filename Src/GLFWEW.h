@@ -9,24 +9,26 @@
 
 namespace GLFWEW {
 	/**
-	* GLFW ̃G[񍐂
+	* GLFW からのエラー報告を処理する
 	*
-	* @param error	G[ԍ
-	* @param desc	G[̓e
+	* @param error	エラー番号
+	* @param desc	エラーの内容
 	*/
 	void ErrorCallback(int error, const char* desc);
 
 	/**
-	* GLFW  GLEW ̃bp[NX
+	* GLFW と GLEW のラッパークラス
 	*/
 	class Window {
 	public:
 		static Window& Instance();
-		bool Init(int w, int h, const char* title);
+		bool Init(int w, int h, const char* title, bool visible = true);
 		bool ShouldClose() const;
 		void SwapBuffers() const;
 		const GamePad& GetGamePad() const;
 		void UpdateGamePad();
+		void SetGamePad(const GamePad& gamepad);
+		bool IsKeyPressed(int key) const;
 
 	private:
 		Window();
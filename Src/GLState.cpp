@@ -0,0 +1,417 @@
+/**
+*	@file GLState.cpp
+*/
+#include "GLState.h"
+#include "Profiler.h"
+#include <stddef.h>
+
+namespace GLState {
+
+	namespace {
+
+		const GLuint unknown = ~0u;	///< 値が分からない(次の呼び出しを省略しない)ことを表す名前
+
+		///UBO のバインディング・ポイントに割り当てた範囲
+		struct BufferRange {
+			GLuint buffer;
+			GLintptr offset;
+			GLsizeiptr size;	///< バッファ全体を割り当てた場合は -1
+		};
+
+		///追跡する有効・無効の状態
+		const GLenum capList[] = { GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST };
+		const size_t capCount = sizeof(capList) / sizeof(capList[0]);
+
+		///最後に設定した OpenGL の状態
+		struct State {
+			GLuint program;
+			GLuint vao;
+			GLuint framebuffer;
+			GLuint activeUnit;
+			GLuint texture2D[maxTextureUnits];
+			GLuint texture2DArray[maxTextureUnits];
+			GLuint uniformBuffer;
+			BufferRange uniformRange[maxUniformBindings];
+			int caps[capCount];		///< 1 なら有効、0 なら無効、-1 なら不明
+			bool hasBlendFunc;
+			GLenum blendFunc[2];
+			bool hasViewport;
+			GLint viewport[4];
+			bool hasScissor;
+			GLint scissor[4];
+		};
+
+		/**
+		*	全ての値が不明な状態を作成する
+		*/
+		State UnknownState() {
+			State s;
+			s.program = unknown;
+			s.vao = unknown;
+			s.framebuffer = unknown;
+			s.activeUnit = unknown;
+			for (GLuint i = 0; i < maxTextureUnits; ++i) {
+				s.texture2D[i] = unknown;
+				s.texture2DArray[i] = unknown;
+			}
+			s.uniformBuffer = unknown;
+			for (BufferRange& e : s.uniformRange) {
+				e = { unknown, 0, 0 };
+			}
+			for (int& e : s.caps) {
+				e = -1;
+			}
+			s.hasBlendFunc = false;
+			s.hasViewport = false;
+			s.hasScissor = false;
+			return s;
+		}
+
+		State state = UnknownState();
+		size_t callCount = 0;		///< このフレームで OpenGL を呼び出した回数
+		size_t savedCount = 0;		///< このフレームで省略した呼び出しの回数
+
+		/**
+		*	テクスチャユニットとターゲットに対応するバインドの記録先を取得する
+		*
+		*	@return 記録先へのポインタ
+		*			追跡していないユニットかターゲットの場合は nullptr
+		*/
+		GLuint* TextureSlot(GLuint unit, GLenum target) {
+			if (unit >= maxTextureUnits) {
+				return nullptr;
+			}
+			switch (target) {
+			case GL_TEXTURE_2D: return &state.texture2D[unit];
+			case GL_TEXTURE_2D_ARRAY: return &state.texture2DArray[unit];
+			default: return nullptr;
+			}
+		}
+
+		/**
+		*	UBO のバインディング・ポイントを設定する
+		*/
+		void BindUniformRange(GLuint index, const BufferRange& range) {
+			if (index < maxUniformBindings) {
+				const BufferRange& current = state.uniformRange[index];
+				if (current.buffer == range.buffer && current.offset == range.offset && current.size == range.size) {
+					++savedCount;
+					return;
+				}
+				state.uniformRange[index] = range;
+			}
+			if (range.size < 0) {
+				glBindBufferBase(GL_UNIFORM_BUFFER, index, range.buffer);
+			} else {
+				glBindBufferRange(GL_UNIFORM_BUFFER, index, range.buffer, range.offset, range.size);
+			}
+			//インデックス付きのバインドは汎用のバインディング・ポイントも変更する
+			state.uniformBuffer = range.buffer;
+			++callCount;
+		}
+	}
+
+	/**
+	*	全ての状態を不明として扱い、次の呼び出しは省略せずに OpenGL に渡す
+	*
+	*	OpenGL の関数で追跡中の状態を直接変更した場合や、コンテキストを作り直した場合に呼び出す
+	*/
+	void Invalidate() {
+		state = UnknownState();
+	}
+
+	/**
+	*	1 フレーム分の呼び出し回数をプロファイラのカウンタに記録する
+	*
+	*	OpenGL を呼び出した回数と、同じ値の設定だったため省略した回数を記録し、数え直す
+	*/
+	void EndFrame() {
+		Profiler::Counter("GLStateCalls", static_cast<double>(callCount));
+		Profiler::Counter("GLStateCallsSaved", static_cast<double>(savedCount));
+		callCount = 0;
+		savedCount = 0;
+	}
+
+	/**
+	*	描画に使うプログラムを設定する
+	*
+	*	@param program	プログラムオブジェクト
+	*/
+	void UseProgram(GLuint program) {
+		if (state.program == program) {
+			++savedCount;
+			return;
+		}
+		glUseProgram(program);
+		state.program = program;
+		++callCount;
+	}
+
+	/**
+	*	VAO をバインドする
+	*
+	*	@param vao	VAO(0 ならバインドを解除する)
+	*/
+	void BindVertexArray(GLuint vao) {
+		if (state.vao == vao) {
+			++savedCount;
+			return;
+		}
+		glBindVertexArray(vao);
+		state.vao = vao;
+		++callCount;
+	}
+
+	/**
+	*	描画先のフレームバッファをバインドする
+	*
+	*	@param framebuffer	フレームバッファオブジェクト(0 ならデフォルトのフレームバッファ)
+	*/
+	void BindFramebuffer(GLuint framebuffer) {
+		if (state.framebuffer == framebuffer) {
+			++savedCount;
+			return;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		state.framebuffer = framebuffer;
+		++callCount;
+	}
+
+	/**
+	*	テクスチャをテクスチャユニットにバインドする
+	*
+	*	@param unit		テクスチャユニット番号(GL_TEXTURE0 からの差)
+	*	@param target	テクスチャの種類(GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY)
+	*	@param texture	テクスチャオブジェクト(0 ならバインドを解除する)
+	*
+	*	アクティブなテクスチャユニットも unit に切り替わる
+	*/
+	void BindTexture(GLuint unit, GLenum target, GLuint texture) {
+		GLuint* slot = TextureSlot(unit, target);
+		if (slot && *slot == texture) {
+			++savedCount;
+			return;
+		}
+		if (state.activeUnit != unit) {
+			glActiveTexture(GL_TEXTURE0 + unit);
+			state.activeUnit = unit;
+			++callCount;
+		}
+		glBindTexture(target, texture);
+		if (slot) {
+			*slot = texture;
+		}
+		++callCount;
+	}
+
+	/**
+	*	バッファを GL_UNIFORM_BUFFER にバインドする
+	*
+	*	@param buffer	バッファオブジェクト
+	*
+	*	glBufferSubData や glMapBufferRange で UBO を更新する前に呼び出す
+	*/
+	void BindUniformBuffer(GLuint buffer) {
+		if (state.uniformBuffer == buffer) {
+			++savedCount;
+			return;
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		state.uniformBuffer = buffer;
+		++callCount;
+	}
+
+	/**
+	*	バッファ全体を UBO のバインディング・ポイントに割り当てる
+	*
+	*	@param index	バインディング・ポイント
+	*	@param buffer	バッファオブジェクト
+	*/
+	void BindUniformBufferBase(GLuint index, GLuint buffer) {
+		BindUniformRange(index, { buffer, 0, -1 });
+	}
+
+	/**
+	*	バッファの範囲を UBO のバインディング・ポイントに割り当てる
+	*
+	*	@param index	バインディング・ポイント
+	*	@param buffer	バッファオブジェクト
+	*	@param offset	割り当てる範囲のバイトオフセット
+	*	@param size		割り当てる範囲のバイト数
+	*/
+	void BindUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+		BindUniformRange(index, { buffer, offset, size });
+	}
+
+	/**
+	*	機能を有効・無効にする
+	*
+	*	@param cap		機能(GL_DEPTH_TEST, GL_CULL_FACE, GL_BLEND, GL_SCISSOR_TEST 以外は毎回 OpenGL に渡す)
+	*	@param enable	有効にするなら true
+	*/
+	void Enable(GLenum cap, bool enable) {
+		int* current = nullptr;
+		for (size_t i = 0; i < capCount; ++i) {
+			if (capList[i] == cap) {
+				current = &state.caps[i];
+				break;
+			}
+		}
+		if (current && *current == static_cast<int>(enable)) {
+			++savedCount;
+			return;
+		}
+		if (enable) {
+			glEnable(cap);
+		} else {
+			glDisable(cap);
+		}
+		if (current) {
+			*current = enable;
+		}
+		++callCount;
+	}
+
+	/**
+	*	ブレンド関数を設定する
+	*
+	*	@param sfactor	描画する色に掛ける係数
+	*	@param dfactor	描画先の色に掛ける係数
+	*/
+	void BlendFunc(GLenum sfactor, GLenum dfactor) {
+		if (state.hasBlendFunc && state.blendFunc[0] == sfactor && state.blendFunc[1] == dfactor) {
+			++savedCount;
+			return;
+		}
+		glBlendFunc(sfactor, dfactor);
+		state.hasBlendFunc = true;
+		state.blendFunc[0] = sfactor;
+		state.blendFunc[1] = dfactor;
+		++callCount;
+	}
+
+	/**
+	*	ビューポートを設定する
+	*/
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+		if (state.hasViewport && state.viewport[0] == x && state.viewport[1] == y && state.viewport[2] == width && state.viewport[3] == height) {
+			++savedCount;
+			return;
+		}
+		glViewport(x, y, width, height);
+		state.hasViewport = true;
+		state.viewport[0] = x;
+		state.viewport[1] = y;
+		state.viewport[2] = width;
+		state.viewport[3] = height;
+		++callCount;
+	}
+
+	/**
+	*	シザー矩形を設定する
+	*/
+	void Scissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+		if (state.hasScissor && state.scissor[0] == x && state.scissor[1] == y && state.scissor[2] == width && state.scissor[3] == height) {
+			++savedCount;
+			return;
+		}
+		glScissor(x, y, width, height);
+		state.hasScissor = true;
+		state.scissor[0] = x;
+		state.scissor[1] = y;
+		state.scissor[2] = width;
+		state.scissor[3] = height;
+		++callCount;
+	}
+
+	/**
+	*	プログラムオブジェクトを削除する
+	*
+	*	@param program	プログラムオブジェクト
+	*/
+	void DeleteProgram(GLuint program) {
+		if (!program) {
+			return;
+		}
+		glDeleteProgram(program);
+		if (state.program == program) {
+			state.program = unknown;
+		}
+	}
+
+	/**
+	*	VAO を削除する
+	*
+	*	@param vao	VAO
+	*
+	*	バインド中の VAO を削除すると、OpenGL と同じくバインドなしの状態として扱う
+	*/
+	void DeleteVertexArray(GLuint vao) {
+		if (!vao) {
+			return;
+		}
+		glDeleteVertexArrays(1, &vao);
+		if (state.vao == vao) {
+			state.vao = 0;
+		}
+	}
+
+	/**
+	*	フレームバッファオブジェクトを削除する
+	*
+	*	@param framebuffer	フレームバッファオブジェクト
+	*/
+	void DeleteFramebuffer(GLuint framebuffer) {
+		if (!framebuffer) {
+			return;
+		}
+		glDeleteFramebuffers(1, &framebuffer);
+		if (state.framebuffer == framebuffer) {
+			state.framebuffer = 0;
+		}
+	}
+
+	/**
+	*	テクスチャオブジェクトを削除する
+	*
+	*	@param texture	テクスチャオブジェクト
+	*
+	*	バインドしていた全てのテクスチャユニットは、バインドなしの状態として扱う
+	*/
+	void DeleteTexture(GLuint texture) {
+		if (!texture) {
+			return;
+		}
+		glDeleteTextures(1, &texture);
+		for (GLuint i = 0; i < maxTextureUnits; ++i) {
+			if (state.texture2D[i] == texture) {
+				state.texture2D[i] = 0;
+			}
+			if (state.texture2DArray[i] == texture) {
+				state.texture2DArray[i] = 0;
+			}
+		}
+	}
+
+	/**
+	*	バッファオブジェクトを削除する
+	*
+	*	@param buffer	バッファオブジェクト
+	*
+	*	UBO として割り当てていたバインディング・ポイントは、値が不明な状態として扱う
+	*/
+	void DeleteBuffer(GLuint buffer) {
+		if (!buffer) {
+			return;
+		}
+		glDeleteBuffers(1, &buffer);
+		if (state.uniformBuffer == buffer) {
+			state.uniformBuffer = 0;
+		}
+		for (BufferRange& e : state.uniformRange) {
+			if (e.buffer == buffer) {
+				e = { unknown, 0, 0 };
+			}
+		}
+	}
+}
@@ -0,0 +1,42 @@
+/**
+*	@file GLState.h
+*/
+#pragma once
+#include <GL/glew.h>
+
+/**
+*	OpenGL の状態の追跡
+*
+*	最後に設定した値を覚えておき、同じ値を設定し直す呼び出しを省略する
+*	追跡するのはプログラム、VAO、フレームバッファ、テクスチャユニット毎のテクスチャ、UBO のバインディング・ポイント
+*	深度テスト・カリング・ブレンド・シザーテストの有効状態、ブレンド関数、ビューポート、シザー矩形
+*
+*	追跡している状態を OpenGL の関数で直接変更した場合は Invalidate を呼び出すこと
+*	オブジェクトは Delete～ で削除し、削除後に同じ名前が再利用されても正しくバインドされるようにする
+*	OpenGL のコンテキストを持つスレッドからのみ呼び出すこと
+*/
+namespace GLState {
+	static const GLuint maxTextureUnits = 16;		///< 追跡するテクスチャユニットの数
+	static const GLuint maxUniformBindings = 16;	///< 追跡する UBO のバインディング・ポイントの数
+
+	void Invalidate();
+	void EndFrame();
+
+	void UseProgram(GLuint program);
+	void BindVertexArray(GLuint vao);
+	void BindFramebuffer(GLuint framebuffer);
+	void BindTexture(GLuint unit, GLenum target, GLuint texture);
+	void BindUniformBuffer(GLuint buffer);
+	void BindUniformBufferBase(GLuint index, GLuint buffer);
+	void BindUniformBufferRange(GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	void Enable(GLenum cap, bool enable);
+	void BlendFunc(GLenum sfactor, GLenum dfactor);
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void Scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	void DeleteProgram(GLuint program);
+	void DeleteVertexArray(GLuint vao);
+	void DeleteFramebuffer(GLuint framebuffer);
+	void DeleteTexture(GLuint texture);
+	void DeleteBuffer(GLuint buffer);
+}
@@ -1,19 +1,27 @@
 #include "GameEngine.h"
 #include "GLFWEW.h"
+#include "GLState.h"
+#include "Profiler.h"
 #include <glm\gtc\matrix_transform.hpp>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <unordered_set>
 
 
-/// _f[^^
+/// 頂点データ型
 struct Vertex {
 
-	glm::vec3 position;		///< W
-	glm::vec4 color;		///< F
-	glm::vec2 texCoord;		///< eNX`W
+	glm::vec3 position;		///< 座標
+	glm::vec4 color;		///< 色
+	glm::vec2 texCoord;		///< テクスチャ座標
 };
 
-/// _f[^
-//{ {W}, {F} , {eNX`W}}
+/// 頂点データ
+//{ {座標}, {色} , {テクスチャ座標}}
 const Vertex vertices[] = {
 	{ { -0.5f, -0.3f, 0.5f },{ 1.0f, 1.0f, 1.0f, 1.0f },{ 0.0f, 0.0f } },
 	{ { 0.3f, -0.3f, 0.5f },{ 1.0f, 0.0f, 0.0f, 1.0f },{ 1.0f, 0.0f } },
@@ -33,7 +41,7 @@ const Vertex vertices[] = {
 	{ { -1.0f,  1.0f, 0.5f },{ 1.0f, 1.0f, 1.0f, 1.0f },{ 0.0f, 1.0f } },
 };
 
-///CfbNXf[^
+///インデックスデータ
 const GLuint indices[] = {
 	0, 1, 2, 2, 3, 0,
 	4, 5, 6, 7, 8, 9,
@@ -41,27 +49,27 @@ const GLuint indices[] = {
 };
 
 /**
-*	`f[^
+*	部分描画データ
 */
 struct RenderingPart {
-	GLsizei size;	///< `悷CfbNX
-	GLvoid* offset;	///< `JnCfbNX̃oCgItZbg
+	GLsizei size;	///< 描画するインデックス数
+	GLvoid* offset;	///< 描画開始インデックスのバイトオフセット
 };
 
 /**
-*	RenderingPart 쐬
+*	RenderingPart を作成する
 *
-*	@param size		`悷CfbNX
-*	@param offset	`JnCfbNX̃oCgItZbg(CfbNXP)
+*	@param size		描画するインデックス数
+*	@param offset	描画開始インデックスのバイトオフセット(インデックス単位)
 *
-*	@return	쐬̕`IuWFNg
+*	@return	作成した部分の描画オブジェクト
 */
 constexpr RenderingPart MakeRenderingPart(GLsizei size, GLsizei offset) {
 	return{ size, reinterpret_cast<GLvoid*>(offset * sizeof(GLuint)) };
 }
 
 /**
-*	`f[^Xg
+*	部分描画データリスト
 */
 static const RenderingPart renderingParts[] = {
 	MakeRenderingPart(12,0),
@@ -69,12 +77,12 @@ static const RenderingPart renderingParts[] = {
 };
 
 /**
-* Vertex Buffer Object 쐬
+* Vertex Buffer Object を作成する
 *
-* @param size _f[^̃TCY
-* @param data _f[^ւ̃|C^
+* @param size 頂点データのサイズ
+* @param data 頂点データへのポインタ
 *
-* @return 쐬 VBO
+* @return 作成した VBO
 */
 GLuint CreateVBO(GLsizeiptr size, const GLvoid* data) {
 	GLuint vbo = 0;
@@ -86,12 +94,12 @@ GLuint CreateVBO(GLsizeiptr size, const GLvoid* data) {
 }
 
 /**
-*	Index Buffer Object 쐬
+*	Index Buffer Object を作成する
 *
-*	@param size CfbNXf[^̃TCY
-*	@param data CfbNXf[^ւ̃|C^
+*	@param size インデックスデータのサイズ
+*	@param data インデックスデータへのポインタ
 *
-*	@return 쐬 IBO
+*	@return 作成した IBO
 */
 GLuint CreateIBO(GLsizeiptr size, const GLvoid* data) {
 	GLuint ibo = 0;
@@ -103,11 +111,11 @@ GLuint CreateIBO(GLsizeiptr size, const GLvoid* data) {
 }
 
 /**
-* _Agr[gݒ肷
+* 頂点アトリビュートを設定する
 *
-* @param index	_Agr[g̃CfbNX
-* @param cls	_f[^^
-* @param mbr	_Agr[gɐݒ肷 cls ̃oϐ
+* @param index	頂点アトリビュートのインデックス
+* @param cls	頂点データ型名
+* @param mbr	頂点アトリビュートに設定する cls のメンバ変数名
 */
 #define SetVertexAttribPointer(index, cls, mbr) SetVertexAttribpointerI( \
 	index,	\
@@ -121,30 +129,30 @@ void SetVertexAttribpointerI(GLuint index, GLint size, GLsizei stride, const GLv
 }
 
 /**
-* Vertex Array Object 쐬
+* Vertex Array Object を作成する
 *
-* @param vbo VAOɊ֘At VBO
+* @param vbo VAOに関連付けられる VBO
 *
-* @return 쐬 VAO
+* @return 作成した VAO
 */
 GLuint CreateVAO(GLuint vbo, GLuint ibo) {
 	GLuint vao = 0;
 	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	GLState::BindVertexArray(vao);
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
 	SetVertexAttribPointer(0, Vertex, position);
 	SetVertexAttribPointer(1, Vertex, color);
 	SetVertexAttribPointer(2, Vertex, texCoord);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-	glBindVertexArray(0);
+	GLState::BindVertexArray(0);
 	return vao;
 }
 
 
 /**
-*	Q[GW̃CX^X擾
+*	ゲームエンジンのインスタンスを取得する
 *
-*	@return	Q[GW̃CX^X
+*	@return	ゲームエンジンのインスタンス
 */
 GameEngine& GameEngine::Instance() {
 	static GameEngine instance;
@@ -152,107 +160,248 @@ GameEngine& GameEngine::Instance() {
 }
 
 /**
-*	Q[GW
+*	ゲームエンジンを初期化する
 *
-*	@param w		EChE̕`͈͂̕	(sNZ)
-*	@param h		EChE̕`͈͂̍	(sNZ)
-*	@param title	EChE^Cg	( UTF-8  0 I[)
+*	@param w		ウインドウの描画範囲の幅	(ピクセル)
+*	@param h		ウインドウの描画範囲の高さ	(ピクセル)
+*	@param title	ウインドウタイトル	( UTF-8 の 0 終端文字列)
+*	@param visible	false ならウインドウを表示しない
 *
-*	@retval	
-*	@retval	s
+*	@retval	初期化成功
+*	@retval	初期化失敗
 *
-*	Run ֐ĂяoOɁAxĂяoĂKv
-*	xɐƁAȍ~̌Ăяoł͉ true Ԃ
+*	Run 関数を呼び出す前に、一度だけ呼び出しておく必要がある
+*	一度初期化に成功すると、以降の呼び出しでは何もせずに true を返す
 */
-bool GameEngine::Init(int w, int h, const char* title) {
+bool GameEngine::Init(int w, int h, const char* title, bool visible) {
 	if (isInitialised) {
 		return true;
 	}
-	if (!GLFWEW::Window::Instance().Init(w, h, title)) {
+	if (!GLFWEW::Window::Instance().Init(w, h, title, visible)) {
 		return false;
 	}
 
-	//<--- ɏǉ --->
+	//<--- ここに初期化処理を追加する --->
+	//圧縮テクスチャの対応状況は GL スレッドで調べておき、ワーカースレッドで動く DecodeDds はその結果を使う
+	Texture::CompressedFormatSupport(GLEW_EXT_texture_compression_s3tc != 0, GLEW_ARB_texture_compression_bptc != 0);
 	vbo = CreateVBO(sizeof(vertices), vertices);
 	ibo = CreateIBO(sizeof(indices), indices);
 	vao = CreateVAO(vbo, ibo);
 	uboLight = UniformBuffer::Create(sizeof(Uniform::LightData), 1, "LightData");
 	uboPostEffect = UniformBuffer::Create(sizeof(Uniform::PostEffectData), 2, "PostEffectData");
 
-	progTutorial = Shader::Program::Create("Res/Tutorial.vert", "Res/Tutorial.frag");
-	progColorFilter = Shader::Program::Create("Res/ColorFilter.vert", "Res/ColorFilter.frag");
+	//シェーダは全て先にコンパイルを要求し、ドライバに並行してコンパイルさせる
+	Shader::EnableParallelCompile();
+	progColorFilter = Shader::Program::CreateAsync("Res/ColorFilter.vert", "Res/ColorFilter.frag");
+
+	//Tutorial シェーダはエンティティ毎に必要な機能だけを持つプログラムを使い分ける
+	//コンパイルが終わるまでは、最も軽い頂点カラーのみのプログラムで代わりに描画する
+	progTutorial = Shader::PermutationSet::Create("Res/Tutorial.vert", "Res/Tutorial.frag");
+	progTutorial->UniformBlockBinding("VertexData", 0);
+	progTutorial->UniformBlockBinding("LightData", 1);
+	if (!progTutorial->Fallback(Shader::Feature_Instanced)) {
+		return false;
+	}
+	const uint32_t fullFeatures =
+		Shader::Feature_Lit | Shader::LightCountFeature(Uniform::maxLightCount) | Shader::Feature_Instanced | Shader::Feature_Textured;
+	Shader::Program* progTutorialFull = progTutorial->Request(fullFeatures);
+	for (int i = 0; i < Uniform::maxLightCount; ++i) {
+		progTutorial->Request(Shader::Feature_Lit | Shader::LightCountFeature(i) | Shader::Feature_Instanced | Shader::Feature_Textured);
+	}
+	progTutorial->Request(Shader::Feature_Instanced | Shader::Feature_Textured);
 
 	offscreen = OffscreenBuffer::Create(800, 600);
-	if (!vbo || !ibo || !vao || !uboLight || !uboPostEffect || !progTutorial || !progColorFilter || !offscreen) {
+	if (!vbo || !ibo || !vao || !uboLight || !uboPostEffect || !progTutorialFull || !progColorFilter || !progColorFilter->Wait() || !offscreen) {
 		return false;
 	}
 
-	progTutorial->UniformBlockBinding("VertexData", 0);
-	progTutorial->UniformBlockBinding("LightData", 1);
 	progColorFilter->UniformBlockBinding("PostEffectData", 2);
+	//ハンドルで指定された場合は、全ての点光源を計算するプログラムを使う
+	//コンパイルの完了は待たず、それまでは他のプログラムと同じく代わりのプログラムで描画する(失敗は UpdateShaderCompilation で報告する)
+	programHandleMap.insert(std::make_pair(std::string("Tutorial"), ProgramHandle{ static_cast<uint32_t>(programHandleList.size()) }));
+	programHandleList.push_back(Shader::ProgramPtr(progTutorial, progTutorialFull));
 
 	meshBuffer = Mesh::Buffer::Create(10 * 1024, 30 * 1024);
 	if (!meshBuffer) {
-		std::cerr << "ERROR: GameEngine ̏Ɏs" << std::endl;
+		std::cerr << "ERROR: GameEngine の初期化に失敗" << std::endl;
 		return false;
 	}
 
 	entityBuffer = Entity::Buffer::Create(1024, sizeof(Uniform::VertexData), 0, "VertexData");
+	stagingBuffer = StagingBuffer::Create(uploadBudget);
+	textureCache = TextureCache::Create(256 * 1024 * 1024);
 
-	if (!entityBuffer) {
-		std::cerr << "ERROR: GameEngine ̏Ɏs" << std::endl;
+	if (!entityBuffer || !stagingBuffer || !textureCache) {
+		std::cerr << "ERROR: GameEngine の初期化に失敗" << std::endl;
 		return false;
 	}
 	rand.seed(std::random_device()());
+	Profiler::Init();
 
+	isVisible = visible;
 	isInitialised = true;
 	return true;
 }
 
 /**
-*	Q[擾
+*	ゲームを取得する
+*
+*	Replay で入力ログを指定した場合、ゲームパッドと経過時間はログから読み込まれ
+*	ログの終端に達するとループを終了する
+*	ウインドウを表示していない場合はバッファの交換の代わりに glFinish で描画の完了を待つ
+*	非同期読み込み中のアセットは、毎フレーム UploadBudget で指定したバイト数まで転送する
+*	F11 キーでプロファイラの計測を切り替え、F12 キーで直近のフレームをキャプチャする
 */
 void GameEngine::Run() {
 //	const double delta = 1.0 / 60.0;
 	GLFWEW::Window& window = GLFWEW::Window::Instance();
-	double prevTime = glfwGetTime();
+	const double startTime = glfwGetTime();
+	double prevTime = startTime;
+	bool prevToggleKey = false;
+	bool prevCaptureKey = false;
 	while (!window.ShouldClose()) {
 		const double curTime = glfwGetTime();
-		const double delta = curTime - prevTime;
+		double delta = glm::min(0.25, curTime - prevTime);
 		prevTime = curTime;
-		window.UpdateGamePad();
-		Update(glm::min(0.25, delta));
+		GamePad gamepad;
+		if (inputPlayer && !inputPlayer->Read(delta, gamepad)) {
+			std::cout << "入力ログの再生が終了: " << inputPlayer->FrameCount() << " フレーム, " <<
+				(glfwGetTime() - startTime) << " 秒" << std::endl;
+			break;
+		}
+		Profiler::BeginFrame();
+		{
+			PROFILE_SCOPE("Input");
+			const bool toggleKey = window.IsKeyPressed(GLFW_KEY_F11);
+			if (toggleKey && !prevToggleKey) {
+				Profiler::Enable(!Profiler::IsEnabled());
+				std::cout << "INFO: プロファイラを" << (Profiler::IsEnabled() ? "有効" : "無効") << "にしました" << std::endl;
+			}
+			prevToggleKey = toggleKey;
+			const bool captureKey = window.IsKeyPressed(GLFW_KEY_F12);
+			if (captureKey && !prevCaptureKey) {
+				if (Profiler::IsEnabled()) {
+					Profiler::RequestCapture();
+				} else {
+					std::cerr << "WARNING: プロファイラが無効なのでキャプチャできません(F11 キーで有効にしてください)" << std::endl;
+				}
+			}
+			prevCaptureKey = captureKey;
+			if (inputPlayer) {
+				window.SetGamePad(gamepad);
+			} else {
+				window.UpdateGamePad();
+				if (inputRecorder) {
+					inputRecorder->Write(delta, window.GetGamePad());
+				}
+			}
+		}
+		UpdateAssetStreaming();
+		UpdateShaderCompilation();
+		Update(delta);
 		Render();
-		window.SwapBuffers();
+		{
+			PROFILE_SCOPE("Swap");
+			if (isVisible) {
+				window.SwapBuffers();
+			} else {
+				glFinish();
+			}
+		}
+		GLState::EndFrame();
+		Profiler::EndFrame();
 	}
 }
 
 /**
-*	ԍXV֐ݒ肷
+*	入力の記録を開始する
+*
+*	@param fileName	記録先のファイル名
 *
-*	@param func ݒ肷XV֐
+*	@retval true	記録開始
+*	@retval false	記録先のファイルを作成できなかった
+*
+*	乱数の種を選び直して記録するため、エンティティを追加する前に呼び出すこと
+*/
+bool GameEngine::Record(const char* fileName) {
+	const uint32_t seed = std::random_device()();
+	inputRecorder = InputLog::Recorder::Create(fileName, seed);
+	if (!inputRecorder) {
+		return false;
+	}
+	inputPlayer.reset();
+	rand.seed(seed);
+	return true;
+}
+
+/**
+*	記録した入力の再生を開始する
+*
+*	@param fileName	再生するログファイル名
+*
+*	@retval true	再生開始
+*	@retval false	ログファイルを読み込めなかった
+*
+*	乱数の種をログの値に設定するため、エンティティを追加する前に呼び出すこと
+*/
+bool GameEngine::Replay(const char* fileName) {
+	inputPlayer = InputLog::Player::Create(fileName);
+	if (!inputPlayer) {
+		return false;
+	}
+	inputRecorder.reset();
+	rand.seed(inputPlayer->Seed());
+	return true;
+}
+
+/**
+*	1 フレーム分の更新と描画を行う
+*
+*	@param delta	前回の更新からの経過時間(秒)
+*
+*	入力の更新とバッファの交換は行わない
+*	ウインドウを表示せずにエンジンを動かす場合(ベンチマーク等)に使用する
+*	フレーム時間に GPU の処理時間を含めるため、glFinish で描画の完了を待つ
+*	非同期読み込みは処理速度によらず、要求から決まったフレーム数で完了する
+*	更新中にコンパイルを要求したシェーダプログラムも、描画の前に完了を待つ
+*/
+void GameEngine::Step(double delta) {
+	isStepping = true;
+	Profiler::BeginFrame();
+	UpdateAssetStreaming();
+	Update(delta);
+	UpdateShaderCompilation();
+	Render();
+	glFinish();
+	GLState::EndFrame();
+	Profiler::EndFrame();
+}
+
+/**
+*	状態更新関数を設定する
+*
+*	@param func 設定する更新関数
 */
 void GameEngine::UpdateFunc(const UpdateFuncType& func) {
 	updateFunc = func;
 }
 
 /**
-*	ԍXV֐擾
+*	状態更新関数を取得する
 *
-*	@param func ݒ肳ĂXV֐
+*	@param func 設定されている更新関数
 */
 const GameEngine::UpdateFuncType& GameEngine::UpdateFunc() const {
 	return updateFunc;
 }
 
 /**
-*	fXgN^
+*	デストラクタ
 */
 GameEngine::~GameEngine() {
-	//<--- ɏIǉ--->
-	if (vao) {
-		glDeleteVertexArrays(1, &vao);
-	}
+	//<--- ここに終了処理を追加する--->
+	Profiler::Shutdown();
+	GLState::DeleteVertexArray(vao);
 	if (ibo) {
 		glDeleteBuffers(1, &ibo);
 	}
@@ -262,41 +411,51 @@ GameEngine::~GameEngine() {
 };
 
 /**
-*	Q[̏ԂXV
+*	ゲームの状態を更新する
 *
-*	@param delta	O̍XV̌oߎ(b)
+*	@param delta	前回の更新からの経過時間(秒)
 */
 void GameEngine::Update(double delta) {
+	PROFILE_SCOPE("Update");
 	if (updateFunc) {
+		PROFILE_SCOPE("UpdateFunc");
 		updateFunc(delta);
 	}
-	//<--- ɍXVǉ--->
+	//<--- ここに更新処理を追加する--->
 	const glm::mat4x4 matProg = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 1.0f, 200.0f);
 	const glm::mat4x4 matView = glm::lookAt(camera.position, camera.target, camera.up);
+	UpdateLightCount();
 	entityBuffer->Update(delta, matView, matProg);
+	textureCache->Update(entityBuffer->TextureList(), textureMipSkip);
 }
 
 
 void GameEngine::Render() const {
-	//<--- ɕ`揈ǉ--->
-	glBindFramebuffer(GL_FRAMEBUFFER, offscreen->GetFrameBuffer());
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_CULL_FACE);
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glViewport(0, 0, 800, 600);
-	glScissor(0, 0, 800, 600);
+	PROFILE_SCOPE("Render");
+	//<--- ここに描画処理を追加する--->
+	GLState::BindFramebuffer(offscreen->GetFrameBuffer());
+	GLState::Enable(GL_DEPTH_TEST, true);
+	GLState::Enable(GL_CULL_FACE, true);
+	GLState::Enable(GL_BLEND, true);
+	GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GLState::Viewport(0, 0, 800, 600);
+	GLState::Scissor(0, 0, 800, 600);
 	glClearColor(0.1f, 0.3f, 0.5f, 0.1f);
 	glClearDepth(1);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	uboLight->BufferSubData(&lightData);
-	entityBuffer->Draw(meshBuffer);
+	{
+		PROFILE_GPU_SCOPE("Scene");
+		entityBuffer->Draw(meshBuffer);
+	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glDisable(GL_DEPTH_TEST);
-	glDisable(GL_CULL_FACE);
-	glDisable(GL_BLEND);
-	glBindVertexArray(vao);
+	PROFILE_SCOPE("PostProcess");
+	PROFILE_GPU_SCOPE("PostProcess");
+	GLState::BindFramebuffer(0);
+	GLState::Enable(GL_DEPTH_TEST, false);
+	GLState::Enable(GL_CULL_FACE, false);
+	GLState::Enable(GL_BLEND, false);
+	GLState::BindVertexArray(vao);
 	progColorFilter->UseProgram();
 	Uniform::PostEffectData postEffect;
 	uboPostEffect->BufferSubData(&postEffect);
@@ -306,91 +465,1055 @@ void GameEngine::Render() const {
 
 
 /**
-*	eNX`ǂݍ
+*	テクスチャを読み込む
 *
-*	@param fileName eNX`t@C
+*	@param fileName テクスチャファイル名
 *
-*	@retval true	ǂݍݐ
-*	@retval false	ǂݍݎs
+*	@retval true	読み込み成功
+*	@retval false	読み込み失敗
+*
+*	GPU メモリの予算を超える場合は、エンティティが使っていないテクスチャを追い出してから読み込む
 */
 bool GameEngine::LoadTextureFromFile(const char* fileName) {
-	const auto itr = textureBuffer.find(fileName);
-	if (itr != textureBuffer.end()) {
+	if (textureCache->Find(fileName)) {
 		return true;
 	}
-	TexturePtr texture = Texture::LoadFromFile(fileName);
+	ImageData image;
+	if (!Texture::Decode(fileName, image)) {
+		return false;
+	}
+	textureCache->Reserve(Texture::StorageBytes(image, textureMipSkip));
+	TexturePtr texture = Texture::Create(image, textureMipSkip);
 	if (!texture) {
 		return false;
 	}
-	textureBuffer.insert(std::make_pair(std::string(fileName), texture));
+	textureCache->Insert(std::vector<std::string>(1, fileName), texture);
 	return true;
 }
 
 /**
-*	bVǂݍ
+*	メッシュを読み込む
 *
-*	@param fileName bVt@C
+*	@param fileName メッシュファイル名
 *
-*	@retval true	ǂݍݐ
-*	@retval false	ǂݍݎs
+*	@retval true	読み込み成功
+*	@retval false	読み込み失敗
 */
 bool GameEngine::LoadMeshFromFile(const char* fileName) {
 	return meshBuffer->LoadMeshFromFile(fileName);
 }
 
 /**
-*	GeBeBǉ
+*	アセットを一括で読み込む
+*
+*	@param manifest	読み込むアセットのリスト
+*
+*	@retval true	全てのアセットの読み込みに成功
+*	@retval false	読み込みに失敗したアセットがある
 *
-*	@param groupId	GeBeB̃O[v ID
-*	@param pos		GeBeB̍W
-*	@param meshName	GeBeB̕\Ɏgp郁bV
-*	@param texName	GeBeB̕\ɎgpeNX`t@C
-*	@param func		GeBeB̏ԂXV֐(܂͊֐IuWFNg)
+*	ファイルの読み込みと変換はワーカースレッドで並列に行い
+*	OpenGL への転送だけをこのスレッドでリストの順に行う
+*	大きさと形式の同じテクスチャは 1 つのテクスチャ配列のレイヤーにまとめ、エンティティをまとめて描画できるようにする
+*	テクスチャ配列のレイヤーは、後続のテクスチャの変換を全て待たずに変換の終わったものから転送する
+*	アセット毎に、変換時間、転送時間、開始からの経過時間を出力する
+*	リスト内で重複したファイル名は 1 回だけ読み込む
+*/
+bool GameEngine::LoadAssets(const AssetManifest& manifest) {
+	///読み込み中のアセット
+	struct Asset {
+		std::string fileName;
+		bool isMesh = false;
+		bool result = false;
+		ImageData image;
+		Mesh::MeshFile mesh;
+		int64_t decodeTime = 0;
+		std::promise<void> decoded;
+	};
+
+	const int64_t startTime = Profiler::Now();
+	std::vector<Asset> assetList(manifest.textureList.size() + manifest.meshList.size());
+	size_t assetCount = 0;
+	//同じファイルを複数回読み込まないよう、重複した名前は最初のものだけを使う
+	std::unordered_set<std::string> requested;
+	for (const std::string& e : manifest.textureList) {
+		if (requested.insert(e).second && !textureCache->Find(e)) {
+			assetList[assetCount++].fileName = e;
+		}
+	}
+	for (const std::string& e : manifest.meshList) {
+		if (requested.insert(e).second) {
+			assetList[assetCount].fileName = e;
+			assetList[assetCount++].isMesh = true;
+		}
+	}
+	if (assetCount == 0) {
+		return true;
+	}
+	std::vector<std::future<void>> decodedList;
+	decodedList.reserve(assetCount);
+	for (size_t i = 0; i < assetCount; ++i) {
+		decodedList.push_back(assetList[i].decoded.get_future());
+	}
+
+	//ワーカースレッドでファイルを読み込んで変換する
+	//@note 例外が発生しても必ず decoded を完了させ、メインスレッドが待ち続けないようにする
+	std::atomic<size_t> nextAsset(0);
+	const size_t threadCount = std::min<size_t>(assetCount, std::max(1u, std::thread::hardware_concurrency()));
+	std::vector<std::future<void>> workers;
+	workers.reserve(threadCount);
+	for (size_t i = 0; i < threadCount; ++i) {
+		workers.push_back(std::async(std::launch::async, [&assetList, &nextAsset, assetCount]() {
+			for (size_t n = nextAsset++; n < assetCount; n = nextAsset++) {
+				Asset& asset = assetList[n];
+				const int64_t begin = Profiler::Now();
+				try {
+					if (asset.isMesh) {
+						asset.result = Mesh::DecodeMeshFile(asset.fileName.c_str(), asset.mesh);
+					} else {
+						asset.result = Texture::Decode(asset.fileName.c_str(), asset.image);
+					}
+				} catch (const std::exception& e) {
+					std::cerr << "ERROR: " << asset.fileName << " の変換中に例外が発生(" << e.what() << ")" << std::endl;
+					asset.result = false;
+				} catch (...) {
+					std::cerr << "ERROR: " << asset.fileName << " の変換中に例外が発生" << std::endl;
+					asset.result = false;
+				}
+				asset.decodeTime = Profiler::Now() - begin;
+				asset.decoded.set_value();
+			}
+		}));
+	}
+
+	//変換の終わったものから順に OpenGL へ転送する
+	bool result = true;
+	for (size_t i = 0; i < assetCount; ++i) {
+		decodedList[i].wait();
+		Asset& asset = assetList[i];
+		if (asset.fileName.empty()) {
+			continue;
+		}
+		const int64_t begin = Profiler::Now();
+		if (!asset.result) {
+			std::cerr << "ERROR: " << asset.fileName << " の読み込みに失敗" << std::endl;
+			result = false;
+			continue;
+		}
+		if (asset.isMesh) {
+			if (!meshBuffer->Upload(asset.mesh)) {
+				result = false;
+			}
+			asset.mesh = Mesh::MeshFile();
+		} else {
+			//大きさと形式の同じ後続のテクスチャを 1 つのテクスチャ配列にまとめる
+			//互換性は変換が終わるまで分からないため、変換中のものの分もレイヤーを確保し、変換の終わったものから順に転送する
+			std::vector<size_t> pendingList;
+			for (size_t j = i + 1; j < assetCount; ++j) {
+				const Asset& other = assetList[j];
+				if (other.isMesh || other.fileName.empty()) {
+					continue;
+				}
+				if (decodedList[j].wait_for(std::chrono::seconds(0)) != std::future_status::ready ||
+					(other.result && Texture::IsArrayCompatible(asset.image, other.image))) {
+					pendingList.push_back(j);
+				}
+			}
+			const int layerCapacity = static_cast<int>(pendingList.size()) + 1;
+			textureCache->Reserve(Texture::StorageBytes(asset.image, textureMipSkip, layerCapacity));
+			TexturePtr texture = Texture::CreateStorage(asset.image, textureMipSkip, layerCapacity);
+			std::vector<Asset*> layerList(1, &asset);
+			if (texture) {
+				Texture::UploadLayer(texture, asset.image, 0, textureMipSkip);
+				while (!pendingList.empty()) {
+					auto itr = std::find_if(pendingList.begin(), pendingList.end(), [&decodedList](size_t j) {
+						return decodedList[j].wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+					});
+					if (itr == pendingList.end()) {
+						itr = pendingList.begin();
+						decodedList[*itr].wait();
+					}
+					Asset& other = assetList[*itr];
+					pendingList.erase(itr);
+					if (other.result && Texture::IsArrayCompatible(asset.image, other.image)) {
+						Texture::UploadLayer(texture, other.image, static_cast<int>(layerList.size()), textureMipSkip);
+						layerList.push_back(&other);
+					}
+				}
+			}
+			std::vector<const ImageData*> images;
+			std::vector<std::string> names;
+			for (const Asset* e : layerList) {
+				images.push_back(&e->image);
+				names.push_back(e->fileName);
+			}
+			if (texture && static_cast<int>(layerList.size()) < layerCapacity) {
+				//互換性のなかったテクスチャの分だけ余ったレイヤーを解放するため、必要な数のレイヤーで作り直す
+				texture.reset();
+				texture = Texture::CreateArray(images, textureMipSkip);
+			}
+			if (texture) {
+				textureCache->Insert(names, texture);
+				if (layerList.size() > 1) {
+					std::cout << asset.fileName << ": " << layerList.size() << " 枚のテクスチャを 1 つのテクスチャ配列にまとめました" << std::endl;
+				}
+			} else {
+				result = false;
+			}
+			for (size_t layer = 1; layer < layerList.size(); ++layer) {
+				//まとめたテクスチャは後で転送しないように、印として名前を消す
+				layerList[layer]->image = ImageData();
+				layerList[layer]->fileName.clear();
+			}
+			asset.image = ImageData();
+		}
+		const int64_t end = Profiler::Now();
+		std::cout << asset.fileName << ": 変換 " << asset.decodeTime / 1.0e6 << "ms, 転送 " << (end - begin) / 1.0e6 <<
+			"ms, 完了 " << (end - startTime) / 1.0e6 << "ms" << std::endl;
+	}
+	for (auto& e : workers) {
+		e.get();
+	}
+	std::cout << "アセット読み込み: " << assetCount << " 個, " << (Profiler::Now() - startTime) / 1.0e6 << "ms" << std::endl;
+	MarkMissingMeshes();
+	return result;
+}
+
+/**
+*	非同期読み込み中のアセット
 *
-*	@return	ǉGeBeBւ̃|C^
-*			ȏGeBeBǉłȂꍇ nullptr Ԃ
-*			]g嗦͂̃|C^oRŐݒ肷
-*			ȂÃ|C^AvP[VŕێKv͂Ȃ
+*	変換はワーカースレッドで行い、転送はメインスレッドで少しずつ行う
+*	decoded は変換対象のデータより後に宣言し、破棄時に変換の終了を待ってからデータを破棄させること
+*/
+struct GameEngine::AsyncAsset {
+	AssetTicketPtr ticket;
+	uint64_t completeFrame = 0;		///< IsDeterministic が true のとき、完了させるフレーム
+	bool isMesh = false;
+	bool isDecoded = false;			///< 変換が終わっていれば true
+	ImageData image;				///< 変換したテクスチャデータ
+	TexturePtr texture;				///< 登録済みの仮表示用テクスチャ
+	TexturePtr streamingTexture;	///< 転送先のテクスチャ
+	Mesh::MeshFile mesh;			///< 変換したメッシュデータ
+	Mesh::MeshUpload upload;		///< メッシュデータの転送先
+	GLsizeiptr uploadedBytes = 0;	///< 転送済みのバイト数(テクスチャは転送中のミップレベルの転送済みの行数、圧縮形式ではブロックの行数)
+	int baseLevel = 0;				///< テクスチャの最上位として転送するミップレベル
+	int uploadLevel = 0;			///< 転送中のテクスチャのミップレベル
+	std::future<bool> decoded;		///< 変換の結果
+};
+
+/**
+*	テクスチャを非同期に読み込む
+*
+*	@param fileName テクスチャファイル名
+*
+*	@return 読み込みの進行状況を表すチケット
+*
+*	テクスチャはすぐに仮表示用の 1x1 ピクセルのものが登録され、エンティティに設定できる
+*	読み込みが終わると、同じ TexturePtr のまま内容が差し替えられる
+*	同じファイルを読み込み中であれば、そのチケットを返す
+*/
+AssetTicketPtr GameEngine::LoadTextureAsync(const char* fileName) {
+	for (const auto& e : asyncAssetList) {
+		if (!e->isMesh && e->ticket->Name() == fileName) {
+			return e->ticket;
+		}
+	}
+	AssetTicketPtr ticket = AssetTicket::Create(fileName);
+	if (textureCache->Find(fileName)) {
+		ticket->Complete(true);
+		return ticket;
+	}
+	TexturePtr texture = TextureCache::CreatePlaceholder();
+	if (!texture) {
+		ticket->Complete(false);
+		return ticket;
+	}
+	textureCache->Insert(std::vector<std::string>(1, fileName), texture, true);
+
+	std::shared_ptr<AsyncAsset> asset = std::make_shared<AsyncAsset>();
+	asset->ticket = ticket;
+	asset->texture = texture;
+	ImageData* image = &asset->image;
+	const std::string name = fileName;
+	asset->decoded = std::async(std::launch::async, [image, name]() { return Texture::Decode(name.c_str(), *image); });
+	asset->completeFrame = streamingFrame + deterministicStreamingFrames;
+	asyncAssetList.push_back(asset);
+	return ticket;
+}
+
+/**
+*	メッシュを非同期に読み込む
+*
+*	@param fileName メッシュファイル名
+*
+*	@return 読み込みの進行状況を表すチケット
+*
+*	読み込みが終わるまで、ファイル内のメッシュを指定したエンティティは仮表示用の立方体で描画される
+*	同じファイルを読み込み中であれば、そのチケットを返す
+*/
+AssetTicketPtr GameEngine::LoadMeshAsync(const char* fileName) {
+	for (const auto& e : asyncAssetList) {
+		if (e->isMesh && e->ticket->Name() == fileName) {
+			return e->ticket;
+		}
+	}
+	std::shared_ptr<AsyncAsset> asset = std::make_shared<AsyncAsset>();
+	asset->ticket = AssetTicket::Create(fileName);
+	asset->isMesh = true;
+	Mesh::MeshFile* mesh = &asset->mesh;
+	const std::string name = fileName;
+	asset->decoded = std::async(std::launch::async, [mesh, name]() { return Mesh::DecodeMeshFile(name.c_str(), *mesh); });
+	asset->completeFrame = streamingFrame + deterministicStreamingFrames;
+	asyncAssetList.push_back(asset);
+	return asset->ticket;
+}
+
+/**
+*	1 フレームに転送する最大バイト数を設定する
+*
+*	@param bytes	転送する最大バイト数
+*
+*	テクスチャは行単位で転送するため、1 行がこれより大きいテクスチャは 1 フレームで全て転送する
+*/
+void GameEngine::UploadBudget(size_t bytes) {
+	if (bytes == 0 || bytes == uploadBudget) {
+		return;
+	}
+	if (StagingBufferPtr p = StagingBuffer::Create(bytes)) {
+		stagingBuffer = p;
+		uploadBudget = bytes;
+	}
+}
+
+/**
+*	1 フレームに転送する最大バイト数を取得する
+*
+*	@return 転送する最大バイト数
+*/
+size_t GameEngine::UploadBudget() const {
+	return uploadBudget;
+}
+
+/**
+*	1 フレームにメッシュバッファのデフラグで移動する最大バイト数を設定する
+*
+*	@param bytes	移動する最大バイト数(0 ならデフラグしない)
+*/
+void GameEngine::MeshDefragmentBudget(size_t bytes) {
+	meshDefragmentBudget = bytes;
+}
+
+/**
+*	クラスタ単位のカリングを有効・無効にする
+*
+*	@param enable	有効にするなら true(既定値)
+*
+*	カリングの効果を比べるときに無効にする
+*/
+void GameEngine::ClusterCulling(bool enable) {
+	entityBuffer->ClusterCulling(enable);
+}
+
+/**
+*	クラスタ単位のカリングが有効か調べる
+*
+*	@retval true	有効
+*	@retval false	無効
+*/
+bool GameEngine::ClusterCulling() const {
+	return entityBuffer->ClusterCulling();
+}
+
+/**
+*	テクスチャの転送を省略する上位のミップレベルの数を設定する
+*
+*	@param levels	省略するレベルの数(0 なら全て転送する)
+*
+*	1 レベル省略するごとに、テクスチャのメモリ使用量は約 1/4 になる
+*	メモリの少ない環境向けの設定で、以後に読み込むテクスチャに適用される
+*/
+void GameEngine::TextureMipSkip(int levels) {
+	textureMipSkip = std::max(levels, 0);
+}
+
+/**
+*	テクスチャの転送を省略する上位のミップレベルの数を取得する
+*/
+int GameEngine::TextureMipSkip() const {
+	return textureMipSkip;
+}
+
+/**
+*	メッシュファイルから読み込んだメッシュを破棄する
+*
+*	@param fileName メッシュファイル名
+*
+*	@retval true	破棄成功
+*	@retval false	読み込まれていないか、転送中
+*
+*	エンティティや雛形が使っていないメッシュはハンドル表から外し、メッシュバッファから破棄できるようにする
+*	ハンドル自体は有効なままで、次に使うときに同じ名前のメッシュを取得し直す
+*	破棄したメッシュを使っているエンティティは、仮表示用の立方体で描画される
+*/
+bool GameEngine::UnloadMesh(const char* fileName) {
+	if (meshBuffer->IsLoaded(fileName)) {
+		for (const std::string& name : meshBuffer->MeshNames(fileName)) {
+			const auto itr = meshHandleMap.find(name);
+			if (itr == meshHandleMap.end()) {
+				continue;
+			}
+			Mesh::MeshPtr& mesh = meshHandleList[itr->second.index];
+			if (mesh && !IsMeshInUse(mesh.get())) {
+				mesh.reset();
+			}
+		}
+	}
+	return meshBuffer->UnloadMesh(fileName);
+}
+
+/**
+*	メッシュハンドルが参照するメッシュを取得する
+*
+*	@param handle	メッシュハンドル
+*
+*	@return handle に対応するメッシュへのポインタ
+*
+*	UnloadMesh でハンドル表から外したメッシュは、ここで取得し直す(読み込まれていなければ仮表示用のメッシュを予約する)
+*/
+const Mesh::Mesh* GameEngine::MeshOf(MeshHandle handle) {
+	Mesh::MeshPtr& mesh = meshHandleList[handle.index];
+	if (!mesh) {
+		mesh = meshBuffer->GetOrReserveMesh(meshHandleNameList[handle.index].c_str());
+	}
+	return mesh.get();
+}
+
+/**
+*	メッシュがエンティティか雛形に使われているか調べる
+*
+*	@param mesh	調べるメッシュ
+*
+*	@retval true	使われている
+*	@retval false	使われていない
+*/
+bool GameEngine::IsMeshInUse(const Mesh::Mesh* mesh) const {
+	for (const PrefabData& e : prefabList) {
+		if (e.mesh == mesh) {
+			return true;
+		}
+	}
+	return entityBuffer->IsMeshInUse(mesh);
+}
+
+/**
+*	テクスチャに使う GPU メモリの予算を設定する
+*
+*	@param bytes	予算のバイト数
+*
+*	読み込みで予算を超える場合は、エンティティが使っていないテクスチャを最後に描画されたのが古い順に追い出す
+*	追い出したテクスチャは、再びエンティティが使うと自動的に読み直される
+*	予算を下げた場合は、次のフレームの更新で予算に収まるまで追い出す
+*/
+void GameEngine::TextureBudget(size_t bytes) {
+	textureCache->Budget(bytes);
+}
+
+/**
+*	テクスチャに使う GPU メモリの予算を取得する
+*
+*	@return 予算のバイト数
+*/
+size_t GameEngine::TextureBudget() const {
+	return textureCache->Budget();
+}
+
+/**
+*	テクスチャを追い出して GPU メモリを解放する
+*
+*	@param fileName テクスチャファイル名
+*
+*	@retval true	解放成功
+*	@retval false	読み込まれていないか、エンティティが使用中か、読み込み中
+*
+*	テクスチャ配列にまとめたテクスチャは、配列全体を解放する
+*	テクスチャハンドルは有効なままで、解放後にエンティティが使うと自動的に読み直される
+*/
+bool GameEngine::UnloadTexture(const char* fileName) {
+	return textureCache->Evict(fileName);
+}
+
+/**
+*	テクスチャキャッシュの統計を取得する
+*
+*	@return ヒット、ミス、追い出しの累計回数と、常駐しているテクスチャのバイト数
+*/
+const TextureCache::Statistics& GameEngine::TextureCacheStatistics() const {
+	return textureCache->GetStatistics();
+}
+
+/**
+*	ステージングバッファ経由でバッファオブジェクトにデータを転送する
+*
+*	@param staging	ステージングバッファ
+*	@param dst		転送先のバッファオブジェクト
+*	@param offset	転送先のバイトオフセット
+*	@param data		転送するデータ
+*	@param size		転送するデータのバイト数
+*	@param progress	転送済みのバイト数
+*
+*	@retval true	全て転送した
+*	@retval false	ステージングバッファの容量が足りず、転送が残っている
+*/
+static bool StreamBuffer(StagingBuffer& staging, GLuint dst, GLintptr offset, const uint8_t* data, GLsizeiptr size, GLsizeiptr& progress) {
+	while (progress < size) {
+		const GLsizeiptr bytes = std::min(size - progress, staging.Remaining());
+		const GLintptr src = staging.Write(data + progress, bytes);
+		if (src < 0) {
+			return false;
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, staging.Id());
+		glBindBuffer(GL_COPY_WRITE_BUFFER, dst);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, src, offset + progress, bytes);
+		progress += bytes;
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return true;
+}
+
+/**
+*	バインド中のテクスチャ配列のレイヤー 0 に、ミップレベルの一部の行を転送する
+*
+*	@param image		画像データ
+*	@param level		画像データのミップレベル
+*	@param targetLevel	転送先のミップレベル
+*	@param firstRow		転送する最初の行(圧縮形式ではブロックの行)
+*	@param rowCount		転送する行数
+*	@param pixels		転送するデータ(ピクセルアンパックバッファをバインド中ならそのオフセット)
+*/
+static void UploadTextureRows(const ImageData& image, int level, GLint targetLevel, GLsizeiptr firstRow, GLsizeiptr rowCount, const GLvoid* pixels) {
+	const GLint y = static_cast<GLint>(firstRow * image.RowHeight());
+	const GLsizei height = std::min(static_cast<GLsizei>(rowCount * image.RowHeight()), image.Height(level) - y);
+	if (image.IsCompressed()) {
+		glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, targetLevel, 0, y, 0, image.Width(level), height, 1,
+			image.iformat, static_cast<GLsizei>(rowCount * image.RowBytes(level)), pixels);
+	} else {
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, targetLevel, 0, y, 0, image.Width(level), height, 1,
+			image.format, GL_UNSIGNED_BYTE, pixels);
+	}
+}
+
+/**
+*	非同期読み込み中のアセットを、ステージングバッファの残り容量の分だけ転送する
+*
+*	@param asset	変換の終わったアセット
+*
+*	@retval true	全て転送し終えた
+*	@retval false	転送しきれなかった(続きは次の呼び出しで転送する)
+*/
+bool GameEngine::StreamAsset(AsyncAsset& asset) {
+	bool isCompleted = false;
+	if (asset.isMesh) {
+		const GLsizeiptr vertexBytes = asset.upload.vertexBytes;
+		GLsizeiptr progress = std::min(asset.uploadedBytes, vertexBytes);
+		if (StreamBuffer(*stagingBuffer, meshBuffer->VertexBufferId(), asset.upload.vboOffset, asset.upload.vertexData, vertexBytes, progress)) {
+			progress = asset.uploadedBytes - vertexBytes;
+			if (progress < 0) {
+				progress = 0;
+			}
+			isCompleted = StreamBuffer(*stagingBuffer, meshBuffer->IndexBufferId(), asset.upload.iboOffset, asset.upload.indexData, asset.upload.indexBytes, progress);
+			asset.uploadedBytes = vertexBytes + progress;
+		} else {
+			asset.uploadedBytes = progress;
+		}
+		if (isCompleted) {
+			meshBuffer->CommitUpload(asset.mesh, asset.upload);
+			asset.mesh = Mesh::MeshFile();
+		}
+	} else {
+		//ミップレベルを大きい順に転送し、予算が残っていれば同じフレームで次のレベルに進む
+		const ImageData& image = asset.image;
+		GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, asset.streamingTexture->Id());
+		while (asset.uploadLevel < image.LevelCount()) {
+			const int level = asset.uploadLevel;
+			const GLint targetLevel = level - asset.baseLevel;
+			const GLsizeiptr levelRows = image.RowCount(level);
+			const GLsizeiptr rowBytes = static_cast<GLsizeiptr>(image.RowBytes(level));
+			const GLsizeiptr rowCount = std::min<GLsizeiptr>(levelRows - asset.uploadedBytes,
+				std::max<GLsizeiptr>(1, stagingBuffer->Remaining() / rowBytes));
+			const uint8_t* pixels = image.Pixels(level) + asset.uploadedBytes * rowBytes;
+			const GLintptr src = stagingBuffer->Write(pixels, rowCount * rowBytes);
+			if (src >= 0) {
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer->Id());
+				UploadTextureRows(image, level, targetLevel, asset.uploadedBytes, rowCount, reinterpret_cast<const GLvoid*>(src));
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				asset.uploadedBytes += rowCount;
+			} else if (rowBytes > stagingBuffer->Size()) {
+				//1 行がステージングバッファに収まらない場合は直接転送する
+				UploadTextureRows(image, level, targetLevel, asset.uploadedBytes, levelRows - asset.uploadedBytes, pixels);
+				asset.uploadedBytes = levelRows;
+			} else {
+				break;
+			}
+			if (asset.uploadedBytes < levelRows) {
+				break;
+			}
+			asset.uploadedBytes = 0;
+			++asset.uploadLevel;
+		}
+		GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+		if (asset.uploadLevel >= image.LevelCount()) {
+			asset.texture->Swap(*asset.streamingTexture);
+			asset.streamingTexture.reset();
+			textureCache->Commit(asset.texture.get());
+			asset.image = ImageData();
+			isCompleted = true;
+		}
+	}
+	return isCompleted;
+}
+
+/**
+*	非同期読み込み中のアセットを転送する
+*
+*	変換の終わったアセットを読み込み要求の順に、UploadBudget のバイト数を上限として転送する
+*	テクスチャはピクセルアンパックバッファ経由でミップレベル毎に行単位で、メッシュはステージングバッファからのコピーで転送する
+*	転送が終わったアセットはチケットに完了を通知する
+*	MeshDefragmentBudget が設定されていれば、メッシュバッファの断片化も少しずつ解消する
+*
+*	IsDeterministic が true の間は、要求から deterministicStreamingFrames フレーム後に変換の終了を待って全て転送する
+*	完了を通知するフレームが処理速度に左右されないので、記録した入力を再生しても同じ結果になる
+*/
+void GameEngine::UpdateAssetStreaming() {
+	++streamingFrame;
+	if (meshDefragmentBudget) {
+		PROFILE_SCOPE("MeshDefragment");
+		meshBuffer->Defragment(meshDefragmentBudget);
+	}
+	if (asyncAssetList.empty()) {
+		return;
+	}
+	PROFILE_SCOPE("AssetStreaming");
+	const bool isDeterministic = IsDeterministic();
+	stagingBuffer->BeginFrame();
+	std::vector<std::pair<AssetTicketPtr, bool>> completedList;
+	bool isMeshCompleted = false;
+	for (auto itr = asyncAssetList.begin(); itr != asyncAssetList.end() && (isDeterministic || stagingBuffer->Remaining() > 0);) {
+		AsyncAsset& asset = **itr;
+		if (isDeterministic && asset.completeFrame > streamingFrame) {
+			break;	//要求の順に期限が来るので、以降のアセットもまだ期限前
+		}
+		isMeshCompleted |= asset.isMesh;
+		if (!asset.isDecoded) {
+			if (!isDeterministic && asset.decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				++itr;
+				continue;
+			}
+			asset.isDecoded = true;
+			bool result = asset.decoded.get();
+			if (result && asset.isMesh && meshBuffer->IsLoaded(asset.ticket->Name().c_str())) {
+				completedList.push_back(std::make_pair(asset.ticket, true));
+				itr = asyncAssetList.erase(itr);
+				continue;
+			}
+			if (result) {
+				if (asset.isMesh) {
+					result = meshBuffer->ReserveUpload(asset.mesh, asset.upload);
+				} else {
+					asset.baseLevel = std::min(textureMipSkip, asset.image.LevelCount() - 1);
+					asset.uploadLevel = asset.baseLevel;
+					textureCache->Reserve(Texture::StorageBytes(asset.image, asset.baseLevel));
+					asset.streamingTexture = Texture::CreateStorage(asset.image, asset.baseLevel);
+					result = static_cast<bool>(asset.streamingTexture);
+				}
+			}
+			if (!result) {
+				std::cerr << "ERROR: " << asset.ticket->Name() << " の読み込みに失敗" << std::endl;
+				if (!asset.isMesh) {
+					//再読み込みできるように仮表示用のテクスチャの登録を解除する
+					const TextureCache::Entry* texture = textureCache->Find(asset.ticket->Name());
+					if (texture && texture->texture == asset.texture) {
+						textureCache->Erase(asset.ticket->Name());
+					}
+				}
+				completedList.push_back(std::make_pair(asset.ticket, false));
+				itr = asyncAssetList.erase(itr);
+				continue;
+			}
+		}
+
+		bool isCompleted = StreamAsset(asset);
+		if (isDeterministic) {
+			//期限のフレームでは、ステージングバッファを使い回して残りを全て転送する
+			while (!isCompleted) {
+				const GLsizeiptr prevBytes = asset.uploadedBytes;
+				const int prevLevel = asset.uploadLevel;
+				stagingBuffer->BeginFrame();
+				isCompleted = StreamAsset(asset);
+				if (!isCompleted && asset.uploadedBytes == prevBytes && asset.uploadLevel == prevLevel) {
+					std::cerr << "WARNING: " << asset.ticket->Name() << " を期限のフレームまでに転送できませんでした" << std::endl;
+					break;
+				}
+			}
+		}
+		if (isCompleted) {
+			completedList.push_back(std::make_pair(asset.ticket, true));
+			itr = asyncAssetList.erase(itr);
+		} else {
+			break;
+		}
+	}
+
+	if (isMeshCompleted) {
+		MarkMissingMeshes();
+	}
+
+	//完了通知で新しい読み込みが要求されてもよいように、リストの更新後に通知する
+	for (auto& e : completedList) {
+		e.first->Complete(e.second);
+	}
+}
+
+/**
+*	決まったフレームで非同期読み込みを完了させるか調べる
+*
+*	@retval true	入力の記録・再生中か、Step でエンジンを動かしている
+*	@retval false	処理速度に合わせて完了させる
+*/
+bool GameEngine::IsDeterministic() const {
+	return isStepping || inputRecorder || inputPlayer;
+}
+
+/**
+*	読み込み待ちのメッシュファイルがなくなっていれば、見つからなかったメッシュを報告する
+*
+*	どのファイルにも含まれていなかったメッシュ名(綴りの誤りなど)は警告を出力し
+*	Mesh::IsMissing が true になる(表示は仮表示用の立方体のまま)
+*/
+void GameEngine::MarkMissingMeshes() {
+	for (const auto& e : asyncAssetList) {
+		if (e->isMesh) {
+			return;
+		}
+	}
+	meshBuffer->MarkMissingMeshes();
+}
+
+/**
+*	コンパイルの完了したシェーダプログラムを仕上げる
+*
+*	完了待ちのプログラムと作成に失敗したプログラムの数をプロファイラのカウンタに記録する
+*	IsDeterministic が true の間は、描画結果が処理速度で変わらないように全ての完了を待つ
+*	作成に失敗したプログラムが増えたら警告を出力する(エンティティは代わりのプログラムで描画される)
+*	ハンドルで参照するプログラムが失敗していれば、そのハンドル名をエラーとして出力する
+*/
+void GameEngine::UpdateShaderCompilation() {
+	PROFILE_SCOPE("ShaderCompilation");
+	if (IsDeterministic()) {
+		progTutorial->Wait();
+	}
+	const size_t pendingCount = progTutorial->Poll();
+	Profiler::Counter("PendingPrograms", static_cast<double>(pendingCount));
+	const size_t failedCount = progTutorial->FailedCount();
+	Profiler::Counter("FailedPrograms", static_cast<double>(failedCount));
+	if (failedCount > failedProgramCount) {
+		std::cerr << "WARNING: Tutorial シェーダのプログラムの作成に " << failedCount - failedProgramCount << " 個失敗しました(計 " <<
+			failedCount << " 個)" << std::endl;
+		for (const auto& e : programHandleMap) {
+			const Shader::ProgramPtr& program = programHandleList[e.second.index];
+			if (program && program->IsFailed()) {
+				std::cerr << "ERROR: シェーダプログラム " << e.first << " の作成に失敗しました(代わりのプログラムで描画します)" << std::endl;
+			}
+		}
+	}
+	failedProgramCount = failedCount;
+}
+
+/**
+*	エンティティに必要な Tutorial シェーダの機能フラグを求める
+*
+*	@param hasLight		ライティングするなら true
+*	@param hasTexture	テクスチャを貼るなら true
+*	@param lightCount	計算する点光源の数
+*
+*	@return 必要な機能だけを持つ機能フラグ
+*
+*	エンティティはインスタンス描画でまとめて描画するので、常に Feature_Instanced を含む
+*/
+static uint32_t TutorialFeatures(bool hasLight, bool hasTexture, int lightCount) {
+	uint32_t features = Shader::Feature_Instanced;
+	if (hasLight) {
+		features |= Shader::Feature_Lit | Shader::LightCountFeature(lightCount);
+	}
+	if (hasTexture) {
+		features |= Shader::Feature_Textured;
+	}
+	return features;
+}
+
+/**
+*	エンティティに必要な機能を満たす、最も軽い Tutorial シェーダのプログラムを選ぶ
+*
+*	@param hasLight		ライティングするなら true
+*	@param hasTexture	テクスチャを貼るなら true
+*	@param lightCount	計算する点光源の数
+*
+*	@return 選んだプログラム(コンパイル中の場合がある)
+*			シェーダファイルを読み込めなかった場合は nullptr
+*
+*	初めて選ぶプログラムはコンパイルを要求するだけで、完了は UpdateShaderCompilation で確認する
+*/
+Shader::Program* GameEngine::SelectProgram(bool hasLight, bool hasTexture, int lightCount) {
+	return progTutorial->Request(TutorialFeatures(hasLight, hasTexture, lightCount));
+}
+
+/**
+*	計算する必要のある点光源の数を求める
+*
+*	@return 明るさが 0 でない最後の点光源のインデックス + 1
+*/
+int GameEngine::ActiveLightCount() const {
+	for (int i = Uniform::maxLightCount; i > 0; --i) {
+		const glm::vec4& color = lightData.light[i - 1].color;
+		if (color.r != 0 || color.g != 0 || color.b != 0) {
+			return i;
+		}
+	}
+	return 0;
+}
+
+/**
+*	点光源の数が変わっていたら、ライティングするエンティティと雛形のプログラムを切り替える
+*
+*	新しい点光源の数のプログラムは、切り替えるエンティティか雛形がある場合だけコンパイルを要求する
+*	新しいプログラムのコンパイルが完了するまでは切り替えず、次のフレームでやり直す
+*/
+void GameEngine::UpdateLightCount() {
+	const int lightCount = ActiveLightCount();
+	if (lightCount == litLightCount) {
+		return;
+	}
+	for (const bool hasTexture : { true, false }) {
+		const Shader::Program* from = progTutorial->Find(TutorialFeatures(true, hasTexture, litLightCount));
+		if (!from) {
+			continue;
+		}
+		Shader::Program* to = SelectProgram(true, hasTexture, lightCount);
+		if (!to || !to->IsReady()) {
+			return;
+		}
+		entityBuffer->ReplaceProgram(from, to);
+		for (PrefabData& e : prefabList) {
+			if (e.program == from) {
+				e.program = to;
+			}
+		}
+	}
+	litLightCount = lightCount;
+}
+
+/**
+*	エンティティを追加する
+*
+*	@param groupId	エンティティのグループ ID
+*	@param pos		エンティティの座標
+*	@param meshName	エンティティの表示に使用するメッシュ名
+*	@param texName	エンティティの表示に使用するテクスチャファイル名(nullptr なら頂点カラーのみで表示する)
+*	@param func		エンティティの状態を更新する関数(または関数オブジェクト)
+*	@param hasLight	true ならライティングする。false なら光源の影響を受けない
+*
+*	@return	追加したエンティティへのポインタ
+*			これ以上エンティティを追加できない場合は nullptr が返される
+*			回転や拡大率はこのポインタ経由で設定する
+*			なお、このポインタをアプリケーション側で保持する必要はない
+*
+*	メッシュやテクスチャが非同期読み込み中の場合は、読み込みが終わるまで仮の表示になる
 */
 Entity::Entity* GameEngine::addEntity(int groupId, const glm::vec3& pos, const char* meshName, const char* texName, Entity::Entity::UpdateFuncType func, bool hasLight) {
-	const Mesh::MeshPtr& mesh = meshBuffer->GetMesh(meshName);
-	const TexturePtr& tex = textureBuffer.find(texName)->second;
-	return entityBuffer->AddEntity(groupId, pos, mesh, tex, progTutorial, func);
-}	
+	const MeshHandle mesh = GetMeshHandle(meshName);
+	TextureCache::Entry textureEntry;
+	if (texName) {
+		const TextureHandle texture = GetTextureHandle(texName);
+		if (!texture.IsValid()) {
+			return nullptr;
+		}
+		textureEntry = textureHandleList[texture.index];
+	}
+	Shader::Program* program = SelectProgram(hasLight, textureEntry.texture != nullptr, litLightCount);
+	if (!program) {
+		return nullptr;
+	}
+	return entityBuffer->AddEntity(groupId, pos, MeshOf(mesh), textureEntry.texture.get(), program, func, textureEntry.layer);
+}
 
 /**
-*	GeBeB폜
+*	メッシュハンドルを取得する
 *
-*	@param 폜GeBeB̃|C^
+*	@param name	メッシュ名
+*
+*	@return name に対応するメッシュハンドル
+*
+*	メッシュが読み込まれていなければ仮表示用のメッシュを予約し、読み込まれると同じハンドルのまま表示が切り替わる
+*	ハンドルが参照するメッシュは UnloadMesh されるまでエンジンが保持するので、エンティティは参照カウントなしで使用できる
+*/
+GameEngine::MeshHandle GameEngine::GetMeshHandle(const char* name) {
+	const auto itr = meshHandleMap.find(name);
+	if (itr != meshHandleMap.end()) {
+		return itr->second;
+	}
+	const MeshHandle handle = { static_cast<uint32_t>(meshHandleList.size()) };
+	meshHandleList.push_back(meshBuffer->GetOrReserveMesh(name));
+	meshHandleNameList.push_back(name);
+	meshHandleMap.insert(std::make_pair(std::string(name), handle));
+	return handle;
+}
+
+/**
+*	テクスチャハンドルを取得する
+*
+*	@param name	テクスチャファイル名
+*
+*	@return name に対応するテクスチャハンドル
+*			テクスチャが読み込まれていない(読み込み要求もされていない)場合は無効なハンドル
+*/
+GameEngine::TextureHandle GameEngine::GetTextureHandle(const char* name) {
+	const auto itr = textureHandleMap.find(name);
+	if (itr != textureHandleMap.end()) {
+		return itr->second;
+	}
+	const TextureCache::Entry* texture = textureCache->Find(name);
+	if (!texture) {
+		std::cerr << "WARNING: テクスチャ'" << name << "'は読み込まれていません" << std::endl;
+		return{};
+	}
+	const TextureHandle handle = { static_cast<uint32_t>(textureHandleList.size()) };
+	textureHandleList.push_back(*texture);
+	textureHandleMap.insert(std::make_pair(std::string(name), handle));
+	return handle;
+}
+
+/**
+*	シェーダプログラムハンドルを取得する
+*
+*	@param name	シェーダプログラム名("Tutorial")
+*
+*	@return name に対応するシェーダプログラムハンドル
+*			存在しない場合は無効なハンドル
+*/
+GameEngine::ProgramHandle GameEngine::GetProgramHandle(const char* name) {
+	const auto itr = programHandleMap.find(name);
+	if (itr == programHandleMap.end()) {
+		std::cerr << "WARNING: シェーダプログラム'" << name << "'はありません" << std::endl;
+		return{};
+	}
+	return itr->second;
+}
+
+/**
+*	エンティティの雛形を登録する
+*
+*	@param prefab	登録する雛形
+*
+*	@return 登録した雛形のハンドル
+*			雛形のハンドルが無効な場合は無効なハンドル
+*
+*	program が無効なハンドルの場合は、hasLight とテクスチャの有無から Tutorial シェーダのプログラムを選ぶ
+*	texture が無効なハンドルの場合はテクスチャを貼らない
+*/
+GameEngine::PrefabHandle GameEngine::RegisterPrefab(const Prefab& prefab) {
+	if (prefab.mesh.index >= meshHandleList.size() || (prefab.texture.IsValid() && prefab.texture.index >= textureHandleList.size()) ||
+		(prefab.program.IsValid() && prefab.program.index >= programHandleList.size())) {
+		std::cerr << "ERROR: エンティティの雛形に無効なハンドルが指定されました" << std::endl;
+		return{};
+	}
+	if (prefab.groupId < 0 || prefab.groupId > Entity::maxGroupID) {
+		std::cerr << "ERROR: エンティティの雛形に範囲外のグループ ID(" << prefab.groupId << ")が指定されました" << std::endl;
+		return{};
+	}
+	PrefabData data;
+	data.prefab = prefab;
+	data.mesh = MeshOf(prefab.mesh);
+	data.texture = prefab.texture.IsValid() ? textureHandleList[prefab.texture.index].texture.get() : nullptr;
+	data.textureLayer = prefab.texture.IsValid() ? textureHandleList[prefab.texture.index].layer : 0;
+	data.program = prefab.program.IsValid() ? programHandleList[prefab.program.index].get() :
+		SelectProgram(prefab.hasLight, data.texture != nullptr, litLightCount);
+	if (!data.program) {
+		return{};
+	}
+	const PrefabHandle handle = { static_cast<uint32_t>(prefabList.size()) };
+	prefabList.push_back(data);
+	return handle;
+}
+
+/**
+*	雛形からエンティティを追加する
+*
+*	@param prefab	エンティティの雛形のハンドル
+*	@param pos		エンティティの座標
+*
+*	@return	追加したエンティティへのポインタ
+*			これ以上エンティティを追加できない場合は nullptr が返される
+*
+*	雛形の衝突形状(または AutoCollision)と初速も設定される
+*	名前の検索も参照カウントの操作も行わないので、弾のように大量に生成するエンティティに使う
+*	状態更新関数はエンティティ毎にコピーするので、関数オブジェクトが持つ状態はエンティティ毎に独立する
+*/
+Entity::Entity* GameEngine::Spawn(PrefabHandle prefab, const glm::vec3& pos) {
+	if (prefab.index >= prefabList.size()) {
+		return nullptr;
+	}
+	const PrefabData& data = prefabList[prefab.index];
+	Entity::Entity* p = entityBuffer->AddEntity(data.prefab.groupId, pos, data.mesh, data.texture, data.program, data.prefab.func, data.textureLayer);
+	if (p) {
+		p->Velocity(data.prefab.velocity);
+		if (data.prefab.autoCollision) {
+			p->AutoCollision(true);
+		} else {
+			p->Collision(data.prefab.collision);
+		}
+	}
+	return p;
+}
+
+/**
+*	エンティティを削除する
+*
+*	@param 削除するエンティティのポインタ
 */
 void GameEngine::RemoveEntity(Entity::Entity* e) {
 	entityBuffer->RemoveEntity(e);
 }
 
 /**
-*	Cgݒ肷
+*	全てのエンティティを削除する
+*/
+void GameEngine::ClearEntities() {
+	entityBuffer->Clear();
+}
+
+/**
+*	ライトを設定する
 *
-*	@param index 擾郉Cg̃CfbNX
-*	@param light Cgf[^
+*	@param index 取得するライトのインデックス
+*	@param light ライトデータ
 */
 void GameEngine::Light(int index, const Uniform::PointLight& light) {
 	if (index < 0 || index >= Uniform::maxLightCount) {
-		std::cout << "WARNING: '" << index << "' ͕sȃCgCfbNXł" << std::endl;
+		std::cout << "WARNING: '" << index << "' は不正なライトインデックスです" << std::endl;
 		return;
 	}
 	lightData.light[index] = light;
 }
 
 /**
-*	Cg擾
+*	ライトを取得する
 *
-*	@param index 擾郉Cg̃CfbNX
+*	@param index 取得するライトのインデックス
 *
-*	@return Cgf[^
+*	@return ライトデータ
 */
 const Uniform::PointLight& GameEngine::Light(int index) const {
 	if (index < 0 || index >= Uniform::maxLightCount) {
-		std::cout << "WARNING: '" << index << "' ͕sȃCgCfbNXł" << std::endl;
+		std::cout << "WARNING: '" << index << "' は不正なライトインデックスです" << std::endl;
 		static const Uniform::PointLight dummy;
 		return dummy;
 	}
@@ -398,91 +1521,100 @@ const Uniform::PointLight& GameEngine::Light(int index) const {
 }
 
 /**
-*	ݒ肷
+*	環境光を設定する
 *
-*	@param color ̖邳
+*	@param color 環境光の明るさ
 */
 void GameEngine::AmbientLight(const glm::vec4& color) {
 	lightData.ambientColor = color;
 }
 
 /**
-*	擾
+*	環境光を取得する
 *
-*	@return ̖邳
+*	@return 環境光の明るさ
 */
 const glm::vec4& GameEngine::AmbientLight() const {
 	return lightData.ambientColor;
 }
 
 /**
-*	_̈ʒuƎpݒ肷
+*	視点の位置と姿勢を設定する
 *
-*	@param cam ݒ肷Jf[^
+*	@param cam 設定するカメラデータ
 */
 void GameEngine::Camera(const GameEngine::CameraData& cam) {
 	camera = cam;
 }
 
 /**
-*	_̈ʒuƎp擾
+*	視点の位置と姿勢を取得する
 *
-*	@return Jf[^
+*	@return カメラデータ
 */
 const GameEngine::CameraData& GameEngine::Camera() const {
 	return camera;
 }
 
 /**
-*	IuWFNg擾
+*	乱数オブジェクトを取得する
 *
-*	@return IuWFNg
+*	@return 乱数オブジェクト
 */
 std::mt19937& GameEngine::Rand() {
 	return rand;
 }
 
 /**
-*	Q[pbh̏Ԃ擾
+*	ゲームパッドの状態を取得する
 */
 const GamePad& GameEngine::GetGamePad() const {
 	return GLFWEW::Window::Instance().GetGamePad();
 }
 
 /**
-*	Փˉnhݒ肷
+*	衝突解決ハンドラを設定する
 *
-*	@param gid0		ՓˑΏۂ̃O[v ID
-*	@param gid1		ՓˑΏۂ̃O[v ID
-*	@param handler	Փˉnh
+*	@param gid0		衝突対象のグループ ID
+*	@param gid1		衝突対象のグループ ID
+*	@param handler	衝突解決ハンドラ
 *
-*	Փ˂ՓˉnhĂяo鎞A菬O[v ID GeBeBɓn
-*	Ŏw肵O[v ID ̏Ƃ͖֌Wł邱Ƃɒ
+*	衝突が発生し衝突解決ハンドラが呼び出される時、より小さいグループ ID を持つエンティティから先に渡される
+*	ここで指定したグループ ID の順序とは無関係であることに注意
 *	ex)
 *		CollisionHandler(10, 1, Func)
-*		ƂR[hŃnho^ƂAՓ˂
-*		Finc(O[v ID = 1 ̃GeBeBAO[v ID = 10 ̃GeBeB)
-*		̂悤ɌĂяo
+*		というコードでハンドラを登録したとする、衝突が発生すると
+*		Finc(グループ ID = 1 のエンティティ、グループ ID = 10 のエンティティ)
+*		のように呼び出される
 */
 void GameEngine::CollisionHandler(int gid0, int gid1, Entity::CollisionHandlerType handler) {
 	entityBuffer->CollisionHandler(gid0, gid1, handler);
 }
 
 /**
-*	Փˉnh擾
+*	衝突解決ハンドラを取得する
 *
-*	@param gid0		ՓˑΏۂ̃O[v ID
-*	@param gid1		ՓˑΏۂ̃O[v ID
+*	@param gid0		衝突対象のグループ ID
+*	@param gid1		衝突対象のグループ ID
 *
-*	@return	Փˉnh
+*	@return	衝突解決ハンドラ
 */
 const Entity::CollisionHandlerType& GameEngine::collisionHandler(int gid0, int gid1) const {
 	return entityBuffer->collisionHandler(gid0, gid1);
 }
 
 /**
-*SĂ̏Փˉnh폜
+*全ての衝突解決ハンドラを削除する
 */
 void GameEngine::ClearCollisionHandlerList() {
 	entityBuffer->ClearCollisionHandlerList();
+}
+
+/**
+*	アクティブなエンティティの数を取得する
+*
+*	@return アクティブなエンティティの数
+*/
+size_t GameEngine::EntityCount() const {
+	return entityBuffer->ActiveCount();
 }
\ No newline at end of file
@@ -5,31 +5,62 @@
 #include "OffscreenBuffer.h"
 #include "Shader.h"
 #include "Texture.h"
+#include "TextureCache.h"
 #include "Mesh.h"
 #include "Entity.h"
 #include "Uniform.h"
 #include "GamePad.h"
+#include "InputLog.h"
+#include "AssetTicket.h"
+#include "StagingBuffer.h"
+#include "AssetHandle.h"
 #include <glm\glm.hpp>
 #include <functional>
+#include <vector>
+#include <string>
 #include <random>
 #include <time.h>
 
 /**
-*	Q[GWNX
+*	ゲームエンジンクラス
 */
 class GameEngine {
 public:
-	typedef std::function<void(double)> UpdateFuncType;		///< Q[ԂXV֐̌^
-	///Jf[^
+	typedef std::function<void(double)> UpdateFuncType;		///< ゲーム状態を更新する関数の型
+	///カメラデータ
 	struct CameraData {
 		glm::vec3 position;
 		glm::vec3 target;
 		glm::vec3 up;
 	};
+	typedef AssetHandle<Mesh::Mesh> MeshHandle;			///< メッシュハンドル
+	typedef AssetHandle<Texture> TextureHandle;			///< テクスチャハンドル
+	typedef AssetHandle<Shader::Program> ProgramHandle;	///< シェーダプログラムハンドル
+	///エンティティの雛形
+	struct Prefab {
+		int groupId = 0;					///< グループ ID
+		MeshHandle mesh;					///< 表示に使用するメッシュ
+		TextureHandle texture;				///< 表示に使用するテクスチャ(無効なハンドルならテクスチャを貼らない)
+		ProgramHandle program;				///< 表示に使用するシェーダプログラム(無効なハンドルなら自動で選ぶ)
+		bool hasLight = true;				///< true ならライティングする(program が無効なハンドルの場合のみ有効)
+		Entity::CollisionData collision = { glm::vec3(0), glm::vec3(0) };	///< 衝突形状
+		bool autoCollision = false;			///< true ならメッシュの AABB を衝突形状にする(collision は無視される)
+		glm::vec3 velocity = glm::vec3(0);	///< 初速
+		Entity::Entity::UpdateFuncType func;	///< 状態を更新する関数
+	};
+	typedef AssetHandle<Prefab> PrefabHandle;	///< エンティティの雛形のハンドル
+	///一括読み込みするアセットのリスト
+	struct AssetManifest {
+		std::vector<std::string> textureList;	///< テクスチャファイル名のリスト
+		std::vector<std::string> meshList;		///< メッシュファイル名のリスト
+	};
 
 	static GameEngine& Instance();
-	bool Init(int w, int h, const char* title);
+	bool Init(int w, int h, const char* title, bool visible = true);
 	void Run();
+	void Step(double delta);
+	bool Record(const char* fileName);
+	bool Replay(const char* fileName);
 	void UpdateFunc(const UpdateFuncType& func);
 	const UpdateFuncType& UpdateFunc() const;
 
@@ -40,17 +71,50 @@ private:
 	GameEngine& operator=(const GameEngine&) = delete;
 	void Update(double delta);
 	void Render() const;
+	struct AsyncAsset;
+	void UpdateAssetStreaming();
+	bool StreamAsset(AsyncAsset& asset);
+	bool IsDeterministic() const;
+	void MarkMissingMeshes();
+	const Mesh::Mesh* MeshOf(MeshHandle handle);
+	bool IsMeshInUse(const Mesh::Mesh* mesh) const;
+	void UpdateShaderCompilation();
+	Shader::Program* SelectProgram(bool hasLight, bool hasTexture, int lightCount);
+	int ActiveLightCount() const;
+	void UpdateLightCount();
 
 private:
 	bool isInitialised = false;
+	bool isVisible = true;
 	UpdateFuncType updateFunc;
 
-	//<--- Ƀo֐ǉ --->
+	//<--- ここにメンバ関数を追加する --->
 public:
 	bool LoadTextureFromFile(const char* fileName);
 	bool LoadMeshFromFile(const char* fileName);
+	bool LoadAssets(const AssetManifest& manifest);
+	AssetTicketPtr LoadTextureAsync(const char* fileName);
+	AssetTicketPtr LoadMeshAsync(const char* fileName);
+	void UploadBudget(size_t bytes);
+	size_t UploadBudget() const;
+	void MeshDefragmentBudget(size_t bytes);
+	void ClusterCulling(bool enable);
+	bool ClusterCulling() const;
+	void TextureMipSkip(int levels);
+	int TextureMipSkip() const;
+	bool UnloadMesh(const char* fileName);
+	void TextureBudget(size_t bytes);
+	size_t TextureBudget() const;
+	bool UnloadTexture(const char* fileName);
+	const TextureCache::Statistics& TextureCacheStatistics() const;
 	Entity::Entity* addEntity(int groupId, const glm::vec3& pos, const char* meshName, const char* texName, Entity::Entity::UpdateFuncType func, bool hasLight = true);
+	MeshHandle GetMeshHandle(const char* name);
+	TextureHandle GetTextureHandle(const char* name);
+	ProgramHandle GetProgramHandle(const char* name);
+	PrefabHandle RegisterPrefab(const Prefab& prefab);
+	Entity::Entity* Spawn(PrefabHandle prefab, const glm::vec3& pos);
 	void RemoveEntity(Entity::Entity*);
+	void ClearEntities();
 	void Light(int index, const Uniform::PointLight& light);
 	const Uniform::PointLight& Light(int index) const;
 	void AmbientLight(const glm::vec4& color);
@@ -62,23 +126,54 @@ public:
 	void CollisionHandler(int gid0, int gid1, Entity::CollisionHandlerType handler);
 	const Entity::CollisionHandlerType& collisionHandler(int gid0, int gid1) const;
 	void ClearCollisionHandlerList();
+	size_t EntityCount() const;
 
 private:
-	//<--- Ƀoϐǉ --->
+	//<--- ここにメンバ変数を追加する --->
 	GLuint vbo = 0;
 	GLuint ibo = 0;
 	GLuint vao = 0;
 	UniformBufferPtr uboLight;
 	UniformBufferPtr uboPostEffect;
-	Shader::ProgramPtr progTutorial;
+	Shader::PermutationSetPtr progTutorial;	///< 機能フラグ毎の Tutorial シェーダ
+	int litLightCount = 0;	///< ライティングするエンティティのプログラムが計算する点光源の数
+	size_t failedProgramCount = 0;	///< 作成に失敗した Tutorial シェーダのプログラムの数(報告済みのもの)
 	Shader::ProgramPtr progColorFilter;
 	OffscreenBufferPtr offscreen;
 
-	std::unordered_map<std::string, TexturePtr> textureBuffer;
+	TextureCachePtr textureCache;	///< 読み込んだテクスチャ(テクスチャ配列にまとめたものはレイヤー番号も持つ)
 	Mesh::BufferPtr meshBuffer;
 	Entity::BufferPtr entityBuffer;
 
 	Uniform::LightData lightData;
 	CameraData camera;
 	std::mt19937 rand;	
+	InputLog::RecorderPtr inputRecorder;
+	InputLog::PlayerPtr inputPlayer;
+
+	std::vector<Mesh::MeshPtr> meshHandleList;		///< ハンドルで参照するメッシュ(UnloadMesh で解放したものは nullptr)
+	std::vector<std::string> meshHandleNameList;	///< メッシュハンドルに対応するメッシュ名
+	std::vector<TextureCache::Entry> textureHandleList;	///< ハンドルで参照するテクスチャ
+	std::vector<Shader::ProgramPtr> programHandleList;	///< ハンドルで参照するシェーダプログラム
+	std::unordered_map<std::string, MeshHandle> meshHandleMap;
+	std::unordered_map<std::string, TextureHandle> textureHandleMap;
+	std::unordered_map<std::string, ProgramHandle> programHandleMap;
+	///ハンドルを解決済みのエンティティの雛形
+	struct PrefabData {
+		Prefab prefab;
+		const Mesh::Mesh* mesh;
+		const Texture* texture;
+		int textureLayer;
+		Shader::Program* program;
+	};
+	std::vector<PrefabData> prefabList;
+
+	std::vector<std::shared_ptr<AsyncAsset>> asyncAssetList;	///< 非同期読み込み中のアセット
+	StagingBufferPtr stagingBuffer;	///< 非同期読み込みの転送に使うバッファ
+	size_t uploadBudget = 1024 * 1024;	///< 1 フレームに転送する最大バイト数
+	size_t meshDefragmentBudget = 0;	///< 1 フレームにデフラグで移動する最大バイト数
+	int textureMipSkip = 0;				///< テクスチャの転送を省略する上位のミップレベルの数
+	bool isStepping = false;			///< Step でエンジンを動かしていれば true
+	uint64_t streamingFrame = 0;		///< UpdateAssetStreaming を呼び出した回数
+	static const uint64_t deterministicStreamingFrames = 8;	///< IsDeterministic が true のとき、読み込みの要求から完了までのフレーム数
 };
\ No newline at end of file
@@ -3,7 +3,7 @@
 #include <stdint.h>
 
 /**
-*	Q[pbh
+*	ゲームパッド情報
 */
 struct GamePad {
 	enum {
@@ -19,6 +19,6 @@ struct GamePad {
 		L	= 0x0200,
 		R	= 0x0400,
 	};
-	uint32_t buttons;		///< ĂԃtO
-	uint32_t buttonDown;	///< ꂽuԂtO
+	uint32_t buttons;		///< 押されている間フラグが立つ
+	uint32_t buttonDown;	///< 押された瞬間だけフラグが立つ
 };
\ No newline at end of file
@@ -0,0 +1,157 @@
+/**
+*	@file ImageFilter.cpp
+*/
+#include "ImageFilter.h"
+#include <algorithm>
+#include <vector>
+#include <string.h>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define IMAGEFILTER_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace ImageFilter {
+
+	namespace {
+
+		/**
+		*	2 行分の画素を要素ごとに 16 ビットで足し合わせる
+		*
+		*	@param row0		1 行目
+		*	@param row1		2 行目
+		*	@param sum		結果を格納する配列
+		*	@param bytes	1 行のバイト数
+		*/
+		void AddRows(const uint8_t* row0, const uint8_t* row1, uint16_t* sum, size_t bytes) {
+			size_t i = 0;
+#ifdef IMAGEFILTER_USE_SSE2
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 16 <= bytes; i += 16) {
+				const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + i));
+				const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + i));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(sum + i), _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(sum + i + 8), _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+			}
+#endif
+			for (; i < bytes; ++i) {
+				sum[i] = static_cast<uint16_t>(row0[i] + row1[i]);
+			}
+		}
+
+		/**
+		*	縦に足し合わせた行から、横に隣り合う 2 画素を平均した行を作る
+		*
+		*	@param sum			AddRows で作成した行
+		*	@param srcWidth		元の画像の幅
+		*	@param dst			結果を格納する行
+		*	@param dstWidth		縮小後の幅
+		*	@param pixelBytes	1 画素のバイト数
+		*
+		*	4 画素の合計に 2 を足して 4 で割ることで、四捨五入した平均を求める
+		*/
+		void AverageColumns(const uint16_t* sum, int srcWidth, uint8_t* dst, int dstWidth, int pixelBytes) {
+			int x = 0;
+#ifdef IMAGEFILTER_USE_SSE2
+			const __m128i bias = _mm_set1_epi16(2);
+			if (pixelBytes == 4 && srcWidth >= 2) {
+				//2 画素ずつ読み込み、上位 64 ビットと下位 64 ビットを足して 1 画素にする
+				for (; x + 2 <= dstWidth; x += 2) {
+					const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sum + x * 8));
+					const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sum + x * 8 + 8));
+					const __m128i s = _mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b));
+					const __m128i avg = _mm_srli_epi16(_mm_add_epi16(s, bias), 2);
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(avg, avg));
+				}
+			} else if (pixelBytes == 3 && srcWidth >= 2) {
+				//6 要素(2 画素)ずらして足し、下位 3 要素を 1 画素にする
+				//8 バイト書き込むので、行末の 2 画素は下のループで処理する
+				const __m128i lowMask = _mm_set_epi16(0, 0, 0, 0, 0, -1, -1, -1);
+				for (; x + 3 <= dstWidth && (x + 2) * 6 + 8 <= srcWidth * 3; x += 2) {
+					const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sum + x * 6));
+					const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sum + x * 6 + 6));
+					const __m128i sa = _mm_and_si128(_mm_add_epi16(a, _mm_srli_si128(a, 6)), lowMask);
+					const __m128i sb = _mm_slli_si128(_mm_and_si128(_mm_add_epi16(b, _mm_srli_si128(b, 6)), lowMask), 6);
+					const __m128i avg = _mm_srli_epi16(_mm_add_epi16(_mm_or_si128(sa, sb), bias), 2);
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 3), _mm_packus_epi16(avg, avg));
+				}
+			}
+#endif
+			for (; x < dstWidth; ++x) {
+				const int x0 = std::min(x * 2, srcWidth - 1) * pixelBytes;
+				const int x1 = std::min(x * 2 + 1, srcWidth - 1) * pixelBytes;
+				for (int c = 0; c < pixelBytes; ++c) {
+					dst[x * pixelBytes + c] = static_cast<uint8_t>((sum[x0 + c] + sum[x1 + c] + 2) >> 2);
+				}
+			}
+		}
+	}
+
+	/**
+	*	画像を縦横半分に縮小する(2x2 のボックスフィルタ)
+	*
+	*	@param src			元の画像
+	*	@param srcWidth		元の画像の幅
+	*	@param srcHeight	元の画像の高さ
+	*	@param srcRowBytes	元の画像の 1 行のバイト数
+	*	@param dst			縮小した画像を格納するバッファ
+	*	@param dstRowBytes	縮小した画像の 1 行のバイト数
+	*	@param pixelBytes	1 画素のバイト数(3 または 4)
+	*
+	*	縮小後の大きさは幅、高さとも半分(1 未満にはならない)
+	*	元の大きさが奇数の場合、最後の行と列は使われない
+	*/
+	void Downsample(const uint8_t* src, int srcWidth, int srcHeight, size_t srcRowBytes,
+		uint8_t* dst, size_t dstRowBytes, int pixelBytes) {
+		const int dstWidth = std::max(1, srcWidth / 2);
+		const int dstHeight = std::max(1, srcHeight / 2);
+		//SIMD で読み込む範囲が行末を越えないように余裕を持たせる
+		std::vector<uint16_t> sum(srcWidth * pixelBytes + 8);
+		for (int y = 0; y < dstHeight; ++y) {
+			const uint8_t* row0 = src + std::min(y * 2, srcHeight - 1) * srcRowBytes;
+			const uint8_t* row1 = src + std::min(y * 2 + 1, srcHeight - 1) * srcRowBytes;
+			AddRows(row0, row1, sum.data(), srcWidth * pixelBytes);
+			AverageColumns(sum.data(), srcWidth, dst + y * dstRowBytes, dstWidth, pixelBytes);
+		}
+	}
+
+	/**
+	*	4 バイト画素の要素を並べ替える
+	*
+	*	@param src			元の画素の配列
+	*	@param dst			並べ替えた画素を格納する配列(src と同じでもよい)
+	*	@param pixelCount	画素数
+	*	@param shift		出力する 4 要素のそれぞれについて、元の画素(リトルエンディアンの 32 ビット値)の何ビット目から取り出すか
+	*						負の値の要素は 255 にする
+	*
+	*	BMP のビットフィールドで指定された並びを BGRA に揃えるために使う
+	*/
+	void Swizzle32(const uint8_t* src, uint8_t* dst, size_t pixelCount, const int* shift) {
+		size_t i = 0;
+#ifdef IMAGEFILTER_USE_SSE2
+		const __m128i byteMask = _mm_set1_epi32(0xff);
+		__m128i constant = _mm_setzero_si128();
+		for (int c = 0; c < 4; ++c) {
+			if (shift[c] < 0) {
+				constant = _mm_or_si128(constant, _mm_set1_epi32(0xff << (c * 8)));
+			}
+		}
+		for (; i + 4 <= pixelCount; i += 4) {
+			const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+			__m128i result = constant;
+			for (int c = 0; c < 4; ++c) {
+				if (shift[c] >= 0) {
+					const __m128i e = _mm_and_si128(_mm_srl_epi32(v, _mm_cvtsi32_si128(shift[c])), byteMask);
+					result = _mm_or_si128(result, _mm_sll_epi32(e, _mm_cvtsi32_si128(c * 8)));
+				}
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), result);
+		}
+#endif
+		for (; i < pixelCount; ++i) {
+			const uint32_t v = src[i * 4] | (src[i * 4 + 1] << 8) | (src[i * 4 + 2] << 16) | (static_cast<uint32_t>(src[i * 4 + 3]) << 24);
+			for (int c = 0; c < 4; ++c) {
+				dst[i * 4 + c] = shift[c] < 0 ? 255 : static_cast<uint8_t>(v >> shift[c]);
+			}
+		}
+	}
+}
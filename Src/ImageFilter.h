@@ -0,0 +1,20 @@
+/**
+*	@file ImageFilter.h
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+*	画像の縮小フィルタ
+*
+*	ミップマップの作成と、読み込んだ画像の画素の並べ替えに使う
+*	SSE2 が使える環境では、行の加算と 4 バイト/3 バイト画素の平均を 16 ビットの SIMD 演算で行う
+*	4 バイト画素の並べ替えも 4 画素ずつ SIMD 演算で行う
+*	OpenGL を使わないので、ワーカースレッドから呼び出してもよい
+*/
+namespace ImageFilter {
+	void Downsample(const uint8_t* src, int srcWidth, int srcHeight, size_t srcRowBytes,
+		uint8_t* dst, size_t dstRowBytes, int pixelBytes);
+	void Swizzle32(const uint8_t* src, uint8_t* dst, size_t pixelCount, const int* shift);
+}
@@ -0,0 +1,180 @@
+/**
+*	@file InputLog.cpp
+*/
+#include "InputLog.h"
+#include <string.h>
+#include <sys/stat.h>
+#include <iostream>
+
+namespace InputLog {
+
+	namespace {
+
+		const char magic[4] = { 'I', 'P', 'L', 'G' };	///< ファイル識別子
+		const uint32_t version = 1;						///< ファイル形式のバージョン
+
+		/// フレームデータのフラグ
+		enum Flag : uint8_t {
+			Flag_GamePad = 0x01,	///< ゲームパッドの状態が変化した
+		};
+
+		/// ログファイルのヘッダ
+		struct Header {
+			char magic[4];
+			uint32_t version;
+			uint32_t seed;
+			uint32_t reserved;
+		};
+
+	}
+
+	/**
+	*	入力記録クラスを作成する
+	*
+	*	@param fileName	記録先のファイル名
+	*	@param seed		記録する乱数の種
+	*
+	*	@return 作成した記録クラスへのポインタ
+	*			作成に失敗した場合は nullptr
+	*/
+	RecorderPtr Recorder::Create(const char* fileName, uint32_t seed) {
+		struct Impl : Recorder { Impl() {} ~Impl() {} };
+		RecorderPtr p = std::make_shared<Impl>();
+		p->fp = fopen(fileName, "wb");
+		if (!p->fp) {
+			std::cerr << "ERROR: " << fileName << " を開けません" << std::endl;
+			return {};
+		}
+		Header header;
+		memcpy(header.magic, magic, sizeof(magic));
+		header.version = version;
+		header.seed = seed;
+		header.reserved = 0;
+		if (fwrite(&header, sizeof(header), 1, p->fp) != 1) {
+			std::cerr << "ERROR: " << fileName << " に書き込めません" << std::endl;
+			return {};
+		}
+		return p;
+	}
+
+	/**
+	*	デストラクタ
+	*/
+	Recorder::~Recorder() {
+		if (fp) {
+			fclose(fp);
+		}
+	}
+
+	/**
+	*	1 フレーム分の入力を記録する
+	*
+	*	@param delta	このフレームの経過時間(秒)
+	*	@param gamepad	このフレームのゲームパッドの状態
+	*
+	*	ゲームパッドの状態は前のフレームから変化した場合のみ記録する
+	*/
+	void Recorder::Write(double delta, const GamePad& gamepad) {
+		uint8_t buf[1 + sizeof(double) + sizeof(uint32_t) * 2];
+		uint8_t flags = 0;
+		if (frameCount == 0 || gamepad.buttons != prevGamePad.buttons || gamepad.buttonDown != prevGamePad.buttonDown) {
+			flags |= Flag_GamePad;
+		}
+		size_t size = 0;
+		buf[size++] = flags;
+		memcpy(buf + size, &delta, sizeof(double));
+		size += sizeof(double);
+		if (flags & Flag_GamePad) {
+			memcpy(buf + size, &gamepad.buttons, sizeof(uint32_t));
+			size += sizeof(uint32_t);
+			memcpy(buf + size, &gamepad.buttonDown, sizeof(uint32_t));
+			size += sizeof(uint32_t);
+		}
+		fwrite(buf, 1, size, fp);
+		prevGamePad = gamepad;
+		++frameCount;
+	}
+
+	/**
+	*	入力再生クラスを作成する
+	*
+	*	@param fileName	再生するログファイル名
+	*
+	*	@return 作成した再生クラスへのポインタ
+	*			作成に失敗した場合は nullptr
+	*/
+	PlayerPtr Player::Create(const char* fileName) {
+		struct stat st;
+		if (stat(fileName, &st)) {
+			std::cerr << "ERROR: " << fileName << " が見つかりません" << std::endl;
+			return {};
+		}
+		if (st.st_size < static_cast<long>(sizeof(Header))) {
+			std::cerr << "ERROR: " << fileName << " は入力ログではありません" << std::endl;
+			return {};
+		}
+		FILE* fp = fopen(fileName, "rb");
+		if (!fp) {
+			std::cerr << "ERROR: " << fileName << " を開けません" << std::endl;
+			return {};
+		}
+		std::vector<uint8_t> buf(st.st_size);
+		const size_t readSize = fread(buf.data(), 1, st.st_size, fp);
+		fclose(fp);
+		if (readSize != static_cast<size_t>(st.st_size)) {
+			std::cerr << "ERROR: " << fileName << " の読み込みに失敗" << std::endl;
+			return {};
+		}
+
+		Header header;
+		memcpy(&header, buf.data(), sizeof(header));
+		if (memcmp(header.magic, magic, sizeof(magic)) != 0) {
+			std::cerr << "ERROR: " << fileName << " は入力ログではありません" << std::endl;
+			return {};
+		}
+		if (header.version != version) {
+			std::cerr << "ERROR: " << fileName << " のバージョン(" << header.version << ")には対応していません" << std::endl;
+			return {};
+		}
+
+		struct Impl : Player { Impl() {} ~Impl() {} };
+		PlayerPtr p = std::make_shared<Impl>();
+		p->data.swap(buf);
+		p->position = sizeof(Header);
+		p->seed = header.seed;
+		return p;
+	}
+
+	/**
+	*	1 フレーム分の入力を読み込む
+	*
+	*	@param delta	このフレームの経過時間を格納する変数
+	*	@param gamepad	このフレームのゲームパッドの状態を格納する変数
+	*
+	*	@retval true	読み込み成功
+	*	@retval false	ログの終端に達した、またはログが壊れている
+	*/
+	bool Player::Read(double& delta, GamePad& gamepad) {
+		if (position + 1 + sizeof(double) > data.size()) {
+			position = data.size();
+			return false;
+		}
+		const uint8_t flags = data[position++];
+		memcpy(&delta, &data[position], sizeof(double));
+		position += sizeof(double);
+		if (flags & Flag_GamePad) {
+			if (position + sizeof(uint32_t) * 2 > data.size()) {
+				std::cerr << "WARNING: 入力ログが途中で終わっています" << std::endl;
+				position = data.size();
+				return false;
+			}
+			memcpy(&gamePad.buttons, &data[position], sizeof(uint32_t));
+			position += sizeof(uint32_t);
+			memcpy(&gamePad.buttonDown, &data[position], sizeof(uint32_t));
+			position += sizeof(uint32_t);
+		}
+		gamepad = gamePad;
+		++frameCount;
+		return true;
+	}
+}
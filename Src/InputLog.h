@@ -0,0 +1,72 @@
+/**
+*	@file InputLog.h
+*/
+#pragma once
+#include "GamePad.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include <memory>
+
+/**
+*	入力の記録と再生
+*
+*	フレーム毎のゲームパッドの状態と経過時間、乱数の種をバイナリ形式で記録する
+*	同じログを再生すれば、ゲームの状態更新は記録時とビット単位で一致する
+*
+*	ファイル形式(リトルエンディアン):
+*		ヘッダ	: magic "IPLG", バージョン(uint32), 乱数の種(uint32), 予約(uint32)
+*		フレーム: フラグ(uint8), 経過時間(double)
+*				  フラグに Flag_GamePad が立っていれば buttons(uint32), buttonDown(uint32) が続く
+*/
+namespace InputLog {
+
+	class Recorder;
+	class Player;
+	typedef std::shared_ptr<Recorder> RecorderPtr;	///< 記録クラスのポインタ
+	typedef std::shared_ptr<Player> PlayerPtr;		///< 再生クラスのポインタ
+
+	/**
+	*	入力を記録するクラス
+	*/
+	class Recorder {
+	public:
+		static RecorderPtr Create(const char* fileName, uint32_t seed);
+		void Write(double delta, const GamePad& gamepad);
+		size_t FrameCount() const { return frameCount; }
+
+	private:
+		Recorder() = default;
+		~Recorder();
+		Recorder(const Recorder&) = delete;
+		Recorder& operator=(const Recorder&) = delete;
+
+		FILE* fp = nullptr;
+		GamePad prevGamePad = {};
+		size_t frameCount = 0;
+	};
+
+	/**
+	*	記録した入力を再生するクラス
+	*/
+	class Player {
+	public:
+		static PlayerPtr Create(const char* fileName);
+		bool Read(double& delta, GamePad& gamepad);
+		bool IsEnd() const { return position >= data.size(); }
+		uint32_t Seed() const { return seed; }
+		size_t FrameCount() const { return frameCount; }
+
+	private:
+		Player() = default;
+		~Player() = default;
+		Player(const Player&) = delete;
+		Player& operator=(const Player&) = delete;
+
+		std::vector<uint8_t> data;
+		size_t position = 0;
+		uint32_t seed = 0;
+		GamePad gamePad = {};
+		size_t frameCount = 0;
+	};
+}
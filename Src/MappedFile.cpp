@@ -0,0 +1,102 @@
+/**
+*	@file MappedFile.cpp
+*/
+#include "MappedFile.h"
+#include <iostream>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/**
+*	ファイルをメモリに割り当てる
+*
+*	@param fileName	ファイル名
+*
+*	@return 作成したメモリマップトファイルへのポインタ
+*			ファイルを開けなかった場合は nullptr
+*
+*	サイズ 0 のファイルは Data() が nullptr を返す
+*/
+MappedFilePtr MappedFile::Open(const char* fileName) {
+	struct Impl : MappedFile { Impl() {} ~Impl() {} };
+	MappedFilePtr p = std::make_shared<Impl>();
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE) {
+		return {};
+	}
+	p->file = hFile;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(hFile, &fileSize)) {
+		std::cerr << "ERROR: " << fileName << " のサイズを取得できません" << std::endl;
+		return {};
+	}
+	p->size = static_cast<size_t>(fileSize.QuadPart);
+	if (p->size == 0) {
+		return p;
+	}
+	HANDLE hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!hMapping) {
+		std::cerr << "ERROR: " << fileName << " のマッピングに失敗" << std::endl;
+		return {};
+	}
+	p->mapping = hMapping;
+	p->data = static_cast<const uint8_t*>(MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0));
+	if (!p->data) {
+		std::cerr << "ERROR: " << fileName << " のマッピングに失敗" << std::endl;
+		return {};
+	}
+#else
+	p->fd = open(fileName, O_RDONLY);
+	if (p->fd < 0) {
+		return {};
+	}
+	struct stat st;
+	if (fstat(p->fd, &st)) {
+		std::cerr << "ERROR: " << fileName << " のサイズを取得できません" << std::endl;
+		return {};
+	}
+	p->size = static_cast<size_t>(st.st_size);
+	if (p->size == 0) {
+		return p;
+	}
+	void* addr = mmap(nullptr, p->size, PROT_READ, MAP_PRIVATE, p->fd, 0);
+	if (addr == MAP_FAILED) {
+		std::cerr << "ERROR: " << fileName << " のマッピングに失敗" << std::endl;
+		return {};
+	}
+	p->data = static_cast<const uint8_t*>(addr);
+#endif
+	return p;
+}
+
+/**
+*	デストラクタ
+*/
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+	if (data) {
+		UnmapViewOfFile(data);
+	}
+	if (mapping) {
+		CloseHandle(mapping);
+	}
+	if (file) {
+		CloseHandle(file);
+	}
+#else
+	if (data) {
+		munmap(const_cast<uint8_t*>(data), size);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+#endif
+}
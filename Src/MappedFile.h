@@ -0,0 +1,39 @@
+/**
+*	@file MappedFile.h
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <memory>
+
+class MappedFile;
+typedef std::shared_ptr<MappedFile> MappedFilePtr;	///< メモリマップトファイルポインタ型
+
+/**
+*	読み取り専用のメモリマップトファイル
+*
+*	ファイルの内容をコピーせずにアドレス空間へ割り当てる
+*	割り当てたメモリはオブジェクトの破棄と同時に解放される
+*/
+class MappedFile {
+public:
+	static MappedFilePtr Open(const char* fileName);
+	const uint8_t* Data() const { return data; }
+	size_t Size() const { return size; }
+
+private:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+	const uint8_t* data = nullptr;	///< 割り当てたメモリの先頭アドレス
+	size_t size = 0;				///< ファイルのバイト数
+#ifdef _WIN32
+	void* file = nullptr;			///< ファイルハンドル
+	void* mapping = nullptr;		///< ファイルマッピングハンドル
+#else
+	int fd = -1;					///< ファイル記述子
+#endif
+};
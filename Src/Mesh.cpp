@@ -1,26 +1,226 @@
 #include "Mesh.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "NativeFbx.h"
+#include "Arena.h"
+#include "GLState.h"
 #include <fbxsdk.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <ctype.h>
+#include <float.h>
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <thread>
 
 /**
-*	ff[^Ǘ̂߂̖O
+*	モデルデータ管理のための名前空間
 */
 namespace Mesh {
-	///_f[^
+	///頂点データ数
 	struct Vertex {
-		glm::vec3 position;	///W
-		glm::vec4 color;	///F
-		glm::vec2 texCoord;	///eNX`W
-		glm::vec3 normal;	///@
+		glm::vec3 position;	///座標
+		glm::vec4 color;	///色
+		glm::vec2 texCoord;	///テクスチャ座標
+		glm::vec3 normal;	///法線
 	};
 
 	/**
-	* Vertex Buffer Object 쐬
+	*	GPU に転送する圧縮した頂点データ
 	*
-	* @param size _f[^̃TCY
-	* @param data _f[^ւ̃|C^
+	*	読み込み時は Vertex で計算し、キャッシュ作成時にこの形式に変換する
+	*	Vertex の 48 バイトに対して 24 バイトなので、同じ大きさの VBO に 2 倍の頂点を格納できる
+	*/
+	struct PackedVertex {
+		glm::vec3 position;		///座標
+		uint8_t color[4];		///色(RGBA 各 8 ビットの正規化整数)
+		uint16_t texCoord[2];	///テクスチャ座標(半精度浮動小数点数)
+		uint32_t normal;		///法線(10:10:10:2 の符号付き正規化整数)
+	};
+
+	/**
+	*	頂点アトリビュートの定義
+	*/
+	struct VertexAttribute {
+		GLuint index;			///頂点アトリビュートのインデックス
+		GLint size;				///要素数
+		GLenum type;			///要素の型
+		GLboolean normalized;	///整数を [0, 1] または [-1, 1] に正規化するなら GL_TRUE
+		size_t offset;			///頂点データ先頭からのバイトオフセット
+	};
+
+	///PackedVertex の頂点レイアウト
+	const VertexAttribute packedVertexLayout[] = {
+		{ 0, 3, GL_FLOAT, GL_FALSE, offsetof(PackedVertex, position) },
+		{ 1, 4, GL_UNSIGNED_BYTE, GL_TRUE, offsetof(PackedVertex, color) },
+		{ 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, texCoord) },
+		{ 3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(PackedVertex, normal) },
+	};
+
+	/**
+	*	float を半精度浮動小数点数に変換する(最近接偶数丸め)
+	*
+	*	@param f	変換する値
+	*
+	*	@return 半精度浮動小数点数のビット列
+	*/
+	uint16_t ToHalf(float f) {
+		uint32_t x;
+		memcpy(&x, &f, sizeof(x));
+		const uint32_t sign = (x >> 16) & 0x8000;
+		const uint32_t biasedExponent = (x >> 23) & 0xff;
+		uint32_t mantissa = x & 0x7fffff;
+		if (biasedExponent == 0xff) {
+			return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+		}
+		const int exponent = static_cast<int>(biasedExponent) - 127 + 15;
+		if (exponent >= 31) {
+			return static_cast<uint16_t>(sign | 0x7c00);
+		}
+		if (exponent <= 0) {
+			//非正規化数
+			if (exponent < -10) {
+				return static_cast<uint16_t>(sign);
+			}
+			mantissa |= 0x800000;
+			const int shift = 14 - exponent;
+			uint32_t half = mantissa >> shift;
+			const uint32_t rest = mantissa & ((1u << shift) - 1);
+			const uint32_t halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (half & 1))) {
+				++half;
+			}
+			return static_cast<uint16_t>(sign | half);
+		}
+		uint32_t half = (exponent << 10) | (mantissa >> 13);
+		const uint32_t rest = mantissa & 0x1fff;
+		if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+			++half;	//仮数部からの桁上がりは指数部に繰り上がる
+		}
+		return static_cast<uint16_t>(sign | half);
+	}
+
+	/**
+	*	[0, 1] の値を 8 ビットの正規化整数に変換する
+	*/
+	uint8_t ToUnorm8(float f) {
+		return static_cast<uint8_t>(glm::clamp(f, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	/**
+	*	[-1, 1] の値を 10 ビットの符号付き正規化整数に変換する
+	*/
+	uint32_t ToSnorm10(float f) {
+		const int i = static_cast<int>(floorf(glm::clamp(f, -1.0f, 1.0f) * 511.0f + 0.5f));
+		return static_cast<uint32_t>(i) & 0x3ff;
+	}
+
+	/**
+	*	頂点データを GPU 用の形式に圧縮する
+	*
+	*	@param v	圧縮する頂点データ
+	*
+	*	@return 圧縮した頂点データ
+	*/
+	PackedVertex PackVertex(const Vertex& v) {
+		PackedVertex p;
+		p.position = v.position;
+		p.color[0] = ToUnorm8(v.color.r);
+		p.color[1] = ToUnorm8(v.color.g);
+		p.color[2] = ToUnorm8(v.color.b);
+		p.color[3] = ToUnorm8(v.color.a);
+		p.texCoord[0] = ToHalf(v.texCoord.x);
+		p.texCoord[1] = ToHalf(v.texCoord.y);
+		p.normal = ToSnorm10(v.normal.x) | (ToSnorm10(v.normal.y) << 10) | (ToSnorm10(v.normal.z) << 20);
+		return p;
+	}
+
+	/**
+	*	半精度浮動小数点数を float に変換する
+	*/
+	float FromHalf(uint16_t h) {
+		const int exponent = (h >> 10) & 0x1f;
+		const int mantissa = h & 0x3ff;
+		float f;
+		if (exponent == 0) {
+			f = ldexpf(static_cast<float>(mantissa), -24);
+		} else if (exponent == 31) {
+			f = mantissa ? NAN : INFINITY;
+		} else {
+			f = ldexpf(static_cast<float>(mantissa | 0x400), exponent - 25);
+		}
+		return (h & 0x8000) ? -f : f;
+	}
+
+	/**
+	*	10 ビットの符号付き正規化整数を float に変換する
+	*/
+	float FromSnorm10(uint32_t i) {
+		const int value = (i & 0x200) ? static_cast<int>(i & 0x3ff) - 0x400 : static_cast<int>(i & 0x3ff);
+		return glm::max(static_cast<float>(value) / 511.0f, -1.0f);
+	}
+
+	/**
+	*	頂点の圧縮誤差が許容範囲内か調べる
+	*
+	*	@param v	圧縮前の頂点データ
+	*	@param p	圧縮後の頂点データ
+	*
+	*	@retval true	全ての要素が許容範囲内
+	*	@retval false	許容範囲を超える要素がある
+	*
+	*	許容誤差は色が 1/510、テクスチャ座標が値の 2^-11 倍、法線が各成分 1/511
+	*/
+	bool CheckPackedVertex(const Vertex& v, const PackedVertex& p) {
+		const float eps = 1e-6f;
+		const float color[] = { v.color.r, v.color.g, v.color.b, v.color.a };
+		for (int i = 0; i < 4; ++i) {
+			if (fabsf(glm::clamp(color[i], 0.0f, 1.0f) - p.color[i] / 255.0f) > 0.5f / 255.0f + eps) {
+				return false;
+			}
+		}
+		const float texCoord[] = { v.texCoord.x, v.texCoord.y };
+		for (int i = 0; i < 2; ++i) {
+			if (fabsf(texCoord[i] - FromHalf(p.texCoord[i])) > fabsf(texCoord[i]) * (1.0f / 2048.0f) + 1e-7f) {
+				return false;
+			}
+		}
+		const float normal[] = { v.normal.x, v.normal.y, v.normal.z };
+		for (int i = 0; i < 3; ++i) {
+			if (fabsf(glm::clamp(normal[i], -1.0f, 1.0f) - FromSnorm10(p.normal >> (i * 10))) > 1.0f / 511.0f + eps) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	*	圧縮した頂点データを元の形式に戻す
+	*
+	*	@param p	圧縮した頂点データ
 	*
-	* @return 쐬 VBO
+	*	@return 展開した頂点データ(GPU が頂点シェーダに渡す値と同じ)
+	*/
+	Vertex UnpackVertex(const PackedVertex& p) {
+		Vertex v;
+		v.position = p.position;
+		v.color = glm::vec4(p.color[0], p.color[1], p.color[2], p.color[3]) * (1.0f / 255.0f);
+		v.texCoord = glm::vec2(FromHalf(p.texCoord[0]), FromHalf(p.texCoord[1]));
+		v.normal = glm::vec3(FromSnorm10(p.normal), FromSnorm10(p.normal >> 10), FromSnorm10(p.normal >> 20));
+		return v;
+	}
+
+	/**
+	* Vertex Buffer Object を作成する
+	*
+	* @param size 頂点データのサイズ
+	* @param data 頂点データへのポインタ
+	*
+	* @return 作成した VBO
 	*/
 	GLuint CreateVBO(GLsizeiptr size, const GLvoid* data) {
 		GLuint vbo = 0;
@@ -32,12 +232,12 @@ namespace Mesh {
 	}
 
 	/**
-	*	Index Buffer Object 쐬
+	*	Index Buffer Object を作成する
 	*
-	*	@param size CfbNXf[^̃TCY
-	*	@param data CfbNXf[^ւ̃|C^
+	*	@param size インデックスデータのサイズ
+	*	@param data インデックスデータへのポインタ
 	*
-	*	@return 쐬 IBO
+	*	@return 作成した IBO
 	*/
 	GLuint CreateIBO(GLsizeiptr size, const GLvoid* data) {
 		GLuint ibo = 0;
@@ -49,50 +249,43 @@ namespace Mesh {
 	}
 
 	/**
-	* _Agr[gݒ肷
+	* 頂点レイアウトに従って頂点アトリビュートを設定する
 	*
-	* @param index	_Agr[g̃CfbNX
-	* @param cls	_f[^^
-	* @param mbr	_Agr[gɐݒ肷 cls ̃oϐ
+	* @param layout	頂点アトリビュートの配列
+	* @param stride	頂点データ 1 個のバイト数
 	*/
-#define SetVertexAttribPointer(index, cls, mbr) SetVertexAttribpointerI( \
-	index,	\
-	sizeof(cls::mbr) / sizeof(float),	\
-	sizeof(cls),	\
-	reinterpret_cast<GLvoid*>(offsetof(cls, mbr)))
-
-	void SetVertexAttribpointerI(GLuint index, GLint size, GLsizei stride, const GLvoid* pointer) {
-		glEnableVertexAttribArray(index);
-		glVertexAttribPointer(index, size, GL_FLOAT, GL_FALSE, stride, pointer);
+	template<size_t N>
+	void SetVertexLayout(const VertexAttribute(&layout)[N], GLsizei stride) {
+		for (const VertexAttribute& e : layout) {
+			glEnableVertexAttribArray(e.index);
+			glVertexAttribPointer(e.index, e.size, e.type, e.normalized, stride, reinterpret_cast<GLvoid*>(e.offset));
+		}
 	}
 
 	/**
-	* Vertex Array Object 쐬
+	* Vertex Array Object を作成する
 	*
-	* @param vbo VAOɊ֘At VBO
+	* @param vbo VAOに関連付けられる VBO
 	*
-	* @return 쐬 VAO
+	* @return 作成した VAO
 	*/
 	GLuint CreateVAO(GLuint vbo, GLuint ibo) {
 		GLuint vao = 0;
 		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
+		GLState::BindVertexArray(vao);
 		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		SetVertexAttribPointer(0, Vertex, position);
-		SetVertexAttribPointer(1, Vertex, color);
-		SetVertexAttribPointer(2, Vertex, texCoord);
-		SetVertexAttribPointer(3, Vertex, normal);
+		SetVertexLayout(packedVertexLayout, sizeof(PackedVertex));
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-		glBindVertexArray(0);
+		GLState::BindVertexArray(0);
 		return vao;
 	}
 
 	/**
-	*	FBX xNg glm xNgɕϊ
+	*	FBX ベクトルを glm ベクトルに変換する
 	*
-	*	@param fbxVec	FBX xNg
+	*	@param fbxVec	FBX ベクトル
 	*
-	*	@return glm		glm xNg
+	*	@return glm		glm ベクトル
 	*/
 	template<typename T>
 	glm::vec4 Tovec4(const T& fbxVec) {
@@ -110,7 +303,7 @@ namespace Mesh {
 	}
 
 	/**
-	*	FBX IuWFNgjׂ̃wp[\
+	*	FBX オブジェクトを破棄する為のヘルパー構造体
 	*/
 	template<typename T>
 	struct Deleter{
@@ -118,122 +311,521 @@ namespace Mesh {
 	};
 
 	/**
-	*	}eẢf[^
+	*	頂点データのハッシュ値を計算する関数オブジェクト
+	*
+	*	Vertex は float だけで構成され、パディングを含まないのでバイト列として扱う
+	*/
+	struct VertexHash {
+		size_t operator()(const Vertex& v) const {
+			const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+			uint64_t hash = 14695981039346656037ULL;
+			for (size_t i = 0; i < sizeof(Vertex); ++i) {
+				hash ^= p[i];
+				hash *= 1099511628211ULL;
+			}
+			return static_cast<size_t>(hash);
+		}
+	};
+
+	/**
+	*	頂点データを比較する関数オブジェクト
+	*/
+	struct VertexEqual {
+		bool operator()(const Vertex& a, const Vertex& b) const {
+			return memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+
+	/**
+	*	マテリアルの仮データ
 	*/
 	struct TemporaryMaterial{
 		glm::vec4 color = glm::vec4(1);
 		std::vector<uint32_t> indexBuffer;
 		std::vector<Vertex> vertexBuffer;
 		std::vector<std::string> textureName;
+		std::vector<std::vector<uint32_t>> lodIndexBuffer;	///LOD 1 以降のインデックス(頂点は indexBuffer と共用)
+		std::vector<MeshOptimizer::TriangleCluster> clusterList;	///LOD 0 のクラスタ(空ならマテリアル全体を描画する)
 	};
 
 	/**
-	*	bV̉f[^
+	*	メッシュの仮データ
 	*/
 	struct TemporaryMesh {
 		std::string name;
 		std::vector<TemporaryMaterial> materialList;
+		size_t lodCount = 1;	///LOD 0 を含む詳細度の段階数
+	};
+
+	///アリーナに置く、頂点からその番号への対応表
+	typedef std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual, ArenaAllocator<std::pair<const Vertex, uint32_t>>> ArenaVertexMap;
+
+	/**
+	*	頂点の重複を取り除きながら仮マテリアルを作るための一時データ
+	*
+	*	対応表と頂点配列はアリーナに置き、三角形の頂点数で予約しておくので変換中に再確保されない
+	*	変換が終わったら Finish で仮マテリアルに必要な分だけ複製する
+	*/
+	struct MaterialBuilder {
+		MaterialBuilder(Arena& arena, size_t cornerCount) : vertexMap(0, VertexHash(), VertexEqual(), ArenaVertexMap::allocator_type(arena)), vertexList(ArenaAllocator<Vertex>(arena)) {
+			vertexMap.reserve(cornerCount);
+			vertexList.reserve(cornerCount);
+		}
+
+		/**
+		*	頂点を追加する
+		*
+		*	同じ値の頂点が既にあれば、そのインデックスを再利用する
+		*/
+		void Add(TemporaryMaterial& material, const Vertex& v) {
+			const auto result = vertexMap.insert(std::make_pair(v, static_cast<uint32_t>(vertexList.size())));
+			if (result.second) {
+				vertexList.push_back(v);
+			}
+			material.indexBuffer.push_back(result.first->second);
+		}
+
+		void Finish(TemporaryMaterial& material) const {
+			material.vertexBuffer.assign(vertexList.begin(), vertexList.end());
+		}
+
+		ArenaVertexMap vertexMap;
+		std::vector<Vertex, ArenaAllocator<Vertex>> vertexList;
 	};
 
 	/**
-	*	FBX f[^𒆊ԃf[^ɕϊNX
+	*	メッシュの変換に使うアリーナの大きさを見積もる
+	*
+	*	@param cornerCount			三角形の頂点の総数
+	*	@param controlPointCount	コントロールポイントの数
+	*
+	*	@return 一時データが 1 ブロックに収まるバイト数
+	*
+	*	対応表のノードとバケットの大きさは実装によって異なるので、ポインタ 3 個分の余裕をみておく
+	*/
+	size_t EstimateArenaBytes(size_t cornerCount, size_t controlPointCount) {
+		const size_t nodeBytes = sizeof(std::pair<const Vertex, uint32_t>) + sizeof(void*) * 3;
+		return cornerCount * (sizeof(Vertex) + nodeBytes + sizeof(void*) * 2) + controlPointCount * sizeof(glm::vec3) + 4096;
+	}
+
+	struct NativeMeshNode;
+
+	///変換の統計を出力するなら true(VerboseLog で設定する)
+	std::atomic<bool> isVerboseLog(false);
+	///組み込みの FBX パーサを使うなら true(--validate-fbx で FBX SDK と一致することを確認してから有効にする)
+	std::atomic<bool> isNativeFbxEnabled(false);
+
+	/**
+	*	FBX データを中間データに変換するクラス
 	*/
 	struct FbxLoader {
 		bool Load(const char* fileName);
+		bool Import(const char* fileName);
+		bool ImportWithSdk(const char* fileName);
+		bool ImportNative(const char* fileName);
 		bool Convert(FbxNode* node);
-		bool LoadMesh(FbxNode* node);
+		void CollectMeshNode(FbxNode* node);
+		bool LoadMesh(FbxNode* node, const FbxAMatrix& matTRS, TemporaryMesh& mesh);
+		bool LoadNativeMesh(const NativeMeshNode& node, const NativeFbx::Node* materialDefaults, TemporaryMesh& mesh);
+		void Optimize(const char* fileName);
+		void GenerateLod(const char* fileName);
+		void BuildClusters(const char* fileName);
+		void RecordArena(const Arena& arena);
+		void ReportMemory(const char* fileName) const;
 
+		///変換対象のノード
+		struct MeshNode {
+			FbxNode* node;		///メッシュを持つノード
+			FbxAMatrix matTRS;	///ノードのグローバル変換行列
+		};
+		std::vector<MeshNode> meshNodeList;
 		std::vector<TemporaryMesh> meshList;
+
+		///一時メモリの統計(メッシュは並列に変換されることがある)
+		std::atomic<size_t> arenaAllocationCount{ 0 };	///アリーナから切り出した回数
+		std::atomic<size_t> arenaBlockCount{ 0 };		///アリーナがヒープから確保した回数
+		std::atomic<size_t> arenaLiveBytes{ 0 };		///変換中のアリーナの合計バイト数
+		std::atomic<size_t> arenaPeakBytes{ 0 };		///arenaLiveBytes の最大値
+
+		bool isVerbose = isVerboseLog;	///メモリ使用量、最適化、LOD、クラスタの統計を出力するなら true
 	};
 
+	///FBX SDK の読み込みを直列化するミューテックス
+	///SDK はスレッドセーフではないため、アセットを並列に変換するときも同時に 1 つのファイルしか読み込まない
+	std::mutex fbxSdkMutex;
+
+	///ノードを並列に変換する最小のポリゴン数
+	const int parallelConvertPolygonCount = 20000;
+	///配列プロパティを並列に展開する最小の要素数
+	const size_t parallelDecodeElementCount = 100000;
+
+	const size_t maxLodCount = 4;			///LOD 0 を含む詳細度の最大段階数
+	const float lodTriangleRatio = 0.5f;	///1 段階ごとに目標とする三角形数の割合
+	const float lodMinReduction = 0.8f;		///三角形数がこの割合より減らなければ LOD を打ち切る
+	const float lodBaseError = 0.01f;		///LOD 1 で許容する誤差(メッシュの大きさに対する割合、段階ごとに 2 倍)
+
+	const size_t clusterMaxTriangles = 96;	///1 クラスタの最大三角形数
+	const size_t clusterMinTriangles = 256;	///クラスタに分割するマテリアルの最小三角形数(Res の Toroid と Aircraft の LOD 0 が対象)
+
 	/**
-	*	FBX t@Cǂݍ
+	*	FBX ファイルを読み込む
 	*
-	*	@param fileName	FBX t@C
+	*	@param fileName	FBX ファイル名
 	*
-	*	@retval true	ǂݍݐ
-	*	@retval false	ǂݍݎs
+	*	@retval true	読み込み成功
+	*	@retval false	読み込み失敗
 	*/
 	bool FbxLoader::Load(const char* fileName) {
+		if (!Import(fileName)) {
+			return false;
+		}
+		Optimize(fileName);
+		GenerateLod(fileName);
+		BuildClusters(fileName);
+		return true;
+	}
+
+	/**
+	*	FBX ファイルを仮データに変換する
+	*
+	*	@param fileName	FBX ファイル名
+	*
+	*	@retval true	変換成功
+	*	@retval false	変換失敗
+	*
+	*	通常は FBX SDK で読み込む
+	*	NativeFbxParser で有効にした場合は、バイナリ形式のファイルを組み込みのパーサで読み込む
+	*	その場合も、テキスト形式のファイルや、パーサが扱えないファイルは FBX SDK で読み込む
+	*/
+	bool FbxLoader::Import(const char* fileName) {
+		if (!isNativeFbxEnabled || !ImportNative(fileName)) {
+			meshList.clear();
+			if (!ImportWithSdk(fileName)) {
+				return false;
+			}
+		}
+		if (isVerbose) {
+			ReportMemory(fileName);
+		}
+		return true;
+	}
+
+	/**
+	*	メッシュの変換に使ったアリーナを統計に加える
+	*
+	*	@param arena	変換に使ったアリーナ(破棄する直前に呼び出す)
+	*
+	*	並列に変換している間の最大使用量は、各メッシュの変換が終わった時点の合計で近似する
+	*/
+	void FbxLoader::RecordArena(const Arena& arena) {
+		arenaAllocationCount += arena.AllocationCount();
+		arenaBlockCount += arena.BlockCount();
+		const size_t live = arenaLiveBytes += arena.ReservedBytes();
+		size_t peak = arenaPeakBytes;
+		while (live > peak && !arenaPeakBytes.compare_exchange_weak(peak, live)) {
+		}
+		arenaLiveBytes -= arena.ReservedBytes();
+	}
+
+	/**
+	*	読み込みに使ったメモリの統計を出力する
+	*
+	*	@param fileName	結果表示用の FBX ファイル名
+	*
+	*	一時データはアリーナ、仮データは要素数どおりに予約した配列に置かれる
+	*	読み込み中の最大メモリ量はアリーナの最大使用量と仮データの合計になる
+	*/
+	void FbxLoader::ReportMemory(const char* fileName) const {
+		size_t bufferCount = 0;
+		size_t bufferBytes = 0;
+		for (const TemporaryMesh& mesh : meshList) {
+			for (const TemporaryMaterial& material : mesh.materialList) {
+				bufferCount += (material.indexBuffer.capacity() ? 1 : 0) + (material.vertexBuffer.capacity() ? 1 : 0);
+				bufferBytes += material.indexBuffer.capacity() * sizeof(uint32_t) + material.vertexBuffer.capacity() * sizeof(Vertex);
+			}
+		}
+		std::cout << fileName << ": 一時データ " << arenaAllocationCount << " 回(ヒープ " << arenaBlockCount << " 回, 最大 " <<
+			arenaPeakBytes / 1024 << "KB), 仮データ " << bufferCount << " 回(" << bufferBytes / 1024 << "KB), 最大 " <<
+			(arenaPeakBytes + bufferBytes) / 1024 << "KB" << std::endl;
+	}
+
+	/**
+	*	FBX SDK を使って FBX ファイルを仮データに変換する
+	*
+	*	@param fileName	FBX ファイル名
+	*
+	*	@retval true	変換成功
+	*	@retval false	変換失敗
+	*
+	*	複数のスレッドから呼び出された場合は、1 つずつ順番に読み込む
+	*/
+	bool FbxLoader::ImportWithSdk(const char* fileName) {
+		std::lock_guard<std::mutex> lock(fbxSdkMutex);
 		std::unique_ptr<FbxManager, Deleter<FbxManager>> fbxManager(FbxManager::Create());
 		if (!fbxManager) {
-			std::cerr << "ERROR: " << fileName << "̓ǂݍ݂Ɏs(fbxManager ̍쐬Ɏs)" << std::endl;
+			std::cerr << "ERROR: " << fileName << "の読み込みに失敗(fbxManager の作成に失敗)" << std::endl;
 			return false;
 		}
 
 		FbxScene* fbxScene = FbxScene::Create(fbxManager.get(), "");
 		if (!fbxScene) {
-			std::cerr << "ERROR: " << fileName << "̓ǂݍ݂Ɏs(fbxScene ̍쐬Ɏs)" << std::endl;
+			std::cerr << "ERROR: " << fileName << "の読み込みに失敗(fbxScene の作成に失敗)" << std::endl;
 			return false;
 		}else{
 			std::unique_ptr<FbxImporter, Deleter<FbxImporter>> fbxImporter(FbxImporter::Create(fbxManager.get(), ""));
 			const bool importStatus = fbxImporter->Initialize(fileName);
 			if (!importStatus || !fbxImporter->Import(fbxScene)) {
-				std::cerr << "ERROR: " << fileName << "̓ǂݍ݂Ɏs" << fbxImporter->GetStatus().GetErrorString() << std::endl;
+				std::cerr << "ERROR: " << fileName << "の読み込みに失敗" << fbxImporter->GetStatus().GetErrorString() << std::endl;
 				return false;
 			}
 		}
 		if (!Convert(fbxScene->GetRootNode())) {
-			std::cerr << "ERROR: " << fileName << "̕ϊɎs" << std::endl;
+			std::cerr << "ERROR: " << fileName << "の変換に失敗" << std::endl;
 			return false;
 		}
 		return true;
 	}
 
 	/**
-	*	FBX f[^f[^ɕϊ
+	*	仮データの三角形と頂点の順序を最適化する
+	*
+	*	@param fileName	結果表示用の FBX ファイル名
+	*
+	*	頂点キャッシュ、オーバードロー、頂点フェッチの順に最適化し
+	*	最適化前後の ACMR と ATVR を出力する
+	*/
+	void FbxLoader::Optimize(const char* fileName) {
+		size_t triangleCount = 0;
+		size_t vertexCount = 0;
+		size_t transformedBefore = 0;
+		size_t transformedAfter = 0;
+		for (TemporaryMesh& mesh : meshList) {
+			for (TemporaryMaterial& material : mesh.materialList) {
+				std::vector<uint32_t>& indices = material.indexBuffer;
+				std::vector<Vertex>& vertices = material.vertexBuffer;
+				if (indices.empty()) {
+					continue;
+				}
+				transformedBefore += MeshOptimizer::AnalyzeVertexCache(indices, vertices.size()).vertexTransformed;
+				MeshOptimizer::OptimizeVertexCache(indices, vertices.size());
+				MeshOptimizer::OptimizeOverdraw(indices, &vertices[0].position, sizeof(Vertex), vertices.size());
+				std::vector<uint32_t> remap;
+				const size_t newVertexCount = MeshOptimizer::OptimizeVertexFetch(indices, remap, vertices.size());
+				MeshOptimizer::RemapVertices(vertices, remap, newVertexCount);
+				transformedAfter += MeshOptimizer::AnalyzeVertexCache(indices, vertices.size()).vertexTransformed;
+				triangleCount += indices.size() / 3;
+				vertexCount += vertices.size();
+			}
+		}
+		if (!isVerbose || triangleCount == 0 || vertexCount == 0) {
+			return;
+		}
+		std::cout << fileName << ": 三角形 " << triangleCount << ", 頂点 " << vertexCount <<
+			", ACMR " << static_cast<float>(transformedBefore) / triangleCount << " -> " << static_cast<float>(transformedAfter) / triangleCount <<
+			", ATVR " << static_cast<float>(transformedBefore) / vertexCount << " -> " << static_cast<float>(transformedAfter) / vertexCount << std::endl;
+	}
+
+	/**
+	*	仮データの詳細度(LOD)を段階的に下げたインデックスを作成する
+	*
+	*	@param fileName	結果表示用の FBX ファイル名
+	*
+	*	前の段階のインデックスを簡略化して、三角形数が約半分になる段階を maxLodCount まで作る
+	*	三角形数が十分に減らなくなった段階で打ち切る
+	*	頂点は全段階で共用するので、増えるのはインデックスデータだけ
+	*/
+	void FbxLoader::GenerateLod(const char* fileName) {
+		for (TemporaryMesh& mesh : meshList) {
+			size_t prevTriangles = 0;
+			for (const TemporaryMaterial& material : mesh.materialList) {
+				prevTriangles += material.indexBuffer.size() / 3;
+			}
+			if (prevTriangles == 0) {
+				continue;
+			}
+			if (isVerbose) {
+				std::cout << fileName << ": " << mesh.name << " LOD 0 三角形 " << prevTriangles;
+			}
+			float maxError = lodBaseError;
+			for (size_t lod = 1; lod < maxLodCount; ++lod, maxError *= 2.0f) {
+				size_t triangles = 0;
+				float error = 0.0f;
+				std::vector<std::vector<uint32_t>> lodList(mesh.materialList.size());
+				for (size_t i = 0; i < mesh.materialList.size(); ++i) {
+					const TemporaryMaterial& material = mesh.materialList[i];
+					lodList[i] = lod == 1 ? material.indexBuffer : material.lodIndexBuffer.back();
+					if (lodList[i].empty()) {
+						continue;
+					}
+					const size_t target = static_cast<size_t>(lodList[i].size() / 3 * lodTriangleRatio) * 3;
+					error = std::max(error, MeshOptimizer::SimplifyMesh(lodList[i], &material.vertexBuffer[0].position, sizeof(Vertex),
+						material.vertexBuffer.size(), target, maxError));
+					MeshOptimizer::OptimizeVertexCache(lodList[i], material.vertexBuffer.size());
+					triangles += lodList[i].size() / 3;
+				}
+				if (triangles == 0 || triangles > prevTriangles * lodMinReduction) {
+					break;
+				}
+				for (size_t i = 0; i < mesh.materialList.size(); ++i) {
+					mesh.materialList[i].lodIndexBuffer.push_back(std::move(lodList[i]));
+				}
+				mesh.lodCount = lod + 1;
+				prevTriangles = triangles;
+				if (isVerbose) {
+					std::cout << ", LOD " << lod << " 三角形 " << triangles << "(誤差 " << error << ")";
+				}
+			}
+			if (isVerbose) {
+				std::cout << std::endl;
+			}
+		}
+	}
+
+	/**
+	*	仮データの LOD 0 のインデックスをカリング用のクラスタに分割する
+	*
+	*	@param fileName	結果表示用の FBX ファイル名
+	*
+	*	三角形数が clusterMinTriangles 以上のマテリアルだけを分割する
+	*	小さいメッシュはクラスタ単位で描画しても減らせる三角形が少なく、描画命令が増えるだけなので分割しない
+	*/
+	void FbxLoader::BuildClusters(const char* fileName) {
+		size_t clusterCount = 0;
+		size_t triangleCount = 0;
+		for (TemporaryMesh& mesh : meshList) {
+			for (TemporaryMaterial& material : mesh.materialList) {
+				if (material.indexBuffer.size() / 3 < clusterMinTriangles) {
+					continue;
+				}
+				MeshOptimizer::BuildClusters(material.indexBuffer, &material.vertexBuffer[0].position, sizeof(Vertex),
+					material.vertexBuffer.size(), clusterMaxTriangles, material.clusterList);
+				clusterCount += material.clusterList.size();
+				triangleCount += material.indexBuffer.size() / 3;
+			}
+		}
+		if (isVerbose && clusterCount) {
+			std::cout << fileName << ": クラスタ " << clusterCount << "(三角形 " << triangleCount << ")" << std::endl;
+		}
+	}
+
+	/**
+	*	処理を複数のスレッドで分担して実行する
+	*
+	*	@param count	処理の数
+	*	@param func		処理番号(0 ~ count - 1)を受け取り、成功なら true を返す関数
+	*
+	*	@retval true	全ての処理が成功
+	*	@retval false	失敗した処理がある
+	*/
+	template<typename F>
+	bool ParallelFor(size_t count, F func) {
+		const size_t threadCount = std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+		std::atomic<size_t> next(0);
+		std::atomic<bool> result(true);
+		std::vector<std::future<void>> workers;
+		workers.reserve(threadCount);
+		for (size_t i = 0; i < threadCount; ++i) {
+			workers.push_back(std::async(std::launch::async, [count, &func, &next, &result]() {
+				for (size_t n = next++; n < count; n = next++) {
+					if (!func(n)) {
+						result = false;
+					}
+				}
+			}));
+		}
+		for (auto& e : workers) {
+			e.get();
+		}
+		return result;
+	}
+
+	/**
+	*	FBX データを仮データに変換する
 	*
-	*	@param fbxNode	ϊ FBX m[hւ̃|C^
+	*	@param fbxNode	変換する FBX ノードへのポインタ
 	*
-	*	@retval true	ϊ
-	*	@retval false	ϊs
+	*	@retval true	変換成功
+	*	@retval false	変換失敗
 	*/
 	bool FbxLoader::Convert(FbxNode* fbxNode) {
-		if (!fbxNode) {
+		meshNodeList.clear();
+		CollectMeshNode(fbxNode);
+		meshList.resize(meshNodeList.size());
+
+		int polygonCount = 0;
+		for (const MeshNode& e : meshNodeList) {
+			polygonCount += e.node->GetMesh()->GetPolygonCount();
+		}
+		if (meshNodeList.size() <= 1 || polygonCount < parallelConvertPolygonCount) {
+			for (size_t i = 0; i < meshNodeList.size(); ++i) {
+				if (!LoadMesh(meshNodeList[i].node, meshNodeList[i].matTRS, meshList[i])) {
+					return false;
+				}
+			}
 			return true;
 		}
-		if (!LoadMesh(fbxNode)) {
-			return false;
+
+		//大きなシーンはノード単位で並列に変換する
+		//@note 各スレッドはシーンを読み取るだけで、変換行列の評価は CollectMeshNode で済ませてある
+		return ParallelFor(meshNodeList.size(), [this](size_t n) {
+			return LoadMesh(meshNodeList[n].node, meshNodeList[n].matTRS, meshList[n]);
+		});
+	}
+
+	/**
+	*	メッシュを持つノードを列挙する
+	*
+	*	@param fbxNode	列挙を開始する FBX ノードへのポインタ
+	*
+	*	ノードのグローバル変換行列もここで計算しておく
+	*	EvaluateGlobalTransform はシーンの評価キャッシュを更新するため、並列に呼び出せない
+	*/
+	void FbxLoader::CollectMeshNode(FbxNode* fbxNode) {
+		if (!fbxNode) {
+			return;
+		}
+		if (fbxNode->GetMesh()) {
+			meshNodeList.push_back(MeshNode{ fbxNode, fbxNode->EvaluateGlobalTransform() });
 		}
 		const int childeCount = fbxNode->GetChildCount();
 		for (int i = 0; i < childeCount; ++i) {
-			if (!Convert(fbxNode->GetChild(i))) {
-				return false;
-			}
+			CollectMeshNode(fbxNode->GetChild(i));
 		}
-		return true;
 	}
 
 	/**
-	*	FBX bVf[^ɕϊ
+	*	FBX メッシュを仮データに変換する
 	*
-	*	@param fbxNode	ϊΏۂ FBX m[hւ̃|C^
+	*	@param fbxNode	変換対象の FBX ノードへのポインタ
+	*	@param matTRS	ノードのグローバル変換行列
+	*	@param mesh		変換したデータを格納する変数
 	*
-	*	@retval true	ϊ
-	*	@retval false	ϊs
+	*	@retval true	変換成功
+	*	@retval false	変換失敗
 	*/
-	bool FbxLoader::LoadMesh(FbxNode* fbxNode) {
+	bool FbxLoader::LoadMesh(FbxNode* fbxNode, const FbxAMatrix& matTRS, TemporaryMesh& mesh) {
 		FbxMesh* fbxMesh = fbxNode->GetMesh();
 		if (!fbxMesh) {
 			return true;
 		}
 
-		TemporaryMesh mesh;
 		mesh.name = fbxNode->GetName();
 
 		if (!fbxMesh->IsTriangleMesh()) {
-			std::cerr << "WARNING: " << mesh.name << "ɂ͎Op`ȊO̖ʂ܂܂Ă܂" << std::endl;
+			std::cerr << "WARNING: " << mesh.name << "には三角形以外の面が含まれています" << std::endl;
 		}
 
-		//}eAǂݎ
+		//マテリアル情報を読み取る
 		const int materialCount = fbxNode->GetMaterialCount();
 		mesh.materialList.reserve(materialCount);
 		for (int i = 0; i < materialCount; ++i) {
 			TemporaryMaterial material;
 			if (FbxSurfaceMaterial* fbxMaterial = fbxNode->GetMaterial(i)) {
-				//}eA̐Fǂݎ
-				const FbxClassId classId = fbxMaterial->GetClassId();
-				if (classId == FbxSurfaceLambert::ClassId || classId == FbxSurfacePhong::ClassId) {
+				//マテリアルの色情報を読み取る
+				//@note FBX SDK は遅延読み込みするため、DLL のデータシンボルである ClassId は参照できない
+				//		代わりにクラス名で判定する
+				const char* className = fbxMaterial->GetClassId().GetName();
+				if (strcmp(className, "FbxSurfaceLambert") == 0 || strcmp(className, "FbxSurfacePhong") == 0) {
 					const FbxSurfaceLambert* pLambert = static_cast<const FbxSurfaceLambert*>(fbxMaterial);
 					material.color = glm::vec4(Tovec3(pLambert->Diffuse.Get()), static_cast<float>(1.0f - pLambert->TransparencyFactor));
 				}
@@ -244,18 +836,18 @@ namespace Mesh {
 			mesh.materialList.push_back(TemporaryMaterial());
 		}
 
-		//_vf̗L𒲂ׂ
+		//頂点要素の有無を調べる
 		const bool hasColor = fbxMesh->GetElementVertexColorCount() > 0;
 		const bool hasTexCoord = fbxMesh->GetElementUVCount() > 0;
 		const bool hasNormal = fbxMesh->GetElementNormalCount() > 0;
 
-		// UV Zbg̃Xg擾
+		// UV セット名のリストを取得する
 		FbxStringList uvSetNameList;
 		fbxMesh->GetUVSetNames(uvSetNameList);
 
-		//Fǂݎ鏀
-		//@note W/ UV /@ȊÕp[^[ɂ͒ړǂݎ֐񋟂ĂȂ
-		//		uFbxGeometryErement ??vNXǂݎKv
+		//色情報を読み取る準備
+		//@note 座標/ UV /法線以外のパラメーターには直接読み取る関数が提供されていないため
+		//		「FbxGeometryErement ??」クラスから読み取る必要がある
 		FbxGeometryElement::EMappingMode colorMappingMode = FbxLayerElement::eNone;
 		bool isColorDirectRef = true;
 		const FbxLayerElementArrayTemplate<int>* colorIndexList = nullptr;
@@ -268,114 +860,1594 @@ namespace Mesh {
 			colorList = &fbxColorList->GetDirectArray();
 		}
 
-		//_ǂ̃}eAɑ邩}eACfbNXXg擾
+		//ポリゴンがどのマテリアルに属するかを示すマテリアルインデックスリストを取得する
+		//全ポリゴン共通(eAllSame)なら先頭の要素だけを使う
 		const FbxLayerElementArrayTemplate<int>* materialIndexList = nullptr;
+		bool isMaterialAllSame = false;
 		if (FbxGeometryElementMaterial* fbxMaterialLayer = fbxMesh->GetElementMaterial()) {
 			materialIndexList = &fbxMaterialLayer->GetIndexArray();
+			isMaterialAllSame = fbxMaterialLayer->GetMappingMode() == FbxLayerElement::eAllSame;
 		}
 
-		//|SɊÂāAf[^obt@̗eʂ\
+		//ポリゴンの属するマテリアル(範囲外なら最初のマテリアル)
+		const auto materialOf = [materialIndexList, isMaterialAllSame, &mesh](int polygonIndex) {
+			const int element = isMaterialAllSame ? 0 : polygonIndex;
+			if (!materialIndexList || element >= materialIndexList->GetCount()) {
+				return static_cast<size_t>(0);
+			}
+			const int materialIndex = (*materialIndexList)[element];
+			return materialIndex >= 0 && static_cast<size_t>(materialIndex) < mesh.materialList.size() ? static_cast<size_t>(materialIndex) : 0;
+		};
+
+		//マテリアル毎の三角形数を数える
+		//多角形は組み込みパーサと同じく、最初の頂点を共有する扇形の三角形に分割する
 		const int polygonCount = fbxMesh->GetPolygonCount();
-		for (auto& e : mesh.materialList) {
-			const size_t avarageCapacity = polygonCount / mesh.materialList.size();
-			e.indexBuffer.reserve(avarageCapacity);
-			e.vertexBuffer.reserve(avarageCapacity);
+		std::vector<size_t> triangleCountList(mesh.materialList.size(), 0);
+		size_t cornerTotal = 0;
+		for (int polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex) {
+			const int polygonSize = fbxMesh->GetPolygonSize(polygonIndex);
+			const size_t triangleCount = polygonSize >= 3 ? polygonSize - 2 : 0;
+			triangleCountList[materialOf(polygonIndex)] += triangleCount;
+			cornerTotal += triangleCount * 3;
 		}
 
-		const FbxAMatrix matTRS(fbxNode->EvaluateGlobalTransform());
+		//一時データは全てアリーナに置き、変換が終わったらまとめて解放する
+		const int controlPointCount = fbxMesh->GetControlPointsCount();
+		Arena arena(EstimateArenaBytes(cornerTotal, controlPointCount));
+
+		//コントロールポイントの座標は、あらかじめ全て変換しておく
 		const FbxAMatrix matR(FbxVector4(0, 0, 0), matTRS.GetR(), FbxVector4(1, 1, 1));
 		const FbxVector4* const fbxControlPoints = fbxMesh->GetControlPoints();
-		int polygonVertex = 0;
+		const ArenaAllocator<glm::vec3> positionAllocator(arena);
+		std::vector<glm::vec3, ArenaAllocator<glm::vec3>> positionList(positionAllocator);
+		positionList.reserve(controlPointCount);
+		for (int i = 0; i < controlPointCount; ++i) {
+			positionList.push_back(Tovec3(matTRS.MultT(fbxControlPoints[i])));
+		}
+
+		//インデックスと対応表の容量を三角形数どおりに予約する
+		//同じ値を持つ頂点を共有するため、マテリアル毎に頂点とインデックスの対応表を作る
+		std::vector<MaterialBuilder> builderList;
+		builderList.reserve(mesh.materialList.size());
+		for (size_t i = 0; i < mesh.materialList.size(); ++i) {
+			mesh.materialList[i].indexBuffer.reserve(triangleCountList[i] * 3);
+			builderList.emplace_back(arena, triangleCountList[i] * 3);
+		}
+
 		for (int polygonIndex = 0; polygonIndex < polygonCount; ++polygonIndex) {
-			for (int pos = 0; pos < 3; ++pos) {
-				Vertex v;
-				const int cpIndex = fbxMesh->GetPolygonVertex(polygonIndex, pos);
-
-				//_W
-				v.position = Tovec3(matTRS.MultT(fbxControlPoints[cpIndex]));
-
-				//_J[
-				v.color = glm::vec4(1);
-				if (hasColor) {
-					switch (colorMappingMode){
-					case fbxsdk::FbxLayerElement::eByControlPoint:
-						v.color = Tovec4((*colorList)[isColorDirectRef ? cpIndex : (*colorIndexList)[cpIndex]]);
-						break;
-					case fbxsdk::FbxLayerElement::eByPolygonVertex:
-						v.color = Tovec4((*colorList)[isColorDirectRef ? polygonVertex : (*colorIndexList)[polygonVertex]]);
-						break;
-					default:
-						break;
-					}
-				}
+			const int polygonSize = fbxMesh->GetPolygonSize(polygonIndex);
+			const int polygonBegin = fbxMesh->GetPolygonVertexIndex(polygonIndex);
+			const size_t materialIndex = materialOf(polygonIndex);
+			for (int k = 2; k < polygonSize; ++k) {
+				const int corners[3] = { 0, k - 1, k };
+				for (const int pos : corners) {
+					Vertex v;
+					const int cpIndex = fbxMesh->GetPolygonVertex(polygonIndex, pos);
+					const int polygonVertex = polygonBegin + pos;
 
-				// UV W
-				v.texCoord = glm::vec2(0);
-				if (hasTexCoord) {
-					FbxVector2 uv;
-					bool unmapped;
-					fbxMesh->GetPolygonVertexUV(polygonIndex, pos, uvSetNameList[0], uv, unmapped);
-					v.texCoord = Tovec2(uv);
-				}
+					//頂点座標
+					v.position = positionList[cpIndex];
+					//頂点カラー
+					v.color = glm::vec4(1);
+					if (hasColor) {
+						switch (colorMappingMode){
+						case fbxsdk::FbxLayerElement::eByControlPoint:
+							v.color = Tovec4((*colorList)[isColorDirectRef ? cpIndex : (*colorIndexList)[cpIndex]]);
+							break;
+						case fbxsdk::FbxLayerElement::eByPolygonVertex:
+							v.color = Tovec4((*colorList)[isColorDirectRef ? polygonVertex : (*colorIndexList)[polygonVertex]]);
+							break;
+						default:
+							break;
+						}
+					}
 
-				//@
-				v.normal = glm::vec3(0, 0, 1);
-				if (hasNormal) {
-					FbxVector4 normal;
-					fbxMesh->GetPolygonVertexNormal(polygonIndex, pos, normal);
-					v.normal = glm::normalize(Tovec3(matR.MultT(normal)));
-				}
+					// UV 座標
+					v.texCoord = glm::vec2(0);
+					if (hasTexCoord) {
+						FbxVector2 uv;
+						bool unmapped;
+						fbxMesh->GetPolygonVertexUV(polygonIndex, pos, uvSetNameList[0], uv, unmapped);
+						v.texCoord = Tovec2(uv);
+					}
 
-				//_ɑΉ鉼}eAɁA_f[^ƃCfbNXf[^ǉ
-				TemporaryMaterial& materialData = mesh.materialList[materialIndexList ? (*materialIndexList)[polygonIndex] : 0];
-				materialData.indexBuffer.push_back(static_cast<uint32_t>(materialData.vertexBuffer.size()));
-				materialData.vertexBuffer.push_back(v);
+					//法線
+					v.normal = glm::vec3(0, 0, 1);
+					if (hasNormal) {
+						FbxVector4 normal;
+						fbxMesh->GetPolygonVertexNormal(polygonIndex, pos, normal);
+						v.normal = glm::normalize(Tovec3(matR.MultT(normal)));
+					}
 
-				++polygonVertex;
+					//頂点に対応する仮マテリアルに、頂点データとインデックスデータを追加する
+					builderList[materialIndex].Add(mesh.materialList[materialIndex], v);
+				}
 			}
 		}
-		meshList.push_back(std::move(mesh));
+		for (size_t i = 0; i < mesh.materialList.size(); ++i) {
+			builderList[i].Finish(mesh.materialList[i]);
+		}
+		RecordArena(arena);
 		return true;
 	}
 
 	/**
-	*	RXgN^
+	*	倍精度の 4x4 行列
 	*
-	*	@param meshName	bVf[^
-	*	@param begin	`悷}eA̐擪CfbNX
-	*	@param end		`悷}eȀI[CfbNX
+	*	組み込みの FBX パーサでノードの変換行列を計算するために使う
+	*	FBX SDK の FbxAMatrix と同じく倍精度で計算し、頂点を変換してから float にする
+	*	m[列][行] の並びで、ベクトルは右から掛ける
 	*/
-	Mesh::Mesh(const std::string& meshName, size_t begin, size_t end) : name(meshName), beginMaterial(begin), endMaterial(end) {}
+	struct Matrix4d {
+		double m[4][4];
 
-	/**
-	*	bV`悷
-	*
-	*	@param buffer	`Ɏgp郁bVobt@ւ̃|C^
-	*/
-	void Mesh::Draw(const BufferPtr& buffer) const {
-		if (!buffer) {
-			return;
+		static Matrix4d Identity() {
+			Matrix4d r;
+			for (int c = 0; c < 4; ++c) {
+				for (int i = 0; i < 4; ++i) {
+					r.m[c][i] = c == i ? 1.0 : 0.0;
+				}
+			}
+			return r;
 		}
-		if (buffer->GetMesh(name.c_str()).get() != this) {
-			std::cerr << "WARNING: obt@ɑ݂ȂbV'" << name << "'`悵悤Ƃ܂" << std::endl;
-			return;
+
+		static Matrix4d Translation(const double* t, double sign = 1.0) {
+			Matrix4d r = Identity();
+			for (int i = 0; i < 3; ++i) {
+				r.m[3][i] = t[i] * sign;
+			}
+			return r;
 		}
-		for (size_t i = beginMaterial; i < endMaterial; ++i) {
-			const Material& m = buffer->GetMaterial(i);
-			glDrawElementsBaseVertex(GL_TRIANGLES, m.size, m.type, m.offset, m.baseVertex);
+
+		static Matrix4d Scaling(const double* s) {
+			Matrix4d r = Identity();
+			for (int i = 0; i < 3; ++i) {
+				r.m[i][i] = s[i];
+			}
+			return r;
 		}
-	}
 
-	/**
-	*	bVobt@쐬
-	*
-	*	@param vboSize	obt@Ɋi[\ȑ_
-	*	@param iboSize	obt@Ɋi[\ȑCfbNX
-	*/
-	BufferPtr Buffer::Create(int vboSize, int iboSize) {
-		struct Impl : Buffer { Impl() {} ~Impl() {} };
-		BufferPtr p = std::make_shared<Impl>();
-		p->vbo = CreateVBO(vboSize * sizeof(Vertex), nullptr);
+		/**
+		*	オイラー角から回転行列を作成する
+		*
+		*	@param degrees	X, Y, Z 軸の回転角(度)
+		*	@param order	FBX の回転順序(0: XYZ, 1: XZY, 2: YZX, 3: YXZ, 4: ZXY, 5: ZYX)
+		*					XYZ なら X 軸の回転が最初に適用される
+		*/
+		static Matrix4d Rotation(const double* degrees, int order) {
+			static const int axisOrder[6][3] = { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 2, 0 }, { 1, 0, 2 }, { 2, 0, 1 }, { 2, 1, 0 } };
+			Matrix4d axis[3];
+			for (int i = 0; i < 3; ++i) {
+				const double rad = degrees[i] * (3.14159265358979323846 / 180.0);
+				const double c = cos(rad);
+				const double s = sin(rad);
+				const int u = (i + 1) % 3;
+				const int v = (i + 2) % 3;
+				axis[i] = Identity();
+				axis[i].m[u][u] = c;
+				axis[i].m[u][v] = s;
+				axis[i].m[v][u] = -s;
+				axis[i].m[v][v] = c;
+			}
+			const int* p = axisOrder[order >= 0 && order < 6 ? order : 0];
+			return axis[p[2]] * axis[p[1]] * axis[p[0]];
+		}
+
+		Matrix4d operator*(const Matrix4d& rhs) const {
+			Matrix4d r;
+			for (int c = 0; c < 4; ++c) {
+				for (int i = 0; i < 4; ++i) {
+					r.m[c][i] = m[0][i] * rhs.m[c][0] + m[1][i] * rhs.m[c][1] + m[2][i] * rhs.m[c][2] + m[3][i] * rhs.m[c][3];
+				}
+			}
+			return r;
+		}
+
+		///回転だけの行列の逆行列(転置行列)を返す
+		Matrix4d Transpose() const {
+			Matrix4d r;
+			for (int c = 0; c < 4; ++c) {
+				for (int i = 0; i < 4; ++i) {
+					r.m[c][i] = m[i][c];
+				}
+			}
+			return r;
+		}
+
+		/**
+		*	ベクトルを変換する
+		*
+		*	@param v	変換するベクトル(3 要素)
+		*	@param w	1 なら座標、0 なら方向として変換する
+		*
+		*	@return 倍精度で変換してから float にしたベクトル
+		*/
+		glm::vec3 Transform(const double* v, double w) const {
+			double r[3];
+			for (int i = 0; i < 3; ++i) {
+				r[i] = m[0][i] * v[0] + m[1][i] * v[1] + m[2][i] * v[2] + m[3][i] * w;
+			}
+			return Tovec3(r);
+		}
+	};
+
+	/**
+	*	組み込みパーサで読み込んだ頂点要素(法線、UV、色、マテリアル番号)
+	*/
+	struct NativeLayer {
+		///値の割り当て方
+		enum Mapping {
+			Mapping_None,			///要素がない、または未対応
+			Mapping_PolygonVertex,	///ポリゴンの頂点毎
+			Mapping_ControlPoint,	///コントロールポイント毎
+			Mapping_Polygon,		///ポリゴン毎
+			Mapping_AllSame,		///全て同じ
+		};
+		Mapping mapping = Mapping_None;
+		bool isIndexed = false;		///index を経由して direct を参照するなら true
+		std::vector<double> direct;	///値の配列
+		std::vector<int32_t> index;	///値の番号の配列
+
+		/**
+		*	頂点に対応する値の番号を求める
+		*
+		*	@param polygonVertex	ポリゴンの頂点の通し番号
+		*	@param controlPoint		コントロールポイントの番号
+		*	@param polygon			ポリゴンの番号
+		*
+		*	@return 値の番号、対応する値がなければ負数
+		*/
+		int64_t Find(size_t polygonVertex, size_t controlPoint, size_t polygon) const {
+			size_t i;
+			switch (mapping) {
+			case Mapping_PolygonVertex: i = polygonVertex; break;
+			case Mapping_ControlPoint: i = controlPoint; break;
+			case Mapping_Polygon: i = polygon; break;
+			case Mapping_AllSame: i = 0; break;
+			default: return -1;
+			}
+			if (!isIndexed) {
+				return static_cast<int64_t>(i);
+			}
+			return i < index.size() ? index[i] : -1;
+		}
+
+		/**
+		*	頂点に対応する値を取得する
+		*
+		*	@param elementSize	値 1 つあたりの要素数
+		*
+		*	@return 値の先頭へのポインタ、対応する値がなければ nullptr
+		*/
+		const double* Get(size_t polygonVertex, size_t controlPoint, size_t polygon, size_t elementSize) const {
+			const int64_t i = Find(polygonVertex, controlPoint, polygon);
+			if (i < 0 || static_cast<size_t>(i + 1) * elementSize > direct.size()) {
+				return nullptr;
+			}
+			return &direct[static_cast<size_t>(i) * elementSize];
+		}
+	};
+
+	/**
+	*	組み込みパーサで読み込んだ、メッシュを持つノード
+	*/
+	struct NativeMeshNode {
+		std::string name;								///ノード名
+		Matrix4d matTRS;								///ノードのグローバル変換行列
+		const NativeFbx::Node* geometry;				///メッシュのジオメトリ
+		std::vector<const NativeFbx::Node*> materials;	///ノードに接続されたマテリアル
+		std::vector<double> vertices;					///コントロールポイントの座標
+		std::vector<int32_t> polygonVertexIndex;		///ポリゴンの頂点(最後の頂点はビット反転されている)
+		NativeLayer normal;
+		NativeLayer texCoord;
+		NativeLayer color;
+		NativeLayer material;
+	};
+
+	/**
+	*	配列プロパティの展開処理
+	*/
+	struct DecodeJob {
+		const NativeFbx::Property* property;
+		std::vector<double>* realList;
+		std::vector<int32_t>* intList;
+
+		bool Run() const { return realList ? property->ToArray(*realList) : property->ToArray(*intList); }
+	};
+
+	///オブジェクト ID をキーとする接続先のリスト
+	typedef std::unordered_map<int64_t, std::vector<const NativeFbx::Node*>> NativeConnectionMap;
+
+	/**
+	*	子ノードの最初のプロパティを配列として取得する
+	*
+	*	@return 配列プロパティへのポインタ、なければ nullptr
+	*/
+	const NativeFbx::Property* FindArrayProperty(const NativeFbx::Node* node, const char* name) {
+		const NativeFbx::Node* child = node ? node->Find(name) : nullptr;
+		if (!child || child->properties.empty() || !child->properties[0].IsArray()) {
+			return nullptr;
+		}
+		return &child->properties[0];
+	}
+
+	/**
+	*	子ノードの最初のプロパティを文字列として取得する
+	*/
+	std::string FindStringProperty(const NativeFbx::Node* node, const char* name) {
+		const NativeFbx::Node* child = node ? node->Find(name) : nullptr;
+		if (!child || child->properties.empty()) {
+			return std::string();
+		}
+		return child->properties[0].ToString();
+	}
+
+	/**
+	*	プロパティテンプレートを検索する
+	*
+	*	@param root			ドキュメントの最上位ノード
+	*	@param objectType	オブジェクトの種類("Model", "Material" など)
+	*
+	*	@return 既定値を持つ Properties70 ノード、なければ nullptr
+	*/
+	const NativeFbx::Node* FindPropertyTemplate(const NativeFbx::Node& root, const char* objectType) {
+		const NativeFbx::Node* definitions = root.Find("Definitions");
+		if (!definitions) {
+			return nullptr;
+		}
+		for (const NativeFbx::Node& e : definitions->children) {
+			if (e.name == "ObjectType" && !e.properties.empty() && e.properties[0].ToString() == objectType) {
+				const NativeFbx::Node* propertyTemplate = e.Find("PropertyTemplate");
+				return propertyTemplate ? propertyTemplate->Find("Properties70") : nullptr;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	*	Properties70 の値を読み取る
+	*
+	*	@param object	オブジェクトのノード
+	*	@param defaults	プロパティテンプレートの Properties70 ノード(nullptr 可)
+	*	@param name		プロパティ名
+	*	@param out		値を格納する配列(見つからなければ変更しない)
+	*	@param count	値の数
+	*/
+	void ReadProperty70(const NativeFbx::Node& object, const NativeFbx::Node* defaults, const char* name, double* out, size_t count) {
+		const NativeFbx::Node* const propertyLists[] = { object.Find("Properties70"), defaults };
+		for (const NativeFbx::Node* list : propertyLists) {
+			if (!list) {
+				continue;
+			}
+			for (const NativeFbx::Node& e : list->children) {
+				//P ノードは 名前, 型, ラベル, フラグ, 値... の順に並ぶ
+				if (e.properties.size() < 4 + count || e.properties[0].ToString() != name) {
+					continue;
+				}
+				for (size_t i = 0; i < count; ++i) {
+					out[i] = e.properties[4 + i].ToDouble();
+				}
+				return;
+			}
+		}
+	}
+
+	/**
+	*	ノードのローカル変換行列を計算する
+	*
+	*	@param model	Model ノード
+	*	@param defaults	Model のプロパティテンプレート(nullptr 可)
+	*
+	*	FBX SDK と同じく T * Roff * Rp * Rpre * R * Rpost^-1 * Rp^-1 * Soff * Sp * S * Sp^-1 の順に合成する
+	*	回転順序と前後の回転は RotationActive が有効な場合だけ適用される
+	*/
+	Matrix4d NativeLocalTransform(const NativeFbx::Node& model, const NativeFbx::Node* defaults) {
+		double translation[3] = { 0, 0, 0 };
+		double rotation[3] = { 0, 0, 0 };
+		double scaling[3] = { 1, 1, 1 };
+		double rotationOffset[3] = { 0, 0, 0 };
+		double rotationPivot[3] = { 0, 0, 0 };
+		double scalingOffset[3] = { 0, 0, 0 };
+		double scalingPivot[3] = { 0, 0, 0 };
+		double preRotation[3] = { 0, 0, 0 };
+		double postRotation[3] = { 0, 0, 0 };
+		double rotationOrder = 0;
+		double rotationActive = 0;
+		ReadProperty70(model, defaults, "Lcl Translation", translation, 3);
+		ReadProperty70(model, defaults, "Lcl Rotation", rotation, 3);
+		ReadProperty70(model, defaults, "Lcl Scaling", scaling, 3);
+		ReadProperty70(model, defaults, "RotationOffset", rotationOffset, 3);
+		ReadProperty70(model, defaults, "RotationPivot", rotationPivot, 3);
+		ReadProperty70(model, defaults, "ScalingOffset", scalingOffset, 3);
+		ReadProperty70(model, defaults, "ScalingPivot", scalingPivot, 3);
+		ReadProperty70(model, defaults, "PreRotation", preRotation, 3);
+		ReadProperty70(model, defaults, "PostRotation", postRotation, 3);
+		ReadProperty70(model, defaults, "RotationOrder", &rotationOrder, 1);
+		ReadProperty70(model, defaults, "RotationActive", &rotationActive, 1);
+
+		Matrix4d matPre = Matrix4d::Identity();
+		Matrix4d matPostInv = Matrix4d::Identity();
+		int order = 0;
+		if (rotationActive != 0) {
+			matPre = Matrix4d::Rotation(preRotation, 0);
+			matPostInv = Matrix4d::Rotation(postRotation, 0).Transpose();
+			order = static_cast<int>(rotationOrder);
+		}
+		return Matrix4d::Translation(translation) * Matrix4d::Translation(rotationOffset) *
+			Matrix4d::Translation(rotationPivot) * matPre * Matrix4d::Rotation(rotation, order) * matPostInv *
+			Matrix4d::Translation(rotationPivot, -1) * Matrix4d::Translation(scalingOffset) *
+			Matrix4d::Translation(scalingPivot) * Matrix4d::Scaling(scaling) * Matrix4d::Translation(scalingPivot, -1);
+	}
+
+	/**
+	*	メッシュを持つノードを列挙する
+	*
+	*	@param id			列挙を開始するオブジェクトの ID(0 はルートノード)
+	*	@param matParent	親ノードのグローバル変換行列
+	*	@param connections	オブジェクト ID をキーとする接続先のリスト
+	*	@param defaults		Model のプロパティテンプレート(nullptr 可)
+	*	@param nodeList		列挙したノードを追加する配列
+	*	@param depth		ノードの深さ
+	*
+	*	@retval true	列挙成功
+	*	@retval false	組み込みパーサでは扱えないノードがある
+	*
+	*	接続の順に深さ優先でたどり、FBX SDK の CollectMeshNode と同じ順序で列挙する
+	*/
+	bool CollectNativeMeshNode(int64_t id, const Matrix4d& matParent, const NativeConnectionMap& connections,
+		const NativeFbx::Node* defaults, std::vector<NativeMeshNode>& nodeList, int depth) {
+		const auto itr = connections.find(id);
+		if (itr == connections.end()) {
+			return true;
+		}
+		if (depth > 256) {
+			return false;
+		}
+		for (const NativeFbx::Node* model : itr->second) {
+			if (model->name != "Model" || model->properties.size() < 3) {
+				continue;
+			}
+			//親のスケールを子の回転の後に掛ける継承方式(RSrs)だけに対応する
+			double inheritType = 1;
+			ReadProperty70(*model, defaults, "InheritType", &inheritType, 1);
+			if (inheritType != 1) {
+				std::cerr << "WARNING: " << model->properties[1].ToString() << " の変換の継承方式(" << inheritType << ")は未対応です" << std::endl;
+				return false;
+			}
+			const Matrix4d matTRS = matParent * NativeLocalTransform(*model, defaults);
+			const int64_t modelId = model->properties[0].ToInt();
+			const auto children = connections.find(modelId);
+			if (children != connections.end()) {
+				NativeMeshNode node;
+				node.geometry = nullptr;
+				for (const NativeFbx::Node* e : children->second) {
+					if (e->name == "Geometry" && !node.geometry && e->properties.size() >= 3 && e->properties[2].ToString() == "Mesh") {
+						node.geometry = e;
+					} else if (e->name == "Material") {
+						node.materials.push_back(e);
+					}
+				}
+				if (node.geometry) {
+					node.name = model->properties[1].ToString();
+					node.matTRS = matTRS;
+					nodeList.push_back(std::move(node));
+				}
+			}
+			if (!CollectNativeMeshNode(modelId, matTRS, connections, defaults, nodeList, depth + 1)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	*	頂点要素の割り当て方を読み取り、配列の展開処理を登録する
+	*
+	*	@param geometry		Geometry ノード
+	*	@param layerName	頂点要素のノード名("LayerElementNormal" など)
+	*	@param directName	値の配列のノード名(マテリアルの場合は nullptr)
+	*	@param indexName	値の番号の配列のノード名
+	*	@param layer		読み取った情報を格納する変数
+	*	@param jobList		展開処理を追加する配列
+	*/
+	void SetupNativeLayer(const NativeFbx::Node& geometry, const char* layerName, const char* directName, const char* indexName,
+		NativeLayer& layer, std::vector<DecodeJob>& jobList) {
+		const NativeFbx::Node* element = geometry.Find(layerName);
+		if (!element) {
+			return;
+		}
+		const std::string mapping = FindStringProperty(element, "MappingInformationType");
+		if (mapping == "ByPolygonVertex") {
+			layer.mapping = NativeLayer::Mapping_PolygonVertex;
+		} else if (mapping == "ByVertice" || mapping == "ByVertex" || mapping == "ByControlPoint") {
+			layer.mapping = NativeLayer::Mapping_ControlPoint;
+		} else if (mapping == "ByPolygon") {
+			layer.mapping = NativeLayer::Mapping_Polygon;
+		} else if (mapping == "AllSame") {
+			layer.mapping = NativeLayer::Mapping_AllSame;
+		} else {
+			return;
+		}
+		//マテリアル番号は配列の値がそのまま番号になる
+		const std::string reference = FindStringProperty(element, "ReferenceInformationType");
+		layer.isIndexed = !directName || reference == "IndexToDirect" || reference == "Index";
+
+		const NativeFbx::Property* direct = directName ? FindArrayProperty(element, directName) : nullptr;
+		const NativeFbx::Property* index = layer.isIndexed ? FindArrayProperty(element, indexName) : nullptr;
+		if ((directName && !direct) || (layer.isIndexed && !index)) {
+			layer.mapping = NativeLayer::Mapping_None;
+			return;
+		}
+		if (direct) {
+			jobList.push_back(DecodeJob{ direct, &layer.direct, nullptr });
+		}
+		if (index) {
+			jobList.push_back(DecodeJob{ index, nullptr, &layer.index });
+		}
+	}
+
+	/**
+	*	組み込みパーサで読み込んだメッシュを仮データに変換する
+	*
+	*	@param node				変換対象のノード
+	*	@param materialDefaults	Material のプロパティテンプレート(nullptr 可)
+	*	@param mesh				変換したデータを格納する変数
+	*
+	*	@retval true	変換成功
+	*	@retval false	データが壊れている
+	*
+	*	FbxLoader::LoadMesh と同じ仮データを作成する
+	*	三角形以外のポリゴンは扇状に三角形に分割する
+	*/
+	bool FbxLoader::LoadNativeMesh(const NativeMeshNode& node, const NativeFbx::Node* materialDefaults, TemporaryMesh& mesh) {
+		mesh.name = node.name;
+
+		//マテリアル情報を読み取る
+		mesh.materialList.reserve(node.materials.size());
+		for (const NativeFbx::Node* e : node.materials) {
+			TemporaryMaterial material;
+			std::string shadingModel = FindStringProperty(e, "ShadingModel");
+			std::transform(shadingModel.begin(), shadingModel.end(), shadingModel.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+			if (shadingModel == "lambert" || shadingModel == "phong") {
+				double diffuse[3] = { 0.8, 0.8, 0.8 };
+				double transparency = 0;
+				ReadProperty70(*e, materialDefaults, "DiffuseColor", diffuse, 3);
+				ReadProperty70(*e, materialDefaults, "TransparencyFactor", &transparency, 1);
+				material.color = glm::vec4(Tovec3(diffuse), static_cast<float>(1.0f - transparency));
+			}
+			mesh.materialList.push_back(material);
+		}
+		if (mesh.materialList.empty()) {
+			mesh.materialList.push_back(TemporaryMaterial());
+		}
+
+		//ポリゴンの属するマテリアル(範囲外なら最初のマテリアル)
+		const auto materialOf = [&node, &mesh](size_t polygonIndex) {
+			const int64_t materialIndex = node.material.Find(0, 0, polygonIndex);
+			return materialIndex >= 0 && static_cast<size_t>(materialIndex) < mesh.materialList.size() ? static_cast<size_t>(materialIndex) : 0;
+		};
+
+		//マテリアル毎の三角形数を数える
+		const std::vector<int32_t>& polygonVertexIndex = node.polygonVertexIndex;
+		std::vector<size_t> triangleCountList(mesh.materialList.size(), 0);
+		size_t cornerTotal = 0;
+		for (size_t n = 0, polygonIndex = 0, polygonBegin = 0; n < polygonVertexIndex.size(); ++n) {
+			if (polygonVertexIndex[n] < 0) {
+				const size_t triangleCount = n + 1 - polygonBegin >= 3 ? n - 1 - polygonBegin : 0;
+				triangleCountList[materialOf(polygonIndex)] += triangleCount;
+				cornerTotal += triangleCount * 3;
+				polygonBegin = n + 1;
+				++polygonIndex;
+			}
+		}
+
+		//一時データは全てアリーナに置き、変換が終わったらまとめて解放する
+		const size_t controlPointCount = node.vertices.size() / 3;
+		Arena arena(EstimateArenaBytes(cornerTotal, controlPointCount));
+
+		//コントロールポイントの座標は、あらかじめ全て変換しておく
+		//法線は変換行列の回転成分だけで変換する
+		Matrix4d matR = node.matTRS;
+		for (int c = 0; c < 3; ++c) {
+			const double length = sqrt(matR.m[c][0] * matR.m[c][0] + matR.m[c][1] * matR.m[c][1] + matR.m[c][2] * matR.m[c][2]);
+			for (int i = 0; i < 3 && length > 0; ++i) {
+				matR.m[c][i] /= length;
+			}
+		}
+		matR.m[3][0] = matR.m[3][1] = matR.m[3][2] = 0;
+		const ArenaAllocator<glm::vec3> positionAllocator(arena);
+		std::vector<glm::vec3, ArenaAllocator<glm::vec3>> positionList(positionAllocator);
+		positionList.reserve(controlPointCount);
+		for (size_t i = 0; i < controlPointCount; ++i) {
+			positionList.push_back(node.matTRS.Transform(&node.vertices[i * 3], 1));
+		}
+
+		//同じ値を持つ頂点を共有するため、マテリアル毎に頂点とインデックスの対応表を作る
+		std::vector<MaterialBuilder> builderList;
+		builderList.reserve(mesh.materialList.size());
+		for (size_t i = 0; i < mesh.materialList.size(); ++i) {
+			mesh.materialList[i].indexBuffer.reserve(triangleCountList[i] * 3);
+			builderList.emplace_back(arena, triangleCountList[i] * 3);
+		}
+
+		bool hasNonTriangle = false;
+		size_t polygonIndex = 0;
+		size_t polygonBegin = 0;
+		for (size_t n = 0; n < polygonVertexIndex.size(); ++n) {
+			if (polygonVertexIndex[n] >= 0) {
+				continue;
+			}
+			const size_t cornerCount = n + 1 - polygonBegin;
+			if (cornerCount != 3) {
+				hasNonTriangle = true;
+			}
+			const size_t materialNo = materialOf(polygonIndex);
+			for (size_t k = 2; k < cornerCount; ++k) {
+				const size_t corners[3] = { polygonBegin, polygonBegin + k - 1, polygonBegin + k };
+				for (const size_t polygonVertex : corners) {
+					int32_t cpIndex = polygonVertexIndex[polygonVertex];
+					if (cpIndex < 0) {
+						cpIndex = ~cpIndex;
+					}
+					if (static_cast<size_t>(cpIndex) >= controlPointCount) {
+						std::cerr << "ERROR: " << mesh.name << "の頂点番号が範囲外です" << std::endl;
+						return false;
+					}
+
+					Vertex v;
+					v.position = positionList[cpIndex];
+					v.color = glm::vec4(1);
+					if (const double* color = node.color.Get(polygonVertex, cpIndex, polygonIndex, 4)) {
+						v.color = Tovec4(color);
+					}
+					v.texCoord = glm::vec2(0);
+					if (const double* uv = node.texCoord.Get(polygonVertex, cpIndex, polygonIndex, 2)) {
+						v.texCoord = Tovec2(uv);
+					}
+					v.normal = glm::vec3(0, 0, 1);
+					if (const double* normal = node.normal.Get(polygonVertex, cpIndex, polygonIndex, 3)) {
+						v.normal = glm::normalize(matR.Transform(normal, 0));
+					}
+
+					builderList[materialNo].Add(mesh.materialList[materialNo], v);
+				}
+			}
+			polygonBegin = n + 1;
+			++polygonIndex;
+		}
+		if (hasNonTriangle) {
+			std::cerr << "WARNING: " << mesh.name << "には三角形以外の面が含まれています" << std::endl;
+		}
+		for (size_t i = 0; i < mesh.materialList.size(); ++i) {
+			builderList[i].Finish(mesh.materialList[i]);
+		}
+		RecordArena(arena);
+		return true;
+	}
+
+	/**
+	*	組み込みのパーサを使って FBX ファイルを仮データに変換する
+	*
+	*	@param fileName	FBX ファイル名
+	*
+	*	@retval true	変換成功
+	*	@retval false	テキスト形式のファイル、または組み込みパーサでは扱えないファイル
+	*
+	*	FBX SDK を使わずにバイナリ形式のファイルを読み込む
+	*	配列プロパティの展開とメッシュの変換は、データが大きければ並列に行う
+	*/
+	bool FbxLoader::ImportNative(const char* fileName) {
+		const NativeFbx::DocumentPtr document = NativeFbx::Document::Open(fileName);
+		if (!document) {
+			return false;
+		}
+		const NativeFbx::Node& root = document->Root();
+		const NativeFbx::Node* objects = root.Find("Objects");
+		const NativeFbx::Node* connections = root.Find("Connections");
+		if (!objects || !connections) {
+			return false;
+		}
+
+		//接続をオブジェクト ID で引けるようにまとめる
+		//@note 接続の順序は FBX SDK での子ノードやマテリアルの順序と同じ
+		std::unordered_map<int64_t, const NativeFbx::Node*> objectMap;
+		objectMap.reserve(objects->children.size());
+		for (const NativeFbx::Node& e : objects->children) {
+			if (!e.properties.empty() && e.properties[0].type == 'L') {
+				objectMap.insert(std::make_pair(e.properties[0].ToInt(), &e));
+			}
+		}
+		NativeConnectionMap connectionMap;
+		for (const NativeFbx::Node& e : connections->children) {
+			if (e.name != "C" || e.properties.size() < 3 || e.properties[0].ToString() != "OO") {
+				continue;
+			}
+			const auto child = objectMap.find(e.properties[1].ToInt());
+			if (child != objectMap.end()) {
+				connectionMap[e.properties[2].ToInt()].push_back(child->second);
+			}
+		}
+
+		std::vector<NativeMeshNode> nodeList;
+		if (!CollectNativeMeshNode(0, Matrix4d::Identity(), connectionMap, FindPropertyTemplate(root, "Model"), nodeList, 0)) {
+			return false;
+		}
+
+		//必要な配列プロパティを列挙して展開する
+		std::vector<DecodeJob> jobList;
+		for (NativeMeshNode& e : nodeList) {
+			const NativeFbx::Property* vertices = FindArrayProperty(e.geometry, "Vertices");
+			const NativeFbx::Property* polygonVertexIndex = FindArrayProperty(e.geometry, "PolygonVertexIndex");
+			if (!vertices || !polygonVertexIndex) {
+				return false;
+			}
+			jobList.push_back(DecodeJob{ vertices, &e.vertices, nullptr });
+			jobList.push_back(DecodeJob{ polygonVertexIndex, nullptr, &e.polygonVertexIndex });
+			SetupNativeLayer(*e.geometry, "LayerElementNormal", "Normals", "NormalsIndex", e.normal, jobList);
+			SetupNativeLayer(*e.geometry, "LayerElementUV", "UV", "UVIndex", e.texCoord, jobList);
+			SetupNativeLayer(*e.geometry, "LayerElementColor", "Colors", "ColorIndex", e.color, jobList);
+			SetupNativeLayer(*e.geometry, "LayerElementMaterial", nullptr, "Materials", e.material, jobList);
+		}
+		size_t elementCount = 0;
+		for (const DecodeJob& e : jobList) {
+			elementCount += e.property->arrayLength;
+		}
+		bool decoded = true;
+		if (jobList.size() <= 1 || elementCount < parallelDecodeElementCount) {
+			for (const DecodeJob& e : jobList) {
+				decoded &= e.Run();
+			}
+		} else {
+			decoded = ParallelFor(jobList.size(), [&jobList](size_t n) { return jobList[n].Run(); });
+		}
+		if (!decoded) {
+			std::cerr << "ERROR: " << fileName << "の配列データが壊れています" << std::endl;
+			return false;
+		}
+
+		const NativeFbx::Node* materialDefaults = FindPropertyTemplate(root, "Material");
+		meshList.clear();
+		meshList.resize(nodeList.size());
+		size_t polygonVertexCount = 0;
+		for (const NativeMeshNode& e : nodeList) {
+			polygonVertexCount += e.polygonVertexIndex.size();
+		}
+		bool converted = true;
+		if (nodeList.size() <= 1 || polygonVertexCount / 3 < static_cast<size_t>(parallelConvertPolygonCount)) {
+			for (size_t i = 0; i < nodeList.size() && converted; ++i) {
+				converted = LoadNativeMesh(nodeList[i], materialDefaults, meshList[i]);
+			}
+		} else {
+			converted = ParallelFor(nodeList.size(), [this, &nodeList, materialDefaults](size_t n) {
+				return LoadNativeMesh(nodeList[n], materialDefaults, meshList[n]);
+			});
+		}
+		if (!converted) {
+			std::cerr << "ERROR: " << fileName << "の変換に失敗" << std::endl;
+		}
+		return converted;
+	}
+
+	/**
+	*	メッシュキャッシュファイルのヘッダ
+	*
+	*	ファイルは以下の順に並ぶ
+	*	- CacheHeader
+	*	- CacheMesh の配列(meshCount 個)
+	*	- CacheMaterial の配列(materialCount 個)
+	*	  メッシュ毎に LOD 0 の全マテリアル、LOD 1 の全マテリアル...の順に並ぶ
+	*	- CacheCluster の配列(clusterCount 個)
+	*	- メッシュ名の文字列(nameBytes バイト、終端文字なし)
+	*	- 頂点データ(vertexOffset から vertexBytes バイト、PackedVertex の配列)
+	*	- インデックスデータ(indexOffset から indexBytes バイト)
+	*	  マテリアル毎に 16 ビットか 32 ビットで、先頭は 4 バイト境界に揃えてある
+	*/
+	struct CacheHeader {
+		char magic[4];			///< ファイル識別子
+		uint32_t version;		///< ファイル形式のバージョン
+		uint64_t sourceHash;	///< 変換元 FBX ファイルのハッシュ値
+		uint32_t vertexSize;	///< 頂点データ 1 個のバイト数
+		uint32_t meshCount;		///< メッシュ数
+		uint32_t materialCount;	///< マテリアル数
+		uint32_t nameBytes;		///< メッシュ名の文字列の総バイト数
+		uint32_t clusterCount;	///< クラスタ数
+		uint32_t reserved;		///< 予約(0)
+		uint64_t vertexOffset;	///< 頂点データのファイル先頭からのバイトオフセット
+		uint64_t vertexBytes;	///< 頂点データのバイト数
+		uint64_t indexOffset;	///< インデックスデータのファイル先頭からのバイトオフセット
+		uint64_t indexBytes;	///< インデックスデータのバイト数
+	};
+
+	/// メッシュキャッシュのメッシュ情報
+	struct CacheMesh {
+		uint32_t nameOffset;	///< メッシュ名の文字列内の位置
+		uint32_t nameLength;	///< メッシュ名の長さ
+		uint32_t materialCount;	///< 1 段階あたりのマテリアル数
+		uint32_t lodCount;		///< LOD 0 を含む詳細度の段階数
+		float center[3];		///< 境界球の中心
+		float radius;			///< 境界球の半径
+		float boundsMin[3];		///< AABB の最小座標
+		float boundsMax[3];		///< AABB の最大座標
+	};
+
+	/// メッシュキャッシュのマテリアル情報
+	struct CacheMaterial {
+		uint32_t indexType;		///< インデックスのデータ型
+		uint32_t indexCount;	///< インデックス数
+		uint64_t indexOffset;	///< インデックスデータ内のバイトオフセット
+		uint32_t baseVertex;	///< 頂点データ内の先頭頂点の位置
+		uint32_t vertexCount;	///< 頂点数
+		float color[4];			///< マテリアルの色
+		uint32_t clusterOffset;	///< 先頭クラスタの位置
+		uint32_t clusterCount;	///< クラスタ数(0 ならマテリアル全体を描画する)
+	};
+
+	/// メッシュキャッシュのクラスタ情報
+	struct CacheCluster {
+		uint32_t indexOffset;	///< マテリアルの先頭からのインデックス数
+		uint32_t indexCount;	///< インデックス数
+		float center[3];		///< 境界球の中心
+		float radius;			///< 境界球の半径
+		float coneAxis[3];		///< 法線錐の軸
+		float coneCutoff;		///< 法線錐の半頂角の sin
+	};
+
+	const char cacheMagic[4] = { 'M', 'E', 'S', 'H' };	///< メッシュキャッシュの識別子
+	const uint32_t cacheVersion = 8;						///< メッシュキャッシュのバージョン
+
+	/**
+	*	頂点数に応じたインデックスのデータ型を選ぶ
+	*
+	*	@param vertexCount	頂点数
+	*
+	*	@return 16 ビットで表せるなら GL_UNSIGNED_SHORT、それ以外は GL_UNSIGNED_INT
+	*/
+	GLenum IndexType(size_t vertexCount) {
+		return vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	}
+
+	/**
+	*	インデックスのデータ型のバイト数を取得する
+	*
+	*	@param type	インデックスのデータ型
+	*
+	*	@return 1 インデックスのバイト数
+	*/
+	uint32_t IndexSize(GLenum type) {
+		return type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+	}
+
+	/**
+	*	インデックスデータのバイト数を 4 バイト境界に切り上げる
+	*
+	*	16 ビットと 32 ビットのインデックスが同じ IBO に混在しても
+	*	各マテリアルの先頭が型の境界に揃うようにする
+	*/
+	uint64_t AlignIndexBytes(uint64_t bytes) {
+		return (bytes + 3) & ~3ULL;
+	}
+
+	/**
+	*	バイト列のハッシュ値を計算する(FNV-1a 64bit)
+	*
+	*	@param data	バイト列の先頭アドレス
+	*	@param size	バイト数
+	*
+	*	@return ハッシュ値
+	*/
+	uint64_t CalcHash(const uint8_t* data, size_t size) {
+		uint64_t hash = 14695981039346656037ULL;
+		for (size_t i = 0; i < size; ++i) {
+			hash ^= data[i];
+			hash *= 1099511628211ULL;
+		}
+		return hash;
+	}
+
+	/**
+	*	メッシュファイル名からキャッシュファイル名を作成する
+	*
+	*	@param fileName	メッシュファイル名
+	*
+	*	@return 拡張子を .mesh に置き換えたファイル名
+	*/
+	std::string CacheFileName(const char* fileName) {
+		std::string name(fileName);
+		const size_t dot = name.find_last_of('.');
+		const size_t separator = name.find_last_of("/\\");
+		if (dot != std::string::npos && (separator == std::string::npos || dot > separator)) {
+			name.resize(dot);
+		}
+		return name + ".mesh";
+	}
+
+	/**
+	*	メッシュキャッシュのヘッダを取得する
+	*
+	*	@param data	キャッシュデータの先頭アドレス
+	*	@param size	キャッシュデータのバイト数
+	*
+	*	@return ヘッダへのポインタ
+	*			形式が正しくない場合は nullptr
+	*/
+	const CacheHeader* GetCacheHeader(const uint8_t* data, size_t size) {
+		if (!data || size < sizeof(CacheHeader)) {
+			return nullptr;
+		}
+		const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+		if (memcmp(header->magic, cacheMagic, sizeof(cacheMagic)) != 0 ||
+			header->version != cacheVersion || header->vertexSize != sizeof(PackedVertex)) {
+			return nullptr;
+		}
+		const uint64_t tableBytes = sizeof(CacheHeader) +
+			static_cast<uint64_t>(header->meshCount) * sizeof(CacheMesh) +
+			static_cast<uint64_t>(header->materialCount) * sizeof(CacheMaterial) +
+			static_cast<uint64_t>(header->clusterCount) * sizeof(CacheCluster) +
+			header->nameBytes;
+		if (tableBytes > header->vertexOffset ||
+			header->vertexOffset + header->vertexBytes > header->indexOffset ||
+			header->indexOffset + header->indexBytes > size) {
+			return nullptr;
+		}
+		return header;
+	}
+
+	/**
+	*	仮データからメッシュキャッシュを作成する
+	*
+	*	@param meshList		仮メッシュデータのリスト
+	*	@param sourceHash	変換元 FBX ファイルのハッシュ値
+	*	@param image		作成したキャッシュデータを格納する配列
+	*/
+	void BuildMeshCache(const std::vector<TemporaryMesh>& meshList, uint64_t sourceHash, std::vector<uint8_t>& image) {
+		std::vector<CacheMesh> meshes;
+		std::vector<CacheMaterial> materials;
+		std::vector<CacheCluster> clusters;
+		std::vector<const std::vector<uint32_t>*> indexList;	//materials の各要素に対応するインデックス配列
+		std::string names;
+		uint64_t vertexCount = 0;
+		uint64_t indexBytes = 0;
+		meshes.reserve(meshList.size());
+		for (const TemporaryMesh& mesh : meshList) {
+			//AABB と境界球を求める
+			glm::vec3 minPos(FLT_MAX);
+			glm::vec3 maxPos(-FLT_MAX);
+			for (const TemporaryMaterial& material : mesh.materialList) {
+				for (const Vertex& v : material.vertexBuffer) {
+					minPos = glm::min(minPos, v.position);
+					maxPos = glm::max(maxPos, v.position);
+				}
+			}
+			if (minPos.x > maxPos.x) {
+				minPos = maxPos = glm::vec3(0);
+			}
+			const glm::vec3 center = (minPos + maxPos) * 0.5f;
+			float radius = 0.0f;
+			for (const TemporaryMaterial& material : mesh.materialList) {
+				for (const Vertex& v : material.vertexBuffer) {
+					radius = std::max(radius, glm::length(v.position - center));
+				}
+			}
+			const CacheMesh m = {
+				static_cast<uint32_t>(names.size()),
+				static_cast<uint32_t>(mesh.name.size()),
+				static_cast<uint32_t>(mesh.materialList.size()),
+				static_cast<uint32_t>(mesh.lodCount),
+				{ center.x, center.y, center.z },
+				radius,
+				{ minPos.x, minPos.y, minPos.z },
+				{ maxPos.x, maxPos.y, maxPos.z }
+			};
+			meshes.push_back(m);
+			names += mesh.name;
+
+			//頂点データは全ての LOD で共用する
+			const uint64_t baseVertex = vertexCount;
+			for (const TemporaryMaterial& material : mesh.materialList) {
+				vertexCount += material.vertexBuffer.size();
+			}
+			for (size_t lod = 0; lod < mesh.lodCount; ++lod) {
+				uint64_t materialBaseVertex = baseVertex;
+				for (const TemporaryMaterial& material : mesh.materialList) {
+					const std::vector<uint32_t>& indices = lod == 0 ? material.indexBuffer : material.lodIndexBuffer[lod - 1];
+					CacheMaterial m;
+					m.indexType = IndexType(material.vertexBuffer.size());
+					m.indexCount = static_cast<uint32_t>(indices.size());
+					m.indexOffset = indexBytes;
+					m.baseVertex = static_cast<uint32_t>(materialBaseVertex);
+					m.vertexCount = static_cast<uint32_t>(material.vertexBuffer.size());
+					memcpy(m.color, &material.color, sizeof(m.color));
+					m.clusterOffset = static_cast<uint32_t>(clusters.size());
+					m.clusterCount = 0;
+					if (lod == 0) {
+						for (const MeshOptimizer::TriangleCluster& e : material.clusterList) {
+							CacheCluster c;
+							c.indexOffset = e.indexOffset;
+							c.indexCount = e.indexCount;
+							memcpy(c.center, e.center, sizeof(c.center));
+							c.radius = e.radius;
+							memcpy(c.coneAxis, e.coneAxis, sizeof(c.coneAxis));
+							c.coneCutoff = e.coneCutoff;
+							clusters.push_back(c);
+						}
+						m.clusterCount = static_cast<uint32_t>(material.clusterList.size());
+					}
+					materials.push_back(m);
+					indexList.push_back(&indices);
+					materialBaseVertex += material.vertexBuffer.size();
+					indexBytes += AlignIndexBytes(m.indexCount * IndexSize(m.indexType));
+				}
+			}
+		}
+
+		CacheHeader header;
+		memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+		header.version = cacheVersion;
+		header.sourceHash = sourceHash;
+		header.vertexSize = sizeof(PackedVertex);
+		header.meshCount = static_cast<uint32_t>(meshes.size());
+		header.materialCount = static_cast<uint32_t>(materials.size());
+		header.nameBytes = static_cast<uint32_t>(names.size());
+		header.clusterCount = static_cast<uint32_t>(clusters.size());
+		header.reserved = 0;
+		const uint64_t tableBytes = sizeof(CacheHeader) + meshes.size() * sizeof(CacheMesh) + materials.size() * sizeof(CacheMaterial) +
+			clusters.size() * sizeof(CacheCluster) + names.size();
+		header.vertexOffset = (tableBytes + 15) & ~15ULL;
+		header.vertexBytes = vertexCount * sizeof(PackedVertex);
+		header.indexOffset = header.vertexOffset + header.vertexBytes;
+		header.indexBytes = indexBytes;
+
+		image.assign(static_cast<size_t>(header.indexOffset + header.indexBytes), 0);
+		uint8_t* p = image.data();
+		memcpy(p, &header, sizeof(header));
+		p += sizeof(header);
+		if (!meshes.empty()) {
+			memcpy(p, meshes.data(), meshes.size() * sizeof(CacheMesh));
+			p += meshes.size() * sizeof(CacheMesh);
+		}
+		if (!materials.empty()) {
+			memcpy(p, materials.data(), materials.size() * sizeof(CacheMaterial));
+			p += materials.size() * sizeof(CacheMaterial);
+		}
+		if (!clusters.empty()) {
+			memcpy(p, clusters.data(), clusters.size() * sizeof(CacheCluster));
+			p += clusters.size() * sizeof(CacheCluster);
+		}
+		if (!names.empty()) {
+			memcpy(p, names.data(), names.size());
+		}
+		uint8_t* pVertex = image.data() + header.vertexOffset;
+#ifdef _DEBUG
+		size_t inaccurateCount = 0;
+#endif
+		for (const TemporaryMesh& mesh : meshList) {
+			for (const TemporaryMaterial& material : mesh.materialList) {
+				for (const Vertex& v : material.vertexBuffer) {
+					const PackedVertex packed = PackVertex(v);
+#ifdef _DEBUG
+					if (!CheckPackedVertex(v, packed)) {
+						++inaccurateCount;
+					}
+#endif
+					memcpy(pVertex, &packed, sizeof(PackedVertex));
+					pVertex += sizeof(PackedVertex);
+				}
+			}
+		}
+		for (size_t i = 0; i < materials.size(); ++i) {
+			const CacheMaterial& material = materials[i];
+			const std::vector<uint32_t>& indices = *indexList[i];
+			uint8_t* pIndex = image.data() + header.indexOffset + material.indexOffset;
+			if (material.indexType == GL_UNSIGNED_SHORT) {
+				for (uint32_t index : indices) {
+					const uint16_t i16 = static_cast<uint16_t>(index);
+					memcpy(pIndex, &i16, sizeof(uint16_t));
+					pIndex += sizeof(uint16_t);
+				}
+			} else if (!indices.empty()) {
+				memcpy(pIndex, indices.data(), indices.size() * sizeof(uint32_t));
+			}
+		}
+#ifdef _DEBUG
+		if (inaccurateCount) {
+			std::cerr << "WARNING: 頂点の圧縮誤差が許容範囲を超えています(" << inaccurateCount << '/' << vertexCount << ')' << std::endl;
+		}
+#endif
+	}
+
+	/**
+	*	FBX ファイルをメッシュキャッシュに変換する
+	*
+	*	@param fileName		FBX ファイル名
+	*	@param sourceHash	FBX ファイルのハッシュ値
+	*	@param image		作成したキャッシュデータを格納する配列
+	*
+	*	@retval true	変換成功
+	*	@retval false	変換失敗
+	*
+	*	作成したキャッシュデータはキャッシュファイルにも書き込まれる
+	*	書き込みに失敗した場合は警告を出力するが、変換は成功として扱う
+	*/
+	bool BakeMeshCache(const char* fileName, uint64_t sourceHash, std::vector<uint8_t>& image) {
+		FbxLoader loader;
+		if (!loader.Load(fileName)) {
+			return false;
+		}
+		BuildMeshCache(loader.meshList, sourceHash, image);
+
+		const std::string cacheName = CacheFileName(fileName);
+		FILE* fp = fopen(cacheName.c_str(), "wb");
+		if (!fp) {
+			std::cerr << "WARNING: " << cacheName << " を作成できません" << std::endl;
+			return true;
+		}
+		const size_t writeSize = fwrite(image.data(), 1, image.size(), fp);
+		fclose(fp);
+		if (writeSize != image.size()) {
+			std::cerr << "WARNING: " << cacheName << " の書き込みに失敗" << std::endl;
+			remove(cacheName.c_str());
+		}
+		return true;
+	}
+
+	/**
+	*	FBX ファイルを変換するときに統計を出力するか設定する
+	*
+	*	@param enable	出力するなら true(初期値は false)
+	*
+	*	メモリ使用量、最適化前後の ACMR と ATVR、LOD ごとの三角形数、クラスタ数をファイル毎に出力する
+	*/
+	void VerboseLog(bool enable) {
+		isVerboseLog = enable;
+	}
+
+	/**
+	*	FBX ファイルの読み込みに組み込みのパーサを使うか設定する
+	*
+	*	@param enable	組み込みのパーサを使うなら true、FBX SDK だけを使うなら false(既定値)
+	*
+	*	有効にする前に、ValidateFbxParser で対象のファイルが FBX SDK と同じ結果になることを確認すること
+	*/
+	void NativeFbxParser(bool enable) {
+		isNativeFbxEnabled = enable;
+	}
+
+	/**
+	*	FBX ファイルからメッシュキャッシュファイルを作成する
+	*
+	*	@param fileName	FBX ファイル名
+	*
+	*	@retval true	作成成功
+	*	@retval false	作成失敗
+	*
+	*	OpenGL の初期化は不要なので、オフラインでの事前変換に使用できる
+	*/
+	bool BakeMeshFile(const char* fileName) {
+		const MappedFilePtr source = MappedFile::Open(fileName);
+		if (!source) {
+			std::cerr << "ERROR: " << fileName << " が見つかりません" << std::endl;
+			return false;
+		}
+		std::vector<uint8_t> image;
+		return BakeMeshCache(fileName, CalcHash(source->Data(), source->Size()), image);
+	}
+
+	/**
+	*	組み込みの FBX パーサの変換結果を FBX SDK と比較する
+	*
+	*	@param fileName	FBX ファイル名
+	*
+	*	@retval true	変換結果が一致した
+	*	@retval false	読み込みに失敗したか、変換結果が一致しなかった
+	*
+	*	最適化前の仮データを比較し、頂点属性の最大誤差を出力する
+	*/
+	bool ValidateFbxParser(const char* fileName) {
+		FbxLoader native;
+		FbxLoader sdk;
+		if (!native.ImportNative(fileName)) {
+			std::cerr << "ERROR: " << fileName << " は組み込みパーサで読み込めません" << std::endl;
+			return false;
+		}
+		if (!sdk.ImportWithSdk(fileName)) {
+			return false;
+		}
+
+		const float tolerance = 1.0e-4f;
+		bool match = native.meshList.size() == sdk.meshList.size();
+		float maxError = 0;
+		for (size_t i = 0; i < std::min(native.meshList.size(), sdk.meshList.size()); ++i) {
+			const TemporaryMesh& a = native.meshList[i];
+			const TemporaryMesh& b = sdk.meshList[i];
+			if (a.name != b.name || a.materialList.size() != b.materialList.size()) {
+				std::cerr << "WARNING: " << a.name << "(SDK: " << b.name << ")のメッシュ名かマテリアル数が一致しません" << std::endl;
+				match = false;
+				continue;
+			}
+			for (size_t j = 0; j < a.materialList.size(); ++j) {
+				const TemporaryMaterial& ma = a.materialList[j];
+				const TemporaryMaterial& mb = b.materialList[j];
+				for (int k = 0; k < 4; ++k) {
+					maxError = std::max(maxError, fabsf(ma.color[k] - mb.color[k]));
+				}
+				if (ma.indexBuffer.size() != mb.indexBuffer.size()) {
+					std::cerr << "WARNING: " << a.name << "のマテリアル" << j << "のインデックス数が一致しません(" <<
+						ma.indexBuffer.size() << "/" << mb.indexBuffer.size() << ")" << std::endl;
+					match = false;
+					continue;
+				}
+				//頂点の共有のされ方は問わず、三角形の角ごとに比較する
+				for (size_t n = 0; n < ma.indexBuffer.size(); ++n) {
+					const float* va = reinterpret_cast<const float*>(&ma.vertexBuffer[ma.indexBuffer[n]]);
+					const float* vb = reinterpret_cast<const float*>(&mb.vertexBuffer[mb.indexBuffer[n]]);
+					for (size_t k = 0; k < sizeof(Vertex) / sizeof(float); ++k) {
+						maxError = std::max(maxError, fabsf(va[k] - vb[k]));
+					}
+				}
+			}
+		}
+		match &= maxError <= tolerance;
+		std::cout << fileName << ": メッシュ数 " << native.meshList.size() << "/" << sdk.meshList.size() <<
+			" 最大誤差 " << maxError << (match ? " 一致" : " 不一致") << std::endl;
+		return match;
+	}
+
+	/**
+	*	FBX ファイルを変換して、各段階の統計を出力する
+	*
+	*	@param fileName	FBX ファイル名
+	*
+	*	@retval true	変換成功
+	*	@retval false	変換失敗
+	*
+	*	キャッシュファイルは作成しない
+	*	最適化前後の ACMR と ATVR、LOD ごとの三角形数、クラスタ数を出力する
+	*/
+	bool AnalyzeMeshFile(const char* fileName) {
+		FbxLoader loader;
+		loader.isVerbose = true;
+		return loader.Load(fileName);
+	}
+
+	/**
+	*	FBX ファイルのクラスタ単位のカリングで描画しない三角形の割合を調べる
+	*
+	*	@param fileName		FBX ファイル名
+	*	@param matView		View 行列
+	*	@param matProj		Projection 行列
+	*	@param modelList	メッシュを配置するモデル行列のリスト
+	*
+	*	@retval true	変換成功
+	*	@retval false	変換失敗
+	*
+	*	クラスタを持つメッシュごとに、全ての配置での視錐台カリングと背面カリングの割合を出力する
+	*/
+	bool AnalyzeClusterCulling(const char* fileName, const glm::mat4& matView, const glm::mat4& matProj, const std::vector<glm::mat4>& modelList) {
+		FbxLoader loader;
+		if (!loader.Load(fileName)) {
+			return false;
+		}
+		ClusterCuller culler;
+		culler.Setup(matView, matProj);
+		for (const TemporaryMesh& mesh : loader.meshList) {
+			size_t clusterCount = 0;
+			size_t triangles = 0;
+			size_t frustumCulled = 0;
+			size_t backfaceCulled = 0;
+			for (const TemporaryMaterial& material : mesh.materialList) {
+				for (const MeshOptimizer::TriangleCluster& e : material.clusterList) {
+					Cluster c;
+					c.center = glm::vec3(e.center[0], e.center[1], e.center[2]);
+					c.radius = e.radius;
+					c.coneAxis = glm::vec3(e.coneAxis[0], e.coneAxis[1], e.coneAxis[2]);
+					c.coneCutoff = e.coneCutoff;
+					for (const glm::mat4& m : modelList) {
+						culler.SetModel(m);
+						const ClusterCuller::Result result = culler.Classify(c);
+						if (result == ClusterCuller::frustumCulled) {
+							frustumCulled += e.indexCount / 3;
+						} else if (result == ClusterCuller::backfaceCulled) {
+							backfaceCulled += e.indexCount / 3;
+						}
+					}
+					triangles += e.indexCount / 3 * modelList.size();
+				}
+				clusterCount += material.clusterList.size();
+			}
+			if (clusterCount == 0 || triangles == 0) {
+				std::cout << fileName << ": " << mesh.name << " クラスタなし" << std::endl;
+				continue;
+			}
+			std::cout << fileName << ": " << mesh.name << " クラスタ " << clusterCount << ", 配置 " << modelList.size() <<
+				", 視錐台 " << frustumCulled * 100.0 / triangles << "%, 背面 " << backfaceCulled * 100.0 / triangles << "%" << std::endl;
+		}
+		return true;
+	}
+
+	/**
+	*	FBX ファイルの全ての頂点を圧縮・展開して誤差を調べる
+	*
+	*	@param fileName	FBX ファイル名
+	*
+	*	@retval true	全ての頂点が CheckPackedVertex の許容範囲内
+	*	@retval false	読み込みに失敗したか、許容範囲を超える頂点がある
+	*
+	*	要素ごとの最大誤差と、法線の向きの最大誤差(度)、圧縮前後の頂点データのバイト数を出力する
+	*/
+	bool CheckVertexPacking(const char* fileName) {
+		FbxLoader loader;
+		loader.isVerbose = true;
+		if (!loader.Import(fileName)) {
+			return false;
+		}
+		size_t vertexCount = 0;
+		size_t inaccurateCount = 0;
+		float positionError = 0;
+		float colorError = 0;
+		float texCoordError = 0;
+		float normalAngle = 0;
+		for (const TemporaryMesh& mesh : loader.meshList) {
+			for (const TemporaryMaterial& material : mesh.materialList) {
+				for (const Vertex& v : material.vertexBuffer) {
+					const PackedVertex packed = PackVertex(v);
+					const Vertex u = UnpackVertex(packed);
+					if (!CheckPackedVertex(v, packed)) {
+						++inaccurateCount;
+					}
+					for (int i = 0; i < 3; ++i) {
+						positionError = std::max(positionError, fabsf(v.position[i] - u.position[i]));
+					}
+					for (int i = 0; i < 4; ++i) {
+						colorError = std::max(colorError, fabsf(glm::clamp(v.color[i], 0.0f, 1.0f) - u.color[i]));
+					}
+					for (int i = 0; i < 2; ++i) {
+						texCoordError = std::max(texCoordError, fabsf(v.texCoord[i] - u.texCoord[i]));
+					}
+					const float lengthProduct = glm::length(v.normal) * glm::length(u.normal);
+					if (lengthProduct > 0) {
+						const float cosAngle = glm::clamp(glm::dot(v.normal, u.normal) / lengthProduct, -1.0f, 1.0f);
+						normalAngle = std::max(normalAngle, acosf(cosAngle) * 180.0f / 3.14159265f);
+					}
+					++vertexCount;
+				}
+			}
+		}
+		std::cout << fileName << ": 頂点 " << vertexCount << ", " << vertexCount * sizeof(Vertex) << " -> " <<
+			vertexCount * sizeof(PackedVertex) << " バイト, 最大誤差 座標 " << positionError << ", 色 " << colorError <<
+			", テクスチャ座標 " << texCoordError << ", 法線 " << normalAngle << " 度, 許容範囲外 " << inaccurateCount << std::endl;
+		return inaccurateCount == 0;
+	}
+
+	/**
+	*	コンストラクタ
+	*
+	*	@param meshName	メッシュデータ名
+	*	@param begin	描画するマテリアルの先頭インデックス
+	*	@param end		描画するマテリアルの終端インデックス
+	*/
+	Mesh::Mesh(const std::string& meshName, size_t begin, size_t end) : name(meshName), beginMaterial(begin), endMaterial(end) {}
+
+	/**
+	*	メッシュを描画する
+	*
+	*	@param buffer	描画に使用するメッシュバッファへのポインタ
+	*	@param lod		描画する詳細度の段階(0 が最も詳細、LodCount 以上は最も粗い段階になる)
+	*	@param instanceCount	インスタンス数(シェーダは gl_InstanceID でインスタンスを区別する)
+	*
+	*	@return 描画した三角形の数(全インスタンスの合計)
+	*/
+	size_t Mesh::Draw(const BufferPtr& buffer, int lod, GLsizei instanceCount) const {
+		if (!buffer) {
+			return 0;
+		}
+		if (buffer.get() != owner) {
+			std::cerr << "WARNING: バッファに存在しないメッシュ'" << name << "'を描画しようとしました" << std::endl;
+			return 0;
+		}
+		size_t begin, end;
+		MaterialRange(lod, begin, end);
+		size_t triangles = 0;
+		for (size_t i = begin; i < end; ++i) {
+			const Material& m = buffer->GetMaterial(i);
+			if (instanceCount > 1) {
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, m.size, m.type, m.offset, instanceCount, m.baseVertex);
+			} else {
+				glDrawElementsBaseVertex(GL_TRIANGLES, m.size, m.type, m.offset, m.baseVertex);
+			}
+			triangles += m.size / 3 * instanceCount;
+		}
+		return triangles;
+	}
+
+	/**
+	*	クラスタ単位でカリングしてメッシュを描画する
+	*
+	*	@param buffer	描画に使用するメッシュバッファへのポインタ
+	*	@param lod		描画する詳細度の段階
+	*	@param culler	視点を設定済みのカリング情報
+	*	@param matModel	メッシュのモデル行列
+	*
+	*	@return 描画した三角形の数
+	*
+	*	クラスタを持たないマテリアルはマテリアル全体を描画する
+	*	拡大率が軸毎に異なる場合と裏返っている場合は法線錐が歪むため、背面カリングを行わない
+	*/
+	size_t Mesh::Draw(const BufferPtr& buffer, int lod, ClusterCuller& culler, const glm::mat4& matModel) const {
+		if (!hasClusters || !culler.isEnabled) {
+			return Draw(buffer, lod);
+		}
+		if (!buffer) {
+			return 0;
+		}
+		if (buffer.get() != owner) {
+			std::cerr << "WARNING: バッファに存在しないメッシュ'" << name << "'を描画しようとしました" << std::endl;
+			return 0;
+		}
+		culler.SetModel(matModel);
+
+		size_t begin, end;
+		MaterialRange(lod, begin, end);
+		size_t triangles = 0;
+		for (size_t i = begin; i < end; ++i) {
+			const Material& m = buffer->GetMaterial(i);
+			if (m.beginCluster == m.endCluster) {
+				glDrawElementsBaseVertex(GL_TRIANGLES, m.size, m.type, m.offset, m.baseVertex);
+				triangles += m.size / 3;
+				continue;
+			}
+			const GLsizeiptr indexSize = m.type == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+			culler.countList.clear();
+			culler.offsetList.clear();
+			culler.statistics.triangles += m.size / 3;
+			for (uint32_t j = m.beginCluster; j < m.endCluster; ++j) {
+				const Cluster& c = buffer->GetCluster(j);
+				const ClusterCuller::Result result = culler.Classify(c);
+				if (result == ClusterCuller::frustumCulled) {
+					culler.statistics.frustumCulled += c.size / 3;
+					continue;
+				} else if (result == ClusterCuller::backfaceCulled) {
+					culler.statistics.backfaceCulled += c.size / 3;
+					continue;
+				}
+				//直前のクラスタと連続していれば 1 つの描画範囲にまとめる
+				const GLvoid* offset = static_cast<const uint8_t*>(m.offset) + c.offset;
+				if (!culler.countList.empty() &&
+					static_cast<const uint8_t*>(culler.offsetList.back()) + culler.countList.back() * indexSize == offset) {
+					culler.countList.back() += c.size;
+				} else {
+					culler.countList.push_back(c.size);
+					culler.offsetList.push_back(offset);
+				}
+				triangles += c.size / 3;
+			}
+			if (!culler.countList.empty()) {
+				culler.baseVertexList.assign(culler.countList.size(), m.baseVertex);
+				glMultiDrawElementsBaseVertex(GL_TRIANGLES, culler.countList.data(), m.type, culler.offsetList.data(),
+					static_cast<GLsizei>(culler.countList.size()), culler.baseVertexList.data());
+			}
+		}
+		return triangles;
+	}
+
+	/**
+	*	カリングに使う視点を設定する
+	*
+	*	@param matView	View 行列
+	*	@param matProj	Projection 行列
+	*/
+	void ClusterCuller::Setup(const glm::mat4& matView, const glm::mat4& matProj) {
+		const glm::mat4 m = matProj * matView;
+		const glm::vec4 row[4] = {
+			glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]),
+			glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]),
+			glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]),
+			glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]),
+		};
+		for (int i = 0; i < 3; ++i) {
+			planes[i * 2 + 0] = row[3] + row[i];
+			planes[i * 2 + 1] = row[3] - row[i];
+		}
+		for (glm::vec4& plane : planes) {
+			const float length = glm::length(glm::vec3(plane));
+			if (length > 0.0f) {
+				plane /= length;
+			}
+		}
+		eye = glm::vec3(glm::inverse(matView)[3]);
+	}
+
+	/**
+	*	判定するメッシュのモデル行列を設定する
+	*
+	*	@param m	モデル行列
+	*
+	*	拡大率が軸ごとに異なるか、裏返す行列の場合は法線錐による背面カリングを行わない
+	*/
+	void ClusterCuller::SetModel(const glm::mat4& m) {
+		const glm::mat3 matRS(m);
+		const float scaleX = glm::length(matRS[0]);
+		const float scaleY = glm::length(matRS[1]);
+		const float scaleZ = glm::length(matRS[2]);
+		const float tolerance = std::max(std::max(scaleX, scaleY), scaleZ) * 0.001f;
+		matModel = m;
+		maxScale = std::max(std::max(scaleX, scaleY), scaleZ);
+		coneCulling = maxScale > 0.0f && std::abs(scaleX - scaleY) <= tolerance && std::abs(scaleX - scaleZ) <= tolerance &&
+			glm::determinant(matRS) > 0.0f;
+		matRotation = coneCulling ? matRS * (1.0f / scaleX) : glm::mat3(1);
+	}
+
+	/**
+	*	クラスタを描画するか判定する
+	*
+	*	@param c	判定するクラスタ
+	*
+	*	@return 判定結果
+	*
+	*	Setup と SetModel を呼び出してから使う
+	*/
+	ClusterCuller::Result ClusterCuller::Classify(const Cluster& c) const {
+		const glm::vec3 center(matModel * glm::vec4(c.center, 1));
+		const float radius = c.radius * maxScale;
+		for (const glm::vec4& plane : planes) {
+			if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+				return frustumCulled;
+			}
+		}
+		//境界球内のどの点から見ても全ての法線が視線と同じ向きなら裏向き
+		if (coneCulling && c.coneCutoff < 1.0f) {
+			const glm::vec3 v = center - eye;
+			if (glm::dot(v, matRotation * c.coneAxis) >= c.coneCutoff * glm::length(v) + radius * (1.0f + c.coneCutoff)) {
+				return backfaceCulled;
+			}
+		}
+		return visible;
+	}
+
+	/**
+	*	詳細度の段階に対応するマテリアルの範囲を取得する
+	*
+	*	@param lod		詳細度の段階(範囲外の値は最も近い段階に丸める)
+	*	@param begin	範囲の先頭のマテリアル番号を格納する変数
+	*	@param end		範囲の終端のマテリアル番号を格納する変数
+	*
+	*	マテリアルは段階毎に同じ数だけ、LOD 0 から順に並んでいる
+	*/
+	void Mesh::MaterialRange(int lod, size_t& begin, size_t& end) const {
+		const size_t count = (endMaterial - beginMaterial) / lodCount;
+		begin = beginMaterial + count * std::min<size_t>(std::max(lod, 0), lodCount - 1);
+		end = begin + count;
+	}
+
+	/**
+	*	メッシュの三角形の数を取得する
+	*
+	*	@param buffer	メッシュを格納しているメッシュバッファへのポインタ
+	*	@param lod		詳細度の段階
+	*
+	*	@return lod の段階で描画される三角形の数
+	*/
+	size_t Mesh::TriangleCount(const BufferPtr& buffer, int lod) const {
+		size_t begin, end;
+		MaterialRange(lod, begin, end);
+		size_t triangles = 0;
+		for (size_t i = begin; i < end; ++i) {
+			triangles += buffer->GetMaterial(i).size / 3;
+		}
+		return triangles;
+	}
+
+	/**
+	*	メッシュバッファを作成する
+	*
+	*	@param vboSize	バッファに格納可能な総頂点数の初期値
+	*	@param iboSize	バッファに格納可能な総インデックス数の初期値
+	*
+	*	容量が足りなくなると、バッファは自動的に拡張される
+	*/
+	BufferPtr Buffer::Create(int vboSize, int iboSize) {
+		struct Impl : Buffer { Impl() {} ~Impl() {} };
+		BufferPtr p = std::make_shared<Impl>();
+		p->vbo = CreateVBO(vboSize * sizeof(PackedVertex), nullptr);
 		if (!p->vbo) {
 			return {};
 		}
@@ -387,16 +2459,17 @@ namespace Mesh {
 		if (!p->vao) {
 			return{};
 		}
+		p->vboAllocator = RangeAllocator(vboSize * sizeof(PackedVertex), sizeof(PackedVertex));
+		p->iboAllocator = RangeAllocator(iboSize * sizeof(uint32_t), sizeof(uint32_t));
+		p->CreatePlaceholder();
 		return p;
 	}
 
 	/**
-	*	fXgN^
+	*	デストラクタ
 	*/
 	Buffer::~Buffer() {
-		if (vao) {
-			glDeleteVertexArrays(1, &vao);
-		}
+		GLState::DeleteVertexArray(vao);
 		if (ibo) {
 
 		}glDeleteBuffers(1, &ibo);
@@ -406,62 +2479,621 @@ namespace Mesh {
 	}
 
 	/**
-	*	bVt@Cǂݍ
+	*	メッシュファイルを読み込んで、バッファに転送できる形式に変換する
+	*
+	*	@param fileName	メッシュファイル名
+	*	@param file		変換したデータを格納する変数
+	*
+	*	@retval true	変換成功
+	*	@retval false	変換失敗
+	*
+	*	FBX ファイルと同じ場所にある .mesh ファイルをキャッシュとして使用する
+	*	キャッシュが存在しないか、FBX ファイルの内容と一致しない場合は FBX ファイルから作り直す
+	*	FBX ファイルが存在しない場合はキャッシュをそのまま使用する
+	*	OpenGL の関数を呼ばないので、ワーカースレッドから呼び出してもよい
+	*/
+	bool DecodeMeshFile(const char* fileName, MeshFile& file) {
+		file.name = fileName;
+		const std::string cacheName = CacheFileName(fileName);
+		const MappedFilePtr source = MappedFile::Open(fileName);
+		const uint64_t sourceHash = source ? CalcHash(source->Data(), source->Size()) : 0;
+		if (MappedFilePtr cache = MappedFile::Open(cacheName.c_str())) {
+			const CacheHeader* header = GetCacheHeader(cache->Data(), cache->Size());
+			if (header && (!source || header->sourceHash == sourceHash)) {
+				file.name = cacheName;
+				file.mappedFile = cache;
+				return true;
+			}
+			if (!source) {
+				std::cerr << "ERROR: " << cacheName << " はメッシュキャッシュではありません" << std::endl;
+				return false;
+			}
+		}
+		if (!source) {
+			std::cerr << "ERROR: " << fileName << " が見つかりません" << std::endl;
+			return false;
+		}
+		return BakeMeshCache(fileName, sourceHash, file.image);
+	}
+
+	/**
+	*	メッシュをファイルから読み込む
 	*
-	*	@param fileName	bVt@C
+	*	@param fileName	メッシュファイル名
 	*
-	*	@retval true	ǂݍݐ
-	*	@retval false	ǂݍݎs
+	*	@retval true	読み込み成功
+	*	@retval false	読み込み失敗
 	*/
 	bool Buffer::LoadMeshFromFile(const char* fileName) {
-		FbxLoader loader;
-		if (!loader.Load(fileName)) {
+		MeshFile file;
+		if (!DecodeMeshFile(fileName, file)) {
+			return false;
+		}
+		return Upload(file);
+	}
+
+	/**
+	*	DecodeMeshFile で変換したデータをバッファに転送する
+	*
+	*	@param file	転送するデータ
+	*
+	*	@retval true	転送成功
+	*	@retval false	転送失敗
+	*/
+	bool Buffer::Upload(const MeshFile& file) {
+		if (IsLoaded(file.name.c_str())) {
+			return true;
+		}
+		MeshUpload upload;
+		if (!ReserveUpload(file, upload)) {
 			return false;
 		}
-		GLint64 vboSize = 0;
-		GLint64 iboSize = 0;
 		glBindBuffer(GL_ARRAY_BUFFER, vbo);
-		glGetBufferParameteri64v(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &vboSize);
+		glBufferSubData(GL_ARRAY_BUFFER, upload.vboOffset, upload.vertexBytes, upload.vertexData);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
-		glGetBufferParameteri64v(GL_ELEMENT_ARRAY_BUFFER, GL_BUFFER_SIZE, &iboSize);
-		for (TemporaryMesh& e : loader.meshList) {
-			for (TemporaryMaterial& material : e.materialList) {
-				const GLsizeiptr verticeBytes = material.vertexBuffer.size() * sizeof(Vertex);
-				if (vboEnd + verticeBytes >= vboSize) {
-					std::cerr << "WARNING: VBO TCYsĂ܂(" << vboEnd << '/' << vboSize << ')' << std::endl;
-					continue;
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, upload.iboOffset, upload.indexBytes, upload.indexData);
+		CommitUpload(file, upload);
+		return true;
+	}
+
+	/**
+	*	メッシュデータの転送先を確保する
+	*
+	*	@param file		転送するデータ
+	*	@param upload	転送先と転送元の情報を格納する変数
+	*
+	*	@retval true	確保成功
+	*	@retval false	データが壊れているか、読み込み済みか、バッファを拡張できない
+	*
+	*	確保した範囲へのデータ転送は呼び出し側で行い、完了したら CommitUpload を呼び出すこと
+	*	確保した範囲は、CommitUpload を呼び出すまで UnloadMesh や Defragment の対象にならない
+	*	頂点データとインデックスデータは GPU 用の形式で格納されているため、そのまま転送できる
+	*/
+	bool Buffer::ReserveUpload(const MeshFile& file, MeshUpload& upload) {
+		const uint8_t* data = file.Data();
+		const CacheHeader* header = GetCacheHeader(data, file.Size());
+		if (!header) {
+			std::cerr << "ERROR: " << file.name << " はメッシュキャッシュではありません" << std::endl;
+			return false;
+		}
+		const CacheMesh* meshes = reinterpret_cast<const CacheMesh*>(data + sizeof(CacheHeader));
+		const CacheMaterial* materials = reinterpret_cast<const CacheMaterial*>(meshes + header->meshCount);
+
+		//データの範囲を検証する
+		uint64_t materialCount = 0;
+		for (uint32_t i = 0; i < header->meshCount; ++i) {
+			materialCount += static_cast<uint64_t>(meshes[i].materialCount) * meshes[i].lodCount;
+			if (static_cast<uint64_t>(meshes[i].nameOffset) + meshes[i].nameLength > header->nameBytes || meshes[i].lodCount == 0) {
+				std::cerr << "ERROR: " << file.name << " が壊れています" << std::endl;
+				return false;
+			}
+		}
+		if (materialCount != header->materialCount) {
+			std::cerr << "ERROR: " << file.name << " が壊れています" << std::endl;
+			return false;
+		}
+		const uint64_t vertexCount = header->vertexBytes / sizeof(PackedVertex);
+		const CacheCluster* clusters = reinterpret_cast<const CacheCluster*>(materials + header->materialCount);
+		for (uint32_t i = 0; i < header->materialCount; ++i) {
+			const CacheMaterial& m = materials[i];
+			if ((m.indexType != GL_UNSIGNED_INT && m.indexType != GL_UNSIGNED_SHORT) ||
+				(m.indexOffset & 3) ||
+				m.indexOffset + static_cast<uint64_t>(m.indexCount) * IndexSize(m.indexType) > header->indexBytes ||
+				static_cast<uint64_t>(m.baseVertex) + m.vertexCount > vertexCount ||
+				static_cast<uint64_t>(m.clusterOffset) + m.clusterCount > header->clusterCount) {
+				std::cerr << "ERROR: " << file.name << " が壊れています" << std::endl;
+				return false;
+			}
+			for (uint32_t j = m.clusterOffset; j < m.clusterOffset + m.clusterCount; ++j) {
+				if (static_cast<uint64_t>(clusters[j].indexOffset) + clusters[j].indexCount > m.indexCount) {
+					std::cerr << "ERROR: " << file.name << " が壊れています" << std::endl;
+					return false;
 				}
-				const GLsizei indexSize = static_cast<GLsizei>(material.indexBuffer.size());
-				const GLsizeiptr indicesBytes = indexSize * sizeof(uint32_t);
-				if (iboEnd + indicesBytes >= iboSize) {
-					std::cerr << "WARNING: IBO TCYsĂ܂(" << iboEnd << '/' << iboSize << ')' << std::endl;
-					continue;
+			}
+		}
+
+		const std::string key = CacheFileName(file.name.c_str());
+		if (allocationList.find(key) != allocationList.end()) {
+			std::cerr << "WARNING: " << file.name << " は読み込み済みです" << std::endl;
+			return false;
+		}
+		const GLsizeiptr verticesBytes = static_cast<GLsizeiptr>(header->vertexBytes);
+		const GLsizeiptr indicesBytes = static_cast<GLsizeiptr>(header->indexBytes);
+		if (!Allocate(verticesBytes, indicesBytes, upload.vboOffset, upload.iboOffset)) {
+			return false;
+		}
+		upload.vertexData = data + header->vertexOffset;
+		upload.vertexBytes = verticesBytes;
+		upload.indexData = data + header->indexOffset;
+		upload.indexBytes = indicesBytes;
+		allocationList.insert(std::make_pair(key, Allocation{ upload.vboOffset, verticesBytes, upload.iboOffset, indicesBytes, 0, 0, 0, 0, {}, false }));
+		return true;
+	}
+
+	/**
+	*	転送を終えたメッシュデータを登録する
+	*
+	*	@param file		転送したデータ
+	*	@param upload	ReserveUpload で確保した転送先の情報
+	*
+	*	GetOrReserveMesh で予約されていたメッシュは、同じオブジェクトのまま描画内容が差し替えられる
+	*/
+	void Buffer::CommitUpload(const MeshFile& file, const MeshUpload& upload) {
+		const uint8_t* data = file.Data();
+		const CacheHeader* header = reinterpret_cast<const CacheHeader*>(data);
+		const CacheMesh* meshes = reinterpret_cast<const CacheMesh*>(data + sizeof(CacheHeader));
+		const CacheMaterial* materials = reinterpret_cast<const CacheMaterial*>(meshes + header->meshCount);
+		const CacheCluster* clusters = reinterpret_cast<const CacheCluster*>(materials + header->materialCount);
+		const char* names = reinterpret_cast<const char*>(clusters + header->clusterCount);
+		const PackedVertex* vertices = reinterpret_cast<const PackedVertex*>(data + header->vertexOffset);
+
+		struct Impl : public Mesh {
+			Impl(const std::string& n, size_t b, size_t e) : Mesh(n, b, e) {}
+			~Impl() {}
+		};
+		const GLint vboBaseVertex = static_cast<GLint>(upload.vboOffset / sizeof(PackedVertex));
+		Allocation& allocation = allocationList.find(CacheFileName(file.name.c_str()))->second;
+		allocation.beginMaterial = materialList.size();
+		allocation.beginCluster = clusterList.size();
+		const CacheMaterial* pMaterial = materials;
+		for (uint32_t i = 0; i < header->meshCount; ++i) {
+			const size_t beginMaterial = materialList.size();
+			bool hasClusters = false;
+			bool isTranslucent = false;
+			for (uint32_t j = 0; j < meshes[i].materialCount * meshes[i].lodCount; ++j, ++pMaterial) {
+				const glm::vec4 color(pMaterial->color[0], pMaterial->color[1], pMaterial->color[2], pMaterial->color[3]);
+				//半透明のものは描画順を変えられないため、マテリアルと頂点カラーのアルファを調べておく
+				isTranslucent = isTranslucent || color.a < 1 || std::any_of(vertices + pMaterial->baseVertex,
+					vertices + pMaterial->baseVertex + pMaterial->vertexCount, [](const PackedVertex& v) { return v.color[3] < 255; });
+				const GLintptr offset = upload.iboOffset + static_cast<GLintptr>(pMaterial->indexOffset);
+				const uint32_t beginCluster = static_cast<uint32_t>(clusterList.size());
+				for (uint32_t k = pMaterial->clusterOffset; k < pMaterial->clusterOffset + pMaterial->clusterCount; ++k) {
+					const CacheCluster& c = clusters[k];
+					clusterList.push_back({ glm::vec3(c.center[0], c.center[1], c.center[2]), c.radius,
+						glm::vec3(c.coneAxis[0], c.coneAxis[1], c.coneAxis[2]), c.coneCutoff,
+						static_cast<GLsizei>(c.indexCount), static_cast<GLsizeiptr>(c.indexOffset * IndexSize(pMaterial->indexType)) });
 				}
-				glBufferSubData(GL_ARRAY_BUFFER, vboEnd, verticeBytes, material.vertexBuffer.data());
-				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, iboEnd, indicesBytes, material.indexBuffer.data());
-				const GLint baseVertex = static_cast<uint32_t>(vboEnd / sizeof(Vertex));
-				materialList.push_back({ GL_UNSIGNED_INT, indexSize, reinterpret_cast<GLvoid*>(iboEnd), baseVertex,material.color });
-				vboEnd += verticeBytes;
-				iboEnd += indicesBytes;
+				hasClusters |= pMaterial->clusterCount > 0;
+				materialList.push_back({ pMaterial->indexType, static_cast<GLsizei>(pMaterial->indexCount), reinterpret_cast<GLvoid*>(offset),
+					vboBaseVertex + static_cast<GLint>(pMaterial->baseVertex), color, beginCluster, static_cast<uint32_t>(clusterList.size()) });
+			}
+			const std::string name(names + meshes[i].nameOffset, meshes[i].nameLength);
+			auto itr = meshList.find(name);
+			if (itr == meshList.end()) {
+				itr = meshList.insert(std::make_pair(name, std::make_shared<Impl>(name, beginMaterial, materialList.size()))).first;
+				itr->second->owner = this;
+			} else if (itr->second->isPlaceholder) {
+				itr->second->beginMaterial = beginMaterial;
+				itr->second->endMaterial = materialList.size();
+				itr->second->isPlaceholder = false;
+				itr->second->isReserved = false;
+				itr->second->isMissing = false;
+			} else {
+				continue;
+			}
+			Mesh& mesh = *itr->second;
+			mesh.lodCount = meshes[i].lodCount;
+			mesh.center = glm::vec3(meshes[i].center[0], meshes[i].center[1], meshes[i].center[2]);
+			mesh.radius = meshes[i].radius;
+			mesh.boundsMin = glm::vec3(meshes[i].boundsMin[0], meshes[i].boundsMin[1], meshes[i].boundsMin[2]);
+			mesh.boundsMax = glm::vec3(meshes[i].boundsMax[0], meshes[i].boundsMax[1], meshes[i].boundsMax[2]);
+			mesh.hasClusters = hasClusters;
+			mesh.isTranslucent = isTranslucent;
+			allocation.meshNames.push_back(name);
+		}
+		allocation.endMaterial = materialList.size();
+		allocation.endCluster = clusterList.size();
+		allocation.isCommitted = true;
+	}
+
+	/**
+	*	仮表示用の立方体をバッファの先頭に作成する
+	*
+	*	GetOrReserveMesh で予約したメッシュは、読み込みが終わるまでこの立方体を表示する
+	*/
+	void Buffer::CreatePlaceholder() {
+		static const float faceList[6][3] = {
+			{ 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+		};
+		PackedVertex vertices[24];
+		uint16_t indices[36];
+		for (int face = 0; face < 6; ++face) {
+			const glm::vec3 n(faceList[face][0], faceList[face][1], faceList[face][2]);
+			const glm::vec3 u(n.y + n.z, n.z + n.x, n.x + n.y);
+			const glm::vec3 v = glm::cross(n, u);
+			for (int i = 0; i < 4; ++i) {
+				const float su = (i == 1 || i == 2) ? 0.5f : -0.5f;
+				const float sv = (i >= 2) ? 0.5f : -0.5f;
+				Vertex vertex;
+				vertex.position = n * 0.5f + u * su + v * sv;
+				vertex.color = glm::vec4(1);
+				vertex.texCoord = glm::vec2(su + 0.5f, sv + 0.5f);
+				vertex.normal = n;
+				vertices[face * 4 + i] = PackVertex(vertex);
+			}
+			static const uint16_t quad[6] = { 0, 1, 2, 2, 3, 0 };
+			for (int i = 0; i < 6; ++i) {
+				indices[face * 6 + i] = static_cast<uint16_t>(face * 4 + quad[i]);
+			}
+		}
+		GLintptr vboOffset;
+		GLintptr iboOffset;
+		if (!Allocate(sizeof(vertices), sizeof(indices), vboOffset, iboOffset)) {
+			return;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, vboOffset, sizeof(vertices), vertices);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ibo);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, iboOffset, sizeof(indices), indices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		placeholderMaterial = materialList.size();
+		materialList.push_back({ GL_UNSIGNED_SHORT, 36, reinterpret_cast<GLvoid*>(iboOffset), static_cast<GLint>(vboOffset / sizeof(PackedVertex)), glm::vec4(1) });
+	}
+
+	/**
+	*	メッシュを仮表示用の立方体に切り替える
+	*
+	*	@param mesh	切り替えるメッシュ
+	*/
+	void Buffer::SetPlaceholder(Mesh& mesh) const {
+		mesh.beginMaterial = placeholderMaterial;
+		mesh.endMaterial = placeholderMaterial + 1;
+		mesh.lodCount = 1;
+		mesh.center = glm::vec3(0);
+		mesh.radius = 0.8660254f; // 一辺 1 の立方体の外接球
+		mesh.boundsMin = glm::vec3(-0.5f);
+		mesh.boundsMax = glm::vec3(0.5f);
+		mesh.hasClusters = false;
+		mesh.isTranslucent = false;
+		mesh.isPlaceholder = true;
+	}
+
+	/**
+	*	VBO と IBO の領域を割り当てる
+	*
+	*	@param vertexBytes	割り当てる頂点データのバイト数
+	*	@param indexBytes	割り当てるインデックスデータのバイト数
+	*	@param vboOffset	割り当てた頂点データのバイトオフセットを格納する変数
+	*	@param iboOffset	割り当てたインデックスデータのバイトオフセットを格納する変数
+	*
+	*	@retval true	割り当て成功
+	*	@retval false	バッファを拡張できなかった
+	*/
+	bool Buffer::Allocate(GLsizeiptr vertexBytes, GLsizeiptr indexBytes, GLintptr& vboOffset, GLintptr& iboOffset) {
+		size_t v = 0;
+		if (!AllocateRange(vbo, vboAllocator, vertexBytes, v)) {
+			return false;
+		}
+		size_t i = 0;
+		if (!AllocateRange(ibo, iboAllocator, indexBytes, i)) {
+			vboAllocator.Free(v, vertexBytes);
+			return false;
+		}
+		vboOffset = static_cast<GLintptr>(v);
+		iboOffset = static_cast<GLintptr>(i);
+		return true;
+	}
+
+	/**
+	*	バッファの領域を割り当てる、空きがなければバッファを拡張する
+	*
+	*	@param buffer		割り当てるバッファオブジェクト(拡張すると新しいバッファに置き換えられる)
+	*	@param allocator	buffer の領域管理
+	*	@param bytes		割り当てるバイト数
+	*	@param offset		割り当てた範囲のバイトオフセットを格納する変数
+	*
+	*	@retval true	割り当て成功
+	*	@retval false	拡張に失敗したか、拡張しても割り当てられなかった
+	*
+	*	bytes が 0 なら何も割り当てず、offset に 0 を格納して成功とする(解放も何もしない)
+	*/
+	bool Buffer::AllocateRange(GLuint& buffer, RangeAllocator& allocator, GLsizeiptr bytes, size_t& offset) {
+		if (bytes <= 0) {
+			offset = 0;
+			return true;
+		}
+		offset = allocator.Allocate(bytes);
+		if (offset != RangeAllocator::npos) {
+			return true;
+		}
+		if (!GrowBuffer(buffer, allocator, bytes)) {
+			return false;
+		}
+		offset = allocator.Allocate(bytes);
+		if (offset == RangeAllocator::npos) {
+			std::cerr << "ERROR: メッシュバッファを拡張しても " << bytes << " バイトを割り当てられません" << std::endl;
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	*	バッファを拡張する
+	*
+	*	@param buffer			拡張するバッファオブジェクト(新しいバッファに置き換えられる)
+	*	@param allocator		buffer の領域管理
+	*	@param requiredBytes	新たに割り当てたいバイト数
+	*
+	*	@retval true	拡張成功
+	*	@retval false	拡張失敗
+	*
+	*	容量を 2 倍(足りなければ requiredBytes 分を追加)にした新しいバッファを作り、内容をコピーする
+	*	VAO はバッファの参照を持つので作り直す
+	*/
+	bool Buffer::GrowBuffer(GLuint& buffer, RangeAllocator& allocator, size_t requiredBytes) {
+		const size_t oldSize = allocator.Capacity();
+		const size_t newSize = std::max(oldSize * 2, oldSize + allocator.AlignedSize(requiredBytes));
+		GLuint newBuffer = 0;
+		glGenBuffers(1, &newBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+		const GLenum result = glGetError();
+		if (result != GL_NO_ERROR) {
+			std::cerr << "ERROR: メッシュバッファの拡張に失敗(" << oldSize << " -> " << newSize << ")" << std::endl;
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			glDeleteBuffers(1, &newBuffer);
+			return false;
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+		buffer = newBuffer;
+		allocator.Grow(newSize);
+
+		GLState::DeleteVertexArray(vao);
+		vao = CreateVAO(vbo, ibo);
+		std::cerr << "WARNING: メッシュバッファを拡張(" << oldSize << " -> " << newSize << " バイト)" << std::endl;
+		return true;
+	}
+
+	/**
+	*	予約したまま読み込まれていないメッシュを、見つからなかったものとして記録する
+	*
+	*	@return 新たに見つからなかったと判定したメッシュの数
+	*
+	*	読み込み待ちのメッシュファイルがなくなった時点で呼び出す
+	*	判定したメッシュは警告を 1 度だけ出力し、IsMissing が true になる
+	*	後で同じ名前のメッシュが読み込まれれば、通常のメッシュに戻る
+	*/
+	size_t Buffer::MarkMissingMeshes() {
+		size_t count = 0;
+		for (auto& e : meshList) {
+			Mesh& mesh = *e.second;
+			if (mesh.isReserved && !mesh.isMissing) {
+				std::cerr << "WARNING: メッシュ'" << e.first << "'は読み込んだどのファイルにも含まれていません" << std::endl;
+				mesh.isMissing = true;
+				++count;
+			}
+		}
+		return count;
+	}
+
+	/**
+	*	メッシュファイルが読み込み済みか調べる
+	*
+	*	@param fileName	メッシュファイル名
+	*
+	*	@retval true	読み込み済み、または転送中
+	*	@retval false	読み込まれていない
+	*/
+	bool Buffer::IsLoaded(const char* fileName) const {
+		return allocationList.find(CacheFileName(fileName)) != allocationList.end();
+	}
+
+	/**
+	*	メッシュファイルが登録したメッシュ名を取得する
+	*
+	*	@param fileName	メッシュファイル名
+	*
+	*	@return fileName から読み込んだメッシュ名のリスト
+	*			読み込まれていなければ空のリスト
+	*/
+	std::vector<std::string> Buffer::MeshNames(const char* fileName) const {
+		const auto itr = allocationList.find(CacheFileName(fileName));
+		if (itr == allocationList.end()) {
+			return{};
+		}
+		return itr->second.meshNames;
+	}
+
+	/**
+	*	メッシュファイルから読み込んだメッシュを破棄する
+	*
+	*	@param fileName	メッシュファイル名
+	*
+	*	@retval true	破棄成功
+	*	@retval false	読み込まれていないか、転送中
+	*
+	*	ファイルに含まれる全てのメッシュを破棄し、VBO と IBO の領域を解放する
+	*	エンティティが使用中のメッシュは、仮表示用の立方体に切り替わる
+	*	同じファイルを再び読み込むと、元のメッシュに戻る
+	*/
+	bool Buffer::UnloadMesh(const char* fileName) {
+		const auto itr = allocationList.find(CacheFileName(fileName));
+		if (itr == allocationList.end()) {
+			std::cerr << "WARNING: " << fileName << " は読み込まれていません" << std::endl;
+			return false;
+		}
+		const Allocation& allocation = itr->second;
+		if (!allocation.isCommitted) {
+			std::cerr << "WARNING: " << fileName << " は転送中のため破棄できません" << std::endl;
+			return false;
+		}
+		vboAllocator.Free(allocation.vboOffset, allocation.vertexBytes);
+		iboAllocator.Free(allocation.iboOffset, allocation.indexBytes);
+		for (const std::string& name : allocation.meshNames) {
+			const auto mesh = meshList.find(name);
+			if (mesh == meshList.end()) {
+				continue;
+			}
+			if (mesh->second.use_count() == 1) {
+				meshList.erase(mesh);
+			} else {
+				SetPlaceholder(*mesh->second);
+			}
+		}
+
+		//後ろにあるマテリアルを詰める
+		const size_t begin = allocation.beginMaterial;
+		const size_t end = allocation.endMaterial;
+		const size_t count = end - begin;
+		materialList.erase(materialList.begin() + begin, materialList.begin() + end);
+		if (placeholderMaterial >= end) {
+			placeholderMaterial -= count;
+		}
+
+		//後ろにあるクラスタを詰める
+		const size_t endCluster = allocation.endCluster;
+		const size_t clusterCount = endCluster - allocation.beginCluster;
+		clusterList.erase(clusterList.begin() + allocation.beginCluster, clusterList.begin() + endCluster);
+		for (Material& e : materialList) {
+			if (e.beginCluster >= endCluster) {
+				e.beginCluster -= static_cast<uint32_t>(clusterCount);
+				e.endCluster -= static_cast<uint32_t>(clusterCount);
+			}
+		}
+		for (auto& e : meshList) {
+			if (e.second->beginMaterial >= end) {
+				e.second->beginMaterial -= count;
+				e.second->endMaterial -= count;
+			}
+		}
+		allocationList.erase(itr);
+		for (auto& e : allocationList) {
+			if (e.second.isCommitted && e.second.beginMaterial >= end) {
+				e.second.beginMaterial -= count;
+				e.second.endMaterial -= count;
 			}
+			if (e.second.isCommitted && e.second.beginCluster >= endCluster) {
+				e.second.beginCluster -= clusterCount;
+				e.second.endCluster -= clusterCount;
+			}
+		}
+		return true;
+	}
+
+	/**
+	*	バッファの後ろにあるメッシュを前の空き領域へ移動する
+	*
+	*	@param maxBytes	移動する最大バイト数
+	*
+	*	@return 移動したバイト数
+	*
+	*	移動はバッファ内のコピーで行い、マテリアルの描画位置を書き換える
+	*	毎フレーム少しずつ呼び出すことで、描画を止めずに断片化を解消できる
+	*/
+	size_t Buffer::Defragment(size_t maxBytes) {
+		std::vector<Allocation*> list;
+		list.reserve(allocationList.size());
+		for (auto& e : allocationList) {
+			if (e.second.isCommitted) {
+				list.push_back(&e.second);
+			}
+		}
+		size_t movedBytes = 0;
+
+		//頂点データを移動する
+		std::sort(list.begin(), list.end(), [](const Allocation* lhs, const Allocation* rhs) { return lhs->vboOffset > rhs->vboOffset; });
+		glBindBuffer(GL_COPY_READ_BUFFER, vbo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+		for (Allocation* e : list) {
+			if (movedBytes >= maxBytes) {
+				break;
+			}
+			const size_t offset = vboAllocator.Allocate(e->vertexBytes, e->vboOffset);
+			if (offset == RangeAllocator::npos) {
+				continue;
+			}
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, e->vboOffset, offset, e->vertexBytes);
+			vboAllocator.Free(e->vboOffset, e->vertexBytes);
+			const GLint delta = static_cast<GLint>((e->vboOffset - static_cast<GLintptr>(offset)) / sizeof(PackedVertex));
+			for (size_t i = e->beginMaterial; i < e->endMaterial; ++i) {
+				materialList[i].baseVertex -= delta;
+			}
+			e->vboOffset = offset;
+			movedBytes += e->vertexBytes;
+		}
+
+		//インデックスデータを移動する
+		std::sort(list.begin(), list.end(), [](const Allocation* lhs, const Allocation* rhs) { return lhs->iboOffset > rhs->iboOffset; });
+		glBindBuffer(GL_COPY_READ_BUFFER, ibo);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, ibo);
+		for (Allocation* e : list) {
+			if (movedBytes >= maxBytes) {
+				break;
+			}
+			const size_t offset = iboAllocator.Allocate(e->indexBytes, e->iboOffset);
+			if (offset == RangeAllocator::npos) {
+				continue;
+			}
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, e->iboOffset, offset, e->indexBytes);
+			iboAllocator.Free(e->iboOffset, e->indexBytes);
+			const GLintptr delta = e->iboOffset - static_cast<GLintptr>(offset);
+			for (size_t i = e->beginMaterial; i < e->endMaterial; ++i) {
+				materialList[i].offset = static_cast<uint8_t*>(materialList[i].offset) - delta;
+			}
+			e->iboOffset = offset;
+			movedBytes += e->indexBytes;
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return movedBytes;
+	}
 
+	/**
+	*	メッシュを取得する、存在しなければ仮表示用のメッシュを予約する
+	*
+	*	@param name	メッシュ名
+	*
+	*	@return name に対応するメッシュへのポインタ
+	*
+	*	予約したメッシュは、同じ名前のメッシュが読み込まれるまで仮表示用の立方体を表示する
+	*/
+	const MeshPtr& Buffer::GetOrReserveMesh(const char* name) {
+		auto itr = meshList.find(name);
+		if (itr == meshList.end()) {
 			struct Impl : public Mesh {
 				Impl(const std::string& n, size_t b, size_t e) : Mesh(n, b, e) {}
-				~Impl(){}
+				~Impl() {}
 			};
-			const size_t endMaterial = materialList.size();
-			const size_t beginMaterial = endMaterial - e.materialList.size();
-			meshList.insert(std::make_pair(e.name, std::make_shared<Impl>(e.name, beginMaterial, endMaterial)));
+			MeshPtr mesh = std::make_shared<Impl>(name, 0, 0);
+			mesh->owner = this;
+			mesh->isReserved = true;
+			SetPlaceholder(*mesh);
+			itr = meshList.insert(std::make_pair(std::string(name), mesh)).first;
 		}
-		return true;
+		return itr->second;
 	}
 
 	/**
-	*	bV擾
+	*	メッシュを取得する
 	*
-	*	@param name	bV
+	*	@param name	メッシュ名
 	*
-	*	@return name ɑΉ郁bVւ̃|C^
+	*	@return name に対応するメッシュへのポインタ
 	*/
 	const MeshPtr& Buffer::GetMesh(const char* name) const {
 		auto itr = meshList.find(name);
@@ -473,11 +3105,11 @@ namespace Mesh {
 	}
 
 	/**
-	*	bV擾
+	*	メッシュを取得する
 	*
-	*	@param index }eACfbNX
+	*	@param index マテリアルインデックス
 	*
-	*	@return index ɑΉ}eA
+	*	@return index に対応するマテリアル
 	*/
 	const Material& Buffer::GetMaterial(size_t index) const {
 		if (index >= materialList.size()) {
@@ -488,10 +3120,10 @@ namespace Mesh {
 	}
 
 	/**
-	*	obt@ێ VAO  OpenGL ̏Ώۂɐݒ肷
+	*	バッファが保持する VAO を OpenGL の処理対象に設定する
 	*/
 	void Buffer::BindVAO() const {
-		glBindVertexArray(vao);
+		GLState::BindVertexArray(vao);
 	}
 }
 
@@ -5,73 +5,236 @@
 #include <string>
 #include <unordered_map>
 #include<memory>
+#include <stdint.h>
+#include "MappedFile.h"
+#include "RangeAllocator.h"
 
 namespace Mesh {
 	class Mesh;
 	class Buffer;
+	class ClusterCuller;
 	
-	typedef std::shared_ptr<Mesh> MeshPtr;		///bVf[^|C^^
-	typedef std::shared_ptr<Buffer> BufferPtr;	///bVobt@|C^^
+	typedef std::shared_ptr<Mesh> MeshPtr;		///メッシュデータポインタ型
+	typedef std::shared_ptr<Buffer> BufferPtr;	///メッシュバッファポインタ型
 
 	/**
-	*	}eA\
+	*	マテリアル構造体
 	*/
 	struct Material {
-		GLenum type;		///CfbNX̃f[^^
-		GLsizei size;		///`悷CfbNX
-		GLvoid* offset;		///`JnCfbNX̃oCgItZbg
-		GLint baseVertex;	///CfbNX 0 Ƃ݂Ȃ钸_z̈ʒu
-		glm::vec4 color;	///}eA̐F
+		GLenum type;		///インデックスのデータ型
+		GLsizei size;		///描画するインデックス数
+		GLvoid* offset;		///描画開始インデックスのバイトオフセット
+		GLint baseVertex;	///インデックス 0 とみなされる頂点配列内の位置
+		glm::vec4 color;	///マテリアルの色
+		uint32_t beginCluster;	///クラスタの先頭インデックス
+		uint32_t endCluster;	///クラスタの終端インデックス(beginCluster と同じならクラスタなし)
 	};
 
 	/**
-	*	bV
+	*	カリング用の三角形のまとまり
+	*/
+	struct Cluster {
+		glm::vec3 center;	///境界球の中心
+		float radius;		///境界球の半径
+		glm::vec3 coneAxis;	///法線錐の軸
+		float coneCutoff;	///法線錐の半頂角の sin(1 なら背面カリングしない)
+		GLsizei size;		///描画するインデックス数
+		GLsizeiptr offset;	///マテリアルの描画開始位置からのバイトオフセット
+	};
+
+	/**
+	*	クラスタ単位のカリング
+	*
+	*	Setup で視点を設定してから Mesh::Draw に渡すと、視錐台の外にあるクラスタと裏を向いたクラスタを描画しない
+	*	残ったクラスタは glMultiDrawElementsBaseVertex でまとめて描画する
+	*/
+	class ClusterCuller {
+		friend class Mesh;
+	public:
+		///カリング結果の三角形数
+		struct Statistics {
+			size_t triangles;		///クラスタを持つマテリアルの三角形数
+			size_t frustumCulled;	///視錐台の外にあるため描画しなかった三角形数
+			size_t backfaceCulled;	///裏を向いているため描画しなかった三角形数
+		};
+
+		///クラスタの判定結果
+		enum Result {
+			visible,		///描画する
+			frustumCulled,	///視錐台の外にある
+			backfaceCulled,	///裏を向いている
+		};
+
+		void Setup(const glm::mat4& matView, const glm::mat4& matProj);
+		void SetModel(const glm::mat4& matModel);
+		Result Classify(const Cluster& cluster) const;
+		void Enable(bool enable) { isEnabled = enable; }
+		bool IsEnabled() const { return isEnabled; }
+		const Statistics& GetStatistics() const { return statistics; }
+		void ResetStatistics() { statistics = Statistics(); }
+
+	private:
+		glm::vec4 planes[6];	///視錐台の平面(ワールド座標系、法線は内向き)
+		glm::vec3 eye;			///視点の座標
+		glm::mat4 matModel;		///判定するメッシュのモデル行列
+		glm::mat3 matRotation;	///法線錐の軸に使う回転行列
+		float maxScale = 1;		///境界球の半径に掛ける拡大率
+		bool coneCulling = false;	///法線錐で背面カリングするなら true(拡大率が均一でない場合は false)
+		bool isEnabled = true;	///カリングするなら true
+		Statistics statistics = Statistics();
+		std::vector<GLsizei> countList;			///描画するインデックス数のリスト
+		std::vector<const GLvoid*> offsetList;	///描画開始位置のリスト
+		std::vector<GLint> baseVertexList;		///ベース頂点のリスト
+	};
+
+	/**
+	*	バッファへの転送待ちのメッシュデータ
+	*
+	*	DecodeMeshFile で作成し、Buffer::Upload でバッファに転送する
+	*/
+	struct MeshFile {
+		std::string name;				///エラー表示用のファイル名
+		MappedFilePtr mappedFile;		///有効なキャッシュファイル
+		std::vector<uint8_t> image;		///作り直したキャッシュデータ(mappedFile が nullptr の場合に使用)
+
+		const uint8_t* Data() const { return mappedFile ? mappedFile->Data() : image.data(); }
+		size_t Size() const { return mappedFile ? mappedFile->Size() : image.size(); }
+	};
+
+	/**
+	*	分割転送するメッシュデータの転送先と転送元
+	*
+	*	Buffer::ReserveUpload で作成し、転送が終わったら Buffer::CommitUpload に渡す
+	*/
+	struct MeshUpload {
+		GLintptr vboOffset;			///頂点データの転送先のバイトオフセット
+		GLintptr iboOffset;			///インデックスデータの転送先のバイトオフセット
+		const uint8_t* vertexData;	///転送する頂点データ
+		GLsizeiptr vertexBytes;		///頂点データのバイト数
+		const uint8_t* indexData;	///転送するインデックスデータ
+		GLsizeiptr indexBytes;		///インデックスデータのバイト数
+	};
+
+	void VerboseLog(bool enable);
+	void NativeFbxParser(bool enable);
+	bool BakeMeshFile(const char* fileName);
+	bool ValidateFbxParser(const char* fileName);
+	bool AnalyzeMeshFile(const char* fileName);
+	bool CheckVertexPacking(const char* fileName);
+	bool AnalyzeClusterCulling(const char* fileName, const glm::mat4& matView, const glm::mat4& matProj, const std::vector<glm::mat4>& modelList);
+	bool DecodeMeshFile(const char* fileName, MeshFile& file);
+
+	/**
+	*	メッシュ
 	*/
 	class Mesh {
 		friend class Buffer;
 	public:
 		const std::string& Name() const { return name; }
-		void Draw(const BufferPtr& buffer) const;
+		size_t Draw(const BufferPtr& buffer, int lod = 0, GLsizei instanceCount = 1) const;
+		size_t Draw(const BufferPtr& buffer, int lod, ClusterCuller& culler, const glm::mat4& matModel) const;
+		size_t TriangleCount(const BufferPtr& buffer, int lod = 0) const;
+		bool IsPlaceholder() const { return isPlaceholder; }
+		bool IsMissing() const { return isMissing; }
+		int LodCount() const { return static_cast<int>(lodCount); }
+		const glm::vec3& BoundingCenter() const { return center; }
+		float BoundingRadius() const { return radius; }
+		bool HasClusters() const { return hasClusters; }
+		bool IsTranslucent() const { return isTranslucent; }
+		const glm::vec3& BoundingMin() const { return boundsMin; }
+		const glm::vec3& BoundingMax() const { return boundsMax; }
 
 	private:
 		Mesh() = default;
 		Mesh(const std::string& n, size_t begin, size_t end);
+		void MaterialRange(int lod, size_t& begin, size_t& end) const;
 		Mesh(const Mesh&) = default;
 		~Mesh() = default;
 		Mesh& operator=(const Mesh&) = default;
 
 	private:
-		std::string name;						///bVf[^
-		std::vector<std::string> textureList;	///eNX`̃Xg
-		size_t beginMaterial = 0;				///`悷}eA̐擪CX^X
-		rsize_t endMaterial = 0;				///`悷}eȀI[CX^X
+		std::string name;						///メッシュデータ名
+		std::vector<std::string> textureList;	///テクスチャ名のリスト
+		size_t beginMaterial = 0;				///描画するマテリアルの先頭インスタンス
+		rsize_t endMaterial = 0;				///描画するマテリアルの終端インスタンス
+		bool isPlaceholder = false;				///読み込み待ちで仮表示中なら true
+		bool isReserved = false;				///GetOrReserveMesh で予約され、まだ一度も読み込まれていなければ true
+		bool isMissing = false;					///予約したまま、読み込んだどのファイルにも含まれていなければ true
+		size_t lodCount = 1;					///詳細度の段階数(マテリアルは段階毎に同じ数だけ並ぶ)
+		glm::vec3 center = glm::vec3(0);		///境界球の中心
+		float radius = 0;						///境界球の半径
+		glm::vec3 boundsMin = glm::vec3(0);		///AABB の最小座標
+		glm::vec3 boundsMax = glm::vec3(0);		///AABB の最大座標
+		const Buffer* owner = nullptr;			///このメッシュを管理するバッファ
+		bool hasClusters = false;				///LOD 0 にクラスタを持つマテリアルがあれば true
+		bool isTranslucent = false;				///半透明のマテリアルか頂点カラーがあれば true
 	};
 
 	/**
-	*	bVobt@
+	*	メッシュバッファ
+	*
+	*	VBO と IBO の領域をメッシュファイル単位で割り当て、UnloadMesh で解放できる
+	*	領域が足りなくなるとバッファを拡張し、Defragment で空き領域を前に詰める
 	*/
 	class Buffer {
 	public:
 		static BufferPtr Create(int vboSize, int iboSize);
 
 		bool LoadMeshFromFile(const char* filename);
+		bool Upload(const MeshFile& file);
+		bool ReserveUpload(const MeshFile& file, MeshUpload& upload);
+		void CommitUpload(const MeshFile& file, const MeshUpload& upload);
 		const MeshPtr& GetMesh(const char* name) const;
+		const MeshPtr& GetOrReserveMesh(const char* name);
+		bool UnloadMesh(const char* fileName);
+		bool IsLoaded(const char* fileName) const;
+		std::vector<std::string> MeshNames(const char* fileName) const;
+		size_t MarkMissingMeshes();
+		size_t Defragment(size_t maxBytes);
 		const Material& GetMaterial(size_t index) const;
+		const Cluster& GetCluster(size_t index) const { return clusterList[index]; }
 		void BindVAO() const;
+		GLuint VertexBufferId() const { return vbo; }
+		GLuint IndexBufferId() const { return ibo; }
+		size_t VertexBufferSize() const { return vboAllocator.Capacity(); }
+		size_t IndexBufferSize() const { return iboAllocator.Capacity(); }
 
 	private:
+		void CreatePlaceholder();
+		void SetPlaceholder(Mesh& mesh) const;
+		bool Allocate(GLsizeiptr vertexBytes, GLsizeiptr indexBytes, GLintptr& vboOffset, GLintptr& iboOffset);
+		bool AllocateRange(GLuint& buffer, RangeAllocator& allocator, GLsizeiptr bytes, size_t& offset);
+		bool GrowBuffer(GLuint& buffer, RangeAllocator& allocator, size_t requiredBytes);
+
 		Buffer() = default;
 		~Buffer();
 		Buffer(const Buffer&) = default;
 		Buffer& operator=(const Buffer&) = default;
 
 	private:
-		GLuint vbo = 0;			///f̒_f[^i[ VBO
-		GLuint ibo = 0;			///f̃CfbNXf[^i[ IBO
-		GLuint vao = 0;			///fp VAO
-		GLintptr vboEnd = 0;	///ǂݍݍϒ_f[^̏I[
-		GLintptr iboEnd = 0;	///ǂݍݍσCfbNXf[^̏I[
-		std::vector<Material> materialList;					///}eAXg
-		std::unordered_map<std::string, MeshPtr> meshList;	///bVXg
+		GLuint vbo = 0;			///モデルの頂点データを格納する VBO
+		GLuint ibo = 0;			///モデルのインデックスデータを格納する IBO
+		GLuint vao = 0;			///モデル用 VAO
+		RangeAllocator vboAllocator;	///VBO の領域管理
+		RangeAllocator iboAllocator;	///IBO の領域管理
+		size_t placeholderMaterial = 0;	///仮表示用の立方体のマテリアル
+		std::vector<Material> materialList;					///マテリアルリスト
+		std::vector<Cluster> clusterList;					///クラスタリスト
+		std::unordered_map<std::string, MeshPtr> meshList;	///メッシュリスト
+
+		///メッシュファイル単位の割り当て情報
+		struct Allocation {
+			GLintptr vboOffset;		///頂点データのバイトオフセット
+			GLsizeiptr vertexBytes;	///頂点データのバイト数
+			GLintptr iboOffset;		///インデックスデータのバイトオフセット
+			GLsizeiptr indexBytes;	///インデックスデータのバイト数
+			size_t beginMaterial;	///マテリアルの先頭インデックス
+			size_t endMaterial;		///マテリアルの終端インデックス
+			size_t beginCluster;	///クラスタの先頭インデックス
+			size_t endCluster;		///クラスタの終端インデックス
+			std::vector<std::string> meshNames;	///このファイルが登録したメッシュ名のリスト
+			bool isCommitted;		///CommitUpload で登録済みなら true
+		};
+		std::unordered_map<std::string, Allocation> allocationList;	///メッシュキャッシュファイル名をキーとする割り当てリスト
 	};
 }
\ No newline at end of file
@@ -0,0 +1,780 @@
+/**
+*	@file MeshOptimizer.cpp
+*/
+#include "MeshOptimizer.h"
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+
+namespace MeshOptimizer {
+
+	namespace {
+
+		const int maxCacheSize = 32;			///< 並べ替えで想定する LRU キャッシュのサイズ
+		const float cacheDecayPower = 1.5f;		///< キャッシュ内の位置による減衰の強さ
+		const float lastTriangleScore = 0.75f;	///< 直前の三角形の頂点のスコア
+		const float valenceBoostScale = 2.0f;	///< 残り三角形数が少ない頂点を優先する強さ
+		const float valenceBoostPower = 0.5f;	///< 残り三角形数による優先度の指数
+
+		/**
+		*	頂点のスコアを計算する(Forsyth 法)
+		*
+		*	@param cachePosition		LRU キャッシュ内の位置(キャッシュにない場合は -1)
+		*	@param remainingTriangles	頂点を使う未出力の三角形の数
+		*
+		*	@return 頂点のスコア
+		*/
+		float VertexScore(int cachePosition, uint32_t remainingTriangles) {
+			if (remainingTriangles == 0) {
+				return -1.0f;
+			}
+			float score = 0.0f;
+			if (cachePosition >= 0) {
+				if (cachePosition < 3) {
+					score = lastTriangleScore;
+				} else {
+					const float scale = 1.0f / (maxCacheSize - 3);
+					score = powf(1.0f - (cachePosition - 3) * scale, cacheDecayPower);
+				}
+			}
+			score += valenceBoostScale * powf(static_cast<float>(remainingTriangles), -valenceBoostPower);
+			return score;
+		}
+
+		/// 3 次元ベクトル
+		struct Vec3 {
+			float x, y, z;
+		};
+
+		Vec3 operator-(const Vec3& a, const Vec3& b) { return Vec3{ a.x - b.x, a.y - b.y, a.z - b.z }; }
+		Vec3 Cross(const Vec3& a, const Vec3& b) { return Vec3{ a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+		float Dot(const Vec3& a, const Vec3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+		/**
+		*	頂点座標を取得する
+		*
+		*	@param positions	頂点配列の先頭の座標へのポインタ
+		*	@param stride		頂点 1 個のバイト数
+		*	@param index		頂点インデックス
+		*/
+		Vec3 Position(const void* positions, size_t stride, uint32_t index) {
+			Vec3 v;
+			memcpy(&v, static_cast<const uint8_t*>(positions) + stride * index, sizeof(Vec3));
+			return v;
+		}
+
+		/**
+		*	誤差二次形式(Quadric Error Metric)
+		*
+		*	平面までの距離の二乗和を x^T A x + 2 b^T x + c の形で保持する
+		*/
+		struct Quadric {
+			double a00, a01, a02, a11, a12, a22;
+			double b0, b1, b2;
+			double c;
+		};
+
+		/**
+		*	平面から二次形式を作成する
+		*
+		*	@param n		平面の単位法線
+		*	@param d		平面の原点からの距離(n・x + d = 0)
+		*	@param weight	重み(三角形の面積)
+		*/
+		Quadric MakeQuadric(const Vec3& n, float d, float weight) {
+			const double x = n.x, y = n.y, z = n.z, w = weight;
+			return Quadric{ x * x * w, x * y * w, x * z * w, y * y * w, y * z * w, z * z * w, x * d * w, y * d * w, z * d * w, d * d * w };
+		}
+
+		void operator+=(Quadric& q, const Quadric& r) {
+			q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02; q.a11 += r.a11; q.a12 += r.a12; q.a22 += r.a22;
+			q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+			q.c += r.c;
+		}
+
+		/**
+		*	二次形式の値(平面までの距離の二乗和)を計算する
+		*/
+		float Evaluate(const Quadric& q, const Vec3& p) {
+			const double x = p.x, y = p.y, z = p.z;
+			const double r = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+				2 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+				2 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+			return static_cast<float>(r > 0 ? r : 0);
+		}
+
+		/// 辺の縮約候補
+		struct Collapse {
+			uint32_t from;	///< 削除する頂点
+			uint32_t to;	///< 残す頂点
+			float error;	///< 縮約による誤差
+		};
+
+		/// 描画順を決めるための三角形のまとまり
+		struct Cluster {
+			size_t begin;	///< 先頭の三角形
+			size_t end;		///< 終端の三角形
+			float sortKey;	///< メッシュの外側を向いているほど大きくなる値
+		};
+	}
+
+	/**
+	*	FIFO 頂点キャッシュでの効率を計算する
+	*
+	*	@param indices		インデックス配列
+	*	@param vertexCount	頂点数
+	*	@param cacheSize	キャッシュに格納できる頂点数
+	*
+	*	@return 頂点キャッシュの効率
+	*/
+	Statistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, size_t cacheSize) {
+		Statistics stats = {};
+		std::vector<size_t> timestamp(vertexCount, 0);
+		std::vector<bool> referenced(vertexCount, false);
+		size_t time = cacheSize + 1;
+		size_t referencedCount = 0;
+		for (uint32_t i : indices) {
+			if (time - timestamp[i] > cacheSize) {
+				timestamp[i] = time++;
+				++stats.vertexTransformed;
+			}
+			if (!referenced[i]) {
+				referenced[i] = true;
+				++referencedCount;
+			}
+		}
+		const size_t triangleCount = indices.size() / 3;
+		stats.acmr = triangleCount ? static_cast<float>(stats.vertexTransformed) / triangleCount : 0.0f;
+		stats.atvr = referencedCount ? static_cast<float>(stats.vertexTransformed) / referencedCount : 0.0f;
+		return stats;
+	}
+
+	/**
+	*	頂点キャッシュの効率が上がるように三角形を並べ替える
+	*
+	*	@param indices		並べ替えるインデックス配列
+	*	@param vertexCount	頂点数
+	*
+	*	Tom Forsyth の "Linear-Speed Vertex Cache Optimisation" に基づく
+	*/
+	void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		//頂点毎に、その頂点を使う三角形のリストを作る
+		std::vector<uint32_t> remaining(vertexCount, 0);
+		for (size_t i = 0; i < triangleCount * 3; ++i) {
+			++remaining[indices[i]];
+		}
+		std::vector<uint32_t> offsets(vertexCount + 1, 0);
+		for (size_t i = 0; i < vertexCount; ++i) {
+			offsets[i + 1] = offsets[i] + remaining[i];
+		}
+		std::vector<uint32_t> adjacency(triangleCount * 3);
+		{
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < triangleCount * 3; ++i) {
+				adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		std::vector<int> cachePosition(vertexCount, -1);
+		std::vector<float> vertexScore(vertexCount);
+		for (size_t i = 0; i < vertexCount; ++i) {
+			vertexScore[i] = VertexScore(-1, remaining[i]);
+		}
+		std::vector<float> triangleScore(triangleCount);
+		std::vector<bool> emitted(triangleCount, false);
+		for (size_t i = 0; i < triangleCount; ++i) {
+			const uint32_t* tri = &indices[i * 3];
+			triangleScore[i] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+		}
+
+		std::vector<uint32_t> result;
+		result.reserve(triangleCount * 3);
+		std::vector<uint32_t> cache;
+		std::vector<uint32_t> newCache;
+		cache.reserve(maxCacheSize + 3);
+		newCache.reserve(maxCacheSize + 3);
+		size_t scanPosition = 0;
+		int64_t bestTriangle = std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin();
+		for (size_t emittedCount = 0; emittedCount < triangleCount; ++emittedCount) {
+			//キャッシュ内に候補がなければ、未出力の三角形を先頭から探す
+			if (bestTriangle < 0) {
+				while (emitted[scanPosition]) {
+					++scanPosition;
+				}
+				bestTriangle = scanPosition;
+			}
+			const uint32_t* tri = &indices[bestTriangle * 3];
+			result.insert(result.end(), tri, tri + 3);
+			emitted[bestTriangle] = true;
+
+			//出力した三角形を隣接リストから取り除く
+			for (int k = 0; k < 3; ++k) {
+				const uint32_t v = tri[k];
+				uint32_t* list = &adjacency[offsets[v]];
+				for (uint32_t j = 0; j < remaining[v]; ++j) {
+					if (list[j] == bestTriangle) {
+						list[j] = list[remaining[v] - 1];
+						break;
+					}
+				}
+				--remaining[v];
+			}
+
+			//出力した三角形の頂点をキャッシュの先頭に移動する
+			newCache.assign(tri, tri + 3);
+			for (uint32_t v : cache) {
+				if (v != tri[0] && v != tri[1] && v != tri[2]) {
+					newCache.push_back(v);
+				}
+			}
+			for (size_t i = 0; i < newCache.size(); ++i) {
+				const uint32_t v = newCache[i];
+				cachePosition[v] = i < maxCacheSize ? static_cast<int>(i) : -1;
+				vertexScore[v] = VertexScore(cachePosition[v], remaining[v]);
+			}
+
+			//キャッシュに関係する三角形のスコアを更新し、次に出力する三角形を選ぶ
+			bestTriangle = -1;
+			float bestScore = -1.0f;
+			for (uint32_t v : newCache) {
+				const uint32_t* list = &adjacency[offsets[v]];
+				for (uint32_t j = 0; j < remaining[v]; ++j) {
+					const uint32_t t = list[j];
+					const uint32_t* p = &indices[t * 3];
+					triangleScore[t] = vertexScore[p[0]] + vertexScore[p[1]] + vertexScore[p[2]];
+					if (triangleScore[t] > bestScore) {
+						bestScore = triangleScore[t];
+						bestTriangle = t;
+					}
+				}
+			}
+			if (newCache.size() > maxCacheSize) {
+				newCache.resize(maxCacheSize);
+			}
+			cache.swap(newCache);
+		}
+		indices.swap(result);
+	}
+
+	/**
+	*	オーバードローが減るように三角形のまとまりを並べ替える
+	*
+	*	@param indices		並べ替えるインデックス配列(OptimizeVertexCache 適用済みであること)
+	*	@param positions	頂点配列の先頭の座標(float x 3)へのポインタ
+	*	@param stride		頂点 1 個のバイト数
+	*	@param vertexCount	頂点数
+	*	@param threshold	まとまりを分割する際に許容する ACMR の悪化率
+	*
+	*	頂点キャッシュが空になる位置でまとまりに分割し、さらに ACMR の悪化が threshold 以下に収まる位置で細かく分割する
+	*	メッシュの外側を向くまとまりほど先に描画されるように並べるので、凸に近い形状では手前の面から描かれる
+	*	(Sander らの "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" に基づく)
+	*/
+	void OptimizeOverdraw(std::vector<uint32_t>& indices, const void* positions, size_t stride, size_t vertexCount, float threshold) {
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		//三角形毎のキャッシュミス数を求める
+		const size_t cacheSize = 16;
+		std::vector<size_t> timestamp(vertexCount, 0);
+		std::vector<uint8_t> missList(triangleCount);
+		size_t time = cacheSize + 1;
+		for (size_t i = 0; i < triangleCount; ++i) {
+			uint8_t miss = 0;
+			for (int k = 0; k < 3; ++k) {
+				const uint32_t v = indices[i * 3 + k];
+				if (time - timestamp[v] > cacheSize) {
+					timestamp[v] = time++;
+					++miss;
+				}
+			}
+			missList[i] = miss;
+		}
+
+		//全頂点が新しく変換される位置(ハード境界)で分割し、その中を ACMR が悪化しない位置(ソフト境界)で分割する
+		std::vector<Cluster> clusters;
+		size_t hardBegin = 0;
+		for (size_t i = 1; i <= triangleCount; ++i) {
+			if (i < triangleCount && missList[i] < 3) {
+				continue;
+			}
+			size_t totalMiss = 0;
+			for (size_t j = hardBegin; j < i; ++j) {
+				totalMiss += missList[j];
+			}
+			const float clusterAcmr = static_cast<float>(totalMiss) / (i - hardBegin);
+			size_t begin = hardBegin;
+			size_t miss = 0;
+			for (size_t j = hardBegin; j < i; ++j) {
+				miss += missList[j];
+				const size_t count = j + 1 - begin;
+				if (j + 1 < i && count >= 8 && static_cast<float>(miss) / count <= clusterAcmr * threshold && missList[j + 1] >= 2) {
+					clusters.push_back(Cluster{ begin, j + 1, 0.0f });
+					begin = j + 1;
+					miss = 0;
+				}
+			}
+			clusters.push_back(Cluster{ begin, i, 0.0f });
+			hardBegin = i;
+		}
+
+		//メッシュの中心を求める
+		Vec3 meshCenter = { 0, 0, 0 };
+		for (size_t i = 0; i < triangleCount * 3; ++i) {
+			const Vec3 p = Position(positions, stride, indices[i]);
+			meshCenter.x += p.x;
+			meshCenter.y += p.y;
+			meshCenter.z += p.z;
+		}
+		const float scale = 1.0f / (triangleCount * 3);
+		meshCenter = Vec3{ meshCenter.x * scale, meshCenter.y * scale, meshCenter.z * scale };
+
+		//まとまり毎に、面積で重み付けした中心と法線から外向きの度合いを求める
+		for (Cluster& cluster : clusters) {
+			Vec3 center = { 0, 0, 0 };
+			Vec3 normal = { 0, 0, 0 };
+			float area = 0.0f;
+			for (size_t i = cluster.begin; i < cluster.end; ++i) {
+				const Vec3 p0 = Position(positions, stride, indices[i * 3 + 0]);
+				const Vec3 p1 = Position(positions, stride, indices[i * 3 + 1]);
+				const Vec3 p2 = Position(positions, stride, indices[i * 3 + 2]);
+				const Vec3 n = Cross(p1 - p0, p2 - p0);
+				const float a = sqrtf(Dot(n, n));
+				center.x += (p0.x + p1.x + p2.x) * a;
+				center.y += (p0.y + p1.y + p2.y) * a;
+				center.z += (p0.z + p1.z + p2.z) * a;
+				normal.x += n.x;
+				normal.y += n.y;
+				normal.z += n.z;
+				area += a;
+			}
+			const float normalLength = sqrtf(Dot(normal, normal));
+			if (area <= 0.0f || normalLength <= 0.0f) {
+				continue;
+			}
+			const float invArea = 1.0f / (area * 3.0f);
+			center = Vec3{ center.x * invArea, center.y * invArea, center.z * invArea };
+			cluster.sortKey = Dot(center - meshCenter, normal) / normalLength;
+		}
+		std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+		std::vector<uint32_t> result;
+		result.reserve(indices.size());
+		for (const Cluster& cluster : clusters) {
+			result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+		}
+		indices.swap(result);
+	}
+
+	/**
+	*	頂点を参照される順に並べ替えるための対応表を作成する
+	*
+	*	@param indices		インデックス配列。新しい頂点番号に書き換えられる
+	*	@param remap		古い頂点番号から新しい頂点番号への対応表を格納する配列
+	*						参照されない頂点には UINT32_MAX が格納される
+	*	@param vertexCount	頂点数
+	*
+	*	@return 並べ替え後の頂点数
+	*
+	*	頂点配列は RemapVertices で並べ替えること
+	*/
+	size_t OptimizeVertexFetch(std::vector<uint32_t>& indices, std::vector<uint32_t>& remap, size_t vertexCount) {
+		remap.assign(vertexCount, UINT32_MAX);
+		uint32_t next = 0;
+		for (uint32_t& i : indices) {
+			if (remap[i] == UINT32_MAX) {
+				remap[i] = next++;
+			}
+			i = remap[i];
+		}
+		return next;
+	}
+
+	/**
+	*	辺の縮約によって三角形数を減らす
+	*
+	*	@param indices			簡略化するインデックス配列。簡略化した結果に書き換えられる
+	*	@param positions		頂点配列の先頭の座標(float x 3)へのポインタ
+	*	@param stride			頂点 1 個のバイト数
+	*	@param vertexCount		頂点数
+	*	@param targetIndexCount	目標のインデックス数
+	*	@param maxError			許容する誤差(メッシュの大きさを 1 とした距離)
+	*
+	*	@return 簡略化による誤差(メッシュの大きさを 1 とした距離)
+	*
+	*	頂点を隣の頂点へ移動させて消す縮約を、誤差二次形式の小さい順に繰り返す(Garland と Heckbert の手法)
+	*	新しい頂点は作らないので、簡略化の結果は元の頂点配列をそのまま参照する
+	*	テクスチャ座標などの継ぎ目にある頂点と、穴の縁にある頂点は形が崩れないように動かさない
+	*/
+	float SimplifyMesh(std::vector<uint32_t>& indices, const void* positions, size_t stride, size_t vertexCount, size_t targetIndexCount, float maxError) {
+		if (indices.size() <= targetIndexCount || vertexCount == 0) {
+			return 0.0f;
+		}
+
+		//座標をメッシュの大きさが 1 になるように正規化する
+		std::vector<Vec3> pos(vertexCount);
+		Vec3 minPos = Position(positions, stride, 0);
+		Vec3 maxPos = minPos;
+		for (uint32_t i = 0; i < vertexCount; ++i) {
+			pos[i] = Position(positions, stride, i);
+			minPos = Vec3{ std::min(minPos.x, pos[i].x), std::min(minPos.y, pos[i].y), std::min(minPos.z, pos[i].z) };
+			maxPos = Vec3{ std::max(maxPos.x, pos[i].x), std::max(maxPos.y, pos[i].y), std::max(maxPos.z, pos[i].z) };
+		}
+		const float extent = std::max(std::max(maxPos.x - minPos.x, maxPos.y - minPos.y), maxPos.z - minPos.z);
+		const float invExtent = extent > 0.0f ? 1.0f / extent : 0.0f;
+		for (Vec3& p : pos) {
+			p = Vec3{ (p.x - minPos.x) * invExtent, (p.y - minPos.y) * invExtent, (p.z - minPos.z) * invExtent };
+		}
+
+		//同じ座標の頂点をまとめ、継ぎ目になっている頂点を固定する
+		struct PositionHash {
+			size_t operator()(const Vec3& v) const {
+				uint32_t h[3];
+				memcpy(h, &v, sizeof(h));
+				return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+			}
+		};
+		struct PositionEqual {
+			bool operator()(const Vec3& a, const Vec3& b) const { return memcmp(&a, &b, sizeof(Vec3)) == 0; }
+		};
+		std::unordered_map<Vec3, uint32_t, PositionHash, PositionEqual> positionMap;
+		std::vector<uint32_t> wedge(vertexCount);
+		std::vector<uint32_t> wedgeCount(vertexCount, 0);
+		for (uint32_t i = 0; i < vertexCount; ++i) {
+			wedge[i] = positionMap.insert(std::make_pair(pos[i], i)).first->second;
+			++wedgeCount[wedge[i]];
+		}
+		std::vector<uint8_t> locked(vertexCount, 0);
+		for (uint32_t i = 0; i < vertexCount; ++i) {
+			if (wedgeCount[wedge[i]] > 1) {
+				locked[i] = 1;
+			}
+		}
+
+		//片側にしか三角形がない辺(穴の縁)の頂点を固定する
+		std::unordered_map<uint64_t, int> edgeCount;
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			for (int k = 0; k < 3; ++k) {
+				const uint32_t a = wedge[indices[i + k]];
+				const uint32_t b = wedge[indices[i + (k + 1) % 3]];
+				++edgeCount[(static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b)];
+			}
+		}
+		std::vector<uint8_t> borderWedge(vertexCount, 0);
+		for (const auto& e : edgeCount) {
+			if (e.second == 1) {
+				borderWedge[static_cast<uint32_t>(e.first >> 32)] = 1;
+				borderWedge[static_cast<uint32_t>(e.first & 0xffffffff)] = 1;
+			}
+		}
+		for (uint32_t i = 0; i < vertexCount; ++i) {
+			if (borderWedge[wedge[i]]) {
+				locked[i] = 1;
+			}
+		}
+
+		//頂点毎に、周囲の三角形の平面から二次形式を作る
+		std::vector<Quadric> quadrics(vertexCount, Quadric{});
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			const Vec3& p0 = pos[indices[i]];
+			const Vec3 n = Cross(pos[indices[i + 1]] - p0, pos[indices[i + 2]] - p0);
+			const float length = sqrtf(Dot(n, n));
+			if (length <= 0.0f) {
+				continue;
+			}
+			const Vec3 unit = { n.x / length, n.y / length, n.z / length };
+			const Quadric q = MakeQuadric(unit, -Dot(unit, p0), length * 0.5f);
+			for (int k = 0; k < 3; ++k) {
+				quadrics[indices[i + k]] += q;
+			}
+		}
+
+		const float maxErrorSq = maxError * maxError;
+		float resultError = 0.0f;
+		std::vector<uint32_t> remap(vertexCount);
+		std::vector<uint8_t> touched(vertexCount);
+		std::vector<uint32_t> triangleOffset(vertexCount + 1);
+		std::vector<uint32_t> adjacency;
+		std::vector<Collapse> collapses;
+		while (indices.size() > targetIndexCount) {
+			//頂点から三角形への対応表を作る
+			std::fill(triangleOffset.begin(), triangleOffset.end(), 0);
+			for (uint32_t i : indices) {
+				++triangleOffset[i + 1];
+			}
+			for (size_t i = 0; i < vertexCount; ++i) {
+				triangleOffset[i + 1] += triangleOffset[i];
+			}
+			adjacency.resize(indices.size());
+			std::vector<uint32_t> fill(triangleOffset.begin(), triangleOffset.end() - 1);
+			for (size_t i = 0; i < indices.size(); ++i) {
+				adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+
+			//縮約候補を誤差の小さい順に並べる
+			collapses.clear();
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				for (int k = 0; k < 3; ++k) {
+					const uint32_t a = indices[i + k];
+					const uint32_t b = indices[i + (k + 1) % 3];
+					if (!locked[a]) {
+						collapses.push_back(Collapse{ a, b, Evaluate(quadrics[a], pos[b]) });
+					}
+					if (!locked[b]) {
+						collapses.push_back(Collapse{ b, a, Evaluate(quadrics[b], pos[a]) });
+					}
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.error < b.error; });
+
+			//周囲が変化していない頂点だけを縮約する
+			for (uint32_t i = 0; i < vertexCount; ++i) {
+				remap[i] = i;
+			}
+			std::fill(touched.begin(), touched.end(), 0);
+			size_t removedTriangles = 0;
+			const size_t triangleBudget = (indices.size() - targetIndexCount + 2) / 3;
+			for (const Collapse& c : collapses) {
+				if (c.error > maxErrorSq || removedTriangles >= triangleBudget) {
+					break;
+				}
+				if (touched[c.from] || touched[c.to]) {
+					continue;
+				}
+
+				//三角形の向きが反転する縮約は行わない
+				bool isFlipped = false;
+				size_t collapsedTriangles = 0;
+				for (uint32_t t = triangleOffset[c.from]; t < triangleOffset[c.from + 1] && !isFlipped; ++t) {
+					const uint32_t* tri = &indices[adjacency[t] * 3];
+					if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+						++collapsedTriangles;
+						continue;
+					}
+					Vec3 p[3];
+					for (int k = 0; k < 3; ++k) {
+						p[k] = pos[tri[k]];
+					}
+					const Vec3 before = Cross(p[1] - p[0], p[2] - p[0]);
+					for (int k = 0; k < 3; ++k) {
+						if (tri[k] == c.from) {
+							p[k] = pos[c.to];
+						}
+					}
+					const Vec3 after = Cross(p[1] - p[0], p[2] - p[0]);
+					isFlipped = Dot(before, after) <= 0.0f;
+				}
+				if (isFlipped) {
+					continue;
+				}
+
+				remap[c.from] = c.to;
+				quadrics[c.to] += quadrics[c.from];
+				for (uint32_t t = triangleOffset[c.from]; t < triangleOffset[c.from + 1]; ++t) {
+					const uint32_t* tri = &indices[adjacency[t] * 3];
+					touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+				}
+				removedTriangles += collapsedTriangles;
+				resultError = std::max(resultError, c.error);
+			}
+			if (removedTriangles == 0) {
+				break;
+			}
+
+			//縮約を反映し、潰れた三角形を取り除く
+			size_t writeIndex = 0;
+			for (size_t i = 0; i < indices.size(); i += 3) {
+				const uint32_t a = remap[indices[i]];
+				const uint32_t b = remap[indices[i + 1]];
+				const uint32_t c = remap[indices[i + 2]];
+				if (a != b && b != c && c != a) {
+					indices[writeIndex++] = a;
+					indices[writeIndex++] = b;
+					indices[writeIndex++] = c;
+				}
+			}
+			indices.resize(writeIndex);
+		}
+		return sqrtf(resultError);
+	}
+
+	/**
+	*	三角形をカリング用のクラスタに分割する
+	*
+	*	@param indices		分割するインデックス配列。クラスタ毎に連続するように並べ替えられる
+	*	@param positions	頂点配列の先頭の座標(float x 3)へのポインタ
+	*	@param stride		頂点 1 個のバイト数
+	*	@param vertexCount	頂点数
+	*	@param maxTriangles	1 クラスタの最大三角形数
+	*	@param clusters		作成したクラスタを格納する配列
+	*
+	*	未出力の三角形を種にして、頂点を共有する三角形のうち中心に近く法線の向きが揃っているものを貪欲に追加する
+	*	クラスタ内の三角形は元の順番を保つので、OptimizeVertexCache と OptimizeOverdraw の結果が残る
+	*	境界球は視錐台カリングに、法線錐は背面カリングに使う
+	*/
+	void BuildClusters(std::vector<uint32_t>& indices, const void* positions, size_t stride, size_t vertexCount, size_t maxTriangles, std::vector<TriangleCluster>& clusters) {
+		clusters.clear();
+		const size_t triangleCount = indices.size() / 3;
+		if (triangleCount == 0 || maxTriangles == 0) {
+			return;
+		}
+
+		//三角形の法線と重心を求める
+		std::vector<Vec3> normals(triangleCount);
+		std::vector<Vec3> centroids(triangleCount);
+		for (size_t i = 0; i < triangleCount; ++i) {
+			const Vec3 a = Position(positions, stride, indices[i * 3 + 0]);
+			const Vec3 b = Position(positions, stride, indices[i * 3 + 1]);
+			const Vec3 c = Position(positions, stride, indices[i * 3 + 2]);
+			const Vec3 n = Cross(b - a, c - a);
+			const float length = sqrtf(Dot(n, n));
+			normals[i] = length > 0.0f ? Vec3{ n.x / length, n.y / length, n.z / length } : Vec3{ 0, 0, 0 };
+			centroids[i] = Vec3{ (a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f, (a.z + b.z + c.z) / 3.0f };
+		}
+
+		//頂点毎に、その頂点を使う三角形のリストを作る
+		std::vector<uint32_t> offsets(vertexCount + 1, 0);
+		for (size_t i = 0; i < triangleCount * 3; ++i) {
+			++offsets[indices[i] + 1];
+		}
+		for (size_t i = 0; i < vertexCount; ++i) {
+			offsets[i + 1] += offsets[i];
+		}
+		std::vector<uint32_t> adjacency(triangleCount * 3);
+		{
+			std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < triangleCount * 3; ++i) {
+				adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+			}
+		}
+
+		std::vector<uint32_t> result;
+		result.reserve(triangleCount * 3);
+		std::vector<bool> emitted(triangleCount, false);
+		std::vector<uint32_t> candidateMark(triangleCount, UINT32_MAX);
+		std::vector<uint32_t> localIndex(vertexCount, UINT32_MAX);
+		std::vector<uint32_t> candidates;
+		std::vector<uint32_t> clusterTriangles;
+		std::vector<uint32_t> clusterVertices;
+		size_t scanPosition = 0;
+		for (size_t emittedCount = 0; emittedCount < triangleCount; ) {
+			while (emitted[scanPosition]) {
+				++scanPosition;
+			}
+			const uint32_t clusterId = static_cast<uint32_t>(clusters.size());
+			candidates.clear();
+			clusterTriangles.clear();
+			Vec3 centerSum = { 0, 0, 0 };
+			Vec3 normalSum = { 0, 0, 0 };
+			Vec3 axis = { 0, 0, 0 };
+			size_t next = scanPosition;
+			for (;;) {
+				//三角形をクラスタに追加し、頂点を共有する三角形を候補にする
+				emitted[next] = true;
+				++emittedCount;
+				clusterTriangles.push_back(static_cast<uint32_t>(next));
+				centerSum = Vec3{ centerSum.x + centroids[next].x, centerSum.y + centroids[next].y, centerSum.z + centroids[next].z };
+				normalSum = Vec3{ normalSum.x + normals[next].x, normalSum.y + normals[next].y, normalSum.z + normals[next].z };
+				const float normalLength = sqrtf(Dot(normalSum, normalSum));
+				axis = normalLength > 0.0f ? Vec3{ normalSum.x / normalLength, normalSum.y / normalLength, normalSum.z / normalLength } : Vec3{ 0, 0, 0 };
+				for (int k = 0; k < 3; ++k) {
+					const uint32_t v = indices[next * 3 + k];
+					for (uint32_t j = offsets[v]; j < offsets[v + 1]; ++j) {
+						const uint32_t t = adjacency[j];
+						if (!emitted[t] && candidateMark[t] != clusterId) {
+							candidateMark[t] = clusterId;
+							candidates.push_back(t);
+						}
+					}
+				}
+				if (clusterTriangles.size() >= maxTriangles) {
+					break;
+				}
+
+				//中心に近く、法線の向きが揃っている候補を選ぶ
+				const float invCount = 1.0f / static_cast<float>(clusterTriangles.size());
+				const Vec3 center = { centerSum.x * invCount, centerSum.y * invCount, centerSum.z * invCount };
+				int64_t best = -1;
+				float bestScore = FLT_MAX;
+				for (size_t i = 0; i < candidates.size(); ) {
+					const uint32_t t = candidates[i];
+					if (emitted[t]) {
+						candidates[i] = candidates.back();
+						candidates.pop_back();
+						continue;
+					}
+					const Vec3 d = centroids[t] - center;
+					const float score = Dot(d, d) * (2.0f - Dot(normals[t], axis));
+					if (score < bestScore) {
+						bestScore = score;
+						best = t;
+					}
+					++i;
+				}
+				if (best < 0) {
+					break;
+				}
+				next = static_cast<size_t>(best);
+			}
+
+			//クラスタ内の三角形を元の順番に戻して出力する
+			std::sort(clusterTriangles.begin(), clusterTriangles.end());
+			clusterVertices.clear();
+			TriangleCluster cluster;
+			cluster.indexOffset = static_cast<uint32_t>(result.size());
+			cluster.indexCount = static_cast<uint32_t>(clusterTriangles.size() * 3);
+			for (uint32_t t : clusterTriangles) {
+				for (int k = 0; k < 3; ++k) {
+					const uint32_t v = indices[t * 3 + k];
+					if (localIndex[v] == UINT32_MAX) {
+						localIndex[v] = static_cast<uint32_t>(clusterVertices.size());
+						clusterVertices.push_back(v);
+					}
+					result.push_back(v);
+				}
+			}
+
+			//境界球を求める
+			Vec3 minPos = Position(positions, stride, clusterVertices[0]);
+			Vec3 maxPos = minPos;
+			for (uint32_t v : clusterVertices) {
+				const Vec3 p = Position(positions, stride, v);
+				minPos = Vec3{ std::min(minPos.x, p.x), std::min(minPos.y, p.y), std::min(minPos.z, p.z) };
+				maxPos = Vec3{ std::max(maxPos.x, p.x), std::max(maxPos.y, p.y), std::max(maxPos.z, p.z) };
+			}
+			const Vec3 center = { (minPos.x + maxPos.x) * 0.5f, (minPos.y + maxPos.y) * 0.5f, (minPos.z + maxPos.z) * 0.5f };
+			float radiusSq = 0.0f;
+			for (uint32_t v : clusterVertices) {
+				const Vec3 d = Position(positions, stride, v) - center;
+				radiusSq = std::max(radiusSq, Dot(d, d));
+				localIndex[v] = UINT32_MAX;
+			}
+			cluster.center[0] = center.x;
+			cluster.center[1] = center.y;
+			cluster.center[2] = center.z;
+			cluster.radius = sqrtf(radiusSq);
+
+			//全ての法線を含む法線錐を求める(半頂角が 90 度以上なら背面カリングしない)
+			float minDot = 1.0f;
+			for (uint32_t t : clusterTriangles) {
+				if (Dot(normals[t], normals[t]) > 0.0f) {
+					minDot = std::min(minDot, Dot(normals[t], axis));
+				}
+			}
+			cluster.coneAxis[0] = axis.x;
+			cluster.coneAxis[1] = axis.y;
+			cluster.coneAxis[2] = axis.z;
+			cluster.coneCutoff = minDot > 0.0f ? sqrtf(1.0f - minDot * minDot) : 1.0f;
+			clusters.push_back(cluster);
+		}
+		indices.swap(result);
+	}
+}
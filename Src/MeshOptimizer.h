@@ -0,0 +1,63 @@
+/**
+*	@file MeshOptimizer.h
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/**
+*	メッシュのインデックス順と頂点順を最適化し、簡略化する
+*
+*	インデックスは三角形リストであること
+*/
+namespace MeshOptimizer {
+
+	/**
+	*	頂点キャッシュの効率
+	*/
+	struct Statistics {
+		size_t vertexTransformed;	///< 頂点シェーダの実行回数
+		float acmr;					///< 三角形 1 個あたりの頂点シェーダ実行回数(Average Cache Miss Ratio)
+		float atvr;					///< 頂点 1 個あたりの頂点シェーダ実行回数(Average Transformed Vertex Ratio)
+	};
+
+	/**
+	*	カリング用の三角形のまとまり
+	*/
+	struct TriangleCluster {
+		uint32_t indexOffset;	///< 先頭インデックスの位置
+		uint32_t indexCount;	///< インデックス数
+		float center[3];		///< 境界球の中心
+		float radius;			///< 境界球の半径
+		float coneAxis[3];		///< 法線錐の軸(単位ベクトル)
+		float coneCutoff;		///< 法線錐の半頂角の sin(1 なら背面カリングしない)
+	};
+
+	Statistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, size_t cacheSize = 16);
+	void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount);
+	void OptimizeOverdraw(std::vector<uint32_t>& indices, const void* positions, size_t stride, size_t vertexCount, float threshold = 1.05f);
+	size_t OptimizeVertexFetch(std::vector<uint32_t>& indices, std::vector<uint32_t>& remap, size_t vertexCount);
+	float SimplifyMesh(std::vector<uint32_t>& indices, const void* positions, size_t stride, size_t vertexCount, size_t targetIndexCount, float maxError);
+	void BuildClusters(std::vector<uint32_t>& indices, const void* positions, size_t stride, size_t vertexCount, size_t maxTriangles, std::vector<TriangleCluster>& clusters);
+
+	/**
+	*	OptimizeVertexFetch で作成した対応表に従って頂点を並べ替える
+	*
+	*	@param vertices		並べ替える頂点配列
+	*	@param remap		OptimizeVertexFetch で作成した対応表
+	*	@param vertexCount	OptimizeVertexFetch の戻り値
+	*
+	*	どの三角形からも参照されない頂点は削除される
+	*/
+	template<typename T>
+	void RemapVertices(std::vector<T>& vertices, const std::vector<uint32_t>& remap, size_t vertexCount) {
+		std::vector<T> tmp(vertexCount);
+		for (size_t i = 0; i < remap.size() && i < vertices.size(); ++i) {
+			if (remap[i] != UINT32_MAX) {
+				tmp[remap[i]] = vertices[i];
+			}
+		}
+		vertices.swap(tmp);
+	}
+}
@@ -0,0 +1,338 @@
+/**
+*	@file NativeFbx.cpp
+*/
+#include "NativeFbx.h"
+#include "Zlib.h"
+#include <string.h>
+#include <iostream>
+
+namespace NativeFbx {
+
+	namespace {
+
+		const char magic[] = "Kaydara FBX Binary  ";	///< ファイル識別子(後ろに 0x00, 0x1a, 0x00 が続く)
+		const size_t headerSize = 27;					///< 識別子とバージョン番号のバイト数
+		const int maxDepth = 64;						///< ノードの入れ子の上限
+		const uint64_t maxInflateRatio = 1032;			///< deflate で圧縮したデータを展開したときの最大倍率
+
+		template<typename T>
+		T Read(const uint8_t* p) {
+			T value;
+			memcpy(&value, p, sizeof(T));
+			return value;
+		}
+
+		/**
+		*	配列の要素 1 個のバイト数を取得する
+		*/
+		size_t ElementSize(char type) {
+			switch (type) {
+			case 'f': case 'i': return 4;
+			case 'd': case 'l': return 8;
+			case 'b': return 1;
+			default: return 0;
+			}
+		}
+
+		/**
+		*	ノードレコードの読み取り
+		*
+		*	バージョン 7500 以降はオフセットと数値が 64 ビットになる
+		*/
+		class Reader {
+		public:
+			Reader(const uint8_t* begin, bool is64bit) : begin(begin), is64bit(is64bit) {}
+			bool ReadNode(const uint8_t*& p, const uint8_t* limit, Node& node, bool& isNull, int depth);
+
+		private:
+			bool ReadProperty(const uint8_t*& p, const uint8_t* propertyEnd, Property& prop);
+
+			const uint8_t* begin;
+			bool is64bit;
+		};
+
+		/**
+		*	ノードレコードを 1 つ読み取る
+		*
+		*	@param p		読み取り位置(読み取ったレコードの次に進む)
+		*	@param limit	レコードが収まらなければならない範囲の終端(親ノードの終端、最上位ならファイルの終端)
+		*	@param node		読み取ったノードを格納する変数
+		*	@param isNull	終端を示す空のレコードなら true が格納される
+		*	@param depth	入れ子の深さ
+		*
+		*	@retval true	読み取り成功
+		*	@retval false	データが壊れている
+		*/
+		bool Reader::ReadNode(const uint8_t*& p, const uint8_t* limit, Node& node, bool& isNull, int depth) {
+			const size_t recordHeaderSize = is64bit ? 25 : 13;
+			if (p > limit || static_cast<size_t>(limit - p) < recordHeaderSize || depth > maxDepth) {
+				return false;
+			}
+			uint64_t endOffset, propertyCount, propertyBytes;
+			if (is64bit) {
+				endOffset = Read<uint64_t>(p);
+				propertyCount = Read<uint64_t>(p + 8);
+				propertyBytes = Read<uint64_t>(p + 16);
+			} else {
+				endOffset = Read<uint32_t>(p);
+				propertyCount = Read<uint32_t>(p + 4);
+				propertyBytes = Read<uint32_t>(p + 8);
+			}
+			const uint8_t nameLength = p[recordHeaderSize - 1];
+			if (endOffset == 0) {
+				isNull = true;
+				p += recordHeaderSize;
+				return true;
+			}
+			isNull = false;
+			const uint8_t* nodeEnd = begin + endOffset;
+			const uint8_t* nameBegin = p + recordHeaderSize;
+			if (endOffset > static_cast<uint64_t>(limit - begin) || nodeEnd < nameBegin + nameLength ||
+				propertyBytes > static_cast<uint64_t>(nodeEnd - nameBegin - nameLength)) {
+				return false;
+			}
+			node.name.assign(reinterpret_cast<const char*>(nameBegin), nameLength);
+
+			const uint8_t* q = nameBegin + nameLength;
+			const uint8_t* propertyEnd = q + propertyBytes;
+			node.properties.resize(static_cast<size_t>(propertyCount < propertyBytes ? propertyCount : propertyBytes));
+			for (Property& e : node.properties) {
+				if (!ReadProperty(q, propertyEnd, e)) {
+					return false;
+				}
+			}
+			q = propertyEnd;
+
+			//子ノードは空のレコードで終わる
+			while (q < nodeEnd) {
+				Node child;
+				bool isChildNull;
+				if (!ReadNode(q, nodeEnd, child, isChildNull, depth + 1)) {
+					return false;
+				}
+				if (isChildNull) {
+					break;
+				}
+				node.children.push_back(std::move(child));
+			}
+			p = nodeEnd;
+			return true;
+		}
+
+		/**
+		*	プロパティを 1 つ読み取る
+		*/
+		bool Reader::ReadProperty(const uint8_t*& p, const uint8_t* propertyEnd, Property& prop) {
+			if (p >= propertyEnd) {
+				return false;
+			}
+			prop.type = static_cast<char>(*p++);
+			prop.arrayLength = 0;
+			prop.encoding = 0;
+			const size_t rest = propertyEnd - p;
+			switch (prop.type) {
+			case 'C': case 'B': prop.size = 1; break;
+			case 'Y': prop.size = 2; break;
+			case 'I': case 'F': prop.size = 4; break;
+			case 'D': case 'L': prop.size = 8; break;
+			case 'S': case 'R':
+				if (rest < 4) {
+					return false;
+				}
+				prop.size = Read<uint32_t>(p);
+				p += 4;
+				break;
+			case 'f': case 'd': case 'l': case 'i': case 'b':
+				if (rest < 12) {
+					return false;
+				}
+				prop.arrayLength = Read<uint32_t>(p);
+				prop.encoding = Read<uint32_t>(p + 4);
+				prop.size = Read<uint32_t>(p + 8);
+				p += 12;
+				if (prop.encoding == 0 && static_cast<uint64_t>(prop.arrayLength) * ElementSize(prop.type) != prop.size) {
+					return false;
+				}
+				break;
+			default:
+				return false;
+			}
+			if (static_cast<size_t>(propertyEnd - p) < prop.size) {
+				return false;
+			}
+			prop.data = p;
+			p += prop.size;
+			return true;
+		}
+
+		/**
+		*	配列プロパティを展開して型変換する
+		*
+		*	@param prop	配列プロパティ
+		*	@param out	展開した値を格納する配列
+		*
+		*	要素数から求めたバイト数が、圧縮データから展開できる最大サイズ(または非圧縮データのサイズ)に
+		*	収まらない場合は、壊れたデータとして展開前に失敗する
+		*/
+		template<typename T>
+		bool DecodeArray(const Property& prop, std::vector<T>& out) {
+			const size_t elementSize = ElementSize(prop.type);
+			if (!prop.IsArray()) {
+				return false;
+			}
+			const uint64_t bytes = static_cast<uint64_t>(prop.arrayLength) * elementSize;
+			const uint64_t maxBytes = prop.encoding == 1 ? static_cast<uint64_t>(prop.size) * maxInflateRatio : prop.size;
+			if (bytes > maxBytes || bytes > SIZE_MAX) {
+				return false;
+			}
+			std::vector<uint8_t> buffer;
+			const uint8_t* p = prop.data;
+			if (prop.encoding == 1) {
+				buffer.resize(static_cast<size_t>(bytes));
+				if (!Zlib::Inflate(prop.data, prop.size, buffer.data(), static_cast<size_t>(bytes))) {
+					return false;
+				}
+				p = buffer.data();
+			} else if (prop.encoding != 0) {
+				return false;
+			}
+			out.resize(prop.arrayLength);
+			for (size_t i = 0; i < prop.arrayLength; ++i, p += elementSize) {
+				switch (prop.type) {
+				case 'f': out[i] = static_cast<T>(Read<float>(p)); break;
+				case 'd': out[i] = static_cast<T>(Read<double>(p)); break;
+				case 'i': out[i] = static_cast<T>(Read<int32_t>(p)); break;
+				case 'l': out[i] = static_cast<T>(Read<int64_t>(p)); break;
+				case 'b': out[i] = static_cast<T>(*p & 1); break;
+				}
+			}
+			return true;
+		}
+	}
+
+	/**
+	*	整数または実数のプロパティを整数として取得する
+	*/
+	int64_t Property::ToInt() const {
+		switch (type) {
+		case 'C': case 'B': return *data;
+		case 'Y': return Read<int16_t>(data);
+		case 'I': return Read<int32_t>(data);
+		case 'L': return Read<int64_t>(data);
+		case 'F': return static_cast<int64_t>(Read<float>(data));
+		case 'D': return static_cast<int64_t>(Read<double>(data));
+		default: return 0;
+		}
+	}
+
+	/**
+	*	整数または実数のプロパティを実数として取得する
+	*/
+	double Property::ToDouble() const {
+		switch (type) {
+		case 'F': return Read<float>(data);
+		case 'D': return Read<double>(data);
+		default: return static_cast<double>(ToInt());
+		}
+	}
+
+	/**
+	*	文字列のプロパティを取得する
+	*
+	*	オブジェクト名の "名前\x00\x01クラス名" は名前の部分だけを返す
+	*/
+	std::string Property::ToString() const {
+		if (type != 'S' && type != 'R') {
+			return std::string();
+		}
+		const char* p = reinterpret_cast<const char*>(data);
+		const void* separator = memchr(p, '\0', size);
+		return std::string(p, separator ? static_cast<const char*>(separator) - p : size);
+	}
+
+	/**
+	*	配列プロパティを実数の配列として取得する
+	*
+	*	@param out	展開した値を格納する配列
+	*
+	*	@retval true	取得成功
+	*	@retval false	配列ではないか、データが壊れている
+	*/
+	bool Property::ToArray(std::vector<double>& out) const {
+		return DecodeArray(*this, out);
+	}
+
+	/**
+	*	配列プロパティを整数の配列として取得する
+	*
+	*	@param out	展開した値を格納する配列
+	*
+	*	@retval true	取得成功
+	*	@retval false	配列ではないか、データが壊れている
+	*/
+	bool Property::ToArray(std::vector<int32_t>& out) const {
+		return DecodeArray(*this, out);
+	}
+
+	/**
+	*	子ノードを名前で検索する
+	*
+	*	@param childName	ノード名
+	*
+	*	@return 最初に見つかった子ノードへのポインタ
+	*			見つからない場合は nullptr
+	*/
+	const Node* Node::Find(const char* childName) const {
+		for (const Node& e : children) {
+			if (e.name == childName) {
+				return &e;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	*	バイナリ形式の FBX ファイルを開く
+	*
+	*	@param fileName	FBX ファイル名
+	*
+	*	@return 読み込んだドキュメントへのポインタ
+	*			テキスト形式の FBX ファイルや壊れたファイルの場合は nullptr
+	*/
+	DocumentPtr Document::Open(const char* fileName) {
+		const MappedFilePtr file = MappedFile::Open(fileName);
+		if (!file) {
+			return nullptr;
+		}
+		const uint8_t* data = file->Data();
+		const size_t size = file->Size();
+		if (size < headerSize || memcmp(data, magic, sizeof(magic) - 1) != 0) {
+			return nullptr;
+		}
+		const uint32_t version = Read<uint32_t>(data + 23);
+		if (version < 7000 || version >= 8000) {
+			std::cerr << "WARNING: " << fileName << " は未対応のバージョン(" << version << ")です" << std::endl;
+			return nullptr;
+		}
+
+		struct Impl : Document { Impl() {} ~Impl() {} };
+		std::shared_ptr<Document> p = std::make_shared<Impl>();
+		p->file = file;
+		p->version = version;
+		Reader reader(data, version >= 7500);
+		const uint8_t* pos = data + headerSize;
+		for (;;) {
+			Node node;
+			bool isNull;
+			if (!reader.ReadNode(pos, data + size, node, isNull, 0)) {
+				std::cerr << "ERROR: " << fileName << " が壊れています" << std::endl;
+				return nullptr;
+			}
+			if (isNull) {
+				break;
+			}
+			p->root.children.push_back(std::move(node));
+		}
+		return p;
+	}
+}
@@ -0,0 +1,71 @@
+/**
+*	@file NativeFbx.h
+*/
+#pragma once
+#include "MappedFile.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+/**
+*	バイナリ形式の FBX ファイル(バージョン 7.x)の読み込み
+*
+*	FBX SDK を使わずにノードレコードを読み取る
+*	ファイルはメモリマップし、配列プロパティは ToArray を呼び出した時点で展開する
+*	読み込み後は読み取り専用なので、複数のスレッドから同時に ToArray を呼び出してもよい
+*/
+namespace NativeFbx {
+	class Document;
+	typedef std::shared_ptr<Document> DocumentPtr;	///< FBX ドキュメントポインタ型
+
+	/**
+	*	ノードのプロパティ
+	*/
+	struct Property {
+		char type;				///< 型コード('I', 'L', 'D', 'S', 'd', 'i' など)
+		const uint8_t* data;	///< 値の先頭(配列の場合は圧縮されていることがある)
+		uint32_t size;			///< data のバイト数
+		uint32_t arrayLength;	///< 配列の要素数
+		uint32_t encoding;		///< 配列の符号化方式(0: 無圧縮, 1: zlib)
+
+		bool IsArray() const { return type == 'f' || type == 'd' || type == 'l' || type == 'i' || type == 'b'; }
+		int64_t ToInt() const;
+		double ToDouble() const;
+		std::string ToString() const;
+		bool ToArray(std::vector<double>& out) const;
+		bool ToArray(std::vector<int32_t>& out) const;
+	};
+
+	/**
+	*	ノードレコード
+	*/
+	struct Node {
+		std::string name;					///< ノード名
+		std::vector<Property> properties;	///< プロパティのリスト
+		std::vector<Node> children;			///< 子ノードのリスト
+
+		const Node* Find(const char* childName) const;
+	};
+
+	/**
+	*	FBX ドキュメント
+	*/
+	class Document {
+	public:
+		static DocumentPtr Open(const char* fileName);
+		uint32_t Version() const { return version; }
+		const Node& Root() const { return root; }
+
+	private:
+		Document() = default;
+		~Document() = default;
+		Document(const Document&) = delete;
+		Document& operator=(const Document&) = delete;
+
+	private:
+		MappedFilePtr file;		///< プロパティが参照するファイル
+		uint32_t version = 0;	///< ファイル形式のバージョン(7400 など)
+		Node root;				///< 最上位のノードを子に持つ仮のノード
+	};
+}
@@ -2,14 +2,15 @@
 *	@file OffscreenBuffer.cpp
 */
 #include"OffscreenBuffer.h"
+#include"GLState.h"
 
 /**
-*	ItXN[obt@쐬
+*	オフスクリーンバッファを作成する
 *
-*	@param	w ItXN[obt@̕@(sNZP)
-*	@param	h ItXN[obt@̍()sNZP
+*	@param	w オフスクリーンバッファの幅　(ピクセル単位)
+*	@param	h オフスクリーンバッファの高さ()ピクセル単位
 *
-*	@return	쐬ItXN[obt@ւ̃|C^
+*	@return	作成したオフスクリーンバッファへのポインタ
 */
 OffscreenBufferPtr OffscreenBuffer::Create(int w, int h) {
 	struct  Impl : OffscreenBuffer{
@@ -21,33 +22,31 @@ OffscreenBufferPtr OffscreenBuffer::Create(int w, int h) {
 		return offscreen;
 	}
 
-	//eNX`쐬
+	//テクスチャを作成
 	offscreen->tex = Texture::Create(w, h, GL_RGBA8, GL_RGBA, nullptr);
 
-	//[xobt@쐬
+	//深度バッファを作成
 	glGenRenderbuffers(1, &offscreen->depthBuffer);
 	glBindRenderbuffer(GL_RENDERBUFFER, offscreen->depthBuffer);
 	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
 	glBindRenderbuffer(GL_RENDERBUFFER, 0);
 
-	//eNX`Ɛ[xobt@t[obt@Ƃē
+	//テクスチャと深度バッファをフレームバッファとして統合
 	glGenFramebuffers(1, &offscreen->frameBuffer);
-	glBindFramebuffer(GL_FRAMEBUFFER, offscreen->frameBuffer);
+	GLState::BindFramebuffer(offscreen->frameBuffer);
 	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, offscreen->depthBuffer);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, offscreen->tex->Id(), 0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(0);
 
 
 	return offscreen;
 }
 
 /**
-*	fXgN^
+*	デストラクタ
 */
 OffscreenBuffer::~OffscreenBuffer() {
-	if (frameBuffer) {
-		glDeleteFramebuffers(1, &frameBuffer);
-	}
+	GLState::DeleteFramebuffer(frameBuffer);
 	if (depthBuffer) {
 		glDeleteRenderbuffers(1, &depthBuffer);
 	}
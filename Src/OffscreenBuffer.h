@@ -10,13 +10,13 @@ class OffscreenBuffer;
 typedef std::shared_ptr<OffscreenBuffer> OffscreenBufferPtr;
 
 /**
-*	ItXN[obt@
+*	オフスクリーンバッファ
 */
 class OffscreenBuffer {
 public:
 	static OffscreenBufferPtr Create(int w, int h);
-	GLuint GetFrameBuffer() const { return frameBuffer; }	///< t[obt@擾
-	GLuint GetTextur() const { return tex->Id(); }	///< t[obt@peNX`擾
+	GLuint GetFrameBuffer() const { return frameBuffer; }	///< フレームバッファを取得する
+	GLuint GetTextur() const { return tex->Id(); }	///< フレームバッファ用テクスチャを取得する
 
 private:
 	OffscreenBuffer() = default;
@@ -26,8 +26,8 @@ private:
 
 
 private:
-	TexturePtr tex;	///< t[obt@peNX`
-	GLuint depthBuffer = 0;	///< [xobt@IuWFNg
-	GLuint frameBuffer = 0;	///< t[obt@IuWFNg
+	TexturePtr tex;	///< フレームバッファ用テクスチャ
+	GLuint depthBuffer = 0;	///< 深度バッファオブジェクト
+	GLuint frameBuffer = 0;	///< フレームバッファオブジェクト
 
 };
\ No newline at end of file
@@ -0,0 +1,518 @@
+/**
+*	@file Profiler.cpp
+*/
+#include "Profiler.h"
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <string>
+#include <iostream>
+#include <stdio.h>
+
+/**
+*	フレームプロファイラ
+*/
+namespace Profiler {
+	std::atomic<bool> isEnabled(false);
+
+	namespace {
+		const uint64_t threadBufferCapacity = 8 * 1024;		///< スレッド毎に保持するサンプル数
+		const int maxFrameHistory = 600;					///< 保持するフレーム情報の数
+		const int gpuLatency = 4;							///< GPU クエリの結果を回収するまでのフレーム数
+		const int maxGpuTimersPerFrame = 32;				///< 1 フレームで使える GPU タイマーの数
+		const int gpuCalibrationInterval = 300;				///< GPU 時計と CPU 時計を合わせ直す間隔(フレーム数)
+
+		/**
+		*	リングバッファの 1 サンプル分の領域
+		*
+		*	書き込み中に他のスレッドから読まれるので、各メンバを atomic にして読み書きを競合させない
+		*/
+		struct SampleSlot {
+			std::atomic<const char*> name{ nullptr };
+			std::atomic<int64_t> time{ 0 };
+			std::atomic<int64_t> duration{ 0 };
+			std::atomic<double> value{ 0 };
+			std::atomic<uint32_t> type{ 0 };
+		};
+
+		/**
+		*	スレッド毎のサンプル用リングバッファ
+		*
+		*	書き込みは所有スレッドだけが行う
+		*	書き込む前に started を進めて release フェンスを置き、書き終えたら head を release で公開する
+		*	読み出し側はコピー後に acquire フェンスを置いて started を読み直し、コピー中に上書きが始まったサンプルを捨てる
+		*/
+		struct ThreadBuffer {
+			SampleSlot samples[threadBufferCapacity];
+			std::atomic<uint64_t> started{ 0 };	///< 書き込みを始めたサンプル数(通算)
+			std::atomic<uint64_t> head{ 0 };	///< 書き終えたサンプル数(通算)
+			int id = 0;							///< trace_event に出力するスレッド ID
+			std::string name;					///< スレッド名
+			bool isInUse = false;				///< スレッドが使用中なら true(registryMutex で保護)
+		};
+
+		std::mutex registryMutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+		int nextThreadId = 0;	///< 次に割り当てるスレッド ID(registryMutex で保護)
+
+		void ReleaseThreadBuffer(ThreadBuffer* p);
+
+		/**
+		*	スレッドが使っているバッファ
+		*
+		*	スレッドの終了時にバッファを返却し、後から作られたスレッドで再利用する
+		*/
+		struct ThreadSlot {
+			ThreadBuffer* buffer = nullptr;
+			~ThreadSlot() {
+				if (buffer) {
+					ReleaseThreadBuffer(buffer);
+				}
+			}
+		};
+		thread_local ThreadSlot currentThread;
+
+		/// フレーム情報
+		struct FrameInfo {
+			int64_t begin = 0;
+			int64_t end = 0;
+		};
+		FrameInfo frameHistory[maxFrameHistory];
+		uint32_t frameCount = 0;
+		uint32_t lastCaptureFrame = 0;
+		int captureFrameCount = 120;
+		double spikeThreshold = 0;
+		std::atomic<bool> isCaptureRequested(false);
+
+		/// GPU タイマー
+		struct GpuQuery {
+			const char* name;
+			GLuint query[2];
+		};
+		/// 1 フレーム分の GPU タイマー
+		struct GpuFrame {
+			GpuQuery timers[maxGpuTimersPerFrame];
+			int count = 0;
+		};
+		GpuFrame gpuFrames[gpuLatency];
+		int gpuFrameIndex = 0;
+		bool isGpuReady = false;
+		int64_t gpuClockOffset = 0;	///< CPU 時刻 - GPU 時刻
+		ThreadBuffer* gpuThread = nullptr;
+
+		/**
+		*	スレッドバッファを登録する
+		*
+		*	@param name	スレッド名
+		*
+		*	@return 登録したスレッドバッファへのポインタ
+		*
+		*	終了したスレッドが返却したバッファがあれば、中身を空にして再利用する
+		*	スレッド毎に約 320KB 使うので、ワーカースレッドが入れ替わってもメモリを増やし続けないようにしている
+		*/
+		ThreadBuffer* RegisterThreadBuffer(const char* name) {
+			std::lock_guard<std::mutex> lock(registryMutex);
+			ThreadBuffer* p = nullptr;
+			for (const auto& e : threadBuffers) {
+				if (!e->isInUse) {
+					p = e.get();
+					break;
+				}
+			}
+			if (!p) {
+				threadBuffers.emplace_back(new ThreadBuffer);
+				p = threadBuffers.back().get();
+			}
+			//読み出しは registryMutex を取ってから行うので、ここで空にしても競合しない
+			p->started.store(0, std::memory_order_relaxed);
+			p->head.store(0, std::memory_order_relaxed);
+			p->id = ++nextThreadId;
+			p->name = name ? name : ("Thread " + std::to_string(p->id));
+			p->isInUse = true;
+			return p;
+		}
+
+		/**
+		*	スレッドバッファを返却する
+		*
+		*	@param p	返却するスレッドバッファ
+		*
+		*	返却したバッファのサンプルは、再利用されるまでキャプチャに含まれる
+		*/
+		void ReleaseThreadBuffer(ThreadBuffer* p) {
+			std::lock_guard<std::mutex> lock(registryMutex);
+			p->isInUse = false;
+		}
+
+		/**
+		*	現在のスレッドのバッファを取得する
+		*/
+		ThreadBuffer& GetThreadBuffer() {
+			if (!currentThread.buffer) {
+				currentThread.buffer = RegisterThreadBuffer(nullptr);
+			}
+			return *currentThread.buffer;
+		}
+
+		/**
+		*	サンプルをリングバッファに書き込む
+		*/
+		void Write(ThreadBuffer& tb, const Sample& sample) {
+			const uint64_t head = tb.head.load(std::memory_order_relaxed);
+			tb.started.store(head + 1, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			SampleSlot& slot = tb.samples[head % threadBufferCapacity];
+			slot.name.store(sample.name, std::memory_order_relaxed);
+			slot.time.store(sample.time, std::memory_order_relaxed);
+			slot.duration.store(sample.duration, std::memory_order_relaxed);
+			slot.value.store(sample.value, std::memory_order_relaxed);
+			slot.type.store(sample.type, std::memory_order_relaxed);
+			tb.head.store(head + 1, std::memory_order_release);
+		}
+
+		/**
+		*	GPU 時計と CPU 時計のずれを計測する
+		*/
+		void CalibrateGpuClock() {
+			GLint64 gpuTime = 0;
+			glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+			gpuClockOffset = Now() - gpuTime;
+		}
+
+		/**
+		*	回収可能になった GPU タイマーの結果をサンプルとして書き込む
+		*
+		*	@param frame 回収するフレーム
+		*
+		*	結果がまだ得られないクエリは、待たずに破棄する
+		*/
+		void ResolveGpuFrame(GpuFrame& frame) {
+			for (int i = 0; i < frame.count; ++i) {
+				const GpuQuery& q = frame.timers[i];
+				GLuint available = 0;
+				glGetQueryObjectuiv(q.query[1], GL_QUERY_RESULT_AVAILABLE, &available);
+				if (!available) {
+					continue;
+				}
+				GLuint64 begin = 0;
+				GLuint64 end = 0;
+				glGetQueryObjectui64v(q.query[0], GL_QUERY_RESULT, &begin);
+				glGetQueryObjectui64v(q.query[1], GL_QUERY_RESULT, &end);
+				const int64_t time = static_cast<int64_t>(begin) + gpuClockOffset;
+				Write(*gpuThread, { q.name, time, static_cast<int64_t>(end - begin), 0, SampleType_Scope });
+			}
+			frame.count = 0;
+		}
+
+		/**
+		*	スレッドバッファから期間内のサンプルを取り出す
+		*
+		*	@param tb		サンプルを取り出すスレッドバッファ
+		*	@param since	この時刻以降のサンプルを取り出す
+		*	@param out		取り出したサンプルの格納先
+		*
+		*	コピー中に上書きが始まった可能性のあるサンプルは捨てる
+		*/
+		void CollectSamples(const ThreadBuffer& tb, int64_t since, std::vector<Sample>& out) {
+			const uint64_t head = tb.head.load(std::memory_order_acquire);
+			const uint64_t tail = head > threadBufferCapacity ? head - threadBufferCapacity : 0;
+			const size_t first = out.size();
+			out.reserve(first + static_cast<size_t>(head - tail));
+			for (uint64_t i = tail; i < head; ++i) {
+				const SampleSlot& slot = tb.samples[i % threadBufferCapacity];
+				Sample s;
+				s.name = slot.name.load(std::memory_order_relaxed);
+				s.time = slot.time.load(std::memory_order_relaxed);
+				s.duration = slot.duration.load(std::memory_order_relaxed);
+				s.value = slot.value.load(std::memory_order_relaxed);
+				s.type = static_cast<SampleType>(slot.type.load(std::memory_order_relaxed));
+				out.push_back(s);
+			}
+			//コピーしたサンプルのどれかに上書きが書き込まれていれば、started はその上書きの分まで進んで見える
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const uint64_t started = tb.started.load(std::memory_order_relaxed);
+			const uint64_t safeTail = started > threadBufferCapacity ? started - threadBufferCapacity : 0;
+			size_t dst = first;
+			for (uint64_t i = tail; i < head; ++i) {
+				const Sample& s = out[first + static_cast<size_t>(i - tail)];
+				if (i >= safeTail && s.time >= since) {
+					out[dst++] = s;
+				}
+			}
+			out.resize(dst);
+		}
+	}
+
+	/**
+	*	プロファイラを初期化する
+	*
+	*	@retval true	GPU タイマーが使用可能
+	*	@retval false	GPU タイマーが使用できない(CPU 計測は使用可能)
+	*
+	*	OpenGL コンテキストを作成したスレッドから呼び出すこと
+	*/
+	bool Init() {
+		if (!currentThread.buffer) {
+			currentThread.buffer = RegisterThreadBuffer("Main");
+		}
+		if (isGpuReady) {
+			return true;
+		}
+		if (!gpuThread) {
+			gpuThread = RegisterThreadBuffer("GPU");
+		}
+		for (GpuFrame& frame : gpuFrames) {
+			for (GpuQuery& q : frame.timers) {
+				glGenQueries(2, q.query);
+			}
+		}
+		const GLenum result = glGetError();
+		if (result != GL_NO_ERROR) {
+			std::cerr << "WARNING: GPU タイマーを作成できません(0x" << std::hex << result << std::dec << ")" << std::endl;
+			return false;
+		}
+		CalibrateGpuClock();
+		isGpuReady = true;
+		return true;
+	}
+
+	/**
+	*	GPU タイマーを破棄する
+	*
+	*	OpenGL コンテキストが有効なうちに呼び出すこと
+	*/
+	void Shutdown() {
+		if (!isGpuReady) {
+			return;
+		}
+		for (GpuFrame& frame : gpuFrames) {
+			for (GpuQuery& q : frame.timers) {
+				glDeleteQueries(2, q.query);
+			}
+			frame.count = 0;
+		}
+		isGpuReady = false;
+	}
+
+	/**
+	*	計測の有効/無効を切り替える
+	*
+	*	@param enable true なら計測を開始し、false なら停止する
+	*/
+	void Enable(bool enable) {
+		isEnabled.store(enable, std::memory_order_relaxed);
+	}
+
+	/**
+	*	現在時刻を取得する
+	*
+	*	@return 現在時刻(ナノ秒)
+	*/
+	int64_t Now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/**
+	*	現在のスレッドに名前を付ける
+	*
+	*	@param name trace_event に出力されるスレッド名
+	*/
+	void ThreadName(const char* name) {
+		ThreadBuffer& tb = GetThreadBuffer();
+		std::lock_guard<std::mutex> lock(registryMutex);
+		tb.name = name;
+	}
+
+	/**
+	*	フレームの開始を記録する
+	*
+	*	メインスレッドから、毎フレームの最初に呼び出すこと
+	*/
+	void BeginFrame() {
+		frameHistory[frameCount % maxFrameHistory].begin = Now();
+		if (!isGpuReady) {
+			return;
+		}
+		gpuFrameIndex = (gpuFrameIndex + 1) % gpuLatency;
+		ResolveGpuFrame(gpuFrames[gpuFrameIndex]);
+		if (IsEnabled() && frameCount % gpuCalibrationInterval == 0) {
+			CalibrateGpuClock();
+		}
+	}
+
+	/**
+	*	フレームの終了を記録する
+	*
+	*	フレーム時間が閾値を超えた場合や、キャプチャが要求されていた場合は
+	*	直近のフレームを trace_event 形式で出力する
+	*/
+	void EndFrame() {
+		FrameInfo& frame = frameHistory[frameCount % maxFrameHistory];
+		frame.end = Now();
+		if (IsEnabled()) {
+			Push("Frame", frame.begin, frame.end);
+			const double seconds = static_cast<double>(frame.end - frame.begin) * 1e-9;
+			bool capture = isCaptureRequested.exchange(false);
+			if (spikeThreshold > 0 && seconds > spikeThreshold && frameCount - lastCaptureFrame > static_cast<uint32_t>(captureFrameCount)) {
+				std::cout << "INFO: フレーム " << frameCount << " の処理時間が " << seconds * 1000.0 << "ms かかりました" << std::endl;
+				capture = true;
+			}
+			if (capture) {
+				const std::string fileName = "Profile_" + std::to_string(frameCount) + ".json";
+				if (WriteChromeTrace(fileName.c_str(), captureFrameCount)) {
+					std::cout << "INFO: プロファイル結果を " << fileName << " に出力しました" << std::endl;
+				}
+				lastCaptureFrame = frameCount;
+			}
+		}
+		++frameCount;
+	}
+
+	/**
+	*	区間計測のサンプルを追加する
+	*
+	*	@param name		区間名(静的な文字列であること)
+	*	@param begin	開始時刻(ナノ秒)
+	*	@param end		終了時刻(ナノ秒)
+	*/
+	void Push(const char* name, int64_t begin, int64_t end) {
+		Write(GetThreadBuffer(), { name, begin, end - begin, 0, SampleType_Scope });
+	}
+
+	/**
+	*	カウンタ値のサンプルを追加する
+	*
+	*	@param name		カウンタ名(静的な文字列であること)
+	*	@param value	カウンタ値
+	*/
+	void Counter(const char* name, double value) {
+		if (IsEnabled()) {
+			Write(GetThreadBuffer(), { name, Now(), 0, value, SampleType_Counter });
+		}
+	}
+
+	/**
+	*	キャプチャするフレーム数を設定する
+	*
+	*	@param count 出力する直近のフレーム数
+	*/
+	void CaptureFrameCount(int count) {
+		captureFrameCount = count < 1 ? 1 : (count > maxFrameHistory ? maxFrameHistory : count);
+	}
+
+	/**
+	*	自動キャプチャを行うフレーム時間の閾値を設定する
+	*
+	*	@param seconds	閾値(秒)
+	*					0 以下なら自動キャプチャを行わない
+	*/
+	void SpikeThreshold(double seconds) {
+		spikeThreshold = seconds;
+	}
+
+	/**
+	*	現在のフレームの終了時にキャプチャを行うよう要求する
+	*/
+	void RequestCapture() {
+		isCaptureRequested.store(true);
+	}
+
+	/**
+	*	直近のフレームを Chrome の trace_event 形式で出力する
+	*
+	*	@param fileName		出力するファイル名
+	*	@param count		出力するフレーム数
+	*
+	*	@retval true	出力成功
+	*	@retval false	出力失敗
+	*/
+	bool WriteChromeTrace(const char* fileName, int count) {
+		const uint32_t available = frameCount < maxFrameHistory ? frameCount : maxFrameHistory;
+		if (count > static_cast<int>(available)) {
+			count = static_cast<int>(available);
+		}
+		const int64_t since = count > 0 ? frameHistory[(frameCount - count) % maxFrameHistory].begin : 0;
+
+		struct ThreadSamples {
+			int id;
+			std::string name;
+			std::vector<Sample> samples;
+		};
+		std::vector<ThreadSamples> threads;
+		{
+			std::lock_guard<std::mutex> lock(registryMutex);
+			threads.reserve(threadBuffers.size());
+			for (const auto& tb : threadBuffers) {
+				threads.push_back({ tb->id, tb->name, {} });
+				CollectSamples(*tb, since, threads.back().samples);
+			}
+		}
+
+		FILE* fp = fopen(fileName, "w");
+		if (!fp) {
+			std::cerr << "ERROR: " << fileName << "を開けません" << std::endl;
+			return false;
+		}
+		fprintf(fp, "{\"traceEvents\":[\n");
+		const char* separator = "";
+		for (const ThreadSamples& t : threads) {
+			fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", separator, t.id, t.name.c_str());
+			separator = ",\n";
+			for (const Sample& s : t.samples) {
+				const double ts = static_cast<double>(s.time - since) * 1e-3;
+				if (s.type == SampleType_Counter) {
+					fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"value\":%g}}", s.name, ts, t.id, s.value);
+				} else {
+					fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}", s.name, ts, static_cast<double>(s.duration) * 1e-3, t.id);
+				}
+			}
+		}
+		fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+		const bool result = ferror(fp) == 0;
+		fclose(fp);
+		return result;
+	}
+
+	/**
+	*	全スレッドのサンプルを取り出す
+	*
+	*	@param since	この時刻以降のサンプルを取り出す
+	*	@param out		取り出したサンプルの格納先(末尾に追加される)
+	*/
+	void ReadSamples(int64_t since, std::vector<Sample>& out) {
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (const auto& tb : threadBuffers) {
+			CollectSamples(*tb, since, out);
+		}
+	}
+
+	/**
+	*	GPU タイマーを開始する
+	*
+	*	@param name 区間名(静的な文字列であること)
+	*/
+	GpuTimer::GpuTimer(const char* name) : slot(-1) {
+		if (!isGpuReady || !IsEnabled()) {
+			return;
+		}
+		GpuFrame& frame = gpuFrames[gpuFrameIndex];
+		if (frame.count >= maxGpuTimersPerFrame) {
+			return;
+		}
+		slot = frame.count++;
+		GpuQuery& q = frame.timers[slot];
+		q.name = name;
+		glQueryCounter(q.query[0], GL_TIMESTAMP);
+	}
+
+	/**
+	*	GPU タイマーを停止する
+	*/
+	GpuTimer::~GpuTimer() {
+		if (slot >= 0) {
+			glQueryCounter(gpuFrames[gpuFrameIndex].timers[slot].query[1], GL_TIMESTAMP);
+		}
+	}
+}
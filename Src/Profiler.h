@@ -0,0 +1,94 @@
+/**
+*	@file Profiler.h
+*/
+#pragma once
+#include <GL/glew.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+/**
+*	フレームプロファイラ
+*
+*	区間計測のサンプルはスレッド毎のリングバッファに書き込まれる
+*	無効時は atomic 変数を 1 回読むだけで計測を行わない
+*/
+namespace Profiler {
+	/// サンプルの種類
+	enum SampleType : uint32_t {
+		SampleType_Scope,	///< 区間計測
+		SampleType_Counter,	///< カウンタ値
+	};
+
+	/**
+	*	計測サンプル
+	*/
+	struct Sample {
+		const char* name;	///< 区間名(静的な文字列であること)
+		int64_t time;		///< 開始時刻(ナノ秒)
+		int64_t duration;	///< 経過時間(ナノ秒)
+		double value;		///< カウンタ値
+		SampleType type;	///< サンプルの種類
+	};
+
+	extern std::atomic<bool> isEnabled;	///< 計測が有効なら true
+
+	/// 計測が有効か調べる
+	inline bool IsEnabled() { return isEnabled.load(std::memory_order_relaxed); }
+
+	bool Init();
+	void Shutdown();
+	void Enable(bool enable);
+	int64_t Now();
+	void ThreadName(const char* name);
+	void BeginFrame();
+	void EndFrame();
+	void Push(const char* name, int64_t begin, int64_t end);
+	void Counter(const char* name, double value);
+	void CaptureFrameCount(int count);
+	void SpikeThreshold(double seconds);
+	void RequestCapture();
+	bool WriteChromeTrace(const char* fileName, int count);
+	void ReadSamples(int64_t since, std::vector<Sample>& out);
+
+	/**
+	*	スコープの間の CPU 時間を計測するクラス
+	*/
+	class ScopedTimer {
+	public:
+		explicit ScopedTimer(const char* n) : name(n), begin(IsEnabled() ? Now() : 0) {}
+		~ScopedTimer() { if (begin) { Push(name, begin, Now()); } }
+
+	private:
+		ScopedTimer(const ScopedTimer&) = delete;
+		ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+		const char* name;
+		int64_t begin;
+	};
+
+	/**
+	*	スコープの間の GPU 時間を計測するクラス
+	*
+	*	GL_TIMESTAMP クエリを発行し、数フレーム後に結果を回収する
+	*/
+	class GpuTimer {
+	public:
+		explicit GpuTimer(const char* name);
+		~GpuTimer();
+
+	private:
+		GpuTimer(const GpuTimer&) = delete;
+		GpuTimer& operator=(const GpuTimer&) = delete;
+
+		int slot;
+	};
+}
+
+#define PROFILE_CONCAT_I(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_I(a, b)
+
+/// 現在のスコープの CPU 時間を計測する
+#define PROFILE_SCOPE(name) Profiler::ScopedTimer PROFILE_CONCAT(profileScope, __LINE__)(name)
+/// 現在のスコープの GPU 時間を計測する
+#define PROFILE_GPU_SCOPE(name) Profiler::GpuTimer PROFILE_CONCAT(profileGpuScope, __LINE__)(name)
@@ -0,0 +1,124 @@
+/**
+*	@file RangeAllocator.cpp
+*/
+#include "RangeAllocator.h"
+
+/**
+*	コンストラクタ
+*
+*	@param capacity		管理するバイト数(alignment の倍数に切り捨てられる)
+*	@param alignment	割り当てる範囲のオフセットとサイズの単位
+*						2 のべき乗でなくてもよいので、頂点サイズを指定すれば頂点単位で割り当てられる
+*/
+RangeAllocator::RangeAllocator(size_t capacity, size_t alignment) :
+	capacity(capacity / alignment * alignment), alignment(alignment)
+{
+	if (this->capacity) {
+		freeList.insert(std::make_pair(size_t(0), this->capacity));
+		freeBytes = this->capacity;
+	}
+}
+
+/**
+*	範囲を割り当てる
+*
+*	@param size		割り当てるバイト数
+*	@param limit	割り当てる範囲の終端の上限
+*
+*	@return 割り当てた範囲のオフセット
+*			割り当てられる空き範囲がない場合は npos を返す
+*
+*	limit を指定すると、その位置より前に収まる範囲だけから割り当てる
+*	デフラグで範囲を前に詰めるときに使う
+*/
+size_t RangeAllocator::Allocate(size_t size, size_t limit) {
+	size = AlignedSize(size);
+	if (size == 0 || size > freeBytes) {
+		return npos;
+	}
+	auto best = freeList.end();
+	for (auto itr = freeList.begin(); itr != freeList.end() && itr->first < limit; ++itr) {
+		if (itr->second < size || (limit != npos && itr->first + size > limit)) {
+			continue;
+		}
+		if (best == freeList.end() || itr->second < best->second) {
+			best = itr;
+			if (best->second == size) {
+				break;
+			}
+		}
+	}
+	if (best == freeList.end()) {
+		return npos;
+	}
+	const size_t offset = best->first;
+	const size_t rest = best->second - size;
+	freeList.erase(best);
+	if (rest) {
+		freeList.insert(std::make_pair(offset + size, rest));
+	}
+	freeBytes -= size;
+	return offset;
+}
+
+/**
+*	範囲を解放する
+*
+*	@param offset	Allocate で割り当てた範囲のオフセット
+*	@param size		Allocate に指定したバイト数
+*/
+void RangeAllocator::Free(size_t offset, size_t size) {
+	size = AlignedSize(size);
+	if (size == 0) {
+		return;
+	}
+	freeBytes += size;
+	auto next = freeList.lower_bound(offset);
+	if (next != freeList.begin()) {
+		auto prev = next;
+		--prev;
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			freeList.erase(prev);
+		}
+	}
+	if (next != freeList.end() && offset + size == next->first) {
+		size += next->second;
+		freeList.erase(next);
+	}
+	freeList.insert(std::make_pair(offset, size));
+}
+
+/**
+*	管理するバイト数を増やす
+*
+*	@param newCapacity	新しいバイト数(alignment の倍数に切り捨てられる)
+*
+*	増えた範囲は空き範囲として追加される
+*	現在より小さい値を指定した場合は何もしない
+*/
+void RangeAllocator::Grow(size_t newCapacity) {
+	newCapacity = newCapacity / alignment * alignment;
+	if (newCapacity <= capacity) {
+		return;
+	}
+	const size_t offset = capacity;
+	capacity = newCapacity;
+	Free(offset, newCapacity - offset);
+}
+
+/**
+*	最大の空き範囲のバイト数を取得する
+*
+*	@return 最大の空き範囲のバイト数
+*/
+size_t RangeAllocator::LargestFreeRange() const {
+	size_t largest = 0;
+	for (const auto& e : freeList) {
+		if (e.second > largest) {
+			largest = e.second;
+		}
+	}
+	return largest;
+}
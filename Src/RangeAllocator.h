@@ -0,0 +1,36 @@
+/**
+*	@file RangeAllocator.h
+*/
+#pragma once
+#include <stddef.h>
+#include <map>
+
+/**
+*	バッファ内の範囲を割り当てるアロケータ
+*
+*	空き範囲をオフセット順に管理し、要求サイズに最も近い空き範囲から割り当てる(ベストフィット)
+*	解放した範囲は前後の空き範囲と結合される
+*	バッファ自体は持たないので、VBO や IBO の領域管理に使う
+*/
+class RangeAllocator {
+public:
+	static const size_t npos = static_cast<size_t>(-1);	///< 割り当て失敗を表す値
+
+	RangeAllocator() = default;
+	RangeAllocator(size_t capacity, size_t alignment);
+	size_t Allocate(size_t size, size_t limit = npos);
+	void Free(size_t offset, size_t size);
+	void Grow(size_t newCapacity);
+	size_t AlignedSize(size_t size) const { return (size + alignment - 1) / alignment * alignment; }
+
+	size_t Capacity() const { return capacity; }
+	size_t Alignment() const { return alignment; }
+	size_t FreeBytes() const { return freeBytes; }
+	size_t LargestFreeRange() const;
+
+private:
+	std::map<size_t, size_t> freeList;	///< 空き範囲のリスト(オフセット -> バイト数)
+	size_t capacity = 0;		///< 管理するバイト数
+	size_t alignment = 1;		///< 割り当てる範囲のオフセットとサイズの単位
+	size_t freeBytes = 0;		///< 空き範囲の合計バイト数
+};
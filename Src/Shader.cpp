@@ -2,144 +2,878 @@
 *	@file Shader.cpp
 */
 #include "Shader.h"
+#include "GLState.h"
+#include "MappedFile.h"
+#include "Profiler.h"
+#include<GLFW/glfw3.h>
 #include<vector>
+#include<algorithm>
 #include<iostream>
 #include<cstdint>
 #include<stdio.h>
+#include<string.h>
 #include<sys\stat.h>
 
+//GLEW 1.x には並列コンパイル拡張の定義がないので、ここで定義する(ARB 版も同じ値)
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 namespace Shader {
+	namespace {
+		///glMaxShaderCompilerThreadsKHR(ARB 版も同じ型)の関数ポインタ型
+		typedef void (APIENTRY *MaxShaderCompilerThreadsProc)(GLuint count);
+
+		bool isParallelCompileSupported = false;	///< EnableParallelCompile で並列コンパイル拡張を検出したら true
+	}
+
 	/**
-	*   VF[_[vO쐬
+	*   完了待ちのコンパイルの情報
+	*/
+	struct Program::Compilation {
+		GLuint vs = 0;				///< 頂点シェーダオブジェクト
+		GLuint fs = 0;				///< フラグメントシェーダオブジェクト
+		std::string displayName;	///< ログに出力する名前
+		std::string cacheName;		///< プログラムバイナリキャッシュのファイル名
+		uint64_t key = 0;			///< プログラムバイナリキャッシュのキー
+		bool useCache = false;		///< 完了したらプログラムバイナリキャッシュに保存するなら true
+		int64_t begin = 0;			///< コンパイルを要求した時刻
+	};
+
+	/**
+	*   シェーダープログラムを作成する
+	*
+	*   @param vsFileName   頂点シェーダーコードへのポインタ
+	*   @param fsFileName   フラグメントシェーダーコードへのポインタ
+	*   @param features     シェーダの先頭に #define として挿入する機能フラグ(Shader::Feature の組み合わせ)
+	*
+	*   @return 作成したプログラムオブジェクト
+	*
+	*   コンパイルとリンクの完了を待ってから返る
+	*/
+	ProgramPtr Program::Create(const char* vsFileName, const char* fsFileName, uint32_t features) {
+		ProgramPtr p = CreateAsync(vsFileName, fsFileName, features);
+		if (!p || !p->Wait()) {
+			return{};
+		}
+		return p;
+	}
+
+	/**
+	*   シェーダープログラムの作成を開始する
+	*
+	*   @param vsFileName   頂点シェーダーコードへのポインタ
+	*   @param fsFileName   フラグメントシェーダーコードへのポインタ
+	*   @param features     シェーダの先頭に #define として挿入する機能フラグ(Shader::Feature の組み合わせ)
 	*
-	*   @param vsFileName   _VF[_[R[hւ̃|C^
-	*   @param fsFileName   tOgVF[_[R[hւ̃|C^
+	*   @return 作成を開始したプログラムオブジェクト
+	*           シェーダファイルを読み込めなかった場合は nullptr
 	*
-	*   @return 쐬vOIuWFNg
+	*   プログラムバイナリキャッシュから読み込めた場合は、準備のできた状態で返る
+	*   それ以外はドライバにコンパイルとリンクを要求するだけで、結果を問い合わせない(問い合わせるとドライバが完了を待つため)
 	*/
-	ProgramPtr Program::Create(const char* vsFileName, const char* fsFileName) {
+	ProgramPtr Program::CreateAsync(const char* vsFileName, const char* fsFileName, uint32_t features) {
 		struct Impl : Program { Impl() {} ~Impl() {} };
 		ProgramPtr p = std::make_shared<Impl>();
 		if (!p) {
-			std::cerr << "ERROR: vO" << vsFileName << "̍쐬Ɏs" << std::endl;
+			std::cerr << "ERROR: プログラム" << vsFileName << "の作成に失敗" << std::endl;
 			return{};
 		}
-		p->program = CreateProgramFromFile(vsFileName, fsFileName);
-			if (!p->program) {
-				return{};
+		//頂点シェーダーファイル名の末尾から .vert を取り除いたものをプログラム名とする
+		p->name = vsFileName;
+		p->name.resize(p->name.size() - 4);
+
+		if (!p->Submit(vsFileName, fsFileName, features)) {
+			return{};
+		}
+		return p;
+	}
+
+	/**
+	*   デストラクタ
+	*/
+	Program::~Program() {
+		if (compilation) {
+			glDeleteShader(compilation->vs);
+			glDeleteShader(compilation->fs);
+		}
+		GLState::DeleteProgram(program);
+	}
+
+	/**
+	*   コンパイルとリンクが完了していれば、プログラムを仕上げる
+	*
+	*   @retval true    完了した(成功したかどうかは IsReady で調べる)
+	*   @retval false   まだ完了していない
+	*
+	*   並列コンパイル拡張があれば GL_COMPLETION_STATUS_KHR で完了を調べ、待たずに返る
+	*   拡張がない場合は完了を調べられないので、完了を待って仕上げる
+	*/
+	bool Program::Poll() {
+		if (state != State_Compiling) {
+			return true;
+		}
+		if (IsParallelCompileSupported()) {
+			GLint isCompleted = GL_FALSE;
+			glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &isCompleted);
+			if (isCompleted != GL_TRUE) {
+				return false;
 			}
+		}
+		Finish();
+		return true;
+	}
 
-		//Tv[̐ƈʒu擾
+	/**
+	*   コンパイルとリンクの完了を待って、プログラムを仕上げる
+	*
+	*   @retval true    描画に使える
+	*   @retval false   コンパイルかリンクに失敗した
+	*/
+	bool Program::Wait() {
+		if (state == State_Compiling) {
+			Finish();
+		}
+		return state == State_Ready;
+	}
+
+	/**
+	*   サンプラーの数と位置を取得し、テクスチャユニットを割り当てる
+	*
+	*   @retval true    成功
+	*   @retval false   サンプラーの位置を取得できなかった
+	*/
+	bool Program::SetupSamplers() {
 		GLint activeUniforms;
-		glGetProgramiv(p->program, GL_ACTIVE_UNIFORMS, &activeUniforms);
+		glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &activeUniforms);
 		for (int i = 0; i < activeUniforms; ++i) {
 			GLint size;
 			GLenum type;
-			GLchar name[128];
-			glGetActiveUniform(p->program, i, sizeof(name), nullptr, &size, &type, name);
-			if (type == GL_SAMPLER_2D) {
-				p->samplerCount = size;
-				p->samplerLocation = glGetUniformLocation(p->program, name);
-				if (p->samplerLocation < 0) {
-					std::cerr << "ERROR: vO" << vsFileName << "̍쐬Ɏs" << std::endl;
-					return{};
+			GLchar uniformName[128];
+			glGetActiveUniform(program, i, sizeof(uniformName), nullptr, &size, &type, uniformName);
+			if (type == GL_SAMPLER_2D || type == GL_SAMPLER_2D_ARRAY) {
+				samplerCount = size;
+				samplerLocation = glGetUniformLocation(program, uniformName);
+				if (samplerLocation < 0) {
+					std::cerr << "ERROR: プログラム" << name << "の作成に失敗" << std::endl;
+					return false;
+				}
+				//サンプラーとテクスチャユニットの対応は変わらないので、ここで一度だけ設定する
+				GLState::UseProgram(program);
+				for (GLint unit = 0; unit < samplerCount; ++unit) {
+					glUniform1i(samplerLocation + unit, unit);
 				}
 				break;
 			}
 		}
-		//_VF[_[t@C̖ .vert 菜̂vOƂ
-		p->name = vsFileName;
-		p->name.resize(p->name.size() - 4);
-
-		return p;
+		return true;
 	}
 
 	/**
-	*   fXgN^
+	*   Uniform ブロックを持っているか調べる
+	*
+	*   @param blockName    調べる Uniform ブロックの名前
+	*
+	*   @retval true    持っている
+	*   @retval false   持っていない(機能フラグによって取り除かれた場合を含む)か、準備ができていない
 	*/
-	Program::~Program() {
-		if (program) {
-			glDeleteProgram(program);
+	bool Program::HasUniformBlock(const char* blockName) const {
+		if (state != State_Ready) {
+			return false;
 		}
+		return glGetUniformBlockIndex(program, blockName) != GL_INVALID_INDEX;
 	}
 
 	/**
-	*   Uniform ubNoCfBOE|CgɊ蓖Ă
+	*   Uniform ブロックをバインディング・ポイントに割り当てる
 	*
-	*   @param blockName    蓖Ă Uniform ubN̖O
-	*   @param bindingPoint 蓖Đ̃oCfBOE|Cg
+	*   @param blockName    割り当てる Uniform ブロックの名前
+	*   @param bindingPoint 割り当て先のバインディング・ポイント
 	*
-	*   @retval true    蓖Đ
-	*   @retval false   蓖Ďs
+	*   @retval true    割り当て成功
+	*   @retval false   割り当て失敗
 	*/
 	bool Program::UniformBlockBinding(const char* blockName, GLuint bindingPoint) {
 		const GLuint blockIndex = glGetUniformBlockIndex(program, blockName);
 		if (blockIndex == GL_INVALID_INDEX) {
-			std::cerr << "ERROR(" << name << "):Uniform ubN''" << blockName << "'܂" << std::endl;
+			std::cerr << "ERROR(" << name << "):Uniform ブロック''" << blockName << "'が見つかりません" << std::endl;
 			return false;
 		}
 		glUniformBlockBinding(program, blockIndex, bindingPoint);
 		const GLenum result = glGetError();
 		if (result != GL_NO_ERROR) {
-			std::cerr << "ERROR(" << name << "):Uniform ubN''" << blockName << "'̃oChɎs" << std::endl;
+			std::cerr << "ERROR(" << name << "):Uniform ブロック''" << blockName << "'のバインドに失敗" << std::endl;
 			return false;
 		}
 		return true;
 	}
 
 	/**
-	*   `pvOɐݒ肷
+	*   描画用プログラムに設定する
+	*
+	*   サンプラーのテクスチャユニットは作成時に設定済みなので、プログラムを切り替えるだけ
+	*   既に設定中なら何もしない
 	*/
 	void Program::UseProgram() {
-		glUseProgram(program);
-		for (GLint i = 0; i < samplerCount; ++i) {
-			glUniform1i(samplerLocation + i, i);
-		}
+		GLState::UseProgram(program);
 	}
 
 	/**
-	*   eNX`eNX`EC[WEjbgɊ蓖Ă
+	*   テクスチャをテクスチャ・イメージ・ユニットに割り当てる
 	*
-	*   @param unit     蓖Đ̃eNX`EC[WEjbgԍ(GL_TEXTURE0~)
-	*   @param type     蓖ĂeNX`̎(GL_TEXTURE_1D, GL_TEXTURE_2D, etc)
-	*   @param texture  蓖ĂeNX`IuWFNg
+	*   @param unit     割り当て先のテクスチャ・イメージ・ユニット番号(GL_TEXTURE0~)
+	*   @param type     割り当てるテクスチャの種類(GL_TEXTURE_1D, GL_TEXTURE_2D, etc)
+	*   @param texture  割り当てるテクスチャオブジェクト
+	*
+	*   既に同じテクスチャを割り当て済みなら何もしない
 	*/
 	void Program::BindTexture(GLenum uint, GLenum type, GLuint texture) {
 		if (uint >= GL_TEXTURE0 && uint < static_cast<GLenum>(GL_TEXTURE0 + samplerCount)) {
-			glActiveTexture(uint);
-			glBindTexture(type, texture);
+			GLState::BindTexture(uint - GL_TEXTURE0, type, texture);
 		}
 	}
 
 
 
+	/**
+	*	パーミュテーションの集合を作成する
+	*
+	*	@param vsFileName	頂点シェーダファイル名
+	*	@param fsFileName	フラグメントシェーダファイル名
+	*
+	*	@return 作成したパーミュテーションの集合
+	*
+	*	この時点ではコンパイルしない
+	*/
+	PermutationSetPtr PermutationSet::Create(const char* vsFileName, const char* fsFileName) {
+		struct Impl : PermutationSet { Impl() {} ~Impl() {} };
+		PermutationSetPtr p = std::make_shared<Impl>();
+		p->vsFileName = vsFileName;
+		p->fsFileName = fsFileName;
+		return p;
+	}
+
+	/**
+	*	作成するプログラムの Uniform ブロックを割り当てるバインディング・ポイントを登録する
+	*
+	*	@param blockName	割り当てる Uniform ブロックの名前
+	*	@param bindingPoint	割り当て先のバインディング・ポイント
+	*
+	*	準備のできたプログラムにはすぐに適用し、完了待ちのプログラムには仕上げる時に適用する
+	*/
+	void PermutationSet::UniformBlockBinding(const char* blockName, GLuint bindingPoint) {
+		blockBindingList.push_back(std::make_pair(std::string(blockName), bindingPoint));
+		for (const auto& e : programMap) {
+			if (e.second && e.second->IsReady() && e.second->HasUniformBlock(blockName)) {
+				e.second->UniformBlockBinding(blockName, bindingPoint);
+			}
+		}
+	}
+
+	/**
+	*	完了待ちのプログラムの代わりに描画に使うプログラムを設定する
+	*
+	*	@param features	代わりに使うプログラムの機能フラグ(Shader::Feature の組み合わせ)
+	*
+	*	@retval true	設定成功
+	*	@retval false	代わりに使うプログラムの作成に失敗した
+	*
+	*	代わりに使うプログラムは完了を待って作成するので、コンパイルの軽い機能フラグを指定すること
+	*	設定済みのプログラムと、以後 Request で作成するプログラムに設定する
+	*/
+	bool PermutationSet::Fallback(uint32_t features) {
+		Program* p = Get(features);
+		if (!p) {
+			return false;
+		}
+		fallback = p;
+		for (const auto& e : programMap) {
+			if (e.second && e.second.get() != p) {
+				e.second->Fallback(p);
+			}
+		}
+		return true;
+	}
+
+	/**
+	*	機能フラグに対応するプログラムを取得する
+	*
+	*	@param features	機能フラグ(Shader::Feature の組み合わせ)
+	*
+	*	@return 機能フラグに対応するプログラム
+	*			作成に失敗した場合は nullptr
+	*
+	*	初めて要求された機能フラグならコンパイルする(失敗した結果も覚えておき、コンパイルし直さない)
+	*	Request で要求済みのプログラムなら、コンパイルの完了を待つ
+	*	戻り値のポインタはパーミュテーションの集合が破棄されるまで有効
+	*/
+	Program* PermutationSet::Get(uint32_t features) {
+		const auto itr = programMap.find(features);
+		if (itr != programMap.end()) {
+			Program* p = itr->second.get();
+			const auto pending = std::find(pendingList.begin(), pendingList.end(), p);
+			if (pending != pendingList.end()) {
+				pendingList.erase(pending);
+				if (p->Wait()) {
+					ApplyBindings(*p);
+				}
+			}
+			return p && p->IsReady() ? p : nullptr;
+		}
+		ProgramPtr p = Program::Create(vsFileName.c_str(), fsFileName.c_str(), features);
+		if (p) {
+			ApplyBindings(*p);
+		}
+		programMap.insert(std::make_pair(features, p));
+		return p.get();
+	}
+
+	/**
+	*	機能フラグに対応するプログラムの作成を要求する
+	*
+	*	@param features	機能フラグ(Shader::Feature の組み合わせ)
+	*
+	*	@return 機能フラグに対応するプログラム
+	*			シェーダファイルを読み込めなかった場合は nullptr
+	*
+	*	コンパイルの完了を待たずに返るので、IsReady が false の間は Fallback のプログラムで描画すること
+	*	完了は Poll で確認する。コンパイルに失敗したプログラムは IsFailed が true になり、以後も準備ができることはない
+	*	戻り値のポインタはパーミュテーションの集合が破棄されるまで有効
+	*/
+	Program* PermutationSet::Request(uint32_t features) {
+		const auto itr = programMap.find(features);
+		if (itr != programMap.end()) {
+			return itr->second.get();
+		}
+		ProgramPtr p = Program::CreateAsync(vsFileName.c_str(), fsFileName.c_str(), features);
+		if (p) {
+			p->Fallback(fallback);
+			if (p->IsReady()) {
+				ApplyBindings(*p);
+			} else if (!p->IsFailed()) {
+				pendingList.push_back(p.get());
+			}
+		}
+		programMap.insert(std::make_pair(features, p));
+		return p.get();
+	}
+
+	/**
+	*	コンパイルの完了したプログラムを仕上げる
+	*
+	*	@return まだ完了していないプログラムの数
+	*
+	*	毎フレーム呼び出す
+	*	並列コンパイル拡張があれば完了したものを全て仕上げる
+	*	拡張がなければ完了を調べられないので、1 回の呼び出しで 1 つだけ完了を待って仕上げ、待ち時間を複数のフレームに分散させる
+	*/
+	size_t PermutationSet::Poll() {
+		const bool isParallel = IsParallelCompileSupported();
+		for (size_t i = 0; i < pendingList.size();) {
+			Program* p = pendingList[i];
+			if (!p->Poll()) {
+				++i;
+				continue;
+			}
+			if (p->IsReady()) {
+				ApplyBindings(*p);
+			}
+			pendingList.erase(pendingList.begin() + i);
+			if (!isParallel) {
+				break;
+			}
+		}
+		return pendingList.size();
+	}
+
+	/**
+	*	コンパイルの完了を待って、完了待ちのプログラムを全て仕上げる
+	*
+	*	完了するフレームを処理速度によらず決めたい場合(ベンチマークや入力の再生など)に、Poll の代わりに呼び出す
+	*/
+	void PermutationSet::Wait() {
+		for (Program* p : pendingList) {
+			if (p->Wait()) {
+				ApplyBindings(*p);
+			}
+		}
+		pendingList.clear();
+	}
+
+	/**
+	*	作成に失敗したプログラムの数を取得する
+	*
+	*	@return シェーダファイルを読み込めなかったか、コンパイルかリンクに失敗した機能フラグの数
+	*/
+	size_t PermutationSet::FailedCount() const {
+		return std::count_if(programMap.begin(), programMap.end(), [](const std::pair<const uint32_t, ProgramPtr>& e) {
+			return !e.second || e.second->IsFailed();
+		});
+	}
+
+	/**
+	*	登録された Uniform ブロックの割り当てを、プログラムが持つ Uniform ブロックに適用する
+	*
+	*	@param program	準備のできたプログラム
+	*/
+	void PermutationSet::ApplyBindings(Program& program) const {
+		for (const auto& e : blockBindingList) {
+			if (program.HasUniformBlock(e.first.c_str())) {
+				program.UniformBlockBinding(e.first.c_str(), e.second);
+			}
+		}
+	}
+
+	/**
+	*	作成済みのプログラムを検索する
+	*
+	*	@param features	機能フラグ(Shader::Feature の組み合わせ)
+	*
+	*	@return 機能フラグに対応するプログラム(完了待ちのものを含む)
+	*			まだ作成していないか、シェーダファイルを読み込めなかった場合は nullptr
+	*/
+	Program* PermutationSet::Find(uint32_t features) const {
+		const auto itr = programMap.find(features);
+		return itr != programMap.end() ? itr->second.get() : nullptr;
+	}
+
+	/**
+	*	機能フラグをシェーダに挿入する #define 文に変換する
+	*
+	*	@param features	機能フラグ(Shader::Feature の組み合わせ)
+	*
+	*	@return 改行区切りの #define 文
+	*			LIGHT_COUNT は Feature_Lit がある場合だけ定義する
+	*/
+	std::string FeatureDefines(uint32_t features) {
+		std::string defines;
+		if (features & Feature_Lit) {
+			defines += "#define LIT\n";
+			defines += "#define LIGHT_COUNT " + std::to_string((features & Feature_LightCountMask) >> Feature_LightCountShift) + "\n";
+		}
+		if (features & Feature_Instanced) {
+			defines += "#define INSTANCED\n";
+		}
+		if (features & Feature_Textured) {
+			defines += "#define TEXTURED\n";
+		}
+		return defines;
+	}
+
+	namespace {
+
+		/**
+		*	シェーダコードの #version 文の直後に #define 文を挿入する
+		*
+		*	@param code		シェーダコード
+		*	@param defines	挿入する #define 文
+		*
+		*	@return #define 文を挿入したシェーダコード
+		*
+		*	コンパイルエラーの行番号が元のファイルと一致するように、#line 文で行番号を戻す
+		*/
+		std::string InsertDefines(const char* code, const std::string& defines) {
+			const std::string source(code);
+			if (source.compare(0, 8, "#version") != 0) {
+				return defines + "#line 1\n" + source;
+			}
+			const size_t eol = source.find('\n');
+			if (eol == std::string::npos) {
+				return source + "\n" + defines;
+			}
+			return source.substr(0, eol + 1) + defines + "#line 2\n" + source.substr(eol + 1);
+		}
+
+		/**
+		*	プログラムバイナリキャッシュのヘッダ
+		*
+		*	ファイルはヘッダの直後に glGetProgramBinary で取得したバイナリ(binaryBytes バイト)が続く
+		*/
+		struct ProgramCacheHeader {
+			char magic[4];			///< ファイル識別子
+			uint32_t version;		///< ファイル形式のバージョン
+			uint64_t key;			///< シェーダのソースとドライバから計算したハッシュ値
+			uint32_t binaryFormat;	///< バイナリの形式(glGetProgramBinary が返した値)
+			uint32_t binaryBytes;	///< バイナリのバイト数
+		};
+
+		const char programCacheMagic[4] = { 'P', 'R', 'O', 'G' };	///< プログラムバイナリキャッシュの識別子
+		const uint32_t programCacheVersion = 1;						///< プログラムバイナリキャッシュのバージョン
+
+		/**
+		*	文字列をハッシュ値に加える(FNV-1a 64bit)
+		*
+		*	@param hash	ハッシュ値
+		*	@param str	加える文字列(nullptr は空文字列として扱う)
+		*
+		*	@return 更新したハッシュ値
+		*
+		*	連結した結果が同じになる別の文字列の組と区別するため、終端文字も加える
+		*/
+		uint64_t HashString(uint64_t hash, const char* str) {
+			if (str) {
+				for (; *str; ++str) {
+					hash ^= static_cast<uint8_t>(*str);
+					hash *= 1099511628211ULL;
+				}
+			}
+			hash *= 1099511628211ULL;
+			return hash;
+		}
+
+		/**
+		*	プログラムバイナリキャッシュのキーを計算する
+		*
+		*	@param vsCode	頂点シェーダコード
+		*	@param fsCode	フラグメントシェーダコード
+		*
+		*	@return シェーダコードとドライバのベンダー、レンダラー、バージョンから計算したハッシュ値
+		*
+		*	ドライバが更新されるとバイナリは使えなくなるので、キーを変えて作り直させる
+		*/
+		uint64_t CalcProgramKey(const GLchar* vsCode, const GLchar* fsCode) {
+			uint64_t hash = 14695981039346656037ULL;
+			hash = HashString(hash, vsCode);
+			hash = HashString(hash, fsCode);
+			hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+			hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+			hash = HashString(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+			return hash;
+		}
+
+		/**
+		*	頂点シェーダファイル名からプログラムバイナリキャッシュのファイル名を作成する
+		*
+		*	@param vsFileName	頂点シェーダファイル名
+		*	@param features		機能フラグ
+		*
+		*	@return 拡張子を .progbin に置き換えたファイル名
+		*			機能フラグがあれば、パーミュテーション毎に別のファイルになるよう拡張子の前に 16 進数で付ける
+		*/
+		std::string ProgramCacheFileName(const char* vsFileName, uint32_t features) {
+			std::string name(vsFileName);
+			const size_t dot = name.find_last_of('.');
+			const size_t separator = name.find_last_of("/\\");
+			if (dot != std::string::npos && (separator == std::string::npos || dot > separator)) {
+				name.resize(dot);
+			}
+			if (features) {
+				char suffix[16];
+				snprintf(suffix, sizeof(suffix), "-%04x", features);
+				name += suffix;
+			}
+			return name + ".progbin";
+		}
+
+		/**
+		*	溜まっている OpenGL のエラーを全て取り出す
+		*
+		*	@return 最初に取り出したエラー
+		*			エラーがなければ GL_NO_ERROR
+		*
+		*	他の処理が残したエラーを、プログラムバイナリの操作の失敗と取り違えないために使う
+		*	コンテキストが失われた場合に終わらなくならないよう、取り出す回数には上限を設ける
+		*/
+		GLenum DrainErrors() {
+			GLenum first = GL_NO_ERROR;
+			for (int i = 0; i < 32; ++i) {
+				const GLenum result = glGetError();
+				if (result == GL_NO_ERROR) {
+					break;
+				}
+				if (first == GL_NO_ERROR) {
+					first = result;
+				}
+			}
+			return first;
+		}
+
+		/**
+		*	ドライバがプログラムバイナリの形式に対応しているか調べる
+		*
+		*	@param binaryFormat	調べるバイナリ形式
+		*
+		*	@retval true	GL_PROGRAM_BINARY_FORMATS に含まれている
+		*	@retval false	含まれていない
+		*/
+		bool IsBinaryFormatSupported(GLenum binaryFormat) {
+			GLint formatCount = 0;
+			glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+			if (formatCount <= 0) {
+				return false;
+			}
+			std::vector<GLint> formatList(formatCount);
+			glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, formatList.data());
+			return std::find(formatList.begin(), formatList.end(), static_cast<GLint>(binaryFormat)) != formatList.end();
+		}
+
+		/**
+		*	プログラムバイナリキャッシュからプログラムオブジェクトを作成する
+		*
+		*	@param cacheName	キャッシュファイル名
+		*	@param key			シェーダのソースとドライバから計算したハッシュ値
+		*
+		*	@return 作成したプログラムオブジェクト
+		*			キャッシュがないか、キーが一致しないか、ドライバがバイナリを受け付けなかった場合は 0
+		*/
+		GLuint LoadProgramCache(const char* cacheName, uint64_t key) {
+			const MappedFilePtr file = MappedFile::Open(cacheName);
+			if (!file || file->Size() < sizeof(ProgramCacheHeader)) {
+				return 0;
+			}
+			ProgramCacheHeader header;
+			memcpy(&header, file->Data(), sizeof(header));
+			if (memcmp(header.magic, programCacheMagic, sizeof(programCacheMagic)) != 0 || header.version != programCacheVersion ||
+				header.binaryBytes > file->Size() - sizeof(header)) {
+				std::cerr << "WARNING: " << cacheName << " が壊れています" << std::endl;
+				return 0;
+			}
+			if (header.key != key) {
+				return 0;
+			}
+			if (!IsBinaryFormatSupported(header.binaryFormat)) {
+				std::cerr << "WARNING: " << cacheName << " のバイナリ形式(0x" << std::hex << header.binaryFormat << std::dec <<
+					")にドライバが対応していません" << std::endl;
+				return 0;
+			}
+			DrainErrors();
+			GLuint program = glCreateProgram();
+			glProgramBinary(program, header.binaryFormat, file->Data() + sizeof(header), header.binaryBytes);
+			const GLenum result = DrainErrors();
+			GLint linkStatus = GL_FALSE;
+			glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+			if (result != GL_NO_ERROR || linkStatus != GL_TRUE) {
+				std::cerr << "WARNING: " << cacheName << " のプログラムバイナリをドライバが受け付けませんでした" << std::endl;
+				glDeleteProgram(program);
+				return 0;
+			}
+			return program;
+		}
+
+		/**
+		*	リンク済みのプログラムオブジェクトをプログラムバイナリキャッシュに書き込む
+		*
+		*	@param cacheName	キャッシュファイル名
+		*	@param key			シェーダのソースとドライバから計算したハッシュ値
+		*	@param program		プログラムオブジェクト
+		*
+		*	@retval true	書き込み成功
+		*	@retval false	バイナリを取得できないか、書き込みに失敗した
+		*/
+		bool SaveProgramCache(const char* cacheName, uint64_t key, GLuint program) {
+			GLint length = 0;
+			glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+			if (length <= 0) {
+				return false;
+			}
+			std::vector<uint8_t> image(sizeof(ProgramCacheHeader) + length);
+			GLenum binaryFormat = 0;
+			GLsizei binaryBytes = 0;
+			DrainErrors();
+			glGetProgramBinary(program, length, &binaryBytes, &binaryFormat, image.data() + sizeof(ProgramCacheHeader));
+			if (DrainErrors() != GL_NO_ERROR || binaryBytes <= 0) {
+				return false;
+			}
+			//読み込み時に受け付けられない形式は保存しない
+			if (!IsBinaryFormatSupported(binaryFormat)) {
+				return false;
+			}
+			ProgramCacheHeader header;
+			memcpy(header.magic, programCacheMagic, sizeof(programCacheMagic));
+			header.version = programCacheVersion;
+			header.key = key;
+			header.binaryFormat = binaryFormat;
+			header.binaryBytes = static_cast<uint32_t>(binaryBytes);
+			memcpy(image.data(), &header, sizeof(header));
+			image.resize(sizeof(header) + binaryBytes);
+
+			FILE* fp = fopen(cacheName, "wb");
+			if (!fp) {
+				std::cerr << "WARNING: " << cacheName << " を作成できません" << std::endl;
+				return false;
+			}
+			const size_t writeSize = fwrite(image.data(), 1, image.size(), fp);
+			fclose(fp);
+			if (writeSize != image.size()) {
+				std::cerr << "WARNING: " << cacheName << " の書き込みに失敗" << std::endl;
+				remove(cacheName);
+				return false;
+			}
+			return true;
+		}
+	}
+
+	/**
+	*	プログラムバイナリを保存・読み込みできるか調べる
+	*
+	*	@retval true	GL_ARB_get_program_binary に対応し、バイナリ形式が 1 つ以上ある
+	*	@retval false	対応していない
+	*/
+	bool IsProgramBinarySupported() {
+		if (!GLEW_ARB_get_program_binary) {
+			return false;
+		}
+		GLint formatCount = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+		return formatCount > 0;
+	}
+
+	/**
+	*	並列コンパイル拡張に対応しているか調べる
+	*
+	*	@retval true	GL_KHR_parallel_shader_compile か GL_ARB_parallel_shader_compile に対応している
+	*	@retval false	対応していないか、まだ EnableParallelCompile を呼び出していない
+	*/
+	bool IsParallelCompileSupported() {
+		return isParallelCompileSupported;
+	}
+
+	/**
+	*	並列コンパイル拡張に対応していれば、ドライバにコンパイル用のスレッドを最大数まで使わせる
+	*
+	*	OpenGL の初期化後、プログラムを作成する前に一度だけ呼び出す
+	*	GLEW 1.x はこの拡張を知らないので、GLFW で拡張を調べて関数を取得する
+	*/
+	void EnableParallelCompile() {
+		MaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+		if (glfwExtensionSupported("GL_KHR_parallel_shader_compile")) {
+			maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(glfwGetProcAddress("glMaxShaderCompilerThreadsKHR"));
+		} else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile")) {
+			maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(glfwGetProcAddress("glMaxShaderCompilerThreadsARB"));
+		}
+		isParallelCompileSupported = maxShaderCompilerThreads != nullptr;
+		if (maxShaderCompilerThreads) {
+			maxShaderCompilerThreads(0xffffffff);
+		}
+	}
+
+	namespace {
+
+		/**
+		*	シェーダのコンパイルを要求する
+		*
+		*	@param type		シェーダの種類
+		*	@param string	シェーダコードへのポインタ
+		*
+		*	@return 作成したシェーダオブジェクト
+		*
+		*	コンパイルの結果は CheckShader で調べる
+		*/
+		GLuint SubmitShader(GLenum type, const GLchar* string) {
+			GLuint shader = glCreateShader(type);
+			glShaderSource(shader, 1, &string, nullptr);
+			glCompileShader(shader);
+			return shader;
+		}
+
+		/**
+		*	シェーダのコンパイル結果を調べる
+		*
+		*	@param shader	シェーダオブジェクト
+		*
+		*	@retval true	コンパイル成功
+		*	@retval false	コンパイル失敗(ログを出力する)
+		*
+		*	並列コンパイル中の場合は完了を待つ
+		*/
+		bool CheckShader(GLuint shader) {
+			GLint compiled = 0;
+			glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+			if (compiled) {
+				return true;
+			}
+			GLint infoLen = 0;
+			glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
+			if (infoLen) {
+				std::vector<char> buf;
+				buf.resize(infoLen);
+				if (static_cast<int>(buf.size()) >= infoLen) {
+					glGetShaderInfoLog(shader, infoLen, NULL, buf.data());
+					std::cerr << "ERROR: シェーダのコンパイルに失敗\n" << buf.data() << std::endl;
+				}
+			}
+			return false;
+		}
+
+		/**
+		*	シェーダのコンパイルとプログラムのリンクを要求する
+		*
+		*	@param vsCode	頂点シェーダコードへのポインタ
+		*	@param fsCode	フラグメントシェーダコードへのポインタ
+		*	@param vs		作成した頂点シェーダオブジェクトを格納する変数
+		*	@param fs		作成したフラグメントシェーダオブジェクトを格納する変数
+		*
+		*	@return 作成したプログラムオブジェクト
+		*
+		*	結果を問い合わせずに返るので、並列コンパイル拡張があればドライバのスレッドで並行してコンパイルされる
+		*	結果は CheckProgram で調べる
+		*/
+		GLuint SubmitProgram(const GLchar* vsCode, const GLchar* fsCode, GLuint& vs, GLuint& fs) {
+			vs = SubmitShader(GL_VERTEX_SHADER, vsCode);
+			fs = SubmitShader(GL_FRAGMENT_SHADER, fsCode);
+			GLuint program = glCreateProgram();
+			if (IsProgramBinarySupported()) {
+				glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			}
+			glAttachShader(program, fs);
+			glAttachShader(program, vs);
+			glLinkProgram(program);
+			return program;
+		}
+
+		/**
+		*	シェーダのコンパイルとプログラムのリンクの結果を調べる
+		*
+		*	@param program	プログラムオブジェクト
+		*	@param vs		頂点シェーダオブジェクト
+		*	@param fs		フラグメントシェーダオブジェクト
+		*
+		*	@retval true	成功
+		*	@retval false	コンパイルかリンクに失敗した(ログを出力する)
+		*
+		*	シェーダオブジェクトは不要になるので削除する
+		*	並列コンパイル中の場合は完了を待つ
+		*/
+		bool CheckProgram(GLuint program, GLuint vs, GLuint fs) {
+			const bool vsCompiled = CheckShader(vs);
+			const bool fsCompiled = CheckShader(fs);
+			glDetachShader(program, vs);
+			glDeleteShader(vs);
+			glDetachShader(program, fs);
+			glDeleteShader(fs);
+			if (!vsCompiled || !fsCompiled) {
+				return false;
+			}
+			GLint linkStatus = GL_FALSE;
+			glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+			if (linkStatus == GL_TRUE) {
+				return true;
+			}
+			GLint infoLen = 0;
+			glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen);
+			if (infoLen) {
+				std::vector<char> buf;
+				buf.resize(infoLen);
+				if (static_cast<int>(buf.size()) >= infoLen) {
+					glGetProgramInfoLog(program, infoLen, NULL, buf.data());
+					std::cerr << "ERROR: シェーダのリンクに失敗\n" << buf.data() << std::endl;
+				}
+			}
+			return false;
+		}
+	}
+
 /**
-* VF[_R[hRpC
+* シェーダコードをコンパイルする
 *
-* @param type	VF[_̎
-* @param string VF[_R[hւ̃|C^
+* @param type	シェーダの種類
+* @param string シェーダコードへのポインタ
 *
-* @return 쐬VF[_IuWFNg
+* @return 作成したシェーダオブジェクト
 */
 GLuint CompileShader(GLenum type, const GLchar* string) {
-	GLuint shader = glCreateShader(type);
-	glShaderSource(shader, 1, &string, nullptr);
-	glCompileShader(shader);
-	GLint compiled = 0;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-	if (!compiled) {
-		GLint infoLen = 0;
-		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &infoLen);
-		if (infoLen) {
-			std::vector<char> buf;
-			buf.resize(infoLen);
-			if (static_cast<int>(buf.size()) >= infoLen) {
-
-				glGetShaderInfoLog(shader, infoLen, NULL, buf.data());
-				std::cerr << "ERROR: VF[_̃RpCɎs\n" << buf.data() << std::endl;
-			}
-		}
+	GLuint shader = SubmitShader(type, string);
+	if (!CheckShader(shader)) {
 		glDeleteShader(shader);
 		return 0;
 	}
@@ -147,38 +881,18 @@ GLuint CompileShader(GLenum type, const GLchar* string) {
 }
 
 /**
-* vOIuWFNg쐬
+* プログラムオブジェクトを作成する
 *
-* @param vsCode _VF[_R[hւ̃|C^
-* @param fsCode tOgVF[_R[hւ̃|C^
+* @param vsCode 頂点シェーダコードへのポインタ
+* @param fsCode フラグメントシェーダコードへのポインタ
 *
-* @return 쐬vOIuWFNg
+* @return 作成したプログラムオブジェクト
 */
 GLuint CreateShaderProgram(const GLchar* vsCode, const GLchar* fsCode) {
-	GLuint vs = CompileShader(GL_VERTEX_SHADER, vsCode);
-	GLuint fs = CompileShader(GL_FRAGMENT_SHADER, fsCode);
-	if (!vs || !fs) {
-		return 0;
-	}
-	GLuint program = glCreateProgram();
-	glAttachShader(program, fs);
-	glDeleteShader(fs);
-	glAttachShader(program, vs);
-	glDeleteShader(vs);
-	glLinkProgram(program);
-	GLint linkStatus = GL_FALSE;
-	glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
-	if (linkStatus != GL_TRUE) {
-		GLint infoLen = 0;
-		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLen);
-		if (infoLen) {
-			std::vector<char> buf;
-			buf.resize(infoLen);
-			if (static_cast<int>(buf.size()) >= infoLen) {
-				glGetProgramInfoLog(program, infoLen, NULL, buf.data());
-				std::cerr << "ERROR: VF[_̃NɎs\n" << buf.data() << std::endl;
-			}
-		}
+	GLuint vs = 0;
+	GLuint fs = 0;
+	GLuint program = SubmitProgram(vsCode, fsCode, vs, fs);
+	if (!CheckProgram(program, vs, fs)) {
 		glDeleteProgram(program);
 		return 0;
 	}
@@ -186,13 +900,13 @@ GLuint CreateShaderProgram(const GLchar* vsCode, const GLchar* fsCode) {
 }
 
 /**
-* t@Cǂݍ
+* ファイルを読み込む
 *
-* @param fileName _ǂݍރt@C
-* @param buf	 ǂݍݐobt@
+* @param fileName 頂点読み込むファイル名
+* @param buf	 読み込み先バッファ
 *
-* @retval ǂݍݐ
-* @retval ǂݍݎs
+* @retval 読み込み成功
+* @retval 読み込み失敗
 */
 bool ReadFile(const char* fileName, std::vector<char>& buf) {
 	struct stat st;
@@ -213,27 +927,142 @@ bool ReadFile(const char* fileName, std::vector<char>& buf) {
 	return true;
 }
 
+	namespace {
+
+		///機能フラグを挿入したシェーダコードと、プログラムバイナリキャッシュの情報
+		struct ProgramSource {
+			std::string vsCode;			///< 頂点シェーダコード
+			std::string fsCode;			///< フラグメントシェーダコード
+			std::string displayName;	///< ログに出力する名前
+			std::string cacheName;		///< プログラムバイナリキャッシュのファイル名
+			uint64_t key = 0;			///< プログラムバイナリキャッシュのキー
+			bool useCache = false;		///< プログラムバイナリキャッシュを使うなら true
+		};
+
+		/**
+		*	シェーダファイルを読み込み、機能フラグを挿入してキャッシュのキーを計算する
+		*
+		*	@param vsFileName	頂点シェーダファイル名
+		*	@param fsFileName	フラグメントシェーダファイル名
+		*	@param features		シェーダの先頭に #define として挿入する機能フラグ(0 ならファイルの内容のまま)
+		*	@param source		結果を格納する変数
+		*
+		*	@retval true	読み込み成功
+		*	@retval false	読み込み失敗
+		*/
+		bool ReadProgramSource(const char* vsFileName, const char* fsFileName, uint32_t features, ProgramSource& source) {
+			std::vector<char> vsBuf;
+			if (!ReadFile(vsFileName, vsBuf)) {
+				std::cerr << "EROOR in Shader::CreateProgramFromFilr:\n" << vsFileName << "を読み込めません" << std::endl;
+				return false;
+			}
+			std::vector<char> fsBuf;
+			if (!ReadFile(fsFileName, fsBuf)) {
+				std::cerr << "EROOR in Shader::CreateProgramFromFilr:\n" << fsFileName << "を読み込めません" << std::endl;
+				return false;
+			}
+			const std::string defines = FeatureDefines(features);
+			source.vsCode = features ? InsertDefines(vsBuf.data(), defines) : std::string(vsBuf.data());
+			source.fsCode = features ? InsertDefines(fsBuf.data(), defines) : std::string(fsBuf.data());
+			source.displayName = vsFileName;
+			if (features) {
+				char suffix[16];
+				snprintf(suffix, sizeof(suffix), "(0x%04x)", features);
+				source.displayName += suffix;
+			}
+			source.useCache = IsProgramBinarySupported();
+			source.key = source.useCache ? CalcProgramKey(source.vsCode.c_str(), source.fsCode.c_str()) : 0;
+			source.cacheName = ProgramCacheFileName(vsFileName, features);
+			return true;
+		}
+	}
 
 	/**
-	* t@CVF[_[vO쐬
+	* ファイルからシェーダープログラムを作成する
 	*
-	* @param vsCode _VF[_R[hւ̃|C^
-	* @param fsCode tOgVF[_R[hւ̃|C^
+	* @param vsCode 頂点シェーダコードへのポインタ
+	* @param fsCode フラグメントシェーダコードへのポインタ
+	* @param features シェーダの先頭に #define として挿入する機能フラグ(0 ならファイルの内容のまま)
 	*
-	* @return 쐬vOIuWFNg
+	* @return 作成したプログラムオブジェクト
+	*
+	* 前回リンクしたプログラムバイナリが頂点シェーダファイルと同じ場所の .progbin にあれば、コンパイルせずに読み込む
+	* シェーダのソースかドライバが変わっていたり、ドライバがバイナリを受け付けない場合はソースからコンパイルし、キャッシュを作り直す
+	* 機能フラグ毎に別のキャッシュファイルを使い、キーは #define 文を挿入した後のソースから計算する
+	* 読み込みにかかった時間と、キャッシュを使ったかどうかを出力する
 	*/
-	GLuint CreateProgramFromFile(const char* vsFileName, const char* fsFileName) {
-		std::vector<char> vsBuf;
-		if (!ReadFile(vsFileName, vsBuf)) {
-			std::cerr << "EROOR in Shader::CreateProgramFromFilr:\n" << vsFileName << "ǂݍ߂܂" << std::endl;
+	GLuint CreateProgramFromFile(const char* vsFileName, const char* fsFileName, uint32_t features) {
+		ProgramSource source;
+		if (!ReadProgramSource(vsFileName, fsFileName, features, source)) {
 			return 0;
 		}
-		std::vector<char> fsBuf;
-		if (!ReadFile(fsFileName, fsBuf)) {
-			std::cerr << "EROOR in Shader::CreateProgramFromFilr:\n" << fsFileName << "ǂݍ߂܂" << std::endl;
+		const int64_t begin = Profiler::Now();
+		if (source.useCache) {
+			if (const GLuint program = LoadProgramCache(source.cacheName.c_str(), source.key)) {
+				std::cout << source.displayName << ": プログラムバイナリから読み込み " << (Profiler::Now() - begin) / 1.0e6 << "ms" << std::endl;
+				return program;
+			}
+		}
+		const GLuint program = CreateShaderProgram(source.vsCode.c_str(), source.fsCode.c_str());
+		if (!program) {
 			return 0;
 		}
-		return CreateShaderProgram(vsBuf.data(), fsBuf.data());
+		const bool isSaved = source.useCache && SaveProgramCache(source.cacheName.c_str(), source.key, program);
+		std::cout << source.displayName << ": ソースからコンパイル " << (Profiler::Now() - begin) / 1.0e6 << "ms" <<
+			(isSaved ? "(プログラムバイナリを保存)" : "") << std::endl;
+		return program;
+	}
+
+	/**
+	*   シェーダファイルを読み込み、プログラムバイナリキャッシュからの読み込みか、コンパイルとリンクの要求を行う
+	*
+	*   @param vsFileName   頂点シェーダファイル名
+	*   @param fsFileName   フラグメントシェーダファイル名
+	*   @param features     シェーダの先頭に #define として挿入する機能フラグ
+	*
+	*   @retval true    読み込みか要求に成功(キャッシュから読み込めた場合は準備ができている)
+	*   @retval false   シェーダファイルを読み込めなかった
+	*/
+	bool Program::Submit(const char* vsFileName, const char* fsFileName, uint32_t features) {
+		ProgramSource source;
+		if (!ReadProgramSource(vsFileName, fsFileName, features, source)) {
+			return false;
+		}
+		const int64_t begin = Profiler::Now();
+		if (source.useCache) {
+			program = LoadProgramCache(source.cacheName.c_str(), source.key);
+			if (program) {
+				std::cout << source.displayName << ": プログラムバイナリから読み込み " << (Profiler::Now() - begin) / 1.0e6 << "ms" << std::endl;
+				state = SetupSamplers() ? State_Ready : State_Failed;
+				return true;
+			}
+		}
+		compilation.reset(new Compilation);
+		compilation->displayName = source.displayName;
+		compilation->cacheName = source.cacheName;
+		compilation->key = source.key;
+		compilation->useCache = source.useCache;
+		compilation->begin = begin;
+		program = SubmitProgram(source.vsCode.c_str(), source.fsCode.c_str(), compilation->vs, compilation->fs);
+		return true;
+	}
+
+	/**
+	*   コンパイルとリンクの結果を調べ、成功していればプログラムバイナリキャッシュを保存してサンプラーを設定する
+	*
+	*   要求してから完了するまでの時間と、キャッシュを保存したかどうかを出力する
+	*/
+	void Program::Finish() {
+		const std::unique_ptr<Compilation> c(std::move(compilation));
+		if (!CheckProgram(program, c->vs, c->fs)) {
+			std::cerr << "ERROR: プログラム" << c->displayName << "の作成に失敗" << std::endl;
+			state = State_Failed;
+			return;
+		}
+		const bool isSaved = c->useCache && SaveProgramCache(c->cacheName.c_str(), c->key, program);
+		std::cout << c->displayName << ": ソースからコンパイル " << (Profiler::Now() - c->begin) / 1.0e6 << "ms" <<
+			(isSaved ? "(プログラムバイナリを保存)" : "") << std::endl;
+		state = SetupSamplers() ? State_Ready : State_Failed;
 	}
 
 }
\ No newline at end of file
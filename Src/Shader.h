@@ -5,18 +5,61 @@
 #include<GL\glew.h>
 #include <string>
 #include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <stdint.h>
 
 namespace Shader {
 	class Program;
-	typedef std::shared_ptr<Program> ProgramPtr;    ///vOIuWFNg|C^^
+	typedef std::shared_ptr<Program> ProgramPtr;    ///プログラムオブジェクトポインタ型
+	class PermutationSet;
+	typedef std::shared_ptr<PermutationSet> PermutationSetPtr;	///< シェーダ・パーミュテーションの集合ポインタ型
 
 	/**
-	*   VF[_[vONX
+	*	シェーダの機能フラグ
+	*
+	*	組み合わせたビットマスクで、コンパイルするプログラムの種類(パーミュテーション)を表す
+	*	各フラグはシェーダの先頭に #define として挿入される
+	*/
+	enum Feature : uint32_t {
+		Feature_Lit = 0x01,			///< 環境光と点光源で照らす(LIT)。なければライティングしない
+		Feature_Instanced = 0x02,	///< gl_InstanceID 番目のインスタンスデータを使う(INSTANCED)。なければ先頭のみ使う
+		Feature_Textured = 0x04,	///< テクスチャを貼る(TEXTURED)。なければ頂点カラーのみ
+
+		Feature_LightCountShift = 8,		///< 計算する点光源の数(LIGHT_COUNT)を格納するビット位置
+		Feature_LightCountMask = 0x0f00,	///< 計算する点光源の数を取り出すマスク
+	};
+
+	/**
+	*	計算する点光源の数を機能フラグに変換する
+	*
+	*	@param n	点光源の数(0～15)
+	*
+	*	@return Feature_Lit と組み合わせる機能フラグ
+	*/
+	inline uint32_t LightCountFeature(int n) { return (static_cast<uint32_t>(n) << Feature_LightCountShift) & Feature_LightCountMask; }
+	std::string FeatureDefines(uint32_t features);
+
+	/**
+	*   シェーダープログラムクラス
+	*
+	*   CreateAsync で作成した場合は、コンパイルとリンクの完了を待たずに返る
+	*   完了は Poll か Wait で確認し、IsReady が true になるまでは描画に使わないこと
 	*/
 	class Program {
 	public:
-		static ProgramPtr Create(const char* vsFileName, const char* fsFileName);
+		static ProgramPtr Create(const char* vsFileName, const char* fsFileName, uint32_t features = 0);
+		static ProgramPtr CreateAsync(const char* vsFileName, const char* fsFileName, uint32_t features = 0);
+
+		bool Poll();
+		bool Wait();
+		bool IsReady() const { return state == State_Ready; }
+		bool IsFailed() const { return state == State_Failed; }
+		void Fallback(Program* p) { fallback = p; }
+		Program* Fallback() const { return fallback; }
 
+		bool HasUniformBlock(const char* blockName) const;
 		bool UniformBlockBinding(const char* blockName, GLuint bindingPoint);
 		void UseProgram();
 		void BindTexture(GLenum uint, GLenum type, GLuint texture);
@@ -27,13 +70,70 @@ namespace Shader {
 		Program(const Program&) = delete;
 		Program& operator= (const Program&) = delete;
 
+		bool Submit(const char* vsFileName, const char* fsFileName, uint32_t features);
+		void Finish();
+		bool SetupSamplers();
+
+		///プログラムの状態
+		enum State {
+			State_Compiling,	///< コンパイルまたはリンクの完了待ち
+			State_Ready,		///< 描画に使える
+			State_Failed,		///< コンパイルかリンクに失敗した
+		};
+		struct Compilation;
+
+	private:
+		State state = State_Compiling;	///< プログラムの状態
+		std::unique_ptr<Compilation> compilation;	///< 完了待ちのコンパイルの情報
+		Program* fallback = nullptr;	///< 準備ができるまで代わりに描画に使うプログラム
+		GLuint program = 0;         ///< プログラムオブジェクト
+		GLint samplerLocation = -1; ///< サンプラーの位置
+		int samplerCount = 0;       ///< サンプラーの数
+		std::string name;           ///< プログラム名
+	};
+
+	/**
+	*	1 組のシェーダファイルから作る、機能フラグ毎のプログラムの集合
+	*
+	*	Get で要求された機能フラグのプログラムを初めて使う時にコンパイルし、以後は同じものを返す
+	*	Request は完了を待たずに返すので、Poll を毎フレーム呼び出して完了したものを仕上げること
+	*	登録した Uniform ブロックの割り当ては、その Uniform ブロックを持つプログラムにだけ適用する
+	*/
+	class PermutationSet {
+	public:
+		static PermutationSetPtr Create(const char* vsFileName, const char* fsFileName);
+
+		void UniformBlockBinding(const char* blockName, GLuint bindingPoint);
+		bool Fallback(uint32_t features);
+		Program* Get(uint32_t features);
+		Program* Request(uint32_t features);
+		Program* Find(uint32_t features) const;
+		size_t Poll();
+		void Wait();
+		size_t FailedCount() const;
+		size_t Count() const { return programMap.size(); }
+		size_t PendingCount() const { return pendingList.size(); }
+
+	private:
+		PermutationSet() = default;
+		~PermutationSet() = default;
+		PermutationSet(const PermutationSet&) = delete;
+		PermutationSet& operator=(const PermutationSet&) = delete;
+
+		void ApplyBindings(Program& program) const;
+
 	private:
-		GLuint program = 0;         ///< vOIuWFNg
-		GLint samplerLocation = -1; ///< Tv[̈ʒu
-		int samplerCount = 0;       ///< Tv[̐
-		std::string name;           ///< vO
+		std::string vsFileName;	///< 頂点シェーダファイル名
+		std::string fsFileName;	///< フラグメントシェーダファイル名
+		std::vector<std::pair<std::string, GLuint>> blockBindingList;	///< Uniform ブロックの割り当てのリスト
+		std::unordered_map<uint32_t, ProgramPtr> programMap;			///< 機能フラグからプログラムを引く表(作成失敗は nullptr)
+		std::vector<Program*> pendingList;	///< コンパイルの完了待ちのプログラム(要求順)
+		Program* fallback = nullptr;		///< 完了待ちのプログラムの代わりに描画に使うプログラム
 	};
 
-	GLuint CreateProgramFromFile(const char* vsFileName, const char* fsFileName);
+	GLuint CreateProgramFromFile(const char* vsFileName, const char* fsFileName, uint32_t features = 0);
+	bool IsProgramBinarySupported();
+	bool IsParallelCompileSupported();
+	void EnableParallelCompile();
 }
 
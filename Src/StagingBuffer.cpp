@@ -0,0 +1,88 @@
+/**
+*	@file StagingBuffer.cpp
+*/
+#include "StagingBuffer.h"
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+
+/**
+*	ステージングバッファを作成する
+*
+*	@param size	バッファのバイト数(1 フレームに転送できる最大バイト数)
+*
+*	@return 作成したステージングバッファへのポインタ
+*			作成に失敗した場合は nullptr を返す
+*/
+StagingBufferPtr StagingBuffer::Create(GLsizeiptr size) {
+	struct Impl : StagingBuffer { Impl() {} ~Impl() {} };
+	StagingBufferPtr p = std::make_shared<Impl>();
+	glGenBuffers(1, &p->id);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, p->id);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	const GLenum result = glGetError();
+	if (result != GL_NO_ERROR) {
+		std::cerr << "ERROR: ステージングバッファの作成に失敗(0x" << std::hex << result << std::dec << ")" << std::endl;
+		return{};
+	}
+	p->size = size;
+	return p;
+}
+
+/**
+*	デストラクタ
+*/
+StagingBuffer::~StagingBuffer() {
+	if (id) {
+		glDeleteBuffers(1, &id);
+	}
+}
+
+/**
+*	フレームの書き込みを開始する
+*
+*	以前の領域を破棄して新しい領域を割り当てる
+*	前のフレームで発行した転送命令は、破棄した領域を使って最後まで実行される
+*/
+void StagingBuffer::BeginFrame() {
+	if (used == 0) {
+		return;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+	glBufferData(GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	used = 0;
+}
+
+/**
+*	バッファにデータを書き込む
+*
+*	@param data	書き込むデータ
+*	@param size	書き込むバイト数
+*
+*	@return 書き込んだ位置のバイトオフセット
+*			残り容量が足りない場合は -1 を返す
+*
+*	書き込む範囲はこのフレームでまだ使われていないので、同期せずにマップする
+*/
+GLintptr StagingBuffer::Write(const void* data, GLsizeiptr size) {
+	if (size <= 0 || size > Remaining()) {
+		return -1;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, id);
+	void* p = glMapBufferRange(GL_COPY_WRITE_BUFFER, used, size,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!p) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return -1;
+	}
+	memcpy(p, data, size);
+	glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	//次の書き込み位置を 16 バイト境界に揃える
+	const GLintptr offset = used;
+	used = std::min<GLsizeiptr>(this->size, (used + size + 15) & ~static_cast<GLsizeiptr>(15));
+	return offset;
+}
@@ -0,0 +1,37 @@
+/**
+*	@file StagingBuffer.h
+*/
+#pragma once
+#include <GL/glew.h>
+#include <memory>
+
+class StagingBuffer;
+typedef std::shared_ptr<StagingBuffer> StagingBufferPtr;	///< ステージングバッファポインタ
+
+/**
+*	GPU へ転送するデータを一時的に置くバッファ
+*
+*	BeginFrame でバッファを破棄して新しい領域を割り当てるので、前のフレームの転送完了を待たずに書き込める
+*	書き込んだ領域は GL_COPY_READ_BUFFER や GL_PIXEL_UNPACK_BUFFER にバインドして転送元として使う
+*/
+class StagingBuffer {
+public:
+	static StagingBufferPtr Create(GLsizeiptr size);
+	void BeginFrame();
+	GLintptr Write(const void* data, GLsizeiptr size);
+
+	GLuint Id() const { return id; }
+	GLsizeiptr Size() const { return size; }
+	GLsizeiptr Remaining() const { return size - used; }
+
+private:
+	StagingBuffer() = default;
+	~StagingBuffer();
+	StagingBuffer(const StagingBuffer&) = delete;
+	StagingBuffer& operator=(const StagingBuffer&) = delete;
+
+private:
+	GLuint id = 0;			///< バッファオブジェクト
+	GLsizeiptr size = 0;	///< バッファのバイト数
+	GLsizeiptr used = 0;	///< このフレームで書き込み済みのバイト数
+};
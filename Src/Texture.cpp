@@ -1,18 +1,31 @@
 #include "Texture.h"
+#include "GLState.h"
+#include "ImageFilter.h"
+#include "TextureCompressor.h"
+#include<algorithm>
+#include<atomic>
 #include<iostream>
 #include<vector>
 #include<stdint.h>
 #include<stdio.h>
+#include<string.h>
 #include<sys/stat.h>
 
+namespace {
+
+std::atomic<bool> hasS3tc(false);	///< BC1, BC3 の DDS を読み込むなら true(CompressedFormatSupport で設定する)
+std::atomic<bool> hasBptc(false);	///< BC7 の DDS を読み込むなら true(CompressedFormatSupport で設定する)
+
+} // unnamed namespace
+
 /**
-*	oCg񂩂琔l𕜌
+*	バイト列から数値を復元する
 *
-*	@param p		oCgւ̃|C^
-*	@param offset	l̃ItZbg
-*	@param size		l̃oCg(1~4)
+*	@param p		バイト列へのポインタ
+*	@param offset	数値のオフセット
+*	@param size		数値のバイト数(1~4)
 *
-*	@return l
+*	@return 復元した数値
 */
 uint32_t Get(const uint8_t* p, size_t offset, size_t size) {
 	uint32_t n = 0;
@@ -24,30 +37,28 @@ uint32_t Get(const uint8_t* p, size_t offset, size_t size) {
 }
 
 /**
-*	RXgN^
+*	コンストラクタ
 */
-Texture::Texture() : texId(0), width(0), height(0){}
+Texture::Texture() : texId(0), target(GL_TEXTURE_2D), width(0), height(0), layerCount(1), hasAlpha(false), bytes(0){}
 
 /**
-*	fXgN^
+*	デストラクタ
 */
 Texture::~Texture() {
-	if (texId) {
-		glDeleteTextures(1, &texId);
-	}
+	GLState::DeleteTexture(texId);
 }
 
 /**
-*	2DeNX`쐬
+*	2Dテクスチャを作成する
 *
-*	@param width	eNX`̕	(sNZ)
-*	@param height	eNX`̍(sNZ)
-*	@param iformat	eNX`̃f[^`
-*	@param format	ANZXvf
-*	@param data		eNX`f[^ւ̃|C^
+*	@param width	テクスチャの幅	(ピクセル数)
+*	@param height	テクスチャの高さ(ピクセル数)
+*	@param iformat	テクスチャのデータ形式
+*	@param format	アクセスする要素
+*	@param data		テクスチャデータへのポインタ
 *
-*	@return	쐬ɐꍇ̓eNX`|C^Ԃ
-*			sꍇ nullptr Ԃ
+*	@return	作成に成功した場合はテクスチャポインタを返す
+*			失敗した場合は nullptr を返す
 */
 TexturePtr Texture::Create(int width, int height, GLenum iformat, GLenum formet, const void* data) {
 	struct Impl : Texture {
@@ -58,12 +69,13 @@ TexturePtr Texture::Create(int width, int height, GLenum iformat, GLenum formet,
 
 	p->width = width;
 	p->height = height;
+	p->bytes = static_cast<size_t>(width) * height * 4;
 	glGenTextures(1, &p->texId);
-	glBindTexture(GL_TEXTURE_2D, p->texId);
+	GLState::BindTexture(0, GL_TEXTURE_2D, p->texId);
 	glTexImage2D(GL_TEXTURE_2D, 0,iformat, width, height, 0, formet, GL_UNSIGNED_BYTE, data);
 	const GLenum result = glGetError();
 	if (result != GL_NO_ERROR) {
-		std::cerr << "error eNX`̍쐬Ɏs: 0x" << std::hex << result << std::endl;
+		std::cerr << "error テクスチャの作成に失敗: 0x" << std::hex << result << std::endl;
 		return{};
 	}
 
@@ -73,72 +85,592 @@ TexturePtr Texture::Create(int width, int height, GLenum iformat, GLenum formet,
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
 
 	return p;
 }
 
 /**
-*	t@C2DeNX`ǂݍ
+*	デコード済みの画像データから2Dテクスチャを作成する
+*
+*	@param image		画像データ
+*	@param skipLevels	転送しない上位のミップレベルの数
 *
-*	@param filename	t@C
+*	@return	作成に成功した場合はテクスチャポインタを返す
+*			失敗した場合は nullptr を返す
 *
-*	@return	쐬ɐꍇ̓eNX`|C^Ԃ
-*			sꍇ nullptr Ԃ
+*	画像データの全てのミップレベルを転送し、トライリニアフィルタで描画する
+*	skipLevels を指定すると、その分だけ小さいミップレベルを最上位にしてメモリを節約する
+*	エンティティの描画に使えるように、1 レイヤーのテクスチャ配列として作成する
 */
-TexturePtr Texture::LoadFromFile(const char* filename) {
-	//t@CTCY̎擾
-	struct stat st;
-	if (stat(filename, &st)) {
+TexturePtr Texture::Create(const ImageData& image, int skipLevels) {
+	return CreateArray(std::vector<const ImageData*>(1, &image), skipLevels);
+}
+
+/**
+*	同じ大きさと形式の画像データを 1 つのテクスチャ配列にまとめる
+*
+*	@param images		レイヤー順の画像データのリスト
+*	@param skipLevels	転送しない上位のミップレベルの数
+*
+*	@return	作成に成功した場合はテクスチャポインタを返す
+*			失敗した場合は nullptr を返す
+*
+*	全ての画像データは IsArrayCompatible で互換性がなければならない
+*	テクスチャの違うエンティティでも、同じ配列のレイヤーなら 1 回の描画命令で描画できる
+*/
+TexturePtr Texture::CreateArray(const std::vector<const ImageData*>& images, int skipLevels) {
+	if (images.empty()) {
 		return{};
 	}
-
-	//TCY
-	const size_t bmpFileHeaderSize = 14;	//rbg}bvt@Cwb_̃oCg
-	const size_t windowsVlHeaderSize = 40;	//rbg}bvwb_̃oCg
-	if (st.st_size < bmpFileHeaderSize + windowsVlHeaderSize) {
+	const ImageData& first = *images[0];
+	for (const ImageData* e : images) {
+		if (!IsArrayCompatible(first, *e)) {
+			std::cerr << "ERROR: テクスチャ配列に大きさか形式の異なる画像が指定されました" << std::endl;
+			return{};
+		}
+	}
+	TexturePtr p = CreateStorage(first, skipLevels, static_cast<int>(images.size()));
+	if (!p) {
 		return{};
 	}
+	for (size_t layer = 0; layer < images.size(); ++layer) {
+		UploadLayer(p, *images[layer], static_cast<int>(layer), skipLevels);
+	}
+	return p;
+}
+
+/**
+*	CreateStorage で作成したテクスチャ配列の 1 レイヤーに画像データを転送する
+*
+*	@param texture		転送先のテクスチャ配列
+*	@param image		画像データ
+*	@param layer		転送先のレイヤー番号
+*	@param skipLevels	転送しない上位のミップレベルの数(CreateStorage と同じ値を指定すること)
+*
+*	@retval true	転送成功
+*	@retval false	レイヤー番号が範囲外
+*
+*	画像データはテクスチャを作成したものと IsArrayCompatible で互換性がなければならない
+*	変換の終わった画像から順にレイヤーを埋めていくために使う
+*/
+bool Texture::UploadLayer(const TexturePtr& texture, const ImageData& image, int layer, int skipLevels) {
+	if (!texture || layer < 0 || layer >= texture->layerCount) {
+		std::cerr << "ERROR: テクスチャ配列のレイヤー番号が範囲外です(" << layer << ")" << std::endl;
+		return false;
+	}
+	const int baseLevel = std::min(std::max(skipLevels, 0), image.LevelCount() - 1);
+	GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, texture->texId);
+	for (int level = baseLevel; level < image.LevelCount(); ++level) {
+		if (image.IsCompressed()) {
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - baseLevel, 0, 0, layer,
+				image.Width(level), image.Height(level), 1, image.iformat, static_cast<GLsizei>(image.LevelBytes(level)), image.Pixels(level));
+		} else {
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level - baseLevel, 0, 0, layer,
+				image.Width(level), image.Height(level), 1, image.format, GL_UNSIGNED_BYTE, image.Pixels(level));
+		}
+	}
+	GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+	return true;
+}
+
+/**
+*	2 つの画像データを同じテクスチャ配列に格納できるか調べる
+*
+*	@param lhs	画像データ
+*	@param rhs	画像データ
+*
+*	@retval true	大きさ、形式、ミップレベル数が全て同じ
+*	@retval false	格納できない
+*/
+bool Texture::IsArrayCompatible(const ImageData& lhs, const ImageData& rhs) {
+	return lhs.width == rhs.width && lhs.height == rhs.height && lhs.iformat == rhs.iformat &&
+		lhs.format == rhs.format && lhs.blockBytes == rhs.blockBytes && lhs.LevelCount() == rhs.LevelCount();
+}
+
+/**
+*	画像データからテクスチャ配列を作成した場合の GPU メモリの使用量を求める
+*
+*	@param image		画像データ
+*	@param skipLevels	作成しない上位のミップレベルの数
+*	@param layerCount	レイヤー数
+*
+*	@return 全ミップレベルと全レイヤーの合計バイト数
+*
+*	無圧縮の形式は、多くの GPU と同じく RGB8 も 1 ピクセル 4 バイトとして数える
+*/
+size_t Texture::StorageBytes(const ImageData& image, int skipLevels, int layerCount) {
+	const int baseLevel = std::min(std::max(skipLevels, 0), image.LevelCount() - 1);
+	size_t bytes = 0;
+	for (int level = baseLevel; level < image.LevelCount(); ++level) {
+		if (image.IsCompressed()) {
+			bytes += image.LevelBytes(level);
+		} else {
+			bytes += static_cast<size_t>(image.Width(level)) * image.Height(level) * 4;
+		}
+	}
+	return bytes * layerCount;
+}
 
-	//t@CJ
-	FILE* fp = fopen(filename, "rb");
-	if (!fp) {
+/**
+*	画像データと同じ大きさとミップレベル数の空のテクスチャ配列を作成する
+*
+*	@param image		画像データ
+*	@param skipLevels	作成しない上位のミップレベルの数
+*	@param layerCount	レイヤー数
+*
+*	@return	作成に成功した場合はテクスチャポインタを返す
+*			失敗した場合は nullptr を返す
+*
+*	ピクセルデータは glTexSubImage3D(圧縮形式では glCompressedTexSubImage3D)で少しずつ転送する
+*	圧縮形式に対応していない環境では glCompressedTexImage3D がエラーになり、作成に失敗する
+*/
+TexturePtr Texture::CreateStorage(const ImageData& image, int skipLevels, int layerCount) {
+	struct Impl : Texture {
+		Impl() {}
+		~Impl() {}
+	};
+	TexturePtr p = std::make_shared <Impl>();
+
+	const int baseLevel = std::min(std::max(skipLevels, 0), image.LevelCount() - 1);
+	const int levelCount = image.LevelCount() - baseLevel;
+	p->target = GL_TEXTURE_2D_ARRAY;
+	p->width = image.Width(baseLevel);
+	p->height = image.Height(baseLevel);
+	p->layerCount = layerCount;
+	p->hasAlpha = image.HasAlpha();
+	p->bytes = StorageBytes(image, skipLevels, layerCount);
+	glGenTextures(1, &p->texId);
+	GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, p->texId);
+	for (int level = 0; level < levelCount; ++level) {
+		if (image.IsCompressed()) {
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, image.iformat, image.Width(baseLevel + level), image.Height(baseLevel + level),
+				layerCount, 0, static_cast<GLsizei>(image.LevelBytes(baseLevel + level) * layerCount), nullptr);
+		} else {
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, level, image.iformat, image.Width(baseLevel + level), image.Height(baseLevel + level),
+				layerCount, 0, image.format, GL_UNSIGNED_BYTE, nullptr);
+		}
+	}
+	const GLenum result = glGetError();
+	if (result != GL_NO_ERROR) {
+		std::cerr << "error テクスチャの作成に失敗: 0x" << std::hex << result << std::endl;
+		GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
 		return{};
 	}
 
-	//ǂݍ
-	std::vector<uint8_t> buf;
-	buf.resize(st.st_size);
-	const size_t readSize = fread(buf.data(), 1,st.st_size, fp);
-	fclose(fp);
-	if (readSize != st.st_size) {
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+
+	return p;
+}
+
+/**
+*	他のテクスチャと内容を交換する
+*
+*	@param other	交換するテクスチャ
+*
+*	TexturePtr を保持したまま中身だけを差し替えるために使う
+*/
+void Texture::Swap(Texture& other) {
+	std::swap(texId, other.texId);
+	std::swap(target, other.target);
+	std::swap(width, other.width);
+	std::swap(height, other.height);
+	std::swap(layerCount, other.layerCount);
+	std::swap(hasAlpha, other.hasAlpha);
+	std::swap(bytes, other.bytes);
+}
+
+/**
+*	ファイルから2Dテクスチャを読み込む
+*
+*	@param filename		ファイル名
+*	@param skipLevels	転送しない上位のミップレベルの数
+*
+*	@return	作成に成功した場合はテクスチャポインタを返す
+*			失敗した場合は nullptr を返す
+*/
+TexturePtr Texture::LoadFromFile(const char* filename, int skipLevels) {
+	ImageData image;
+	if (!Decode(filename, image)) {
 		return{};
 	}
+	return Create(image, skipLevels);
+}
 
-	//ǂݍ񂾃t@C BMP ׂ
-	const uint8_t* pHeader = buf.data();
+/**
+*	画像ファイルを読み込んで、テクスチャ作成用のデータに変換する
+*
+*	@param filename			ファイル名
+*	@param image			変換したデータを格納する変数
+*	@param allowCompressed	事前に圧縮した DDS ファイルがあればそちらを読み込む場合は true
+*
+*	@retval true	変換成功
+*	@retval false	変換失敗
+*
+*	OpenGL の関数を呼ばないので、ワーカースレッドから呼び出してもよい
+*	ミップマップもここで作成する
+*	CompressedFileName の DDS ファイルが元のファイル以降に更新されていれば、元のファイルの代わりに読み込む
+*/
+bool Texture::Decode(const char* filename, ImageData& image, bool allowCompressed) {
+	if (allowCompressed) {
+		const std::string ddsName = CompressedFileName(filename);
+		struct stat ddsSt, srcSt;
+		if (ddsName != filename && !stat(ddsName.c_str(), &ddsSt) &&
+			(stat(filename, &srcSt) || ddsSt.st_mtime >= srcSt.st_mtime)) {
+			const MappedFilePtr ddsFile = MappedFile::Open(ddsName.c_str());
+			if (ddsFile && DecodeDds(ddsName.c_str(), ddsFile, image)) {
+				return true;
+			}
+		}
+	}
+	const MappedFilePtr file = MappedFile::Open(filename);
+	if (!file) {
+		return false;
+	}
+	if (file->Size() >= 4 && !memcmp(file->Data(), "DDS ", 4)) {
+		return DecodeDds(filename, file, image);
+	}
+	if (!DecodeBmp(filename, file, image)) {
+		return false;
+	}
+	GenerateMipmaps(image);
+	return true;
+}
+
+/**
+*	BMP ファイルの内容をテクスチャ作成用のデータに変換する
+*
+*	@param filename	ファイル名(エラー表示用)
+*	@param file		メモリマップしたファイル
+*	@param image	変換したデータを格納する変数
+*
+*	@retval true	変換成功
+*	@retval false	未対応の形式か、データが壊れている
+*
+*	対応する形式は 24 ビット、32 ビット(ビットフィールド指定を含む)、8 ビットのパレット形式(無圧縮と RLE8)
+*	下から上に並んだ 24 ビットと BGRA 順の 32 ビットの画像は変換せず、ファイルを直接参照する
+*	BMP の 1 行は 4 バイト境界に揃っているので、GL_UNPACK_ALIGNMENT の既定値(4)でそのまま転送できる
+*	上から下に並んだ画像は行を入れ替え、BGRA 以外の並びの 32 ビット画像は画素を並べ替えてコピーする
+*	パレット形式は 24 ビットの BGR に展開する
+*/
+bool Texture::DecodeBmp(const char* filename, const MappedFilePtr& file, ImageData& image) {
+	//サイズ判定
+	const size_t bmpFileHeaderSize = 14;	//ビットマップファイルヘッダのバイト数
+	const size_t windowsVlHeaderSize = 40;	//ビットマップ情報ヘッダのバイト数
+	const uint8_t* pHeader = file->Data();
+	const size_t fileSize = file->Size();
+	if (fileSize < bmpFileHeaderSize + windowsVlHeaderSize) {
+		return false;
+	}
+
+	//読み込んだファイルが BMP か調べる
 	if (pHeader[0] != 'B' || pHeader[1] != 'M') {
-		return{};
+		return false;
 	}
 
-	//BMP t@C̏擾
+	//BMP ファイルの情報を取得
 	const size_t offsetBytes = Get(pHeader, 10, 4);
 	const uint32_t infoSize = Get(pHeader, 14, 4);
-	const uint32_t width = Get(pHeader, 18, 4);
-	const uint32_t height = Get(pHeader, 22, 4);
+	const int32_t width = static_cast<int32_t>(Get(pHeader, 18, 4));
+	const int32_t rawHeight = static_cast<int32_t>(Get(pHeader, 22, 4));
 	const uint32_t bitCount = Get(pHeader, 28, 2);
 	const uint32_t compression = Get(pHeader, 30, 4);
-	const size_t pixelBytes = bitCount / 8;
-	if (infoSize != windowsVlHeaderSize || bitCount != 24 || (width * pixelBytes) % 4) {
-		return{};
+	const uint32_t colorCount = Get(pHeader, 46, 4);
+	const bool isTopDown = rawHeight < 0;
+	const int32_t height = isTopDown ? -rawHeight : rawHeight;
+	if (infoSize < windowsVlHeaderSize || width <= 0 || height <= 0 || width > 0x8000 || height > 0x8000) {
+		return false;
 	}
+	const uint32_t biRgb = 0, biRle8 = 1, biBitFields = 3;
 
-	//ڍ׃f[^
-	const size_t imageSize = width * height * pixelBytes;
-	if (buf.size() < offsetBytes + imageSize) {
-		return{};
+	ImageData bmp;
+	bmp.width = width;
+	bmp.height = height;
+	int shift[4] = { 0, 8, 16, 24 };	//32 ビット画像の BGRA の各要素のビット位置
+	bool isSwizzled = false;
+	if (bitCount == 24 && compression == biRgb) {
+		bmp.iformat = GL_RGB8;
+		bmp.format = GL_BGR;
+	} else if (bitCount == 32 && (compression == biRgb || compression == biBitFields)) {
+		//ビットフィールドは情報ヘッダの後ろ(V4 以降のヘッダでは内部)に R, G, B, A の順に並ぶ
+		uint32_t masks[4] = { 0x00ff0000, 0x0000ff00, 0x000000ff, 0 };
+		if (compression == biBitFields) {
+			if (fileSize < bmpFileHeaderSize + windowsVlHeaderSize + 16) {
+				return false;
+			}
+			for (int i = 0; i < 4; ++i) {
+				masks[i] = Get(pHeader, bmpFileHeaderSize + windowsVlHeaderSize + i * 4, 4);
+			}
+			if (infoSize < 56) {
+				masks[3] = 0;
+			}
+		}
+		//BGRA の順に、各要素を取り出すビット位置を求める
+		static const int maskIndex[4] = { 2, 1, 0, 3 };
+		for (int c = 0; c < 4; ++c) {
+			const uint32_t mask = masks[maskIndex[c]];
+			shift[c] = -1;
+			for (int bit = 0; bit < 32; bit += 8) {
+				if (mask == (0xffu << bit)) {
+					shift[c] = bit;
+				}
+			}
+			if (mask && shift[c] < 0) {
+				std::cerr << "ERROR: " << filename << " は未対応のビットフィールドです" << std::endl;
+				return false;
+			}
+		}
+		bmp.iformat = shift[3] < 0 ? GL_RGB8 : GL_RGBA8;
+		bmp.format = GL_BGRA;
+		isSwizzled = shift[0] != 0 || shift[1] != 8 || shift[2] != 16 || (shift[3] >= 0 && shift[3] != 24);
+	} else if (bitCount == 8 && (compression == biRgb || compression == biRle8)) {
+		//パレットを取得
+		const size_t paletteOffset = bmpFileHeaderSize + infoSize;
+		const size_t paletteSize = colorCount ? std::min<uint32_t>(colorCount, 256) : 256;
+		if (fileSize < paletteOffset + paletteSize * 4 || fileSize < offsetBytes) {
+			return false;
+		}
+		uint8_t palette[256][3] = {};
+		for (size_t i = 0; i < paletteSize; ++i) {
+			memcpy(palette[i], pHeader + paletteOffset + i * 4, 3);
+		}
+		bmp.iformat = GL_RGB8;
+		bmp.format = GL_BGR;
+		bmp.buffer.resize(bmp.LevelBytes());
+		const auto PutPixel = [&](int x, int y, uint8_t index) {
+			memcpy(bmp.buffer.data() + (isTopDown ? height - 1 - y : y) * bmp.RowBytes() + x * 3, palette[index], 3);
+		};
+		const uint8_t* p = pHeader + offsetBytes;
+		const uint8_t* end = pHeader + fileSize;
+		if (compression == biRgb) {
+			const size_t srcRowBytes = (width + 3) & ~3;
+			if (static_cast<size_t>(end - p) < srcRowBytes * height) {
+				return false;
+			}
+			for (int y = 0; y < height; ++y, p += srcRowBytes) {
+				for (int x = 0; x < width; ++x) {
+					PutPixel(x, y, p[x]);
+				}
+			}
+		} else {
+			//RLE8: (個数, 色) の組か、0 に続く制御コード(0: 行末, 1: 終端, 2: 移動, 3 以上: 非圧縮の画素数)
+			//描かれなかった画素は黒のままにする
+			if (isTopDown) {
+				return false;
+			}
+			int x = 0;
+			int y = 0;
+			while (end - p >= 2 && y < height) {
+				const uint8_t count = p[0];
+				const uint8_t code = p[1];
+				p += 2;
+				if (count) {
+					for (int i = 0; i < count && x < width; ++i, ++x) {
+						PutPixel(x, y, code);
+					}
+				} else if (code == 0) {
+					x = 0;
+					++y;
+				} else if (code == 1) {
+					break;
+				} else if (code == 2) {
+					if (end - p < 2) {
+						break;
+					}
+					x += p[0];
+					y += p[1];
+					p += 2;
+				} else {
+					const size_t runBytes = (code + 1) & ~1;
+					if (static_cast<size_t>(end - p) < runBytes) {
+						break;
+					}
+					for (int i = 0; i < code && x < width; ++i, ++x) {
+						PutPixel(x, y, p[i]);
+					}
+					p += runBytes;
+				}
+			}
+		}
+		image = std::move(bmp);
+		return true;
+	} else {
+		return false;
+	}
+
+	if (fileSize < offsetBytes || fileSize - offsetBytes < bmp.LevelBytes()) {
+		return false;
+	}
+	if (isSwizzled || isTopDown) {
+		bmp.buffer.resize(bmp.LevelBytes());
+		for (int y = 0; y < height; ++y) {
+			const uint8_t* src = pHeader + offsetBytes + (isTopDown ? height - 1 - y : y) * bmp.RowBytes();
+			uint8_t* dst = bmp.buffer.data() + y * bmp.RowBytes();
+			if (isSwizzled) {
+				ImageFilter::Swizzle32(src, dst, width, shift);
+			} else {
+				memcpy(dst, src, bmp.RowBytes());
+			}
+		}
+	} else {
+		//変換の要らない画像はファイルを直接参照する
+		bmp.file = file;
+		bmp.offset = offsetBytes;
+	}
+	image = std::move(bmp);
+	return true;
+}
+
+/**
+*	画像データのミップマップを作成する
+*
+*	@param image	ミップマップを追加する画像データ
+*
+*	1x1 ピクセルになるまで、前のレベルを 2x2 のボックスフィルタで縮小していく
+*	追加するレベルの合計バイト数を先に求めて、バッファの再確保を 1 回で済ませる
+*	最上位レベルがファイルを直接参照している場合、buffer にはミップレベル 1 以降だけを格納する
+*/
+void Texture::GenerateMipmaps(ImageData& image) {
+	image.mipOffset.clear();
+	size_t end = image.file ? 0 : image.offset + image.LevelBytes();
+	for (int level = 1; image.Width(level - 1) > 1 || image.Height(level - 1) > 1; ++level) {
+		image.mipOffset.push_back(end);
+		end += image.RowBytes(level) * image.Height(level);
 	}
+	image.buffer.resize(end);
+	for (int level = 1; level < image.LevelCount(); ++level) {
+		const int src = level - 1;
+		ImageFilter::Downsample(image.Pixels(src), image.Width(src), image.Height(src), image.RowBytes(src),
+			image.buffer.data() + image.mipOffset[level - 1], image.RowBytes(level), image.PixelBytes());
+	}
+}
 
-	//eNX`̍쐬
-	return Create(width, height, GL_RGB8, GL_BGR, buf.data() + offsetBytes);
-}
\ No newline at end of file
+/**
+*	事前に圧縮したテクスチャのファイル名を取得する
+*
+*	@param filename	元の画像のファイル名
+*
+*	@return 拡張子を .dds に置き換えたファイル名
+*/
+std::string Texture::CompressedFileName(const char* filename) {
+	std::string name(filename);
+	const size_t dot = name.find_last_of('.');
+	const size_t separator = name.find_last_of("/\\");
+	if (dot != std::string::npos && (separator == std::string::npos || dot > separator)) {
+		name.resize(dot);
+	}
+	return name + ".dds";
+}
+
+/**
+*	DDS ファイルの内容をテクスチャ作成用のデータに変換する
+*
+*	@param filename	ファイル名(エラー表示用)
+*	@param file		メモリマップしたファイル
+*	@param image	変換したデータを格納する変数
+*
+*	@retval true	変換成功
+*	@retval false	未対応の形式か、データが壊れている
+*
+*	対応する形式は BC1(DXT1), BC3(DXT5), BC7(DX10 拡張ヘッダ、モード 6 のブロックのみ)
+*	DDS は上から下の順に並んでいるので、OpenGL の下から上の順に反転して buffer に格納する
+*	CompressedFormatSupport で対応していないとされた形式は読み込まない
+*/
+bool Texture::DecodeDds(const char* filename, const MappedFilePtr& file, ImageData& image) {
+	const size_t ddsHeaderSize = 128;		//"DDS " と DDS_HEADER のバイト数
+	const size_t ddsHeaderDx10Size = 20;	//DDS_HEADER_DXT10 のバイト数
+	const uint8_t* pHeader = file->Data();
+	const size_t fileSize = file->Size();
+	if (fileSize < ddsHeaderSize || memcmp(pHeader, "DDS ", 4) || Get(pHeader, 4, 4) != 124) {
+		std::cerr << "ERROR: " << filename << " は DDS ファイルではありません" << std::endl;
+		return false;
+	}
+	const uint32_t height = Get(pHeader, 12, 4);
+	const uint32_t width = Get(pHeader, 16, 4);
+	const uint32_t mipCount = Get(pHeader, 28, 4);
+	const uint32_t fourCC = Get(pHeader, 84, 4);
+	const auto MakeFourCC = [](const char* s) { return Get(reinterpret_cast<const uint8_t*>(s), 0, 4); };
+
+	ImageData dds;
+	dds.width = width;
+	dds.height = height;
+	dds.format = GL_RGBA;
+	dds.offset = ddsHeaderSize;
+	uint32_t dxgiFormat = 0;
+	if (fourCC == MakeFourCC("DXT1")) {
+		dxgiFormat = 71;
+	} else if (fourCC == MakeFourCC("DXT5")) {
+		dxgiFormat = 77;
+	} else if (fourCC == MakeFourCC("DX10") && fileSize >= ddsHeaderSize + ddsHeaderDx10Size) {
+		dxgiFormat = Get(pHeader, ddsHeaderSize, 4);
+		dds.offset += ddsHeaderDx10Size;
+	}
+	switch (dxgiFormat) {
+	case 71: //DXGI_FORMAT_BC1_UNORM
+		if (!hasS3tc) {
+			return false;
+		}
+		dds.iformat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		dds.blockBytes = 8;
+		break;
+	case 77: //DXGI_FORMAT_BC3_UNORM
+		if (!hasS3tc) {
+			return false;
+		}
+		dds.iformat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		dds.blockBytes = 16;
+		break;
+	case 98: //DXGI_FORMAT_BC7_UNORM
+		if (!hasBptc) {
+			return false;
+		}
+		dds.iformat = GL_COMPRESSED_RGBA_BPTC_UNORM;
+		dds.blockBytes = 16;
+		break;
+	default:
+		std::cerr << "ERROR: " << filename << " は未対応の圧縮形式です" << std::endl;
+		return false;
+	}
+	if (width == 0 || height == 0) {
+		std::cerr << "ERROR: " << filename << " が壊れています" << std::endl;
+		return false;
+	}
+
+	//ミップレベルの位置を求め、データが揃っているか調べる
+	size_t end = dds.offset + dds.LevelBytes(0);
+	for (uint32_t level = 1; level < mipCount && (dds.Width(level - 1) > 1 || dds.Height(level - 1) > 1); ++level) {
+		dds.mipOffset.push_back(end);
+		end += dds.LevelBytes(level);
+	}
+	if (fileSize < end) {
+		std::cerr << "ERROR: " << filename << " が壊れています" << std::endl;
+		return false;
+	}
+	dds.file = file;
+	if (!TextureCompressor::FlipVertical(dds)) {
+		std::cerr << "ERROR: " << filename << " を上下反転できません" << std::endl;
+		return false;
+	}
+	image = std::move(dds);
+	return true;
+}
+
+/**
+*	圧縮テクスチャの形式に対応しているかを設定する
+*
+*	@param s3tc	EXT_texture_compression_s3tc(BC1, BC3)に対応していれば true
+*	@param bptc	ARB_texture_compression_bptc(BC7)に対応していれば true
+*
+*	DecodeDds はワーカースレッドからも呼ばれるので、GLEW の変数ではなくここで設定した値で判定する
+*	GL スレッドで、コンテキストを作成した後に一度だけ呼び出す(呼び出すまではどちらも非対応として扱う)
+*/
+void Texture::CompressedFormatSupport(bool s3tc, bool bptc) {
+	hasS3tc = s3tc;
+	hasBptc = bptc;
+}
@@ -1,23 +1,93 @@
 #pragma once
 
 #include<GL/glew.h>
+#include"MappedFile.h"
+#include<algorithm>
 #include<memory>
+#include<string>
+#include<vector>
+#include<stdint.h>
 
 class Texture;
-///eNX`|C^
+///テクスチャポインタ
 typedef std::shared_ptr<Texture> TexturePtr;
 
 /**
-*	eNX`NX
+*	デコード済みの画像データ
+*
+*	Texture::Decode で作成し、Texture::Create で GPU に転送する
+*	OpenGL を使わないので、ワーカースレッドで作成できる
+*	ミップマップはファイルの内容の後ろに、1 行を 4 バイト境界に揃えて格納する
+*	ブロック圧縮形式(DDS ファイル)の場合、1 行は 4x4 画素のブロックの並びになる
+*
+*	変換の要らないファイルはメモリマップしたまま参照し、buffer にコピーしない
+*	file が有効な場合、最上位レベルは file 内の offset の位置にある
+*	ミップレベル 1 以降は buffer が空なら file 内に、そうでなければ buffer 内にある
+*/
+struct ImageData {
+	int width = 0;				///< 画像の幅(ピクセル数)
+	int height = 0;				///< 画像の高さ(ピクセル数)
+	GLenum iformat = GL_RGB8;	///< テクスチャのデータ形式
+	GLenum format = GL_BGR;		///< ピクセルデータの要素の並び
+	MappedFilePtr file;			///< ピクセルデータを直接参照するファイル
+	std::vector<uint8_t> buffer;	///< 変換したピクセルデータとミップマップ
+	size_t offset = 0;			///< file または buffer 内のピクセルデータの位置
+	std::vector<size_t> mipOffset;	///< file または buffer 内のミップレベル 1 以降のピクセルデータの位置
+	int blockBytes = 0;			///< 圧縮ブロック 1 個のバイト数(0 なら無圧縮)
+
+	int LevelCount() const { return static_cast<int>(mipOffset.size()) + 1; }
+	int Width(int level = 0) const { return std::max(1, width >> level); }
+	int Height(int level = 0) const { return std::max(1, height >> level); }
+	int PixelBytes() const { return format == GL_BGRA || format == GL_RGBA ? 4 : 3; }
+	bool IsCompressed() const { return blockBytes != 0; }
+	bool HasAlpha() const {
+		return iformat == GL_RGBA8 || iformat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT || iformat == GL_COMPRESSED_RGBA_BPTC_UNORM;
+	}
+	const uint8_t* Pixels(int level = 0) const {
+		if (level == 0) {
+			return (file ? file->Data() : buffer.data()) + offset;
+		}
+		return (buffer.empty() ? file->Data() : buffer.data()) + mipOffset[level - 1];
+	}
+	size_t RowBytes(int level = 0) const {
+		return IsCompressed() ? (Width(level) + 3) / 4 * blockBytes : (Width(level) * PixelBytes() + 3) & ~3;
+	}
+	int RowHeight() const { return IsCompressed() ? 4 : 1; }
+	int RowCount(int level = 0) const { return (Height(level) + RowHeight() - 1) / RowHeight(); }
+	size_t LevelBytes(int level = 0) const { return RowBytes(level) * RowCount(level); }
+};
+
+/**
+*	テクスチャクラス
+*
+*	画像データから作成したテクスチャは GL_TEXTURE_2D_ARRAY(1 枚だけでも 1 レイヤーの配列)になる
+*	大きさを指定して作成したテクスチャ(オフスクリーンバッファなど)は GL_TEXTURE_2D になる
 */
 class Texture{
 public:
 	static TexturePtr Create(int width, int height, GLenum iformat, GLenum formet, const void* data);
-	static TexturePtr LoadFromFile(const char*);
+	static TexturePtr Create(const ImageData& image, int skipLevels = 0);
+	static TexturePtr CreateArray(const std::vector<const ImageData*>& images, int skipLevels = 0);
+	static TexturePtr CreateStorage(const ImageData& image, int skipLevels = 0, int layerCount = 1);
+	static bool UploadLayer(const TexturePtr& texture, const ImageData& image, int layer, int skipLevels = 0);
+	static bool IsArrayCompatible(const ImageData& lhs, const ImageData& rhs);
+	static size_t StorageBytes(const ImageData& image, int skipLevels = 0, int layerCount = 1);
+	static TexturePtr LoadFromFile(const char*, int skipLevels = 0);
+	static bool Decode(const char* filename, ImageData& image, bool allowCompressed = true);
+	static bool DecodeBmp(const char* filename, const MappedFilePtr& file, ImageData& image);
+	static bool DecodeDds(const char* filename, const MappedFilePtr& file, ImageData& image);
+	static void GenerateMipmaps(ImageData& image);
+	static std::string CompressedFileName(const char* filename);
+	static void CompressedFormatSupport(bool s3tc, bool bptc);
 
 	GLuint Id() const { return texId; }
+	GLenum Target() const { return target; }
 	GLsizei Width() const { return width; }
 	GLsizei Hieght() const { return height; }
+	int LayerCount() const { return layerCount; }
+	bool HasAlpha() const { return hasAlpha; }
+	size_t Bytes() const { return bytes; }
+	void Swap(Texture& other);
 
 private:
 	Texture();
@@ -26,6 +96,10 @@ private:
 	Texture& operator = (const Texture&) = delete;
 
 	GLuint texId;
+	GLenum target;	///< GL_TEXTURE_2D または GL_TEXTURE_2D_ARRAY
 	int width;
 	int height;
+	int layerCount;	///< テクスチャ配列のレイヤー数
+	bool hasAlpha;	///< アルファチャンネルを持つ形式なら true
+	size_t bytes;	///< GPU メモリの使用量(全ミップレベルと全レイヤーの合計)
 };
\ No newline at end of file
@@ -0,0 +1,318 @@
+/**
+*	@file TextureCache.cpp
+*/
+#include "TextureCache.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+/**
+*	テクスチャキャッシュを作成する
+*
+*	@param budget	GPU メモリ使用量の予算(バイト数)
+*
+*	@return 作成したテクスチャキャッシュへのポインタ
+*/
+TextureCachePtr TextureCache::Create(size_t budget) {
+	struct Impl : TextureCache { Impl() {} ~Impl() {} };
+	TextureCachePtr p = std::make_shared<Impl>();
+	p->budget = budget;
+	return p;
+}
+
+/**
+*	仮表示用の 1x1 ピクセルの白いテクスチャを作成する
+*
+*	@return	作成に成功した場合はテクスチャポインタを返す
+*			失敗した場合は nullptr を返す
+*/
+TexturePtr TextureCache::CreatePlaceholder() {
+	ImageData image;
+	image.width = 1;
+	image.height = 1;
+	image.buffer.assign(4, 255);
+	return Texture::Create(image);
+}
+
+/**
+*	ファイル名からテクスチャを検索する
+*
+*	@param name	テクスチャファイル名
+*
+*	@return name に対応するテクスチャとレイヤー番号へのポインタ
+*			登録されていない場合は nullptr
+*
+*	追い出したテクスチャも登録は残っているので、仮表示用の内容のまま返す
+*	戻り値のポインタは、次に登録か登録解除をするまで有効
+*/
+const TextureCache::Entry* TextureCache::Find(const std::string& name) {
+	const auto itr = entryMap.find(name);
+	if (itr == entryMap.end()) {
+		return nullptr;
+	}
+	const auto record = recordMap.find(itr->second.texture.get());
+	if (record != recordMap.end() && !record->second->isEvicted && !record->second->isLoading) {
+		++statistics.hits;
+	}
+	return &itr->second;
+}
+
+/**
+*	これから読み込むテクスチャのために GPU メモリを空ける
+*
+*	@param bytes	読み込むテクスチャの GPU メモリ使用量
+*
+*	@retval true	予算内に収まる
+*	@retval false	エンティティが使っているテクスチャが多く、追い出しても予算を超える
+*
+*	エンティティが使っていないテクスチャを、最後に使われたのが古い順に予算に収まるまで追い出す
+*	予算を超える場合も読み込みは行えるが、bytes が 0 でなければ警告を出力する
+*/
+bool TextureCache::Reserve(size_t bytes) {
+	while (statistics.residentBytes + bytes > budget) {
+		Record* victim = nullptr;
+		for (const auto& e : recordMap) {
+			Record& record = *e.second;
+			if (record.isUsed || record.isEvicted || record.isLoading) {
+				continue;
+			}
+			if (!victim || record.lastUsedFrame < victim->lastUsedFrame) {
+				victim = &record;
+			}
+		}
+		if (!victim) {
+			if (bytes) {
+				std::cerr << "WARNING: テクスチャの予算(" << budget / (1024 * 1024) << "MB)を超えて読み込みます(使用量 " <<
+					(statistics.residentBytes + bytes) / (1024 * 1024) << "MB)" << std::endl;
+			}
+			return false;
+		}
+		EvictRecord(*victim);
+		if (!victim->isEvicted) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+*	読み込んだテクスチャを登録する
+*
+*	@param names		テクスチャファイル名のリスト(テクスチャ配列の場合はレイヤー順)
+*	@param texture		登録するテクスチャ
+*	@param isLoading	非同期読み込み中の仮表示用テクスチャなら true
+*
+*	isLoading が true の場合は、読み込みが終わったら Commit を呼び出すこと
+*/
+void TextureCache::Insert(const std::vector<std::string>& names, const TexturePtr& texture, bool isLoading) {
+	RecordPtr record = std::make_shared<Record>();
+	record->texture = texture;
+	record->names = names;
+	record->bytes = texture->Bytes();
+	record->lastUsedFrame = frame;
+	record->isLoading = isLoading;
+	for (size_t layer = 0; layer < names.size(); ++layer) {
+		entryMap[names[layer]] = Entry{ texture, static_cast<int>(layer) };
+	}
+	recordMap[texture.get()] = record;
+	statistics.residentBytes += record->bytes;
+	statistics.misses += names.size();
+}
+
+/**
+*	非同期読み込みが終わったテクスチャの GPU メモリ使用量を数え直す
+*
+*	@param texture	内容を差し替えたテクスチャ
+*/
+void TextureCache::Commit(const Texture* texture) {
+	const auto itr = recordMap.find(texture);
+	if (itr == recordMap.end()) {
+		return;
+	}
+	Record& record = *itr->second;
+	statistics.residentBytes -= record.bytes;
+	record.bytes = texture->Bytes();
+	statistics.residentBytes += record.bytes;
+	record.isLoading = false;
+}
+
+/**
+*	テクスチャの登録を解除する
+*
+*	@param name	テクスチャファイル名
+*
+*	テクスチャ配列の場合は、まとめた全てのファイルの登録を解除する
+*	TexturePtr はキャッシュから外れるだけなので、保持しているハンドルはそのまま使える
+*/
+void TextureCache::Erase(const std::string& name) {
+	const auto itr = entryMap.find(name);
+	if (itr == entryMap.end()) {
+		return;
+	}
+	const auto record = recordMap.find(itr->second.texture.get());
+	if (record == recordMap.end()) {
+		entryMap.erase(itr);
+		return;
+	}
+	const RecordPtr p = record->second;
+	Remove(p);
+}
+
+/**
+*	テクスチャを追い出して GPU メモリを解放する
+*
+*	@param name	テクスチャファイル名
+*
+*	@retval true	追い出した
+*	@retval false	登録されていないか、エンティティが使用中か、読み込み中か、追い出し済み
+*
+*	テクスチャ配列の場合は、まとめた全てのファイルを追い出す
+*	追い出した後もエンティティが使えば、自動的に読み直される
+*/
+bool TextureCache::Evict(const std::string& name) {
+	const auto itr = entryMap.find(name);
+	if (itr == entryMap.end()) {
+		return false;
+	}
+	const auto record = recordMap.find(itr->second.texture.get());
+	if (record == recordMap.end()) {
+		return false;
+	}
+	Record& e = *record->second;
+	if (e.isUsed || e.isLoading || e.isEvicted) {
+		return false;
+	}
+	EvictRecord(e);
+	return e.isEvicted;
+}
+
+/**
+*	エンティティが使っているテクスチャを記録し、読み直しを進める
+*
+*	@param usedList		このフレームでエンティティが使っているテクスチャのリスト
+*	@param skipLevels	読み直すテクスチャの転送しない上位のミップレベルの数
+*
+*	毎フレーム、エンティティバッファの更新後に呼び出す
+*	追い出したテクスチャを使っていれば、ワーカースレッドでファイルの読み直しを始める
+*	読み直しの終わったテクスチャは転送して元の内容に戻す
+*	予算を下げた場合などで使用量が予算を超えていれば、使っていないテクスチャを追い出す
+*	フレーム毎のヒット、ミス、追い出しの回数と常駐しているバイト数をプロファイラのカウンタに記録する
+*/
+void TextureCache::Update(const std::vector<const Texture*>& usedList, int skipLevels) {
+	++frame;
+	for (const auto& e : recordMap) {
+		e.second->isUsed = false;
+	}
+	for (const Texture* texture : usedList) {
+		const auto itr = recordMap.find(texture);
+		if (itr == recordMap.end()) {
+			continue;
+		}
+		const RecordPtr& record = itr->second;
+		record->isUsed = true;
+		record->lastUsedFrame = frame;
+		if (!record->isEvicted || record->isLoading) {
+			continue;
+		}
+		record->isLoading = true;
+		record->images.assign(record->names.size(), ImageData());
+		statistics.misses += record->names.size();
+		std::vector<ImageData>* images = &record->images;
+		const std::vector<std::string> names = record->names;
+		record->reload = std::async(std::launch::async, [images, names]() {
+			for (size_t i = 0; i < names.size(); ++i) {
+				if (!Texture::Decode(names[i].c_str(), (*images)[i])) {
+					return false;
+				}
+			}
+			return true;
+		});
+		reloadList.push_back(record);
+	}
+
+	for (size_t i = 0; i < reloadList.size();) {
+		if (reloadList[i]->reload.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			++i;
+			continue;
+		}
+		const RecordPtr record = reloadList[i];
+		reloadList.erase(reloadList.begin() + i);
+		FinishReload(record, skipLevels);
+	}
+	Reserve(0);
+
+	Profiler::Counter("TextureCacheHits", static_cast<double>(statistics.hits - reported.hits));
+	Profiler::Counter("TextureCacheMisses", static_cast<double>(statistics.misses - reported.misses));
+	Profiler::Counter("TextureCacheEvictions", static_cast<double>(statistics.evictions - reported.evictions));
+	Profiler::Counter("TextureResidentBytes", static_cast<double>(statistics.residentBytes));
+	reported = statistics;
+}
+
+/**
+*	テクスチャを仮表示用の内容に差し替えて GPU メモリを解放する
+*
+*	@param record	追い出すテクスチャの情報
+*/
+void TextureCache::EvictRecord(Record& record) {
+	TexturePtr placeholder = CreatePlaceholder();
+	if (!placeholder) {
+		return;
+	}
+	//差し替えた元の内容は placeholder と一緒に破棄される
+	record.texture->Swap(*placeholder);
+	statistics.residentBytes -= record.bytes;
+	record.bytes = record.texture->Bytes();
+	statistics.residentBytes += record.bytes;
+	record.isEvicted = true;
+	++statistics.evictions;
+}
+
+/**
+*	読み直した画像データを転送して、テクスチャを元の内容に戻す
+*
+*	@param record		読み直したテクスチャの情報
+*	@param skipLevels	転送しない上位のミップレベルの数
+*
+*	読み直しに失敗した場合は登録を解除し、テクスチャは仮表示用の内容のままにする
+*/
+void TextureCache::FinishReload(const RecordPtr& record, int skipLevels) {
+	record->isLoading = false;
+	TexturePtr texture;
+	if (record->reload.get()) {
+		std::vector<const ImageData*> images;
+		for (const ImageData& e : record->images) {
+			images.push_back(&e);
+		}
+		Reserve(Texture::StorageBytes(record->images[0], skipLevels, static_cast<int>(images.size())));
+		texture = Texture::CreateArray(images, skipLevels);
+	}
+	record->images.clear();
+	if (!texture) {
+		std::cerr << "ERROR: " << record->names[0] << " の読み直しに失敗" << std::endl;
+		Remove(record);
+		return;
+	}
+	record->texture->Swap(*texture);
+	statistics.residentBytes -= record->bytes;
+	record->bytes = record->texture->Bytes();
+	statistics.residentBytes += record->bytes;
+	record->isEvicted = false;
+}
+
+/**
+*	テクスチャの情報と、それを指す全てのファイル名の登録を解除する
+*
+*	@param record	登録を解除するテクスチャの情報
+*/
+void TextureCache::Remove(const RecordPtr& record) {
+	for (const std::string& name : record->names) {
+		const auto itr = entryMap.find(name);
+		if (itr != entryMap.end() && itr->second.texture == record->texture) {
+			entryMap.erase(itr);
+		}
+	}
+	reloadList.erase(std::remove(reloadList.begin(), reloadList.end(), record), reloadList.end());
+	statistics.residentBytes -= record->bytes;
+	recordMap.erase(record->texture.get());
+}
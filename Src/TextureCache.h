@@ -0,0 +1,92 @@
+/**
+*	@file TextureCache.h
+*/
+#pragma once
+#include "Texture.h"
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+class TextureCache;
+typedef std::shared_ptr<TextureCache> TextureCachePtr;	///< テクスチャキャッシュポインタ
+
+/**
+*	GPU メモリの予算付きテクスチャキャッシュ
+*
+*	ファイル名から、テクスチャとテクスチャ配列のレイヤー番号を引く
+*	テクスチャ毎に GPU メモリの使用量(大きさ x 形式 x ミップレベル x レイヤー数)を数え
+*	読み込みで予算を超える場合は、エンティティが使っていないテクスチャを最後に描画されたのが古い順に追い出す
+*	追い出したテクスチャは TexturePtr を保持したまま 1x1 の仮表示用の内容に差し替えるので、エンティティのポインタは無効にならない
+*	再びエンティティが使うと、ワーカースレッドでファイルを読み直して元の内容に戻す
+*	テクスチャ配列は、まとめた全てのファイルを 1 つの単位として追い出し、読み直す
+*/
+class TextureCache {
+public:
+	///ファイル名に対応するテクスチャ
+	struct Entry {
+		TexturePtr texture;
+		int layer = 0;	///< テクスチャ配列のレイヤー番号
+	};
+	///キャッシュの統計(作成時からの累計)
+	struct Statistics {
+		size_t hits;			///< 名前で検索したテクスチャが常駐していた回数
+		size_t misses;			///< ファイルから読み込んだ回数(初回の読み込みと読み直し)
+		size_t evictions;		///< テクスチャを追い出した回数
+		size_t residentBytes;	///< 常駐しているテクスチャの GPU メモリ使用量
+	};
+
+	static TextureCachePtr Create(size_t budget);
+	static TexturePtr CreatePlaceholder();
+
+	const Entry* Find(const std::string& name);
+	bool Reserve(size_t bytes);
+	void Insert(const std::vector<std::string>& names, const TexturePtr& texture, bool isLoading = false);
+	void Commit(const Texture* texture);
+	void Erase(const std::string& name);
+	bool Evict(const std::string& name);
+	void Update(const std::vector<const Texture*>& usedList, int skipLevels);
+
+	void Budget(size_t bytes) { budget = bytes; }
+	size_t Budget() const { return budget; }
+	const Statistics& GetStatistics() const { return statistics; }
+
+private:
+	TextureCache() = default;
+	~TextureCache() = default;
+	TextureCache(const TextureCache&) = delete;
+	TextureCache& operator=(const TextureCache&) = delete;
+
+	/**
+	*	キャッシュするテクスチャ 1 つ分の情報
+	*
+	*	reload は images より後に宣言し、破棄時に読み直しの終了を待ってから画像データを破棄させること
+	*/
+	struct Record {
+		TexturePtr texture;
+		std::vector<std::string> names;	///< レイヤー順のファイル名
+		size_t bytes = 0;				///< 数えている GPU メモリ使用量
+		uint64_t lastUsedFrame = 0;		///< 最後にエンティティが使ったフレーム
+		bool isUsed = false;			///< 直前の Update でエンティティが使っていれば true
+		bool isEvicted = false;			///< 追い出して仮表示用の内容になっていれば true
+		bool isLoading = false;			///< 非同期読み込み中または読み直し中なら true(追い出さない)
+		std::vector<ImageData> images;	///< 読み直した画像データ
+		std::future<bool> reload;		///< 読み直しの結果
+	};
+	typedef std::shared_ptr<Record> RecordPtr;
+
+	void EvictRecord(Record& record);
+	void FinishReload(const RecordPtr& record, int skipLevels);
+	void Remove(const RecordPtr& record);
+
+private:
+	size_t budget = 0;		///< GPU メモリ使用量の予算
+	uint64_t frame = 0;		///< Update を呼び出した回数
+	Statistics statistics = Statistics();
+	Statistics reported = Statistics();	///< 前回プロファイラに記録した統計
+	std::unordered_map<std::string, Entry> entryMap;				///< ファイル名からテクスチャを引く表
+	std::unordered_map<const Texture*, RecordPtr> recordMap;		///< テクスチャからキャッシュの情報を引く表
+	std::vector<RecordPtr> reloadList;	///< 読み直し中のテクスチャ
+};
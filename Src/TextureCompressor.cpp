@@ -0,0 +1,927 @@
+/**
+*	@file TextureCompressor.cpp
+*/
+#include "TextureCompressor.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+namespace TextureCompressor {
+
+	namespace {
+
+		const size_t ddsHeaderSize = 128;		///< "DDS " と DDS_HEADER のバイト数
+		const size_t ddsHeaderDx10Size = 20;	///< DDS_HEADER_DXT10 のバイト数
+		const int refineIterations = 3;			///< 端点を最小二乗法で修正する回数
+
+		///BC7 モード 6 の 4 ビットインデックスの補間の重み(64 分率)
+		const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+		void Put32(uint8_t* p, uint32_t value) {
+			for (int i = 0; i < 4; ++i) {
+				p[i] = static_cast<uint8_t>(value >> (i * 8));
+			}
+		}
+
+		/**
+		*	ブロックの画素を、主軸の方向に並ぶ 2 つの端点で近似する
+		*
+		*	@param pixels	ブロックの画素(16 個)
+		*	@param channels	使用する要素数(3 なら RGB, 4 なら RGBA)
+		*	@param e0		主軸の負側の端点を格納する配列
+		*	@param e1		主軸の正側の端点を格納する配列
+		*
+		*	主軸は共分散行列のべき乗法で求める
+		*/
+		void FitPrincipalAxis(const float (*pixels)[4], int channels, float* e0, float* e1) {
+			float mean[4] = {};
+			for (int i = 0; i < 16; ++i) {
+				for (int c = 0; c < channels; ++c) {
+					mean[c] += pixels[i][c] / 16.0f;
+				}
+			}
+			float cov[4][4] = {};
+			for (int i = 0; i < 16; ++i) {
+				for (int a = 0; a < channels; ++a) {
+					for (int b = 0; b < channels; ++b) {
+						cov[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+					}
+				}
+			}
+			float axis[4] = { 1, 1, 1, 1 };
+			for (int n = 0; n < 8; ++n) {
+				float v[4] = {};
+				float maxAbs = 0;
+				for (int a = 0; a < channels; ++a) {
+					for (int b = 0; b < channels; ++b) {
+						v[a] += cov[a][b] * axis[b];
+					}
+					maxAbs = std::max(maxAbs, fabsf(v[a]));
+				}
+				if (maxAbs < 1e-6f) {
+					break;
+				}
+				for (int a = 0; a < channels; ++a) {
+					axis[a] = v[a] / maxAbs;
+				}
+			}
+			float tMin = 0;
+			float tMax = 0;
+			float axisLength2 = 0;
+			for (int c = 0; c < channels; ++c) {
+				axisLength2 += axis[c] * axis[c];
+			}
+			for (int i = 0; i < 16; ++i) {
+				float t = 0;
+				for (int c = 0; c < channels; ++c) {
+					t += (pixels[i][c] - mean[c]) * axis[c];
+				}
+				tMin = std::min(tMin, t / axisLength2);
+				tMax = std::max(tMax, t / axisLength2);
+			}
+			for (int c = 0; c < channels; ++c) {
+				e0[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tMin));
+				e1[c] = std::min(255.0f, std::max(0.0f, mean[c] + axis[c] * tMax));
+			}
+		}
+
+		/**
+		*	インデックスを固定して、誤差が最小になる端点を求める(最小二乗法)
+		*
+		*	@param pixels	ブロックの画素(16 個)
+		*	@param weights	各画素の e1 側への補間の割合(0~1)
+		*	@param channels	使用する要素数
+		*	@param e0		端点 0(更新される)
+		*	@param e1		端点 1(更新される)
+		*/
+		void RefineEndpoints(const float (*pixels)[4], const float* weights, int channels, float* e0, float* e1) {
+			float aa = 0, ab = 0, bb = 0;
+			float ax[4] = {}, bx[4] = {};
+			for (int i = 0; i < 16; ++i) {
+				const float b = weights[i];
+				const float a = 1.0f - b;
+				aa += a * a;
+				ab += a * b;
+				bb += b * b;
+				for (int c = 0; c < channels; ++c) {
+					ax[c] += a * pixels[i][c];
+					bx[c] += b * pixels[i][c];
+				}
+			}
+			const float det = aa * bb - ab * ab;
+			if (fabsf(det) < 1e-6f) {
+				return;
+			}
+			for (int c = 0; c < channels; ++c) {
+				e0[c] = std::min(255.0f, std::max(0.0f, (ax[c] * bb - bx[c] * ab) / det));
+				e1[c] = std::min(255.0f, std::max(0.0f, (bx[c] * aa - ax[c] * ab) / det));
+			}
+		}
+
+		uint16_t To565(const float* c) {
+			const int r = static_cast<int>(c[0] * 31.0f / 255.0f + 0.5f);
+			const int g = static_cast<int>(c[1] * 63.0f / 255.0f + 0.5f);
+			const int b = static_cast<int>(c[2] * 31.0f / 255.0f + 0.5f);
+			return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+		}
+
+		void From565(uint16_t c, int* rgb) {
+			const int r = (c >> 11) & 31;
+			const int g = (c >> 5) & 63;
+			const int b = c & 31;
+			rgb[0] = (r << 3) | (r >> 2);
+			rgb[1] = (g << 2) | (g >> 4);
+			rgb[2] = (b << 3) | (b >> 2);
+		}
+
+		/**
+		*	BC1 の 4 色モードのカラーブロックを作る
+		*
+		*	@param rgba		ブロックの画素(16 個の RGBA)
+		*	@param block	圧縮したデータを格納する 8 バイトのバッファ
+		*
+		*	BC3 のカラーブロックとしても使えるように、常に c0 > c1 の 4 色モードにする
+		*/
+		void EncodeColorBlock(const uint8_t* rgba, uint8_t* block) {
+			float pixels[16][4];
+			for (int i = 0; i < 16; ++i) {
+				for (int c = 0; c < 4; ++c) {
+					pixels[i][c] = rgba[i * 4 + c];
+				}
+			}
+			float e0[4], e1[4];
+			FitPrincipalAxis(pixels, 3, e1, e0);
+
+			int bestError = INT32_MAX;
+			for (int iteration = 0; iteration <= refineIterations; ++iteration) {
+				uint16_t c0 = To565(e0);
+				uint16_t c1 = To565(e1);
+				if (c0 < c1) {
+					std::swap(c0, c1);
+					std::swap(e0, e1);
+				}
+				int palette[4][3];
+				From565(c0, palette[0]);
+				From565(c1, palette[1]);
+				for (int c = 0; c < 3; ++c) {
+					palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+					palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+				}
+				uint32_t indices = 0;
+				int error = 0;
+				float weights[16];
+				static const float paletteWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+				for (int i = 0; i < 16; ++i) {
+					int best = 0;
+					int bestDistance = INT32_MAX;
+					for (int k = 0; k < (c0 == c1 ? 1 : 4); ++k) {
+						int distance = 0;
+						for (int c = 0; c < 3; ++c) {
+							const int d = palette[k][c] - rgba[i * 4 + c];
+							distance += d * d;
+						}
+						if (distance < bestDistance) {
+							bestDistance = distance;
+							best = k;
+						}
+					}
+					indices |= best << (i * 2);
+					error += bestDistance;
+					weights[i] = paletteWeights[best];
+				}
+				if (error < bestError) {
+					bestError = error;
+					block[0] = static_cast<uint8_t>(c0);
+					block[1] = static_cast<uint8_t>(c0 >> 8);
+					block[2] = static_cast<uint8_t>(c1);
+					block[3] = static_cast<uint8_t>(c1 >> 8);
+					Put32(block + 4, indices);
+				}
+				if (error == 0 || c0 == c1) {
+					break;
+				}
+				float a[4], b[4];
+				std::copy(e0, e0 + 4, a);
+				std::copy(e1, e1 + 4, b);
+				RefineEndpoints(pixels, weights, 3, a, b);
+				std::copy(a, a + 4, e0);
+				std::copy(b, b + 4, e1);
+			}
+		}
+
+		/**
+		*	BC3 のアルファブロックを作る
+		*
+		*	最大値と最小値を端点にして、8 段階で補間する
+		*/
+		void EncodeAlphaBlock(const uint8_t* rgba, uint8_t* block) {
+			int a0 = 0;
+			int a1 = 255;
+			for (int i = 0; i < 16; ++i) {
+				a0 = std::max<int>(a0, rgba[i * 4 + 3]);
+				a1 = std::min<int>(a1, rgba[i * 4 + 3]);
+			}
+			int palette[8] = { a0, a1 };
+			for (int k = 2; k < 8; ++k) {
+				palette[k] = ((8 - k) * a0 + (k - 1) * a1 + 3) / 7;
+			}
+			uint64_t indices = 0;
+			for (int i = 0; i < 16 && a0 != a1; ++i) {
+				int best = 0;
+				int bestDistance = INT32_MAX;
+				for (int k = 0; k < 8; ++k) {
+					const int distance = abs(palette[k] - rgba[i * 4 + 3]);
+					if (distance < bestDistance) {
+						bestDistance = distance;
+						best = k;
+					}
+				}
+				indices |= static_cast<uint64_t>(best) << (i * 3);
+			}
+			block[0] = static_cast<uint8_t>(a0);
+			block[1] = static_cast<uint8_t>(a1);
+			for (int i = 0; i < 6; ++i) {
+				block[2 + i] = static_cast<uint8_t>(indices >> (i * 8));
+			}
+		}
+
+		/**
+		*	128 ビットのブロックへのビット単位の書き込み(下位ビットから詰める)
+		*/
+		struct BitWriter {
+			uint8_t* p;
+			int pos = 0;
+			explicit BitWriter(uint8_t* block) : p(block) { memset(p, 0, 16); }
+			void Write(uint32_t value, int bits) {
+				for (int i = 0; i < bits; ++i, ++pos) {
+					p[pos / 8] |= static_cast<uint8_t>(((value >> i) & 1) << (pos % 8));
+				}
+			}
+		};
+
+		/**
+		*	128 ビットのブロックからのビット単位の読み込み
+		*/
+		struct BitReader {
+			const uint8_t* p;
+			int pos = 0;
+			explicit BitReader(const uint8_t* block) : p(block) {}
+			uint32_t Read(int bits) {
+				uint32_t value = 0;
+				for (int i = 0; i < bits; ++i, ++pos) {
+					value |= ((p[pos / 8] >> (pos % 8)) & 1) << i;
+				}
+				return value;
+			}
+		};
+
+		/**
+		*	BC7 の端点を 7 ビット + P ビットに量子化する
+		*
+		*	@param e		端点(RGBA)
+		*	@param q		量子化した 7 ビットの値を格納する配列
+		*
+		*	@return 誤差の小さいほうの P ビット
+		*/
+		int QuantizeBC7Endpoint(const float* e, int* q) {
+			int bestP = 0;
+			float bestError = FLT_MAX;
+			for (int p = 0; p < 2; ++p) {
+				float error = 0;
+				int candidate[4];
+				for (int c = 0; c < 4; ++c) {
+					candidate[c] = std::min(127, std::max(0, static_cast<int>((e[c] - p) / 2.0f + 0.5f)));
+					const float d = static_cast<float>(candidate[c] * 2 + p) - e[c];
+					error += d * d;
+				}
+				if (error < bestError) {
+					bestError = error;
+					bestP = p;
+					std::copy(candidate, candidate + 4, q);
+				}
+			}
+			return bestP;
+		}
+
+		/**
+		*	画像から 4x4 画素のブロックを RGBA で取り出す
+		*
+		*	@param image	画像データ(無圧縮)
+		*	@param level	ミップレベル
+		*	@param bx		ブロックの X 座標
+		*	@param by		ブロックの Y 座標
+		*	@param rgba		取り出した 16 個の RGBA を格納するバッファ
+		*
+		*	画像の端からはみ出す画素は端の画素で埋める
+		*/
+		void ExtractBlock(const ImageData& image, int level, int bx, int by, uint8_t* rgba) {
+			const int w = image.Width(level);
+			const int h = image.Height(level);
+			const int pixelBytes = image.PixelBytes();
+			const bool isBgr = image.format == GL_BGR || image.format == GL_BGRA;
+			for (int y = 0; y < 4; ++y) {
+				const uint8_t* row = image.Pixels(level) + std::min(by * 4 + y, h - 1) * image.RowBytes(level);
+				for (int x = 0; x < 4; ++x) {
+					const uint8_t* p = row + std::min(bx * 4 + x, w - 1) * pixelBytes;
+					uint8_t* q = rgba + (y * 4 + x) * 4;
+					q[0] = p[isBgr ? 2 : 0];
+					q[1] = p[1];
+					q[2] = p[isBgr ? 0 : 2];
+					q[3] = image.HasAlpha() ? p[3] : 255;
+				}
+			}
+		}
+
+		/**
+		*	DDS_HEADER の dwFlags, dwCaps の値
+		*/
+		const uint32_t ddsdCaps = 0x1, ddsdHeight = 0x2, ddsdWidth = 0x4, ddsdPixelFormat = 0x1000;
+		const uint32_t ddsdMipMapCount = 0x20000, ddsdLinearSize = 0x80000;
+		const uint32_t ddpfFourCC = 0x4;
+		const uint32_t ddscapsComplex = 0x8, ddscapsTexture = 0x1000, ddscapsMipMap = 0x400000;
+	}
+
+	/**
+	*	4x4 画素を BC1 形式に圧縮する
+	*
+	*	@param rgba		ブロックの画素(行優先の 16 個の RGBA)
+	*	@param block	圧縮したデータを格納する 8 バイトのバッファ
+	*/
+	void EncodeBC1(const uint8_t* rgba, uint8_t* block) {
+		EncodeColorBlock(rgba, block);
+	}
+
+	/**
+	*	4x4 画素を BC3 形式に圧縮する
+	*
+	*	@param rgba		ブロックの画素(行優先の 16 個の RGBA)
+	*	@param block	圧縮したデータを格納する 16 バイトのバッファ
+	*/
+	void EncodeBC3(const uint8_t* rgba, uint8_t* block) {
+		EncodeAlphaBlock(rgba, block);
+		EncodeColorBlock(rgba, block + 8);
+	}
+
+	/**
+	*	4x4 画素を BC7 形式(モード 6)に圧縮する
+	*
+	*	@param rgba		ブロックの画素(行優先の 16 個の RGBA)
+	*	@param block	圧縮したデータを格納する 16 バイトのバッファ
+	*
+	*	主軸の端点から始め、インデックスの割り当てと端点の最小二乗法による修正を繰り返す
+	*/
+	void EncodeBC7(const uint8_t* rgba, uint8_t* block) {
+		float pixels[16][4];
+		for (int i = 0; i < 16; ++i) {
+			for (int c = 0; c < 4; ++c) {
+				pixels[i][c] = rgba[i * 4 + c];
+			}
+		}
+		float e0[4], e1[4];
+		FitPrincipalAxis(pixels, 4, e0, e1);
+
+		int bestError = INT32_MAX;
+		for (int iteration = 0; iteration <= refineIterations; ++iteration) {
+			int q0[4], q1[4];
+			int p0 = QuantizeBC7Endpoint(e0, q0);
+			int p1 = QuantizeBC7Endpoint(e1, q1);
+			int palette[16][4];
+			for (int k = 0; k < 16; ++k) {
+				for (int c = 0; c < 4; ++c) {
+					const int v0 = q0[c] * 2 + p0;
+					const int v1 = q1[c] * 2 + p1;
+					palette[k][c] = ((64 - bc7Weights[k]) * v0 + bc7Weights[k] * v1 + 32) >> 6;
+				}
+			}
+			int indices[16];
+			float weights[16];
+			int error = 0;
+			for (int i = 0; i < 16; ++i) {
+				int bestDistance = INT32_MAX;
+				for (int k = 0; k < 16; ++k) {
+					int distance = 0;
+					for (int c = 0; c < 4; ++c) {
+						const int d = palette[k][c] - rgba[i * 4 + c];
+						distance += d * d;
+					}
+					if (distance < bestDistance) {
+						bestDistance = distance;
+						indices[i] = k;
+					}
+				}
+				error += bestDistance;
+				weights[i] = bc7Weights[indices[i]] / 64.0f;
+			}
+			if (error < bestError) {
+				bestError = error;
+				//先頭の画素のインデックスの最上位ビットは 0 でなければならない(省略される)ので、端点を入れ替える
+				if (indices[0] & 8) {
+					std::swap(q0, q1);
+					std::swap(p0, p1);
+					for (int& e : indices) {
+						e = 15 - e;
+					}
+				}
+				BitWriter writer(block);
+				writer.Write(1 << 6, 7);
+				for (int c = 0; c < 4; ++c) {
+					writer.Write(q0[c], 7);
+					writer.Write(q1[c], 7);
+				}
+				writer.Write(p0, 1);
+				writer.Write(p1, 1);
+				writer.Write(indices[0], 3);
+				for (int i = 1; i < 16; ++i) {
+					writer.Write(indices[i], 4);
+				}
+			}
+			if (error == 0) {
+				break;
+			}
+			RefineEndpoints(pixels, weights, 4, e0, e1);
+		}
+	}
+
+	/**
+	*	圧縮したブロックを展開する
+	*
+	*	@param format	圧縮形式
+	*	@param block	圧縮したデータ
+	*	@param rgba		展開した 16 個の RGBA を格納するバッファ
+	*
+	*	画質の評価に使う
+	*	BC7 はこのエンコーダが出力するモード 6 だけに対応し、他のモードはマゼンタになる
+	*/
+	void DecodeBlock(Format format, const uint8_t* block, uint8_t* rgba) {
+		if (format == Format::BC7) {
+			BitReader reader(block);
+			if (reader.Read(7) != (1 << 6)) {
+				for (int i = 0; i < 16; ++i) {
+					rgba[i * 4 + 0] = 255;
+					rgba[i * 4 + 1] = 0;
+					rgba[i * 4 + 2] = 255;
+					rgba[i * 4 + 3] = 255;
+				}
+				return;
+			}
+			int q[2][4];
+			for (int c = 0; c < 4; ++c) {
+				q[0][c] = reader.Read(7);
+				q[1][c] = reader.Read(7);
+			}
+			const int p0 = reader.Read(1);
+			const int p1 = reader.Read(1);
+			for (int i = 0; i < 16; ++i) {
+				const int index = reader.Read(i == 0 ? 3 : 4);
+				for (int c = 0; c < 4; ++c) {
+					const int v0 = q[0][c] * 2 + p0;
+					const int v1 = q[1][c] * 2 + p1;
+					rgba[i * 4 + c] = static_cast<uint8_t>(((64 - bc7Weights[index]) * v0 + bc7Weights[index] * v1 + 32) >> 6);
+				}
+			}
+			return;
+		}
+
+		const uint8_t* colorBlock = block;
+		if (format == Format::BC3) {
+			colorBlock = block + 8;
+			const int a0 = block[0];
+			const int a1 = block[1];
+			int palette[8] = { a0, a1 };
+			if (a0 > a1) {
+				for (int k = 2; k < 8; ++k) {
+					palette[k] = ((8 - k) * a0 + (k - 1) * a1 + 3) / 7;
+				}
+			} else {
+				for (int k = 2; k < 6; ++k) {
+					palette[k] = ((6 - k) * a0 + (k - 1) * a1 + 2) / 5;
+				}
+				palette[6] = 0;
+				palette[7] = 255;
+			}
+			uint64_t indices = 0;
+			for (int i = 0; i < 6; ++i) {
+				indices |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+			}
+			for (int i = 0; i < 16; ++i) {
+				rgba[i * 4 + 3] = static_cast<uint8_t>(palette[(indices >> (i * 3)) & 7]);
+			}
+		}
+		const uint16_t c0 = static_cast<uint16_t>(colorBlock[0] | (colorBlock[1] << 8));
+		const uint16_t c1 = static_cast<uint16_t>(colorBlock[2] | (colorBlock[3] << 8));
+		int palette[4][4];
+		From565(c0, palette[0]);
+		From565(c1, palette[1]);
+		palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+		if (c0 > c1 || format == Format::BC3) {
+			for (int c = 0; c < 3; ++c) {
+				palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+			}
+		} else {
+			for (int c = 0; c < 3; ++c) {
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+			palette[3][3] = 0;
+		}
+		const uint32_t indices = colorBlock[4] | (colorBlock[5] << 8) | (colorBlock[6] << 16) | (static_cast<uint32_t>(colorBlock[7]) << 24);
+		for (int i = 0; i < 16; ++i) {
+			const int* color = palette[(indices >> (i * 2)) & 3];
+			for (int c = 0; c < (format == Format::BC3 ? 3 : 4); ++c) {
+				rgba[i * 4 + c] = static_cast<uint8_t>(color[c]);
+			}
+		}
+	}
+
+	/**
+	*	テクスチャのデータ形式から圧縮形式を求める
+	*
+	*	@param iformat	テクスチャのデータ形式
+	*	@param format	圧縮形式を格納する変数
+	*
+	*	@retval true	BC1, BC3, BC7 のいずれか
+	*	@retval false	それ以外の形式
+	*/
+	bool FormatOf(GLenum iformat, Format& format) {
+		switch (iformat) {
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: format = Format::BC1; return true;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: format = Format::BC3; return true;
+		case GL_COMPRESSED_RGBA_BPTC_UNORM: format = Format::BC7; return true;
+		default: return false;
+		}
+	}
+
+	/**
+	*	圧縮したブロックの画素の行を上下反転する
+	*
+	*	@param format	圧縮形式
+	*	@param block	反転するブロック
+	*	@param rows		反転する行数(画像の高さが 4 未満のブロックでは画像の高さ、それ以外は 4)
+	*
+	*	@retval true	反転成功
+	*	@retval false	BC7 のモード 6 以外のブロックだった
+	*
+	*	端点はそのままで、画素ごとのインデックスだけを並べ替える
+	*	BC7 は先頭の画素のインデックスの最上位ビットが 0 になるように、必要なら端点を入れ替えてインデックスを反転する
+	*/
+	bool FlipBlock(Format format, uint8_t* block, int rows) {
+		int source[16];
+		for (int i = 0; i < 16; ++i) {
+			const int y = i / 4;
+			source[i] = (y < rows ? rows - 1 - y : y) * 4 + i % 4;
+		}
+		if (format == Format::BC7) {
+			BitReader reader(block);
+			if (reader.Read(7) != (1 << 6)) {
+				return false;
+			}
+			int q[2][4];
+			for (int c = 0; c < 4; ++c) {
+				q[0][c] = reader.Read(7);
+				q[1][c] = reader.Read(7);
+			}
+			int p[2];
+			p[0] = reader.Read(1);
+			p[1] = reader.Read(1);
+			int indices[16];
+			for (int i = 0; i < 16; ++i) {
+				indices[i] = reader.Read(i == 0 ? 3 : 4);
+			}
+			int flipped[16];
+			for (int i = 0; i < 16; ++i) {
+				flipped[i] = indices[source[i]];
+			}
+			const int swap = flipped[0] & 8 ? 1 : 0;
+			BitWriter writer(block);
+			writer.Write(1 << 6, 7);
+			for (int c = 0; c < 4; ++c) {
+				writer.Write(q[swap][c], 7);
+				writer.Write(q[1 - swap][c], 7);
+			}
+			writer.Write(p[swap], 1);
+			writer.Write(p[1 - swap], 1);
+			for (int i = 0; i < 16; ++i) {
+				writer.Write(swap ? 15 - flipped[i] : flipped[i], i == 0 ? 3 : 4);
+			}
+			return true;
+		}
+
+		if (format == Format::BC3) {
+			uint64_t indices = 0;
+			for (int i = 0; i < 6; ++i) {
+				indices |= static_cast<uint64_t>(block[2 + i]) << (i * 8);
+			}
+			uint64_t flipped = 0;
+			for (int i = 0; i < 16; ++i) {
+				flipped |= ((indices >> (source[i] * 3)) & 7) << (i * 3);
+			}
+			for (int i = 0; i < 6; ++i) {
+				block[2 + i] = static_cast<uint8_t>(flipped >> (i * 8));
+			}
+			block += 8;
+		}
+		const uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | (static_cast<uint32_t>(block[7]) << 24);
+		uint32_t flipped = 0;
+		for (int i = 0; i < 16; ++i) {
+			flipped |= ((indices >> (source[i] * 2)) & 3) << (i * 2);
+		}
+		Put32(block + 4, flipped);
+		return true;
+	}
+
+	/**
+	*	圧縮した画像の全てのミップレベルを上下反転する
+	*
+	*	@param image	反転する画像データ(ファイルを参照している場合は buffer に複製してから反転する)
+	*
+	*	@retval true	反転成功
+	*	@retval false	無圧縮の画像、4 の倍数でない 4 より大きい高さのミップレベルがある、または反転できないブロックがある
+	*
+	*	ブロックの行の順序を逆にしてから、各ブロックの中の行を反転する
+	*	OpenGL の下から上の順と、DDS の上から下の順を相互に変換するのに使う
+	*/
+	bool FlipVertical(ImageData& image) {
+		Format format;
+		if (!image.IsCompressed() || !FormatOf(image.iformat, format)) {
+			return false;
+		}
+		for (int level = 0; level < image.LevelCount(); ++level) {
+			if (image.Height(level) > 4 && image.Height(level) % 4) {
+				return false;
+			}
+		}
+		if (image.file) {
+			const uint8_t* data = image.file->Data();
+			const size_t begin = image.offset;
+			const size_t end = image.mipOffset.empty() ? begin + image.LevelBytes(0) :
+				image.mipOffset.back() + image.LevelBytes(image.LevelCount() - 1);
+			image.buffer.assign(data + begin, data + end);
+			for (size_t& e : image.mipOffset) {
+				e -= begin;
+			}
+			image.offset = 0;
+			image.file.reset();
+		}
+		std::vector<uint8_t> row;
+		for (int level = 0; level < image.LevelCount(); ++level) {
+			uint8_t* pixels = image.buffer.data() + (level ? image.mipOffset[level - 1] : image.offset);
+			const size_t rowBytes = image.RowBytes(level);
+			const int rowCount = image.RowCount(level);
+			row.resize(rowBytes);
+			for (int by = 0; by < rowCount / 2; ++by) {
+				uint8_t* a = pixels + by * rowBytes;
+				uint8_t* b = pixels + (rowCount - 1 - by) * rowBytes;
+				memcpy(row.data(), a, rowBytes);
+				memcpy(a, b, rowBytes);
+				memcpy(b, row.data(), rowBytes);
+			}
+			const int rows = std::min(image.Height(level), 4);
+			for (uint8_t* block = pixels; block < pixels + rowBytes * rowCount; block += image.blockBytes) {
+				if (!FlipBlock(format, block, rows)) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	/**
+	*	画像の全てのミップレベルをブロック圧縮する
+	*
+	*	@param source		圧縮する画像データ(無圧縮、ミップマップ作成済み)
+	*	@param format		圧縮形式
+	*	@param compressed	圧縮したデータを格納する変数
+	*
+	*	@retval true	圧縮成功
+	*	@retval false	source が圧縮済みだった
+	*
+	*	ブロックの行を単位として、ハードウェアスレッドの数だけ並列に圧縮する
+	*	行の順序は source と同じ(BMP と OpenGL の下から上の順)、DDS ファイルへは WriteDds が上から下の順に直して書き出す
+	*/
+	bool Compress(const ImageData& source, Format format, ImageData& compressed) {
+		if (source.IsCompressed()) {
+			return false;
+		}
+		ImageData image;
+		image.width = source.width;
+		image.height = source.height;
+		image.format = GL_RGBA;
+		switch (format) {
+		case Format::BC1: image.iformat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT; image.blockBytes = 8; break;
+		case Format::BC3: image.iformat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; image.blockBytes = 16; break;
+		case Format::BC7: image.iformat = GL_COMPRESSED_RGBA_BPTC_UNORM; image.blockBytes = 16; break;
+		}
+		struct Job {
+			int level;
+			int blockRow;
+		};
+		std::vector<Job> jobs;
+		size_t end = 0;
+		for (int level = 0; level < source.LevelCount(); ++level) {
+			if (level) {
+				image.mipOffset.push_back(end);
+			}
+			end += image.LevelBytes(level);
+			for (int row = 0; row < image.RowCount(level); ++row) {
+				jobs.push_back({ level, row });
+			}
+		}
+		image.buffer.resize(end);
+
+		std::atomic<size_t> next(0);
+		const auto worker = [&]() {
+			uint8_t rgba[16 * 4];
+			for (size_t i = next++; i < jobs.size(); i = next++) {
+				const Job& job = jobs[i];
+				uint8_t* block = image.buffer.data() + (job.level ? image.mipOffset[job.level - 1] : 0) +
+					job.blockRow * image.RowBytes(job.level);
+				const int blockCount = (image.Width(job.level) + 3) / 4;
+				for (int bx = 0; bx < blockCount; ++bx, block += image.blockBytes) {
+					ExtractBlock(source, job.level, bx, job.blockRow, rgba);
+					switch (format) {
+					case Format::BC1: EncodeBC1(rgba, block); break;
+					case Format::BC3: EncodeBC3(rgba, block); break;
+					case Format::BC7: EncodeBC7(rgba, block); break;
+					}
+				}
+			}
+		};
+		const unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<std::future<void>> futures;
+		for (unsigned int i = 1; i < threadCount; ++i) {
+			futures.push_back(std::async(std::launch::async, worker));
+		}
+		worker();
+		for (auto& e : futures) {
+			e.get();
+		}
+		compressed = std::move(image);
+		return true;
+	}
+
+	/**
+	*	圧縮したデータの画質を元の画像と比較する
+	*
+	*	@param source		元の画像データ
+	*	@param compressed	Compress で圧縮したデータ
+	*	@param level		比較するミップレベル
+	*
+	*	@return PSNR(dB)
+	*			元の画像にアルファがなければ RGB だけを比較する
+	*			完全に一致した場合は 100 を返す
+	*/
+	double CalcPsnr(const ImageData& source, const ImageData& compressed, int level) {
+		Format format = Format::BC7;
+		FormatOf(compressed.iformat, format);
+		const int channels = source.HasAlpha() ? 4 : 3;
+		const int w = compressed.Width(level);
+		const int h = compressed.Height(level);
+		double squaredError = 0;
+		uint8_t original[16 * 4];
+		uint8_t decoded[16 * 4];
+		for (int by = 0; by < compressed.RowCount(level); ++by) {
+			const uint8_t* block = compressed.Pixels(level) + by * compressed.RowBytes(level);
+			for (int bx = 0; bx * 4 < w; ++bx, block += compressed.blockBytes) {
+				ExtractBlock(source, level, bx, by, original);
+				DecodeBlock(format, block, decoded);
+				for (int i = 0; i < 16; ++i) {
+					if (bx * 4 + i % 4 >= w || by * 4 + i / 4 >= h) {
+						continue;
+					}
+					for (int c = 0; c < channels; ++c) {
+						const int d = original[i * 4 + c] - decoded[i * 4 + c];
+						squaredError += d * d;
+					}
+				}
+			}
+		}
+		const double mse = squaredError / (static_cast<double>(w) * h * channels);
+		if (mse <= 0) {
+			return 100;
+		}
+		return 10.0 * log10(255.0 * 255.0 / mse);
+	}
+
+	/**
+	*	圧縮したデータを DDS ファイルに書き出す
+	*
+	*	@param fileName		ファイル名
+	*	@param compressed	Compress で圧縮したデータ
+	*
+	*	@retval true	書き出し成功
+	*	@retval false	書き出し失敗
+	*
+	*	BC1 と BC3 は DXT1, DXT5 の FourCC、BC7 は DX10 拡張ヘッダで形式を示す
+	*	DDS の標準どおり、ブロックの行もブロック内の画素も上から下の順にして書き出す(読み込み時に Texture::DecodeDds が反転する)
+	*/
+	bool WriteDds(const char* fileName, const ImageData& source) {
+		ImageData compressed = source;
+		if (!FlipVertical(compressed)) {
+			std::cerr << "ERROR: " << fileName << " の画像を上下反転できません(高さ " << source.height << ")" << std::endl;
+			return false;
+		}
+		const bool isDx10 = compressed.iformat == GL_COMPRESSED_RGBA_BPTC_UNORM;
+		std::vector<uint8_t> header(ddsHeaderSize + (isDx10 ? ddsHeaderDx10Size : 0), 0);
+		uint8_t* p = header.data();
+		memcpy(p, "DDS ", 4);
+		Put32(p + 4, 124);
+		Put32(p + 8, ddsdCaps | ddsdHeight | ddsdWidth | ddsdPixelFormat | ddsdMipMapCount | ddsdLinearSize);
+		Put32(p + 12, compressed.height);
+		Put32(p + 16, compressed.width);
+		Put32(p + 20, static_cast<uint32_t>(compressed.LevelBytes(0)));
+		Put32(p + 28, compressed.LevelCount());
+		Put32(p + 76, 32);
+		Put32(p + 80, ddpfFourCC);
+		if (isDx10) {
+			memcpy(p + 84, "DX10", 4);
+			Put32(p + ddsHeaderSize, 98);		//DXGI_FORMAT_BC7_UNORM
+			Put32(p + ddsHeaderSize + 4, 3);	//D3D10_RESOURCE_DIMENSION_TEXTURE2D
+			Put32(p + ddsHeaderSize + 12, 1);	//arraySize
+		} else {
+			memcpy(p + 84, compressed.iformat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? "DXT1" : "DXT5", 4);
+		}
+		Put32(p + 108, ddscapsTexture | (compressed.LevelCount() > 1 ? ddscapsComplex | ddscapsMipMap : 0));
+
+		FILE* fp = fopen(fileName, "wb");
+		if (!fp) {
+			std::cerr << "ERROR: " << fileName << " を作成できません" << std::endl;
+			return false;
+		}
+		const size_t dataBytes = compressed.buffer.size() - compressed.offset;
+		bool result = fwrite(header.data(), 1, header.size(), fp) == header.size();
+		result &= fwrite(compressed.buffer.data() + compressed.offset, 1, dataBytes, fp) == dataBytes;
+		result &= fclose(fp) == 0;
+		if (!result) {
+			std::cerr << "ERROR: " << fileName << " の書き込みに失敗" << std::endl;
+		}
+		return result;
+	}
+
+	/**
+	*	画像ファイルを圧縮して DDS ファイルを作成する
+	*
+	*	@param fileName		画像ファイル名
+	*	@param formatName	圧縮形式("bc1", "bc3", "bc7")
+	*						nullptr ならアルファのある画像は BC3、ない画像は BC1 にする
+	*
+	*	@retval true	作成成功
+	*	@retval false	作成失敗
+	*
+	*	出力先は Texture::CompressedFileName のファイル名で、以降の Texture::Decode はそちらを読み込む
+	*	圧縮速度と最上位のミップレベルの PSNR を表示する
+	*/
+	bool BakeTextureFile(const char* fileName, const char* formatName) {
+		ImageData source;
+		if (!Texture::Decode(fileName, source, false)) {
+			std::cerr << "ERROR: " << fileName << " を読み込めません" << std::endl;
+			return false;
+		}
+		Format format = source.HasAlpha() ? Format::BC3 : Format::BC1;
+		if (formatName) {
+			if (strcmp(formatName, "bc1") == 0) {
+				format = Format::BC1;
+			} else if (strcmp(formatName, "bc3") == 0) {
+				format = Format::BC3;
+			} else if (strcmp(formatName, "bc7") == 0) {
+				format = Format::BC7;
+			} else {
+				std::cerr << "ERROR: 不明な圧縮形式 " << formatName << std::endl;
+				return false;
+			}
+		}
+
+		ImageData compressed;
+		const int64_t begin = Profiler::Now();
+		if (!Compress(source, format, compressed)) {
+			return false;
+		}
+		const double seconds = static_cast<double>(Profiler::Now() - begin) / 1e9;
+		size_t pixelCount = 0;
+		size_t sourceBytes = 0;
+		for (int level = 0; level < source.LevelCount(); ++level) {
+			pixelCount += static_cast<size_t>(source.Width(level)) * source.Height(level);
+			sourceBytes += source.RowBytes(level) * source.Height(level);
+		}
+		const std::string outName = Texture::CompressedFileName(fileName);
+		if (!WriteDds(outName.c_str(), compressed)) {
+			return false;
+		}
+		static const char* const formatNames[] = { "BC1", "BC3", "BC7" };
+		std::cout << fileName << " -> " << outName << ": " << formatNames[static_cast<int>(format)] <<
+			" " << source.width << "x" << source.height << " ミップレベル " << source.LevelCount() <<
+			" スレッド " << std::max(1u, std::thread::hardware_concurrency()) <<
+			" " << seconds * 1000.0 << "ms (" << pixelCount / seconds / 1e6 << " Mpixel/s)" <<
+			" PSNR " << CalcPsnr(source, compressed) << "dB" <<
+			" " << sourceBytes / 1024 << "KB -> " << compressed.buffer.size() / 1024 << "KB" << std::endl;
+		return true;
+	}
+}
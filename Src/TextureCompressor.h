@@ -0,0 +1,36 @@
+/**
+*	@file TextureCompressor.h
+*/
+#pragma once
+#include "Texture.h"
+#include <stdint.h>
+
+/**
+*	テクスチャのブロック圧縮(BC1/BC3/BC7)
+*
+*	画像を 4x4 画素のブロック単位で圧縮し、DDS ファイルに書き出す
+*	BC7 はモード 6(1 サブセット、RGBA 各 7 ビット + P ビット、4 ビットインデックス)だけを使う
+*	オフラインでの事前変換用で、ブロックは複数のスレッドで並列に圧縮する
+*/
+namespace TextureCompressor {
+
+	///圧縮形式
+	enum class Format {
+		BC1,	///< RGB 8 バイト/ブロック(アルファなし)
+		BC3,	///< RGBA 16 バイト/ブロック(アルファは 8 段階の補間)
+		BC7,	///< RGBA 16 バイト/ブロック(高画質、GL 4.2 または ARB_texture_compression_bptc が必要)
+	};
+
+	void EncodeBC1(const uint8_t* rgba, uint8_t* block);
+	void EncodeBC3(const uint8_t* rgba, uint8_t* block);
+	void EncodeBC7(const uint8_t* rgba, uint8_t* block);
+	void DecodeBlock(Format format, const uint8_t* block, uint8_t* rgba);
+	bool FormatOf(GLenum iformat, Format& format);
+	bool FlipBlock(Format format, uint8_t* block, int rows);
+	bool FlipVertical(ImageData& image);
+
+	bool Compress(const ImageData& source, Format format, ImageData& compressed);
+	double CalcPsnr(const ImageData& source, const ImageData& compressed, int level = 0);
+	bool WriteDds(const char* fileName, const ImageData& compressed);
+	bool BakeTextureFile(const char* fileName, const char* formatName);
+}
@@ -4,36 +4,45 @@
 
 
 namespace Uniform {
-	//VF[_̃p[^^
+	//シェーダのパラメータ型(インスタンス 1 個分)
 	struct VertexData {
 		glm::mat4 matMVP;
 		glm::mat4 matModel;
 		glm::mat3x4 matNormal;
 		glm::vec4 color;
+		glm::vec4 texLayer;	///< x: テクスチャ配列のレイヤー番号(yzw は未使用)
 	};
 
 	/**
-	*   Cgf[^(_)
+	*	1 回のインスタンス描画で描画できるエンティティの最大数
+	*
+	*	頂点シェーダの VertexData ブロックの配列の長さと一致させること
+	*	ブロックのサイズが GL_MAX_UNIFORM_BLOCK_SIZE の最低保証値(16KB)を超えないようにする
+	*/
+	const int maxInstanceCount = 64;
+
+	/**
+	*   ライトデータ(点光源)
 	*/
 	struct PointLight {
-		glm::vec4 position; ///< W([hWn)
-		glm::vec4 color;    ///< 邳
+		glm::vec4 position; ///< 座標(ワールド座標系)
+		glm::vec4 color;    ///< 明るさ
 	};
 
-	const int maxLightCount = 4;    ///< Cg̐
+	const int maxLightCount = 4;    ///< ライトの数
 
 	/**
-	*   CeBOp[^
+	*   ライティングパラメータ
 	*/
 	struct LightData {
-		glm::vec4 ambientColor;             ///< 
-		PointLight light[maxLightCount];    ///< Cg̃Xg
+		glm::vec4 ambientColor;             ///< 環境光
+		PointLight light[maxLightCount];    ///< ライトのリスト
 	};
 
 	/**
-	*   |XgGtFNgf[^
+	*   ポストエフェクトデータ
 	*/
 	struct PostEffectData {
-		glm::mat4x4 matColor;	///< Fϊs
+		glm::mat4x4 matColor;	///< 色変換行列
 	};
 }
@@ -1,35 +1,36 @@
-//CN[h
+//インクルード
 #include "UniformBuffer.h"
+#include "GLState.h"
 #include <iostream>
 
 /**
-*   UniformBuffer 쐬
+*   UniformBuffer を作成する
 *
-*   @param size         obt@̃oCgTCY
-*   @param bindingPoint obt@蓖ĂoCfBOE|Cg
-*   @param name         obt@
+*   @param size         バッファのバイトサイズ
+*   @param bindingPoint バッファを割り当てるバインディング・ポイント
+*   @param name         バッファ名
 *
-*   @return 쐬 UniformBuffer ւ̃|C^
+*   @return 作成した UniformBuffer へのポインタ
 */
 UniformBufferPtr UniformBuffer::Create(GLsizeiptr size, GLuint bindingPoint, const char* name){
     struct Impl : UniformBuffer{ Impl(){} ~Impl(){} };
     UniformBufferPtr p = std::make_shared<Impl>();
     if(!p){
-        std::cerr << "ERROR: UBO" << name << "̍쐬Ɏs" << std::endl;
+        std::cerr << "ERROR: UBO" << name << "の作成に失敗" << std::endl;
         return {};
     }
 
     glGenBuffers(1, &p->ubo);
-    glBindBuffer(GL_UNIFORM_BUFFER, p->ubo);
+    GLState::BindUniformBuffer(p->ubo);
 	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
-    glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, p->ubo);
+    GLState::BindUniformBufferBase(bindingPoint, p->ubo);
     const GLenum result = glGetError();
     if(result != GL_NO_ERROR){
-        std::cerr << "ERROR: UBO" << name <<  "'̍쐬Ɏs" << std::endl;
+        std::cerr << "ERROR: UBO" << name <<  "'の作成に失敗" << std::endl;
         return {};
     }
 
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    GLState::BindUniformBuffer(0);
 
     p->size = size;
     p->bindingPoint = bindingPoint;
@@ -39,62 +40,62 @@ UniformBufferPtr UniformBuffer::Create(GLsizeiptr size, GLuint bindingPoint, con
 }
 
 /**
-*   fXgN^
+*   デストラクタ
 */
 UniformBuffer::~UniformBuffer(){
-    if(ubo){
-        glDeleteBuffers(1, &ubo);
-    }
+    GLState::DeleteBuffer(ubo);
 }
 
 /**
-*  UniformBuffer Ƀf[^] 
+*  UniformBuffer にデータを転送する 
 *
-*   @param data     ]f[^ւ̃|C^
-*   @param offset   ]̃oCgItZbg
-*   @param size     ]oCg
+*   @param data     転送するデータへのポインタ
+*   @param offset   転送先のバイトオフセット
+*   @param size     転送するバイト数
 *
-*   @retval true    ]
-*   @retval false   ]s
+*   @retval true    転送成功
+*   @retval false   転送失敗
 *
-*   offset  size ̗ 0 ̏ꍇAobt@TCY = UBO TCYƂē]
+*   offset と size の両方が 0 の場合、バッファサイズ = UBO サイズとして転送される
 */
 bool UniformBuffer::BufferSubData(const GLvoid* data, GLintptr offset, GLsizeiptr size ){
     if(offset + size > this->size){
-        std::cerr << "ERROR (" << name << "):]͈͂obt@TCY𒴂Ă܂(Buffer =" <<
+        std::cerr << "ERROR (" << name << "):転送範囲がバッファサイズを超えています(Buffer =" <<
         this->size << ", offset =" << offset << ", size =" << size << ")" <<std::endl;
         return false;
     }
     if(offset == 0 && size == 0){
         size = this->size;
     }
-    glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+    GLState::BindUniformBuffer(ubo);
     glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
     return true;
 }
 
 /**
-*  w肳ꂽ͈͂oCfBOE|CgɊ蓖Ă
+*  指定された範囲をバインディング・ポイントに割り当てる
+*
+*   @param offset 割り当てる範囲のバイトオフセット
+*   @param size   割り当てる範囲のバイト数
 *
-*   @param offset 蓖Ă͈͂̃oCgItZbg
-*   @param size   蓖Ă͈͂̃oCg
+*   既に同じ範囲を割り当て済みなら何もしない
 */
 void UniformBuffer::BufferRange(GLintptr offset, GLsizeiptr size) const {
-	glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, ubo, offset, size);
+	GLState::BindUniformBufferRange(bindingPoint, ubo, offset, size);
 }
 
 /**
-*  UBO VXeɃ}bv
+*  UBO をシステムメモリにマップする
 *
-*   @return }bv|C^ւ̃|C^
+*   @return マップしたポインタへのポインタ
 */
 void* UniformBuffer::MapBuffer() const {
-	glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+	GLState::BindUniformBuffer(ubo);
 	return glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
 }
 
 /**
-*  obt@̊蓖Ă
+*  バッファの割り当てを解除する
 */
 void UniformBuffer::UnmapBuffer() const {
 	glUnmapBuffer(GL_UNIFORM_BUFFER);
@@ -1,15 +1,15 @@
 #pragma once
-//CN[h
+//インクルード
 #include <GL/glew.h>
 #include <string>
 #include <memory>
 
 class UniformBuffer;
 
-typedef std::shared_ptr<UniformBuffer> UniformBufferPtr;    ///< UBO |C^
+typedef std::shared_ptr<UniformBuffer> UniformBufferPtr;    ///< UBO ポインタ
 
 /**
-*   UBO NX
+*   UBO クラス
 */
 class UniformBuffer{
 public:
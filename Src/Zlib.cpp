@@ -0,0 +1,375 @@
+/**
+*	@file Zlib.cpp
+*/
+#include "Zlib.h"
+#include <string.h>
+#include <vector>
+
+namespace Zlib {
+
+	namespace {
+
+		const int maxCodeBits = 15;	///< ハフマン符号の最大ビット数
+
+		/// 長さ符号(257~285)の基本値と追加ビット数
+		const uint16_t lengthBase[29] = {
+			3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+		};
+		const uint8_t lengthExtra[29] = {
+			0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+		};
+
+		/// 距離符号(0~29)の基本値と追加ビット数
+		const uint16_t distanceBase[30] = {
+			1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+			1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+		};
+		const uint8_t distanceExtra[30] = {
+			0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+		};
+
+		/// 符号長の符号長が並ぶ順序
+		const uint8_t codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+		/**
+		*	LSB から順にビットを読み取るクラス
+		*/
+		class BitReader {
+		public:
+			BitReader(const uint8_t* p, const uint8_t* end) : p(p), end(end) {}
+
+			/// 読み取れるだけバッファに補充する
+			void Fill() {
+				while (count <= 56 && p != end) {
+					bits |= static_cast<uint64_t>(*p++) << count;
+					count += 8;
+				}
+			}
+			bool Read(int n, uint32_t& value) {
+				Fill();
+				if (count < n) {
+					return false;
+				}
+				value = static_cast<uint32_t>(bits & ((1ULL << n) - 1));
+				Skip(n);
+				return true;
+			}
+			uint32_t Peek(int n) const { return static_cast<uint32_t>(bits & ((1ULL << n) - 1)); }
+			void Skip(int n) { bits >>= n; count -= n; }
+			int Count() const { return count; }
+
+			/// バイト境界まで読み飛ばし、バッファに残ったバイトを読み取り位置に戻す
+			void AlignToByte() {
+				Skip(count & 7);
+				p -= count / 8;
+				bits = 0;
+				count = 0;
+			}
+			const uint8_t* Position() const { return p; }
+			size_t Remaining() const { return end - p; }
+			void Advance(size_t n) { p += n; }
+
+		private:
+			const uint8_t* p;
+			const uint8_t* end;
+			uint64_t bits = 0;
+			int count = 0;
+		};
+
+		/**
+		*	ハフマン符号の復号表
+		*
+		*	符号を反転したビット列をインデックスとして、(シンボル << 4) | 符号長 を引く
+		*/
+		struct HuffmanTable {
+			std::vector<uint16_t> entries;
+			int bits = 0;
+
+			bool Build(const uint8_t* lengths, int count);
+			bool Decode(BitReader& reader, uint32_t& symbol) const;
+		};
+
+		/**
+		*	符号長の配列から復号表を作成する
+		*
+		*	@param lengths	シンボル毎の符号長(0 なら未使用)
+		*	@param count	シンボル数
+		*
+		*	@retval true	作成成功
+		*	@retval false	符号長が不正
+		*/
+		bool HuffmanTable::Build(const uint8_t* lengths, int count) {
+			int lengthCount[maxCodeBits + 1] = {};
+			bits = 0;
+			for (int i = 0; i < count; ++i) {
+				++lengthCount[lengths[i]];
+				if (lengths[i] > bits) {
+					bits = lengths[i];
+				}
+			}
+			lengthCount[0] = 0;
+			int left = 1;
+			for (int i = 1; i <= maxCodeBits; ++i) {
+				left = (left << 1) - lengthCount[i];
+				if (left < 0) {
+					return false;
+				}
+			}
+			int nextCode[maxCodeBits + 1] = {};
+			for (int i = 1, code = 0; i <= maxCodeBits; ++i) {
+				code = (code + lengthCount[i - 1]) << 1;
+				nextCode[i] = code;
+			}
+			entries.assign(static_cast<size_t>(1) << bits, 0);
+			for (int symbol = 0; symbol < count; ++symbol) {
+				const int length = lengths[symbol];
+				if (length == 0) {
+					continue;
+				}
+				const int code = nextCode[length]++;
+				int reversed = 0;
+				for (int i = 0; i < length; ++i) {
+					reversed |= ((code >> i) & 1) << (length - 1 - i);
+				}
+				const uint16_t entry = static_cast<uint16_t>((symbol << 4) | length);
+				for (size_t i = reversed; i < entries.size(); i += static_cast<size_t>(1) << length) {
+					entries[i] = entry;
+				}
+			}
+			return true;
+		}
+
+		/**
+		*	シンボルを 1 つ復号する
+		*/
+		bool HuffmanTable::Decode(BitReader& reader, uint32_t& symbol) const {
+			if (bits == 0) {
+				return false;
+			}
+			reader.Fill();
+			const uint16_t entry = entries[reader.Peek(bits)];
+			const int length = entry & 15;
+			if (length == 0 || length > reader.Count()) {
+				return false;
+			}
+			reader.Skip(length);
+			symbol = entry >> 4;
+			return true;
+		}
+
+		/**
+		*	固定ハフマン符号の復号表を作成する
+		*/
+		void BuildFixedTables(HuffmanTable& literal, HuffmanTable& distance) {
+			uint8_t lengths[288];
+			memset(lengths, 8, 144);
+			memset(lengths + 144, 9, 112);
+			memset(lengths + 256, 7, 24);
+			memset(lengths + 280, 8, 8);
+			literal.Build(lengths, 288);
+			memset(lengths, 5, 30);
+			distance.Build(lengths, 30);
+		}
+
+		/**
+		*	動的ハフマン符号の復号表を読み取る
+		*/
+		bool ReadDynamicTables(BitReader& reader, HuffmanTable& literal, HuffmanTable& distance) {
+			uint32_t literalCount, distanceCount, codeLengthCount;
+			if (!reader.Read(5, literalCount) || !reader.Read(5, distanceCount) || !reader.Read(4, codeLengthCount)) {
+				return false;
+			}
+			literalCount += 257;
+			distanceCount += 1;
+			codeLengthCount += 4;
+			if (literalCount > 286 || distanceCount > 30) {
+				return false;
+			}
+			uint8_t codeLengths[19] = {};
+			for (uint32_t i = 0; i < codeLengthCount; ++i) {
+				uint32_t length;
+				if (!reader.Read(3, length)) {
+					return false;
+				}
+				codeLengths[codeLengthOrder[i]] = static_cast<uint8_t>(length);
+			}
+			HuffmanTable codeLengthTable;
+			if (!codeLengthTable.Build(codeLengths, 19)) {
+				return false;
+			}
+
+			uint8_t lengths[286 + 30] = {};
+			for (uint32_t i = 0; i < literalCount + distanceCount; ) {
+				uint32_t symbol;
+				if (!codeLengthTable.Decode(reader, symbol)) {
+					return false;
+				}
+				if (symbol < 16) {
+					lengths[i++] = static_cast<uint8_t>(symbol);
+					continue;
+				}
+				uint32_t repeat;
+				uint8_t value = 0;
+				if (symbol == 16) {
+					if (i == 0 || !reader.Read(2, repeat)) {
+						return false;
+					}
+					value = lengths[i - 1];
+					repeat += 3;
+				} else if (symbol == 17) {
+					if (!reader.Read(3, repeat)) {
+						return false;
+					}
+					repeat += 3;
+				} else {
+					if (!reader.Read(7, repeat)) {
+						return false;
+					}
+					repeat += 11;
+				}
+				if (i + repeat > literalCount + distanceCount) {
+					return false;
+				}
+				memset(lengths + i, value, repeat);
+				i += repeat;
+			}
+			if (lengths[256] == 0) {
+				return false;
+			}
+			return literal.Build(lengths, literalCount) && distance.Build(lengths + literalCount, distanceCount);
+		}
+
+		/**
+		*	ハフマン符号で圧縮されたブロックを展開する
+		*/
+		bool InflateBlock(BitReader& reader, const HuffmanTable& literal, const HuffmanTable& distance, uint8_t* dst, size_t dstSize, size_t& written) {
+			for (;;) {
+				uint32_t symbol;
+				if (!literal.Decode(reader, symbol)) {
+					return false;
+				}
+				if (symbol < 256) {
+					if (written >= dstSize) {
+						return false;
+					}
+					dst[written++] = static_cast<uint8_t>(symbol);
+					continue;
+				}
+				if (symbol == 256) {
+					return true;
+				}
+				symbol -= 257;
+				if (symbol >= 29) {
+					return false;
+				}
+				uint32_t extra;
+				if (!reader.Read(lengthExtra[symbol], extra)) {
+					return false;
+				}
+				const size_t length = lengthBase[symbol] + extra;
+				uint32_t distanceSymbol;
+				if (!distance.Decode(reader, distanceSymbol) || distanceSymbol >= 30 || !reader.Read(distanceExtra[distanceSymbol], extra)) {
+					return false;
+				}
+				const size_t offset = distanceBase[distanceSymbol] + extra;
+				if (offset > written || length > dstSize - written) {
+					return false;
+				}
+				//重なりがあり得るので 1 バイトずつコピーする
+				const uint8_t* from = dst + written - offset;
+				uint8_t* to = dst + written;
+				for (size_t i = 0; i < length; ++i) {
+					to[i] = from[i];
+				}
+				written += length;
+			}
+		}
+
+		/**
+		*	Adler-32 チェックサムを計算する
+		*/
+		uint32_t Adler32(const uint8_t* p, size_t size) {
+			uint32_t a = 1;
+			uint32_t b = 0;
+			while (size) {
+				const size_t n = size < 5552 ? size : 5552;
+				for (size_t i = 0; i < n; ++i) {
+					a += p[i];
+					b += a;
+				}
+				a %= 65521;
+				b %= 65521;
+				p += n;
+				size -= n;
+			}
+			return (b << 16) | a;
+		}
+	}
+
+	/**
+	*	zlib 形式のデータを展開する
+	*
+	*	@param src		圧縮されたデータ
+	*	@param srcSize	圧縮されたデータのバイト数
+	*	@param dst		展開先のバッファ
+	*	@param dstSize	展開後のバイト数
+	*
+	*	@retval true	展開成功
+	*	@retval false	データが壊れているか、展開後のサイズが dstSize と一致しない
+	*/
+	bool Inflate(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+		//zlib ヘッダ(圧縮方式は deflate のみ、プリセット辞書は非対応)
+		if (srcSize < 6 || (src[0] & 0x0f) != 8 || (src[0] >> 4) > 7 || ((src[0] << 8) | src[1]) % 31 != 0 || (src[1] & 0x20)) {
+			return false;
+		}
+		BitReader reader(src + 2, src + srcSize);
+		size_t written = 0;
+		HuffmanTable literal;
+		HuffmanTable distance;
+		for (uint32_t isFinal = 0; !isFinal; ) {
+			uint32_t type;
+			if (!reader.Read(1, isFinal) || !reader.Read(2, type)) {
+				return false;
+			}
+			if (type == 0) {
+				//無圧縮ブロック
+				reader.AlignToByte();
+				if (reader.Remaining() < 4) {
+					return false;
+				}
+				const uint8_t* p = reader.Position();
+				const size_t length = p[0] | (p[1] << 8);
+				const size_t inverted = p[2] | (p[3] << 8);
+				if ((length ^ 0xffff) != inverted || reader.Remaining() - 4 < length || length > dstSize - written) {
+					return false;
+				}
+				memcpy(dst + written, p + 4, length);
+				written += length;
+				reader.Advance(4 + length);
+			} else if (type == 1) {
+				BuildFixedTables(literal, distance);
+				if (!InflateBlock(reader, literal, distance, dst, dstSize, written)) {
+					return false;
+				}
+			} else if (type == 2) {
+				if (!ReadDynamicTables(reader, literal, distance) || !InflateBlock(reader, literal, distance, dst, dstSize, written)) {
+					return false;
+				}
+			} else {
+				return false;
+			}
+		}
+		if (written != dstSize) {
+			return false;
+		}
+
+		//末尾の Adler-32 を検証する
+		reader.AlignToByte();
+		if (reader.Remaining() < 4) {
+			return false;
+		}
+		const uint8_t* p = reader.Position();
+		const uint32_t checksum = (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+		return checksum == Adler32(dst, dstSize);
+	}
+}
@@ -0,0 +1,16 @@
+/**
+*	@file Zlib.h
+*/
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+*	zlib 形式(RFC 1950)のデータの展開
+*
+*	FBX の配列プロパティのように、展開後のサイズが分かっているデータを一度に展開する
+*	状態を持たないので、複数のスレッドから同時に呼び出してもよい
+*/
+namespace Zlib {
+	bool Inflate(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize);
+}
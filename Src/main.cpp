@@ -3,12 +3,18 @@
 */
 
 #include"GameEngine.h"
+#include"TextureCompressor.h"
+#include"Profiler.h"
 #include<glm\gtc\matrix_transform.hpp>
 #include<random>
+#include<iostream>
+#include<string.h>
+#include<stdlib.h>
+#include<vector>
 
 using namespace Uniform;
 
-//GeBeB̏Փ˃O[vID
+//エンティティの衝突グループID
 enum EntityGroupId {
 	EntityGroupId_Player,
 	EntityGroupId_PlayerShot,
@@ -17,37 +23,37 @@ enum EntityGroupId {
 	EntityGroupId_Others,
 };
 
-//Փˌ`󃊃Xg
-static const Entity::CollisionData collisionDataList[] = {
-	{ glm::vec3(-1.0f, -1.0f, -1.0f), glm::vec3(1.0f, 1.0f, 1.0f) },
-	{ glm::vec3(-0.5f, -0.5f, -1.0f), glm::vec3(0.5f, 0.5f, 1.0f) },
-	{ glm::vec3(-1.0f, -1.0f, -1.0f), glm::vec3(1.0f, 1.0f, 1.0f) },
-	{ glm::vec3(-0.25f, -0.25f, -0.25f), glm::vec3(0.25f, 0.25f, 0.25f) },
+///エンティティの雛形
+struct PrefabList {
+	GameEngine::PrefabHandle playerShot;	///< 自機の弾
+	GameEngine::PrefabHandle enemy;			///< 敵の円盤
+	GameEngine::PrefabHandle blast;			///< 爆発
 };
+static PrefabList prefabs;
 
-/// 3D xN^[^
+/// 3D ベクター型
 struct Vector3 {
 	float x, y, z;
 };
 
-/// RGBA J[
+/// RGBA カラー
 struct Color {
 	float r, g, b, a;
 };
 
 /**
-*	G̉~Ղ̏ԂXV
+*	敵の円盤の状態を更新する
 */
 struct UpdateToroid {
 		void operator()(Entity::Entity& entity, double delta) {
-		//͈͊Oɏo폜
+		//範囲外に出たら削除する
 		const glm::vec3 pos = entity.Position();
 		if (std::abs(pos.x) > 40.0f || std::abs(pos.z) > 40.0f) {
 			GameEngine::Instance().RemoveEntity(&entity);
 			return;
 		}
 
-		//~Ղ]
+		//円盤を回転させる
 		float rot = glm::angle(entity.Rotation());
 		rot += glm::radians(15.0f) * static_cast<float>(delta);
 		if (rot > glm::pi<float>() * 2.0f) {
@@ -55,7 +61,7 @@ struct UpdateToroid {
 		}
 		entity.Rotation(glm::angleAxis(rot, glm::vec3(0, 1, 0)));
 
-		//_VF[_̃p[^ UBO ɃRs[
+		//頂点シェーダのパラメータを UBO にコピーする
 /*		VertexData data;
 		data.matModel = entity.CalcModelMatrix();
 		data.matNormal = glm::mat4_cast(entity.Rotation());
@@ -65,7 +71,7 @@ struct UpdateToroid {
 };
 
 /**
-*	@e̍XV
+*	自機弾の更新
 */
 struct UpdatePlayerShot{
 	void operator()(Entity::Entity& entity, double delta) {
@@ -78,7 +84,7 @@ struct UpdatePlayerShot{
 };
 
 /**
-*	̍XV
+*	爆発の更新
 */
 struct UpdateBlast {
 	void operator()(Entity::Entity& entity, double delta) {
@@ -87,9 +93,9 @@ struct UpdateBlast {
 			entity.Destroy();
 			return;
 		}
-		const float variation = static_cast<float>(timer * 4);		//ω
-		entity.Scale(glm::vec3(static_cast<float>(1 + variation)));	//XɊg
-		//Ԍo߂ŐFƓxω
+		const float variation = static_cast<float>(timer * 4);		//変化量
+		entity.Scale(glm::vec3(static_cast<float>(1 + variation)));	//徐々に拡大
+		//時間経過で色と透明度を変化させる
 		static const glm::vec4 color[] = {
 			glm::vec4(1.0f, 1.0f, 0.75f, 1),
 			glm::vec4(1.0f, 0.5f, 0.1f, 1),
@@ -99,7 +105,7 @@ struct UpdateBlast {
 		const glm::vec4 col1 = color[static_cast<int>(variation) + 1];
 		const glm::vec4 newColor = glm::mix(col0, col1, std::fmod(variation, 1));
 		entity.Color(newColor);
-		// Y]
+		// Y軸回転させる
 		glm::vec3 euler = glm::eulerAngles(entity.Rotation());
 		euler.y += glm::radians(60.0f) * static_cast<float>(delta);
 		entity.Rotation(glm::quat(euler));
@@ -109,7 +115,7 @@ struct UpdateBlast {
 };
 
 /**
-*	@̍XV
+*	自機の更新
 */
 struct UpdatePlayer {
 	void operator()(Entity::Entity& entity, double delta) {
@@ -145,10 +151,7 @@ struct UpdatePlayer {
 				glm::vec3 pos = entity.Position();
 				pos.x -= 0.3f;
 				for (int i = 0; i < 2; ++i) {
-					if (Entity::Entity* p = game.addEntity(EntityGroupId_PlayerShot, pos, "NormalShot", "Res/Player.bmp", UpdatePlayerShot())) {
-						p->Velocity(glm::vec3(0, 0, 80));
-						p->Collision(collisionDataList[EntityGroupId_PlayerShot]);
-					}
+					game.Spawn(prefabs.playerShot, pos);
 					pos.x += 0.6f;
 				}
 				shotInterval = 0.25;
@@ -157,7 +160,7 @@ struct UpdatePlayer {
 			shotInterval = 0;
 		}
 
-		//_VF[_̃p[^ UBO ɃRs[
+		//頂点シェーダのパラメータを UBO にコピーする
 	/*	VertexData data;
 		data.matModel = entity.CalcModelMatrix();
 		data.matNormal = glm::mat4_cast(entity.Rotation());
@@ -170,12 +173,12 @@ private:
 };
 
 /**
-* Q[̏ԂXV
+* ゲームの状態を更新する
 *
-* @param entityBuffer	GGeBeBǉ̃GeBeBobt@
-* @param meshBuffer		GGeBeB̃bVǗĂ郁bVobt@
-* @param tex			GGeBeBp̃eNX`
-* @param prog			GGeBeBp̃VF[_vO
+* @param entityBuffer	敵エンティティ追加先のエンティティバッファ
+* @param meshBuffer		敵エンティティのメッシュを管理しているメッシュバッファ
+* @param tex			敵エンティティ用のテクスチャ
+* @param prog			敵エンティティ用のシェーダプログラム
 */
 /*void Update(Entity::BufferPtr entityBuffer, Mesh::BufferPtr meshBuffer, TexturePtr tex, Shader::ProgramPtr prog) {
 	static std::mt19937 rand(time(nullptr));
@@ -199,7 +202,9 @@ struct Update {
 		GameEngine& game = GameEngine::Instance();
 		if (!pPlayer) {
 			pPlayer = game.addEntity(EntityGroupId_Player, glm::vec3(0, 0, 2), "Aircraft", "Res/Player.bmp", UpdatePlayer());
-			pPlayer->Collision(collisionDataList[EntityGroupId_Player]);
+			if (pPlayer) {
+				pPlayer->AutoCollision(true);
+			}
 		}
 
 		game.Camera({ glm::vec4(0, 20, -8, 1), glm::vec3(0, 0, 12), glm::vec3(0,0,1) });
@@ -213,9 +218,8 @@ struct Update {
 			const std::uniform_int_distribution<> rndAddingCount(1, 5);
 			for (int i = rndAddingCount(game.Rand()); i > 0; --i) {
 				const glm::vec3 pos(distributerX(game.Rand()), 0, distributerZ(game.Rand()));
-				if (Entity::Entity* p = game.addEntity(EntityGroupId_Enemy, pos, "Toroid", "Res/Toroid.bmp", UpdateToroid())) {
+				if (Entity::Entity* p = game.Spawn(prefabs.enemy, pos)) {
 					p->Velocity(glm::vec3(pos.x < 0 ? 1.0f : -1.0f, 0, -10));
-					p->Collision(collisionDataList[EntityGroupId_Enemy]);
 				}
 			}
 			interval = rndInterval(game.Rand());
@@ -228,11 +232,48 @@ struct Update {
 };
 
 /**
-*	@̒eƓG̏Փˏ
+*	エンティティの雛形を登録する
+*
+*	@retval true	登録成功
+*	@retval false	登録失敗
+*/
+bool RegisterPrefabs() {
+	GameEngine& game = GameEngine::Instance();
+
+	GameEngine::Prefab playerShot;
+	playerShot.groupId = EntityGroupId_PlayerShot;
+	playerShot.mesh = game.GetMeshHandle("NormalShot");
+	playerShot.texture = game.GetTextureHandle("Res/Player.bmp");
+	playerShot.autoCollision = true;
+	playerShot.velocity = glm::vec3(0, 0, 80);
+	playerShot.func = UpdatePlayerShot();
+	prefabs.playerShot = game.RegisterPrefab(playerShot);
+
+	GameEngine::Prefab enemy;
+	enemy.groupId = EntityGroupId_Enemy;
+	enemy.mesh = game.GetMeshHandle("Toroid");
+	enemy.texture = game.GetTextureHandle("Res/Toroid.bmp");
+	enemy.autoCollision = true;
+	enemy.func = UpdateToroid();
+	prefabs.enemy = game.RegisterPrefab(enemy);
+
+	GameEngine::Prefab blast;
+	blast.groupId = EntityGroupId_Others;
+	blast.mesh = game.GetMeshHandle("Blast");
+	blast.texture = enemy.texture;
+	blast.autoCollision = true;
+	blast.func = UpdateBlast();
+	prefabs.blast = game.RegisterPrefab(blast);
+
+	return prefabs.playerShot.IsValid() && prefabs.enemy.IsValid() && prefabs.blast.IsValid();
+}
+
+/**
+*	自機の弾と敵の衝突処理
 */
 void PlayerShotAndEnemyCollisionHandler(Entity::Entity& lhs, Entity::Entity& rhs) {
 	GameEngine& game = GameEngine::Instance();
-	if (Entity::Entity* p = game.addEntity(EntityGroupId_Others, rhs.Position(), "Blast", "Res/Toroid.bmp", UpdateBlast())) {
+	if (Entity::Entity* p = game.Spawn(prefabs.blast, rhs.Position())) {
 		const std::uniform_real_distribution<float> rotRange(0.0f, glm::pi<float>() * 2);
 		p->Rotation(glm::quat(glm::vec3(0, rotRange(game.Rand()), 0)));
 	}
@@ -242,7 +283,7 @@ void PlayerShotAndEnemyCollisionHandler(Entity::Entity& lhs, Entity::Entity& rhs
 
 void PlayerAndEnemyCollisionHandlerr(Entity::Entity& lhs, Entity::Entity& rhs) {
 	GameEngine& game = GameEngine::Instance();
-	if (Entity::Entity* p = game.addEntity(EntityGroupId_Others, rhs.Position(), "Blast", "Res/Toroid.bmp", UpdateBlast())) {
+	if (Entity::Entity* p = game.Spawn(prefabs.blast, rhs.Position())) {
 		const std::uniform_real_distribution<float> rotRange(0.0f, glm::pi<float>() * 2);
 		p->Rotation(glm::quat(glm::vec3(0, rotRange(game.Rand()), 0)));
 	}
@@ -253,12 +294,12 @@ void PlayerAndEnemyCollisionHandlerr(Entity::Entity& lhs, Entity::Entity& rhs) {
 }
 
 /**
-* Uniform Block Object 쐬
+* Uniform Block Object を作成する
 *
-* @param size	Uniform Block ̃TCY
-* @param size	Uniform Block ɓ]f[^ւ̃|C^
+* @param size	Uniform Block のサイズ
+* @param size	Uniform Block に転送するデータへのポインタ
 *
-* @return 쐬 UBO
+* @return 作成した UBO
 */
 GLuint CreateUBO(GLsizeiptr size, const GLvoid* data = nullptr) {
 	GLuint ubo;
@@ -269,16 +310,113 @@ GLuint CreateUBO(GLsizeiptr size, const GLvoid* data = nullptr) {
 	return ubo;
 }
 
-int main() {
+/**
+*	エントリーポイント
+*
+*	@param argc	コマンドライン引数の数
+*	@param argv	コマンドライン引数
+*
+*	コマンドライン引数:
+*		--record <file>	入力を記録する
+*		--replay <file>	記録した入力を再生する
+*		--headless		ウインドウを表示せずに再生する(--replay と併用)
+*		--bake <file>	FBX ファイルからメッシュキャッシュを作成して終了する(複数指定可)
+*		--validate-fbx <file>	組み込みの FBX パーサの変換結果を FBX SDK と比較して終了する(複数指定可)
+*		--native-fbx	バイナリ形式の FBX ファイルを組み込みのパーサで読み込む(--validate-fbx で一致を確認してから使う)
+*		--mip-skip <n>	テクスチャの上位 n 段階のミップレベルを転送しない(メモリの少ない環境向け)
+*		--texture-budget <MB>	テクスチャに使う GPU メモリの予算(超えると使っていないテクスチャを追い出す)
+*		--bake-texture <file>	画像ファイルをブロック圧縮した DDS ファイルを作成して終了する(複数指定可)
+*		--texture-format <bc1|bc3|bc7>	--bake-texture の圧縮形式(省略時はアルファの有無で BC1 か BC3)
+*		--verbose		メッシュの変換時に、最適化や LOD などの統計を出力する
+*		--profile		起動時からプロファイラを有効にする(実行中は F11 キーで切り替え、F12 キーでキャプチャ)
+*		--profile-spike <ms>	指定したミリ秒を超えたフレームを自動的にキャプチャする(プロファイラも有効になる)
+*/
+int main(int argc, char** argv) {
+	const char* recordFile = nullptr;
+	const char* replayFile = nullptr;
+	bool headless = false;
+	int mipSkip = 0;
+	int textureBudget = 0;
+	std::vector<const char*> bakeFiles;
+	std::vector<const char*> validateFiles;
+	std::vector<const char*> bakeTextureFiles;
+	const char* textureFormat = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+			recordFile = argv[++i];
+		} else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+			replayFile = argv[++i];
+		} else if (strcmp(argv[i], "--headless") == 0) {
+			headless = true;
+		} else if (strcmp(argv[i], "--bake") == 0 && i + 1 < argc) {
+			bakeFiles.push_back(argv[++i]);
+		} else if (strcmp(argv[i], "--validate-fbx") == 0 && i + 1 < argc) {
+			validateFiles.push_back(argv[++i]);
+		} else if (strcmp(argv[i], "--mip-skip") == 0 && i + 1 < argc) {
+			mipSkip = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+			textureBudget = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--bake-texture") == 0 && i + 1 < argc) {
+			bakeTextureFiles.push_back(argv[++i]);
+		} else if (strcmp(argv[i], "--texture-format") == 0 && i + 1 < argc) {
+			textureFormat = argv[++i];
+		} else if (strcmp(argv[i], "--native-fbx") == 0) {
+			Mesh::NativeFbxParser(true);
+		} else if (strcmp(argv[i], "--verbose") == 0) {
+			Mesh::VerboseLog(true);
+		} else if (strcmp(argv[i], "--profile") == 0) {
+			Profiler::Enable(true);
+		} else if (strcmp(argv[i], "--profile-spike") == 0 && i + 1 < argc) {
+			Profiler::SpikeThreshold(atof(argv[++i]) / 1000.0);
+			Profiler::Enable(true);
+		} else {
+			std::cerr << "WARNING: 不明な引数 " << argv[i] << std::endl;
+		}
+	}
+	if (!bakeFiles.empty() || !validateFiles.empty() || !bakeTextureFiles.empty()) {
+		bool result = true;
+		for (const char* e : validateFiles) {
+			result &= Mesh::ValidateFbxParser(e);
+		}
+		for (const char* e : bakeFiles) {
+			result &= Mesh::BakeMeshFile(e);
+		}
+		for (const char* e : bakeTextureFiles) {
+			result &= TextureCompressor::BakeTextureFile(e, textureFormat);
+		}
+		return result ? 0 : -1;
+	}
+	if (headless && !replayFile) {
+		std::cerr << "ERROR: --headless は --replay と併用してください" << std::endl;
+		return -1;
+	}
+
 	GameEngine& game = GameEngine::Instance();
-	if (!game.Init(800, 600, "OpenGlTutrial")) {
+	if (!game.Init(800, 600, "OpenGlTutrial", !headless)) {
+		return -1;
+	}
+	game.TextureMipSkip(mipSkip);
+	if (textureBudget > 0) {
+		game.TextureBudget(static_cast<size_t>(textureBudget) * 1024 * 1024);
+	}
+	if (replayFile) {
+		if (!game.Replay(replayFile)) {
+			return -1;
+		}
+	} else if (recordFile) {
+		if (!game.Record(recordFile)) {
+			return -1;
+		}
+	}
+	GameEngine::AssetManifest manifest;
+	manifest.textureList = { "Res/Toroid.bmp", "Res/Player.bmp" };
+	manifest.meshList = { "Res/Toroid.fbx", "Res/Player.fbx", "Res/Blast.fbx" };
+	if (!game.LoadAssets(manifest)) {
+		return -1;
+	}
+	if (!RegisterPrefabs()) {
 		return -1;
 	}
-	game.LoadTextureFromFile("Res/Toroid.bmp");
-	game.LoadTextureFromFile("Res/Player.bmp");
-	game.LoadMeshFromFile("Res/Toroid.fbx");
-	game.LoadMeshFromFile("Res/Player.fbx");
-	game.LoadMeshFromFile("Res/Blast.fbx");
 	game.CollisionHandler(EntityGroupId_PlayerShot, EntityGroupId_Enemy, &PlayerShotAndEnemyCollisionHandler);
 //	game.CollisionHandler(EntityGroupId_Player, EntityGroupId_Enemy, &PlayerAndEnemyCollisionHandlerr);
 	game.UpdateFunc(Update());
@@ -288,12 +426,12 @@ int main() {
 }
 
 
-///Gg[|Cg
+///エントリーポイント
 /*int main() {
 
 
-	//Op`
-	//IuWFNg̍쐬
+	//三角形を書く
+	//オブジェクトの作成
 	const GLuint vbo = CreateVBO(sizeof(vertices), vertices);
 	const GLuint ibo = CreateIBO(sizeof(indices), indices);
 	const GLuint vao = CreateVAO(vbo, ibo);
@@ -318,7 +456,7 @@ int main() {
 	progTutorial->UniformBlockBinding("VertexData", 0);
 	progTutorial->UniformBlockBinding("LightData", 1);
 
-	//glUseProgram ֐̌ĂяoύX
+	//glUseProgram 関数の呼び出しを変更
 //	progTutorial->UseProgram();
 
 	TexturePtr tex = Texture::LoadFpomFile("Res/Sample.bmp");
@@ -341,10 +479,10 @@ int main() {
 	const OffscreenBufferPtr offscreen = OffscreenBuffer::Create(800, 600);
 
 
-	//[xobt@
+	//深度バッファ
 	glEnable(GL_DEPTH_TEST);
 
-	//eNX`f[^
+	//テクスチャデータ
 	static const uint32_t textureData[] = {
 		0xffffffff, 0xffcccccc, 0xffffffff, 0xffcccccc, 0xffffffff,
 		0xff888888, 0xffffffff, 0xff888888, 0xffffffff, 0xff888888,
@@ -353,7 +491,7 @@ int main() {
 		0xffffffff, 0xff000000, 0xffffffff, 0xff000000, 0xffffffff,
 	};
 
-	//C[v
+	//メインループ
 	while (!window.ShouldClose()) {
 		Update(entityBuffer, meshBuffer, texToroid, progTutorial);
 		glBindFramebuffer(GL_FRAMEBUFFER, offscreen->GetFrameBuffer());
@@ -363,11 +501,11 @@ int main() {
 
 		const glm::vec3 viewPos = glm::vec4(0, 20, -20, 1);
 
-		//_f[^̕`
+		//頂点データの描画
 //		glUseProgram(progTutorial);
 		progTutorial->UseProgram();
 
-		//UBOɃf[^]
+		//UBOにデータを転送する
 //		glUseProgram(progTutorial);
 		const glm::mat4x4 matProj = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
 		const glm::mat4x4 matView = glm::lookAt(viewPos, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
@@ -433,7 +571,7 @@ int main() {
 	glDeleteVertexArrays(1, &vao);
 	glDeleteBuffers(1, &vbo);
 
-	//I
+	//終了処理
 	glfwTerminate();
 
 	return 0;